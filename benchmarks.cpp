@@ -0,0 +1,1067 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <thread>
+
+#include "spv_defs.hpp"
+#include "spv_runner.hpp"
+#include "spv_viewer.hpp"
+
+#ifdef _WIN32
+#define ftell _ftelli64
+#define fseek _fseeki64
+#endif
+
+static bool get_file_content(const char* filename, void** out_data, uint64_t* out_bytes) noexcept
+{
+	FILE* file;
+
+	if (fopen_s(&file, filename, "rb") != 0)
+	{
+		fprintf(stderr, "Could not open file '%s'.\n", filename);
+
+		return false;
+	}
+
+	if (fseek(file, 0, SEEK_END) != 0)
+	{
+		fprintf(stderr, "Could not seek in file '%s'.\n", filename);
+
+		fclose(file);
+
+		return false;
+	}
+
+	const int64_t bytes = ftell(file);
+
+	if (bytes < 0)
+	{
+		fprintf(stderr, "Could not ftell in file '%s'.\n", filename);
+
+		fclose(file);
+
+		return false;
+	}
+
+	if (fseek(file, 0, SEEK_SET) != 0)
+	{
+		fprintf(stderr, "Could not seek in file '%s'.\n", filename);
+
+		fclose(file);
+
+		return false;
+	}
+
+	void* buffer = malloc(bytes);
+
+	if (buffer == nullptr)
+	{
+		fprintf(stderr, "malloc failed.\n");
+
+		fclose(file);
+
+		return false;
+	}
+
+	if (fread(buffer, 1, bytes, file) != static_cast<uint64_t>(bytes))
+	{
+		fprintf(stderr, "Could not read from file '%s'.\n", filename);
+
+		free(buffer);
+
+		fclose(file);
+
+		return false;
+	}
+
+	fclose(file);
+
+	*out_data = buffer;
+
+	*out_bytes = static_cast<uint64_t>(bytes);
+
+	return true;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) noexcept
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Resources bound to every shader run by the runner benchmark. Shaders only pick
+// up the (set, binding) pairs they actually declare, so binding a generous set of
+// zeroed buffers and images is enough for any compute shader in test_data.
+static constexpr uint32_t bench_descriptor_sets = 2;
+
+static constexpr uint32_t bench_bindings_per_set = 8;
+
+static constexpr uint64_t bench_buffer_bytes = 1 << 22;
+
+static constexpr uint32_t bench_image_extent = 64;
+
+static constexpr uint32_t bench_image_layers = 4;
+
+static constexpr uint32_t bench_texel_bytes = 16;
+
+struct bench_resources
+{
+	spvcpu::buffer_binding buffers[bench_descriptor_sets * bench_bindings_per_set];
+
+	spvcpu::image_binding images[bench_descriptor_sets * bench_bindings_per_set];
+
+	uint32_t push_constants[64];
+};
+
+static bool create_bench_resources(bench_resources* out) noexcept
+{
+	memset(out, 0, sizeof(*out));
+
+	for (uint32_t i = 0; i != bench_descriptor_sets * bench_bindings_per_set; ++i)
+	{
+		const uint64_t slice_pitch = static_cast<uint64_t>(bench_image_extent) * bench_image_extent * bench_texel_bytes;
+
+		out->buffers[i] = { i / bench_bindings_per_set, i % bench_bindings_per_set, bench_buffer_bytes, calloc(1, bench_buffer_bytes) };
+
+		out->images[i] = { i / bench_bindings_per_set, i % bench_bindings_per_set, { bench_image_extent, bench_image_extent, bench_image_layers }, bench_image_extent * bench_texel_bytes, slice_pitch, calloc(bench_image_layers, slice_pitch) };
+
+		if (out->buffers[i].data == nullptr || out->images[i].data == nullptr)
+		{
+			fprintf(stderr, "calloc failed.\n");
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void free_bench_resources(bench_resources* resources) noexcept
+{
+	for (uint32_t i = 0; i != bench_descriptor_sets * bench_bindings_per_set; ++i)
+	{
+		free(resources->buffers[i].data);
+
+		free(resources->images[i].data);
+	}
+}
+
+// Selects the invocation run for the index-th iteration of a runner benchmark.
+// Invocations cover a 4x4x4 block of each workgroup, which stays within the
+// local size of all shaders in test_data, and successive blocks move on to the
+// next workgroup.
+static void select_invocation(uint32_t index, spvcpu::module_init_info* info) noexcept
+{
+	info->local_invocation_id[0] = index % 4;
+	info->local_invocation_id[1] = (index / 4) % 4;
+	info->local_invocation_id[2] = (index / 16) % 4;
+
+	info->workgroup_id[0] = index / 64;
+}
+
+// Times creating the module through create_cpu_module and through
+// create_cpu_module_cached, first cold and then warm. The cold call only misses
+// the cache if cache_directory does not hold the module yet. Returns the module
+// created by the last warm call.
+static bool bench_module_creation(uint64_t shader_bytes, const void* shader_data, const void* spird_data, const char* cache_directory, void** out_module) noexcept
+{
+	static constexpr uint32_t warm_iteration_count = 16;
+
+	void* module;
+
+	const std::chrono::steady_clock::time_point compile_start = std::chrono::steady_clock::now();
+
+	if (spvcpu::result rst = spvcpu::create_cpu_module(shader_bytes, shader_data, spird_data, &module); rst != spvcpu::result::success)
+	{
+		fprintf(stderr, "spvcpu::create_cpu_module failed with error %d.\n", static_cast<uint32_t>(rst));
+
+		return false;
+	}
+
+	const double compile_seconds = seconds_since(compile_start);
+
+	spvcpu::free_cpu_module(module);
+
+	const std::chrono::steady_clock::time_point cold_start = std::chrono::steady_clock::now();
+
+	if (spvcpu::result rst = spvcpu::create_cpu_module_cached(shader_bytes, shader_data, spird_data, cache_directory, &module); rst != spvcpu::result::success)
+	{
+		fprintf(stderr, "spvcpu::create_cpu_module_cached failed with error %d.\n", static_cast<uint32_t>(rst));
+
+		return false;
+	}
+
+	const double cold_seconds = seconds_since(cold_start);
+
+	double warm_seconds = 0.0;
+
+	for (uint32_t i = 0; i != warm_iteration_count; ++i)
+	{
+		spvcpu::free_cpu_module(module);
+
+		const std::chrono::steady_clock::time_point warm_start = std::chrono::steady_clock::now();
+
+		if (spvcpu::result rst = spvcpu::create_cpu_module_cached(shader_bytes, shader_data, spird_data, cache_directory, &module); rst != spvcpu::result::success)
+		{
+			fprintf(stderr, "spvcpu::create_cpu_module_cached failed with error %d.\n", static_cast<uint32_t>(rst));
+
+			return false;
+		}
+
+		warm_seconds += seconds_since(warm_start);
+	}
+
+	printf("module creation: compile %.3f ms, cached cold %.3f ms, cached warm %.3f ms\n", compile_seconds * 1e3, cold_seconds * 1e3, warm_seconds / warm_iteration_count * 1e3);
+
+	*out_module = module;
+
+	return true;
+}
+
+static int bench_runner(int argc, const char** argv) noexcept
+{
+	if (argc < 3 || argc > 5)
+	{
+		fprintf(stderr, "Usage: %s shader-file spird-file [invocation-count [cache-directory]]\n", argv[0]);
+
+		return 0;
+	}
+
+	const uint32_t invocation_count = argc >= 4 ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 10)) : 4096;
+
+	const char* const cache_directory = argc == 5 ? argv[4] : nullptr;
+
+	void* shader_data;
+
+	uint64_t shader_bytes;
+
+	void* spird_data;
+
+	uint64_t spird_bytes;
+
+	if (!get_file_content(argv[1], &shader_data, &shader_bytes))
+		return 1;
+
+	if (!get_file_content(argv[2], &spird_data, &spird_bytes))
+		return 1;
+
+	void* module;
+
+	if (cache_directory != nullptr)
+	{
+		// The invocations below then run on the module loaded from the cache.
+		if (!bench_module_creation(shader_bytes, shader_data, spird_data, cache_directory, &module))
+			return 1;
+	}
+	else if (spvcpu::result rst = spvcpu::create_cpu_module(shader_bytes, shader_data, spird_data, &module); rst != spvcpu::result::success)
+	{
+		fprintf(stderr, "spvcpu::create_cpu_module failed with error %d.\n", static_cast<uint32_t>(rst));
+
+		return 1;
+	}
+
+	bench_resources* resources = static_cast<bench_resources*>(malloc(sizeof(bench_resources)));
+
+	if (resources == nullptr || !create_bench_resources(resources))
+		return 1;
+
+	spvcpu::module_init_info info{};
+	info.buffer_count = bench_descriptor_sets * bench_bindings_per_set;
+	info.buffers = resources->buffers;
+	info.image_count = bench_descriptor_sets * bench_bindings_per_set;
+	info.images = resources->images;
+	info.push_constant_bytes = sizeof(resources->push_constants);
+	info.push_constants = resources->push_constants;
+	info.workgroup_count[0] = (invocation_count + 63) / 64;
+	info.workgroup_count[1] = 1;
+	info.workgroup_count[2] = 1;
+
+	// Count the executed instructions by single-stepping every invocation once.
+	// This also warms up caches for the timed run below.
+	uint64_t instruction_count = 0;
+
+	for (uint32_t i = 0; i != invocation_count; ++i)
+	{
+		select_invocation(i, &info);
+
+		spvcpu::module_state state;
+
+		if (spvcpu::result rst = spvcpu::initialize_cpu_module(module, &info, &state); rst != spvcpu::result::success)
+		{
+			fprintf(stderr, "spvcpu::initialize_cpu_module failed with error %d.\n", static_cast<uint32_t>(rst));
+
+			return 1;
+		}
+
+		while (state.m_status == spvcpu::execution_status::running)
+		{
+			if (spvcpu::result rst = spvcpu::step_module(module, &state); rst != spvcpu::result::success)
+			{
+				fprintf(stderr, "spvcpu::step_module failed with error %d.\n", static_cast<uint32_t>(rst));
+
+				return 1;
+			}
+
+			++instruction_count;
+		}
+
+		spvcpu::free_module_state(&state);
+	}
+
+	double run_seconds = 0.0;
+
+	for (uint32_t i = 0; i != invocation_count; ++i)
+	{
+		select_invocation(i, &info);
+
+		spvcpu::module_state state;
+
+		if (spvcpu::result rst = spvcpu::initialize_cpu_module(module, &info, &state); rst != spvcpu::result::success)
+		{
+			fprintf(stderr, "spvcpu::initialize_cpu_module failed with error %d.\n", static_cast<uint32_t>(rst));
+
+			return 1;
+		}
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		const spvcpu::result rst = spvcpu::run_module(module, &state);
+
+		run_seconds += seconds_since(start);
+
+		if (rst != spvcpu::result::success)
+		{
+			fprintf(stderr, "spvcpu::run_module failed with error %d.\n", static_cast<uint32_t>(rst));
+
+			return 1;
+		}
+
+		spvcpu::free_module_state(&state);
+	}
+
+#if defined(SPVCPU_JIT) && defined(SPVCPU_JIT_REGISTER_ALLOCATION)
+	const char* const dispatch_name = "native";
+#elif defined(SPVCPU_JIT)
+	const char* const dispatch_name = "native, all-spill";
+#elif defined(SPVCPU_THREADED_DISPATCH)
+	const char* const dispatch_name = "threaded";
+#else
+	const char* const dispatch_name = "switch";
+#endif
+
+	printf("runner (%s dispatch): %u invocations, %llu instructions in %.3f s, %.1f M instructions/s\n", dispatch_name, invocation_count, static_cast<unsigned long long>(instruction_count), run_seconds, instruction_count / run_seconds * 1e-6);
+
+	free_bench_resources(resources);
+
+	free(resources);
+
+	spvcpu::free_cpu_module(module);
+
+	free(spird_data);
+
+	free(shader_data);
+
+	return 0;
+}
+
+static int bench_dispatch(int argc, const char** argv) noexcept
+{
+	if (argc != 3 && argc != 4)
+	{
+		fprintf(stderr, "Usage: %s shader-file spird-file [workgroup-count]\n", argv[0]);
+
+		return 0;
+	}
+
+	const uint32_t group_count = argc == 4 ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 10)) : 256;
+
+	void* shader_data;
+
+	uint64_t shader_bytes;
+
+	void* spird_data;
+
+	uint64_t spird_bytes;
+
+	if (!get_file_content(argv[1], &shader_data, &shader_bytes))
+		return 1;
+
+	if (!get_file_content(argv[2], &spird_data, &spird_bytes))
+		return 1;
+
+	void* module;
+
+	if (spvcpu::result rst = spvcpu::create_cpu_module(shader_bytes, shader_data, spird_data, &module); rst != spvcpu::result::success)
+	{
+		fprintf(stderr, "spvcpu::create_cpu_module failed with error %d.\n", static_cast<uint32_t>(rst));
+
+		return 1;
+	}
+
+	bench_resources* resources = static_cast<bench_resources*>(malloc(sizeof(bench_resources)));
+
+	if (resources == nullptr || !create_bench_resources(resources))
+		return 1;
+
+	spvcpu::module_init_info info{};
+	info.buffer_count = bench_descriptor_sets * bench_bindings_per_set;
+	info.buffers = resources->buffers;
+	info.image_count = bench_descriptor_sets * bench_bindings_per_set;
+	info.images = resources->images;
+	info.push_constant_bytes = sizeof(resources->push_constants);
+	info.push_constants = resources->push_constants;
+
+	const uint32_t max_thread_count = std::thread::hardware_concurrency() != 0 ? std::thread::hardware_concurrency() : 1;
+
+	double single_thread_seconds = 0.0;
+
+	for (uint32_t thread_count = 1; ; thread_count = thread_count * 2 < max_thread_count ? thread_count * 2 : max_thread_count)
+	{
+		void* pool;
+
+		if (spvcpu::result rst = spvcpu::create_thread_pool(thread_count, &pool); rst != spvcpu::result::success)
+		{
+			fprintf(stderr, "spvcpu::create_thread_pool failed with error %d.\n", static_cast<uint32_t>(rst));
+
+			return 1;
+		}
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		const spvcpu::result rst = spvcpu::dispatch(pool, module, &info, group_count, 1, 1, 1);
+
+		const double seconds = seconds_since(start);
+
+		spvcpu::free_thread_pool(pool);
+
+		if (rst != spvcpu::result::success)
+		{
+			fprintf(stderr, "spvcpu::dispatch failed with error %d.\n", static_cast<uint32_t>(rst));
+
+			return 1;
+		}
+
+		if (thread_count == 1)
+			single_thread_seconds = seconds;
+
+		printf("dispatch (%u threads): %u workgroups in %.3f s, %.1f workgroups/s, %.2fx speedup\n", thread_count, group_count, seconds, group_count / seconds, single_thread_seconds / seconds);
+
+		if (thread_count == max_thread_count)
+			break;
+	}
+
+	free_bench_resources(resources);
+
+	free(resources);
+
+	spvcpu::free_cpu_module(module);
+
+	free(spird_data);
+
+	free(shader_data);
+
+	return 0;
+}
+
+static int bench_disasm(int argc, const char** argv) noexcept
+{
+	if (argc != 3 && argc != 4)
+	{
+		fprintf(stderr, "Usage: %s shader-file spird-file [iteration-count]\n", argv[0]);
+
+		return 0;
+	}
+
+	const uint32_t iteration_count = argc == 4 ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 10)) : 200;
+
+	void* shader_data;
+
+	uint64_t shader_bytes;
+
+	void* spird_data;
+
+	uint64_t spird_bytes;
+
+	if (!get_file_content(argv[1], &shader_data, &shader_bytes))
+		return 1;
+
+	if (!get_file_content(argv[2], &spird_data, &spird_bytes))
+		return 1;
+
+	// Ids and literals make up most of the output with type info, so both
+	// modes are measured separately.
+	for (uint32_t print_type_info = 0; print_type_info != 2; ++print_type_info)
+	{
+		uint64_t disassembly_bytes = 0;
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		for (uint32_t i = 0; i != iteration_count; ++i)
+		{
+			char* disassembly;
+
+			if (spvcpu::result rst = spvcpu::disassemble(shader_bytes, shader_data, spird_data, print_type_info != 0, &disassembly_bytes, &disassembly); rst != spvcpu::result::success)
+			{
+				fprintf(stderr, "spvcpu::disassemble failed with error %d.\n", static_cast<uint32_t>(rst));
+
+				return 1;
+			}
+
+			free(disassembly);
+		}
+
+		const double seconds = seconds_since(start);
+
+		printf("disasm (%s): %u iterations of %llu bytes in %.3f s, %.1f us/iteration, %.1f MB/s\n", print_type_info != 0 ? "types" : "no types", iteration_count, static_cast<unsigned long long>(disassembly_bytes), seconds, seconds / iteration_count * 1e6, disassembly_bytes * static_cast<double>(iteration_count) / seconds * 1e-6);
+	}
+
+	free(spird_data);
+
+	free(shader_data);
+
+	return 0;
+}
+
+// Synthetic SPIR-V module written by the corpus benchmark. Ids below
+// corpus_id::first_local are global and fixed, function-local ids are handed
+// out by next_local.
+struct corpus_module
+{
+	uint32_t* words;
+
+	uint64_t word_count;
+
+	uint64_t word_capacity;
+
+	uint64_t instruction_count;
+
+	uint32_t next_local;
+
+	uint32_t id_bound;
+
+	bool failed;
+};
+
+namespace corpus_id
+{
+	enum : uint32_t
+	{
+		glsl = 1,
+		main,
+		void_,
+		bool_,
+		int_,
+		uint_,
+		float_,
+		uvec3,
+		vec4,
+		fn_void,
+		float_array,
+		buffer_struct,
+		ptr_buffer,
+		ptr_float,
+		ptr_uvec3,
+		int_0,
+		uint_0,
+		uint_1,
+		uint_4,
+		uint_mask,
+		float_0,
+		float_1,
+		float_half,
+		vec4_1,
+		input_buffer,
+		output_buffer,
+		global_invocation_id,
+		first_local,
+	};
+}
+
+// Function-local ids are never reused, since SPIR-V requires every id to be
+// defined only once per module. generate_corpus_module stops adding functions
+// before they would run out.
+static uint32_t corpus_local(corpus_module* m) noexcept
+{
+	const uint32_t id = m->next_local;
+
+	m->next_local = id + 1;
+
+	m->id_bound = id + 1;
+
+	return id;
+}
+
+// Appends an instruction consisting of the operands in before, the string name
+// if it is not null, and the operands in after.
+static void corpus_emit(corpus_module* m, Op op, std::initializer_list<uint32_t> before, const char* name = nullptr, std::initializer_list<uint32_t> after = {}) noexcept
+{
+	const uint32_t name_words = name == nullptr ? 0 : static_cast<uint32_t>(strlen(name) / 4 + 1);
+
+	const uint32_t word_count = static_cast<uint32_t>(1 + before.size() + name_words + after.size());
+
+	if (m->word_count + word_count > m->word_capacity)
+	{
+		const uint64_t new_capacity = m->word_capacity * 2 + word_count;
+
+		uint32_t* tmp = static_cast<uint32_t*>(realloc(m->words, new_capacity * sizeof(uint32_t)));
+
+		if (tmp == nullptr)
+		{
+			m->failed = true;
+
+			return;
+		}
+
+		m->words = tmp;
+
+		m->word_capacity = new_capacity;
+	}
+
+	uint32_t* out = m->words + m->word_count;
+
+	*out++ = (word_count << 16) | static_cast<uint32_t>(op);
+
+	for (const uint32_t w : before)
+		*out++ = w;
+
+	if (name != nullptr)
+	{
+		memset(out, 0, name_words * sizeof(uint32_t));
+
+		memcpy(out, name, strlen(name));
+
+		out += name_words;
+	}
+
+	for (const uint32_t w : after)
+		*out++ = w;
+
+	m->word_count += word_count;
+
+	m->instruction_count += 1;
+}
+
+static void corpus_emit_globals(corpus_module* m) noexcept
+{
+	using namespace corpus_id;
+
+	corpus_emit(m, Op::Capability, { static_cast<uint32_t>(Capability::Shader) });
+
+	corpus_emit(m, Op::ExtInstImport, { glsl }, "GLSL.std.450");
+
+	corpus_emit(m, Op::MemoryModel, { static_cast<uint32_t>(AddressingModel::Logical), static_cast<uint32_t>(MemoryModel::GLSL450) });
+
+	corpus_emit(m, Op::EntryPoint, { static_cast<uint32_t>(ExecutionModel::GLCompute), main }, "main", { global_invocation_id });
+
+	corpus_emit(m, Op::ExecutionMode, { main, static_cast<uint32_t>(ExecutionMode::LocalSize), 64, 1, 1 });
+
+	corpus_emit(m, Op::Name, { main }, "main");
+
+	corpus_emit(m, Op::Name, { buffer_struct }, "buffer_data");
+
+	corpus_emit(m, Op::MemberName, { buffer_struct, 0 }, "values");
+
+	corpus_emit(m, Op::Name, { input_buffer }, "input_buffer");
+
+	corpus_emit(m, Op::Name, { output_buffer }, "output_buffer");
+
+	corpus_emit(m, Op::Name, { global_invocation_id }, "gl_GlobalInvocationID");
+
+	corpus_emit(m, Op::Decorate, { global_invocation_id, static_cast<uint32_t>(Decoration::BuiltIn), static_cast<uint32_t>(Builtin::GlobalInvocationId) });
+
+	corpus_emit(m, Op::Decorate, { float_array, static_cast<uint32_t>(Decoration::ArrayStride), 4 });
+
+	corpus_emit(m, Op::MemberDecorate, { buffer_struct, 0, static_cast<uint32_t>(Decoration::Offset), 0 });
+
+	corpus_emit(m, Op::Decorate, { buffer_struct, static_cast<uint32_t>(Decoration::Block) });
+
+	corpus_emit(m, Op::Decorate, { input_buffer, static_cast<uint32_t>(Decoration::DescriptorSet), 0 });
+
+	corpus_emit(m, Op::Decorate, { input_buffer, static_cast<uint32_t>(Decoration::Binding), 0 });
+
+	corpus_emit(m, Op::Decorate, { output_buffer, static_cast<uint32_t>(Decoration::DescriptorSet), 0 });
+
+	corpus_emit(m, Op::Decorate, { output_buffer, static_cast<uint32_t>(Decoration::Binding), 1 });
+
+	corpus_emit(m, Op::TypeVoid, { void_ });
+
+	corpus_emit(m, Op::TypeBool, { bool_ });
+
+	corpus_emit(m, Op::TypeInt, { int_, 32, 1 });
+
+	corpus_emit(m, Op::TypeInt, { uint_, 32, 0 });
+
+	corpus_emit(m, Op::TypeFloat, { float_, 32 });
+
+	corpus_emit(m, Op::TypeVector, { uvec3, uint_, 3 });
+
+	corpus_emit(m, Op::TypeVector, { vec4, float_, 4 });
+
+	corpus_emit(m, Op::TypeFunction, { fn_void, void_ });
+
+	corpus_emit(m, Op::TypeRuntimeArray, { float_array, float_ });
+
+	corpus_emit(m, Op::TypeStruct, { buffer_struct, float_array });
+
+	corpus_emit(m, Op::TypePointer, { ptr_buffer, static_cast<uint32_t>(StorageClass::StorageBuffer), buffer_struct });
+
+	corpus_emit(m, Op::TypePointer, { ptr_float, static_cast<uint32_t>(StorageClass::StorageBuffer), float_ });
+
+	corpus_emit(m, Op::TypePointer, { ptr_uvec3, static_cast<uint32_t>(StorageClass::Input), uvec3 });
+
+	corpus_emit(m, Op::Constant, { int_, int_0, 0 });
+
+	corpus_emit(m, Op::Constant, { uint_, uint_0, 0 });
+
+	corpus_emit(m, Op::Constant, { uint_, uint_1, 1 });
+
+	corpus_emit(m, Op::Constant, { uint_, uint_4, 4 });
+
+	corpus_emit(m, Op::Constant, { uint_, uint_mask, 0xFFFF });
+
+	corpus_emit(m, Op::Constant, { float_, float_0, 0x00000000 });
+
+	corpus_emit(m, Op::Constant, { float_, float_1, 0x3F800000 });
+
+	corpus_emit(m, Op::Constant, { float_, float_half, 0x3F000000 });
+
+	corpus_emit(m, Op::ConstantComposite, { vec4, vec4_1, float_1, float_1, float_1, float_1 });
+
+	corpus_emit(m, Op::Variable, { ptr_buffer, input_buffer, static_cast<uint32_t>(StorageClass::StorageBuffer) });
+
+	corpus_emit(m, Op::Variable, { ptr_buffer, output_buffer, static_cast<uint32_t>(StorageClass::StorageBuffer) });
+
+	corpus_emit(m, Op::Variable, { ptr_uvec3, global_invocation_id, static_cast<uint32_t>(StorageClass::Input) });
+}
+
+// Emits a load, some arithmetic, a selection and every few calls a loop,
+// followed by a store. x is the current index into the buffers and label the
+// block control currently is in. Both are updated for the next call.
+static void corpus_emit_block(corpus_module* m, bool with_loop, uint32_t* x, uint32_t* label) noexcept
+{
+	using namespace corpus_id;
+
+	const uint32_t p = corpus_local(m);
+
+	corpus_emit(m, Op::AccessChain, { ptr_float, p, input_buffer, int_0, *x });
+
+	const uint32_t v = corpus_local(m);
+
+	corpus_emit(m, Op::Load, { float_, v, p });
+
+	const uint32_t xf = corpus_local(m);
+
+	corpus_emit(m, Op::ConvertUToF, { float_, xf, *x });
+
+	const uint32_t a = corpus_local(m);
+
+	corpus_emit(m, Op::FMul, { float_, a, v, xf });
+
+	const uint32_t b = corpus_local(m);
+
+	corpus_emit(m, Op::FAdd, { float_, b, a, float_1 });
+
+	// 13 is Sin in GLSL.std.450.
+	const uint32_t s = corpus_local(m);
+
+	corpus_emit(m, Op::ExtInst, { float_, s, glsl, 13, b });
+
+	const uint32_t vec = corpus_local(m);
+
+	corpus_emit(m, Op::CompositeConstruct, { vec4, vec, s, b, a, v });
+
+	const uint32_t shuffled = corpus_local(m);
+
+	corpus_emit(m, Op::VectorShuffle, { vec4, shuffled, vec, vec4_1, 7, 2, 1, 0 });
+
+	const uint32_t d = corpus_local(m);
+
+	corpus_emit(m, Op::Dot, { float_, d, vec, shuffled });
+
+	const uint32_t cond = corpus_local(m);
+
+	corpus_emit(m, Op::FOrdLessThan, { bool_, cond, d, float_0 });
+
+	const uint32_t then_label = corpus_local(m);
+
+	const uint32_t merge_label = corpus_local(m);
+
+	corpus_emit(m, Op::SelectionMerge, { merge_label, 0 });
+
+	corpus_emit(m, Op::BranchConditional, { cond, then_label, merge_label });
+
+	corpus_emit(m, Op::Label, { then_label });
+
+	const uint32_t n = corpus_local(m);
+
+	corpus_emit(m, Op::FMul, { float_, n, d, float_half });
+
+	corpus_emit(m, Op::Branch, { merge_label });
+
+	corpus_emit(m, Op::Label, { merge_label });
+
+	const uint32_t r = corpus_local(m);
+
+	corpus_emit(m, Op::Phi, { float_, r, n, then_label, d, *label });
+
+	const uint32_t q = corpus_local(m);
+
+	corpus_emit(m, Op::AccessChain, { ptr_float, q, output_buffer, int_0, *x });
+
+	corpus_emit(m, Op::Store, { q, r });
+
+	*label = merge_label;
+
+	if (with_loop)
+	{
+		const uint32_t header_label = corpus_local(m);
+
+		const uint32_t body_label = corpus_local(m);
+
+		const uint32_t continue_label = corpus_local(m);
+
+		const uint32_t exit_label = corpus_local(m);
+
+		const uint32_t i = corpus_local(m);
+
+		const uint32_t i_next = corpus_local(m);
+
+		const uint32_t in_range = corpus_local(m);
+
+		corpus_emit(m, Op::Branch, { header_label });
+
+		corpus_emit(m, Op::Label, { header_label });
+
+		corpus_emit(m, Op::Phi, { uint_, i, uint_0, *label, i_next, continue_label });
+
+		corpus_emit(m, Op::LoopMerge, { exit_label, continue_label, 0 });
+
+		corpus_emit(m, Op::Branch, { body_label });
+
+		corpus_emit(m, Op::Label, { body_label });
+
+		corpus_emit(m, Op::ULessThan, { bool_, in_range, i, uint_4 });
+
+		corpus_emit(m, Op::BranchConditional, { in_range, continue_label, exit_label });
+
+		corpus_emit(m, Op::Label, { continue_label });
+
+		corpus_emit(m, Op::IAdd, { uint_, i_next, i, uint_1 });
+
+		corpus_emit(m, Op::Branch, { header_label });
+
+		corpus_emit(m, Op::Label, { exit_label });
+
+		*label = exit_label;
+	}
+
+	const uint32_t x_incremented = corpus_local(m);
+
+	corpus_emit(m, Op::IAdd, { uint_, x_incremented, *x, uint_1 });
+
+	const uint32_t x_masked = corpus_local(m);
+
+	corpus_emit(m, Op::BitwiseAnd, { uint_, x_masked, x_incremented, uint_mask });
+
+	*x = x_masked;
+}
+
+static constexpr uint32_t corpus_blocks_per_function = 16;
+
+// Upper bound on the ids used by one function, which needs four ids besides its
+// blocks, each of which uses at most 24.
+static constexpr uint32_t corpus_max_function_ids = 4 + corpus_blocks_per_function * 24;
+
+// Generates a compute shader of roughly target_bytes. It is built from
+// functions of corpus_blocks_per_function blocks each, the last of which is cut
+// short once the target is reached. Since ids are never reused, modules are
+// limited to about 98 MB by spirv::max_id_bound, so the largest default target
+// produces a slightly smaller module.
+static bool generate_corpus_module(uint64_t target_bytes, corpus_module* out) noexcept
+{
+	using namespace corpus_id;
+
+	*out = {};
+
+	out->next_local = first_local;
+
+	out->id_bound = first_local;
+
+	// Leave room for the header, which is filled in once the id bound is known.
+	corpus_emit(out, Op::Nop, { 0, 0, 0, 0 });
+
+	out->instruction_count = 0;
+
+	corpus_emit_globals(out);
+
+	bool is_main = true;
+
+	while (!out->failed && (is_main || (out->word_count * sizeof(uint32_t) < target_bytes && out->id_bound + corpus_max_function_ids <= spirv::max_id_bound)))
+	{
+		corpus_emit(out, Op::Function, { void_, is_main ? static_cast<uint32_t>(main) : corpus_local(out), 0, fn_void });
+
+		uint32_t label = corpus_local(out);
+
+		corpus_emit(out, Op::Label, { label });
+
+		const uint32_t gid = corpus_local(out);
+
+		corpus_emit(out, Op::Load, { uvec3, gid, global_invocation_id });
+
+		uint32_t x = corpus_local(out);
+
+		corpus_emit(out, Op::CompositeExtract, { uint_, x, gid, 0 });
+
+		for (uint32_t i = 0; i != corpus_blocks_per_function && out->word_count * sizeof(uint32_t) < target_bytes; ++i)
+			corpus_emit_block(out, i % 4 == 3, &x, &label);
+
+		corpus_emit(out, Op::Return, {});
+
+		corpus_emit(out, Op::FunctionEnd, {});
+
+		is_main = false;
+	}
+
+	if (out->failed)
+	{
+		free(out->words);
+
+		return false;
+	}
+
+	out->words[0] = spirv::magic_number;
+
+	out->words[1] = spirv::version_1_3;
+
+	out->words[2] = 0;
+
+	out->words[3] = out->id_bound;
+
+	out->words[4] = 0;
+
+	return true;
+}
+
+static int bench_disasm_corpus(int argc, const char** argv) noexcept
+{
+	if (argc != 2 && argc != 3)
+	{
+		fprintf(stderr, "Usage: %s spird-file [max-module-bytes]\n", argv[0]);
+
+		return 0;
+	}
+
+	const uint64_t max_module_bytes = argc == 3 ? strtoull(argv[2], nullptr, 10) : 100'000'000;
+
+	void* spird_data;
+
+	uint64_t spird_bytes;
+
+	if (!get_file_content(argv[1], &spird_data, &spird_bytes))
+		return 1;
+
+	// Each case is repeated until it has run for at least this long, so that
+	// small modules are not dominated by timer resolution.
+	static constexpr double min_seconds = 0.5;
+
+	for (uint64_t target_bytes = 1'000; target_bytes <= max_module_bytes; target_bytes *= 10)
+	{
+		corpus_module module;
+
+		if (!generate_corpus_module(target_bytes, &module))
+		{
+			fprintf(stderr, "Failed to generate module of %llu bytes.\n", static_cast<unsigned long long>(target_bytes));
+
+			return 1;
+		}
+
+		const uint64_t module_bytes = module.word_count * sizeof(uint32_t);
+
+		for (uint32_t print_type_info = 0; print_type_info != 2; ++print_type_info)
+		{
+			uint32_t iteration_count = 0;
+
+			double seconds;
+
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			do
+			{
+				uint64_t disassembly_bytes;
+
+				char* disassembly;
+
+				if (spvcpu::result rst = spvcpu::disassemble(module_bytes, module.words, spird_data, print_type_info != 0, &disassembly_bytes, &disassembly); rst != spvcpu::result::success)
+				{
+					fprintf(stderr, "spvcpu::disassemble failed on module of %llu bytes with error %d.\n", static_cast<unsigned long long>(module_bytes), static_cast<uint32_t>(rst));
+
+					return 1;
+				}
+
+				free(disassembly);
+
+				iteration_count += 1;
+
+				seconds = seconds_since(start);
+			}
+			while (seconds < min_seconds);
+
+			// One line per case with fixed fields, so that runs can be compared by
+			// splitting on whitespace.
+			printf("disasm-corpus %llu %s: %llu bytes, %llu instructions, %u iterations in %.3f s, %.1f MB/s, %.2f M instructions/s\n",
+				static_cast<unsigned long long>(target_bytes),
+				print_type_info != 0 ? "types" : "no-types",
+				static_cast<unsigned long long>(module_bytes),
+				static_cast<unsigned long long>(module.instruction_count),
+				iteration_count,
+				seconds,
+				module_bytes * static_cast<double>(iteration_count) / seconds * 1e-6,
+				module.instruction_count * static_cast<double>(iteration_count) / seconds * 1e-6);
+		}
+
+		free(module.words);
+	}
+
+	free(spird_data);
+
+	return 0;
+}
+
+static void print_usage(const char* prog_name) noexcept
+{
+	fprintf(stderr, "Usage: %s (--runner | --dispatch | --disasm | --disasm-corpus) [additional args...]\n", prog_name);
+}
+
+int main(int argc, const char** argv)
+{
+	if (argc < 2)
+	{
+		print_usage(argv[0]);
+
+		return 0;
+	}
+	else if (strcmp(argv[1], "--runner") == 0)
+	{
+		return bench_runner(argc - 1, argv + 1);
+	}
+	else if (strcmp(argv[1], "--dispatch") == 0)
+	{
+		return bench_dispatch(argc - 1, argv + 1);
+	}
+	else if (strcmp(argv[1], "--disasm") == 0)
+	{
+		return bench_disasm(argc - 1, argv + 1);
+	}
+	else if (strcmp(argv[1], "--disasm-corpus") == 0)
+	{
+		return bench_disasm_corpus(argc - 1, argv + 1);
+	}
+	else
+	{
+		print_usage(argv[0]);
+
+		return 0;
+	}
+}
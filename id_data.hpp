@@ -269,12 +269,15 @@ private:
 
 			m_ids.memset(0xFF);
 
-			m_table_size_log2 *= 2;
+			m_table_size_log2 += 1;
 
 			const uint32_t mask = (1 << m_table_size_log2) - 1;
 
 			for (uint32_t i = 0; i != size; ++i)
 			{
+				if (old[i].id == ~0u)
+					continue;
+
 				uint32_t h = hash(old[i].id, m_table_size_log2);
 
 				while (m_ids[h].id != ~0u)
@@ -295,6 +298,8 @@ private:
 
 		m_ids[h] = mapper;
 
+		++m_used_ids;
+
 		return true;
 	}
 
@@ -319,20 +324,57 @@ public:
 		return spvcpu::result::success;
 	}
 
+	// Initializes the map to hold the same entries as src.
+	spvcpu::result initialize_copy(const id_type_map& src) noexcept
+	{
+		if (!m_types.initialize(src.m_types.size() + 512) || !m_types.append_range(src.m_types.data(), src.m_types.size()))
+			return spvcpu::result::no_memory;
+
+		if (!m_constants.initialize(src.m_constants.size() + 512) || !m_constants.append_range(src.m_constants.data(), src.m_constants.size()))
+			return spvcpu::result::no_memory;
+
+		if (!m_ids.initialize(src.m_ids.size()))
+			return spvcpu::result::no_memory;
+
+		memcpy(m_ids.data(), src.m_ids.data(), src.m_ids.size() * sizeof(id_data_mapper));
+
+		m_table_size_log2 = src.m_table_size_log2;
+
+		m_used_ids = src.m_used_ids;
+
+		return spvcpu::result::success;
+	}
+
+	// Removes all entries while keeping the allocated memory for reuse.
+	void reset() noexcept
+	{
+		m_types.clear();
+
+		m_constants.clear();
+
+		m_ids.memset(0xFF);
+
+		m_used_ids = 0;
+	}
+
 	spvcpu::result add(uint32_t id, uint32_t type_id, const constant_data* constant_value = nullptr) noexcept
 	{
 		uint32_t type_h = hash(type_id, m_table_size_log2);
 
+		const uint32_t mask = (1 << m_table_size_log2) - 1;
+
 		const uint32_t initial_type_h = type_h;
 
 		while (m_ids[type_h].id != type_id)
 		{
-			type_h = (type_h + 1);
+			type_h = (type_h + 1) & mask;
 
 			if (m_ids[type_h].id == ~0u || type_h == initial_type_h)
 				return spvcpu::result::id_not_found;
 		}
 
+		const uint32_t type_index = m_ids[type_h].type_index;
+
 		uint32_t constant_index = ~0u;
 
 		if (constant_value != nullptr)
@@ -343,7 +385,7 @@ public:
 				return spvcpu::result::no_memory;
 		}
 		
-		if (!add_internal({ id, type_h, constant_index }))
+		if (!add_internal({ id, type_index, constant_index }))
 			return spvcpu::result::no_memory;
 		
 		return spvcpu::result::success;
@@ -372,7 +414,7 @@ public:
 		{
 			h = (h + 1) & mask;
 
-			if (h == initial_h)
+			if (m_ids[h].id == ~0u || h == initial_h)
 				return spvcpu::result::id_not_found;
 		}
 		
@@ -0,0 +1,465 @@
+#include "runner_program.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include "spird_defs.hpp"
+
+// The cache relies on mmap for loading native code, so it is only implemented
+// on Linux. Elsewhere, every lookup misses and nothing is stored.
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Each cached program is a single file named after a hash of its SPIR-V and the
+// version of the spird data it was lowered with. The file starts with a
+// cache_header, followed by the sections it describes. Sections hold the
+// contents of the corresponding cpu_program members, except for
+// cpu_program::m_id_names, which is stored as offsets into m_strings, and the
+// SPIR-V itself, which is compared in full to rule out hash collisions. A hash
+// over everything following the header guards against corrupted files. Native
+// code comes last and starts on a page boundary, so that it can be mapped
+// directly from the file.
+//
+// cache_format_version has to be incremented whenever the layout of any of the
+// stored structures or the lowered instruction stream changes.
+static constexpr uint32_t cache_magic = 0x43565053;
+
+static constexpr uint32_t cache_format_version = 1;
+
+enum class cache_section : uint32_t
+{
+	code,
+	initial_registers,
+	register_offsets,
+	layout_nodes,
+	layout_members,
+	variables,
+	entry_points,
+	strings,
+	id_names,
+	spirv,
+	native_offsets,
+	native_relocations,
+	native_code,
+	count,
+};
+
+struct cache_section_info
+{
+	uint64_t offset;
+
+	uint64_t bytes;
+};
+
+struct cache_header
+{
+	uint32_t magic;
+
+	uint32_t format_version;
+
+	uint32_t spird_version;
+
+	// native_code_variant() of the process storing the program, or 0 if it was
+	// built without SPVCPU_JIT.
+	uint32_t native_variant;
+
+	uint64_t spirv_bytes;
+
+	uint64_t spirv_hash;
+
+	// Hash of the file contents following the header.
+	uint64_t contents_hash;
+
+	uint32_t id_bound;
+
+	uint32_t register_words;
+
+	uint32_t memory_bytes;
+
+	uint32_t scratch_words;
+
+	uint32_t function_count;
+
+	uint32_t pool_words;
+
+	uint32_t workgroup_size_id;
+
+	uint32_t native_exit_offset;
+
+	cache_section_info sections[static_cast<uint32_t>(cache_section::count)];
+};
+
+#if defined(__linux__)
+
+static uint32_t current_native_variant() noexcept
+{
+#if defined(SPVCPU_JIT)
+	return native_code_variant();
+#else
+	return 0;
+#endif
+}
+
+static constexpr uint64_t fnv_offset_basis = 0xCBF29CE484222325;
+
+// 64-bit FNV-1a, continuing from hash.
+static uint64_t hash_bytes(uint64_t hash, const void* data, uint64_t bytes) noexcept
+{
+	const uint8_t* const curr = static_cast<const uint8_t*>(data);
+
+	for (uint64_t i = 0; i != bytes; ++i)
+		hash = (hash ^ curr[i]) * 0x100000001B3;
+
+	return hash;
+}
+
+static constexpr uint32_t max_path_chars = 4096;
+
+static bool get_cache_path(const char* cache_directory, uint64_t spirv_hash, uint32_t spird_version, char (&out_path)[max_path_chars]) noexcept
+{
+	const int chars = snprintf(out_path, sizeof(out_path), "%s/%016llx-%u.spvcpu", cache_directory, static_cast<unsigned long long>(spirv_hash), spird_version);
+
+	return chars > 0 && static_cast<uint32_t>(chars) < sizeof(out_path);
+}
+
+template<typename T>
+static bool read_section(const uint8_t* file, const cache_header* header, cache_section section, simple_vec<T>* out) noexcept
+{
+	const cache_section_info& info = header->sections[static_cast<uint32_t>(section)];
+
+	if (info.bytes % sizeof(T) != 0 || info.bytes / sizeof(T) >= UINT32_MAX)
+		return false;
+
+	const uint32_t count = static_cast<uint32_t>(info.bytes / sizeof(T));
+
+	return out->initialize(count + 1) && out->append_range(reinterpret_cast<const T*>(file + info.offset), count);
+}
+
+static bool read_program(int fd, const uint8_t* file, uint64_t file_bytes, uint64_t spirv_bytes, const void* spirv, uint32_t spird_version, uint64_t spirv_hash, cpu_program* out_program) noexcept
+{
+	const cache_header* const header = reinterpret_cast<const cache_header*>(file);
+
+	if (header->magic != cache_magic || header->format_version != cache_format_version || header->spird_version != spird_version || header->native_variant != current_native_variant())
+		return false;
+
+	if (header->spirv_bytes != spirv_bytes || header->spirv_hash != spirv_hash)
+		return false;
+
+	if (hash_bytes(fnv_offset_basis, file + sizeof(cache_header), file_bytes - sizeof(cache_header)) != header->contents_hash)
+		return false;
+
+	for (const cache_section_info& info : header->sections)
+	{
+		if (info.offset > file_bytes || info.bytes > file_bytes - info.offset)
+			return false;
+	}
+
+	const cache_section_info& spirv_info = header->sections[static_cast<uint32_t>(cache_section::spirv)];
+
+	if (spirv_info.bytes != spirv_bytes || memcmp(file + spirv_info.offset, spirv, spirv_bytes) != 0)
+		return false;
+
+	out_program->m_id_bound = header->id_bound;
+	out_program->m_register_words = header->register_words;
+	out_program->m_memory_bytes = header->memory_bytes;
+	out_program->m_scratch_words = header->scratch_words;
+	out_program->m_function_count = header->function_count;
+	out_program->m_pool_words = header->pool_words;
+	out_program->m_workgroup_size_id = header->workgroup_size_id;
+
+	simple_vec<uint32_t> name_offsets;
+
+	if (!read_section(file, header, cache_section::code, &out_program->m_code) ||
+	    !read_section(file, header, cache_section::initial_registers, &out_program->m_initial_registers) ||
+	    !read_section(file, header, cache_section::register_offsets, &out_program->m_register_offsets) ||
+	    !read_section(file, header, cache_section::layout_nodes, &out_program->m_layout_nodes) ||
+	    !read_section(file, header, cache_section::layout_members, &out_program->m_layout_members) ||
+	    !read_section(file, header, cache_section::variables, &out_program->m_variables) ||
+	    !read_section(file, header, cache_section::entry_points, &out_program->m_entry_points) ||
+	    !read_section(file, header, cache_section::strings, &out_program->m_strings) ||
+	    !read_section(file, header, cache_section::id_names, &name_offsets))
+		return false;
+
+	if (!out_program->m_id_names.initialize(name_offsets.size() + 1))
+		return false;
+
+	for (uint32_t i = 0; i != name_offsets.size(); ++i)
+	{
+		if (name_offsets[i] != ~0u && name_offsets[i] >= out_program->m_strings.size())
+			return false;
+
+		if (!out_program->m_id_names.append(name_offsets[i] == ~0u ? nullptr : out_program->m_strings.data() + name_offsets[i]))
+			return false;
+	}
+
+#if defined(SPVCPU_JIT)
+	native_code& native = out_program->m_native;
+
+	if (!read_section(file, header, cache_section::native_offsets, &native.m_offsets) ||
+	    !read_section(file, header, cache_section::native_relocations, &native.m_relocations))
+		return false;
+
+	if (native.m_offsets.size() != out_program->m_code.size())
+		return false;
+
+	const cache_section_info& code_info = header->sections[static_cast<uint32_t>(cache_section::native_code)];
+
+	const uint64_t page_bytes = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+	if (code_info.bytes == 0 || code_info.offset % page_bytes != 0 || code_info.bytes % page_bytes != 0 || header->native_exit_offset >= code_info.bytes)
+		return false;
+
+	for (uint32_t i = 0; i != native.m_offsets.size(); ++i)
+	{
+		if (native.m_offsets[i] != ~0u && native.m_offsets[i] >= code_info.bytes)
+			return false;
+	}
+
+	for (uint32_t i = 0; i != native.m_relocations.size(); ++i)
+	{
+		if (native.m_relocations[i] > code_info.bytes - 8)
+			return false;
+	}
+
+	// Mapped privately, so that patching relocations does not write through to
+	// the file. Only the pages holding relocations are copied.
+	void* const pages = mmap(nullptr, code_info.bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, static_cast<off_t>(code_info.offset));
+
+	if (pages == MAP_FAILED)
+		return false;
+
+	native.m_code = static_cast<uint8_t*>(pages);
+
+	native.m_bytes = code_info.bytes;
+
+	native.m_exit_offset = header->native_exit_offset;
+
+	if (link_native(&native) != spvcpu::result::success)
+		return false;
+#else
+	(void) fd;
+#endif
+
+	return true;
+}
+
+static void set_section(cache_header* header, const void** section_data, cache_section section, const void* data, uint64_t bytes) noexcept
+{
+	section_data[static_cast<uint32_t>(section)] = data;
+
+	header->sections[static_cast<uint32_t>(section)].bytes = bytes;
+}
+
+struct cache_writer
+{
+	int fd;
+
+	uint64_t offset;
+
+	uint64_t contents_hash;
+
+	bool ok;
+};
+
+static void write_bytes(cache_writer* writer, const void* data, uint64_t bytes) noexcept
+{
+	writer->contents_hash = hash_bytes(writer->contents_hash, data, bytes);
+
+	const uint8_t* curr = static_cast<const uint8_t*>(data);
+
+	while (writer->ok && bytes != 0)
+	{
+		const ssize_t written = write(writer->fd, curr, bytes);
+
+		if (written <= 0)
+		{
+			writer->ok = false;
+
+			return;
+		}
+
+		curr += written;
+
+		bytes -= static_cast<uint64_t>(written);
+
+		writer->offset += static_cast<uint64_t>(written);
+	}
+}
+
+static void write_padding(cache_writer* writer, uint64_t offset) noexcept
+{
+	static constexpr uint8_t zeroes[256]{};
+
+	while (writer->ok && writer->offset != offset)
+		write_bytes(writer, zeroes, offset - writer->offset < sizeof(zeroes) ? offset - writer->offset : sizeof(zeroes));
+}
+
+#endif // __linux__
+
+bool load_cached_program(const char* cache_directory, uint64_t spirv_bytes, const void* spirv, const void* spird, cpu_program* out_program) noexcept
+{
+#if defined(__linux__)
+	const uint32_t spird_version = static_cast<const spird::file_header*>(spird)->version;
+
+	const uint64_t spirv_hash = hash_bytes(fnv_offset_basis, spirv, spirv_bytes);
+
+	char path[max_path_chars];
+
+	if (!get_cache_path(cache_directory, spirv_hash, spird_version, path))
+		return false;
+
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd == -1)
+		return false;
+
+	struct stat file_stat;
+
+	if (fstat(fd, &file_stat) != 0 || static_cast<uint64_t>(file_stat.st_size) < sizeof(cache_header))
+	{
+		close(fd);
+
+		return false;
+	}
+
+	const uint64_t file_bytes = static_cast<uint64_t>(file_stat.st_size);
+
+	void* const file = mmap(nullptr, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (file == MAP_FAILED)
+	{
+		close(fd);
+
+		return false;
+	}
+
+	const bool is_loaded = read_program(fd, static_cast<const uint8_t*>(file), file_bytes, spirv_bytes, spirv, spird_version, spirv_hash, out_program);
+
+	munmap(file, file_bytes);
+
+	close(fd);
+
+	return is_loaded;
+#else
+	return false;
+#endif
+}
+
+void store_cached_program(const char* cache_directory, uint64_t spirv_bytes, const void* spirv, const void* spird, const cpu_program* program) noexcept
+{
+#if defined(__linux__)
+	const uint32_t spird_version = static_cast<const spird::file_header*>(spird)->version;
+
+	const uint64_t spirv_hash = hash_bytes(fnv_offset_basis, spirv, spirv_bytes);
+
+	char path[max_path_chars];
+
+	char temp_path[max_path_chars];
+
+	if (!get_cache_path(cache_directory, spirv_hash, spird_version, path))
+		return;
+
+	const int temp_chars = snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", path, static_cast<int>(getpid()));
+
+	if (temp_chars <= 0 || static_cast<uint32_t>(temp_chars) >= sizeof(temp_path))
+		return;
+
+	simple_vec<uint32_t> name_offsets;
+
+	if (!name_offsets.initialize(program->m_id_names.size() + 1))
+		return;
+
+	for (uint32_t i = 0; i != program->m_id_names.size(); ++i)
+	{
+		const char* const name = program->m_id_names[i];
+
+		if (!name_offsets.append(name == nullptr ? ~0u : static_cast<uint32_t>(name - program->m_strings.data())))
+			return;
+	}
+
+	cache_header header{};
+
+	header.magic = cache_magic;
+	header.format_version = cache_format_version;
+	header.spird_version = spird_version;
+	header.native_variant = current_native_variant();
+	header.spirv_bytes = spirv_bytes;
+	header.spirv_hash = spirv_hash;
+	header.id_bound = program->m_id_bound;
+	header.register_words = program->m_register_words;
+	header.memory_bytes = program->m_memory_bytes;
+	header.scratch_words = program->m_scratch_words;
+	header.function_count = program->m_function_count;
+	header.pool_words = program->m_pool_words;
+	header.workgroup_size_id = program->m_workgroup_size_id;
+
+	const void* section_data[static_cast<uint32_t>(cache_section::count)]{};
+
+	set_section(&header, section_data, cache_section::code, program->m_code.data(), program->m_code.size() * sizeof(uint32_t));
+	set_section(&header, section_data, cache_section::initial_registers, program->m_initial_registers.data(), program->m_initial_registers.size() * sizeof(uint32_t));
+	set_section(&header, section_data, cache_section::register_offsets, program->m_register_offsets.data(), program->m_register_offsets.size() * sizeof(uint32_t));
+	set_section(&header, section_data, cache_section::layout_nodes, program->m_layout_nodes.data(), program->m_layout_nodes.size() * sizeof(layout_node));
+	set_section(&header, section_data, cache_section::layout_members, program->m_layout_members.data(), program->m_layout_members.size() * sizeof(layout_member));
+	set_section(&header, section_data, cache_section::variables, program->m_variables.data(), program->m_variables.size() * sizeof(program_variable));
+	set_section(&header, section_data, cache_section::entry_points, program->m_entry_points.data(), program->m_entry_points.size() * sizeof(entry_point_info));
+	set_section(&header, section_data, cache_section::strings, program->m_strings.data(), program->m_strings.size());
+	set_section(&header, section_data, cache_section::id_names, name_offsets.data(), name_offsets.size() * sizeof(uint32_t));
+	set_section(&header, section_data, cache_section::spirv, spirv, spirv_bytes);
+
+#if defined(SPVCPU_JIT)
+	header.native_exit_offset = program->m_native.m_exit_offset;
+
+	set_section(&header, section_data, cache_section::native_offsets, program->m_native.m_offsets.data(), program->m_native.m_offsets.size() * sizeof(uint32_t));
+	set_section(&header, section_data, cache_section::native_relocations, program->m_native.m_relocations.data(), program->m_native.m_relocations.size() * sizeof(uint32_t));
+	set_section(&header, section_data, cache_section::native_code, program->m_native.m_code, program->m_native.m_bytes);
+#endif
+
+	const uint64_t page_bytes = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+	uint64_t offset = sizeof(cache_header);
+
+	for (uint32_t i = 0; i != static_cast<uint32_t>(cache_section::count); ++i)
+	{
+		const uint64_t alignment = i == static_cast<uint32_t>(cache_section::native_code) ? page_bytes : 8;
+
+		offset = (offset + alignment - 1) & ~(alignment - 1);
+
+		header.sections[i].offset = offset;
+
+		offset += header.sections[i].bytes;
+	}
+
+	mkdir(cache_directory, 0777);
+
+	// Written to a temporary file first and then renamed, so that concurrent
+	// loads never observe a partially written file.
+	cache_writer writer{ open(temp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644), 0, 0, true };
+
+	if (writer.fd == -1)
+		return;
+
+	// The header is written last, once the hash of the contents is known.
+	write_padding(&writer, sizeof(header));
+
+	writer.contents_hash = fnv_offset_basis;
+
+	for (uint32_t i = 0; i != static_cast<uint32_t>(cache_section::count); ++i)
+	{
+		write_padding(&writer, header.sections[i].offset);
+
+		write_bytes(&writer, section_data[i], header.sections[i].bytes);
+	}
+
+	header.contents_hash = writer.contents_hash;
+
+	if (writer.ok && pwrite(writer.fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)))
+		writer.ok = false;
+
+	if (close(writer.fd) != 0 || !writer.ok || rename(temp_path, path) != 0)
+		unlink(temp_path);
+#endif
+}
@@ -0,0 +1,306 @@
+#include "spv_runner.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+
+// Workgroups of a dispatch are identified by their linear index, with x varying
+// fastest. Every worker owns a range of indices it runs from the front. Once its
+// own range is empty, a worker steals the back half of another worker's range.
+// Begin and end of a range are packed into a single word (begin in the low half)
+// so that both the owner and thieves can claim indices with one CAS. Since every
+// index is only ever part of one range, a non-empty packed value can never
+// reappear, which rules out ABA.
+struct alignas(64) work_range
+{
+	std::atomic<uint64_t> packed;
+};
+
+static uint64_t pack_range(uint32_t begin, uint32_t end) noexcept
+{
+	return begin | static_cast<uint64_t>(end) << 32;
+}
+
+struct dispatch_job
+{
+	const void* module;
+
+	spvcpu::module_init_info init_info;
+
+	uint32_t lane_count;
+
+	// First error returned by any workgroup. Workers stop picking up new
+	// workgroups once this is set.
+	std::atomic<spvcpu::result> error;
+};
+
+struct thread_pool
+{
+	uint32_t m_thread_count;
+
+	// m_thread_count - 1 workers. The thread calling dispatch acts as worker 0.
+	std::thread* m_threads;
+
+	work_range* m_ranges;
+
+	std::mutex m_mutex;
+
+	std::condition_variable m_start;
+
+	std::condition_variable m_done;
+
+	// Incremented for every dispatch, waking up the workers.
+	uint64_t m_generation;
+
+	// Number of workers still running the current dispatch, not counting the
+	// calling thread.
+	uint32_t m_active;
+
+	bool m_stop;
+
+	dispatch_job* m_job;
+};
+
+static bool pop_own(work_range* range, uint32_t* out_index) noexcept
+{
+	uint64_t packed = range->packed.load(std::memory_order_relaxed);
+
+	while (true)
+	{
+		const uint32_t begin = static_cast<uint32_t>(packed);
+
+		const uint32_t end = static_cast<uint32_t>(packed >> 32);
+
+		if (begin >= end)
+			return false;
+
+		if (range->packed.compare_exchange_weak(packed, pack_range(begin + 1, end), std::memory_order_relaxed))
+		{
+			*out_index = begin;
+
+			return true;
+		}
+	}
+}
+
+static bool steal(thread_pool* pool, uint32_t worker, uint32_t* out_index) noexcept
+{
+	for (uint32_t i = 1; i != pool->m_thread_count; ++i)
+	{
+		work_range* const victim = pool->m_ranges + (worker + i) % pool->m_thread_count;
+
+		uint64_t packed = victim->packed.load(std::memory_order_relaxed);
+
+		while (true)
+		{
+			const uint32_t begin = static_cast<uint32_t>(packed);
+
+			const uint32_t end = static_cast<uint32_t>(packed >> 32);
+
+			if (begin >= end)
+				break;
+
+			const uint32_t mid = begin + (end - begin) / 2;
+
+			if (victim->packed.compare_exchange_weak(packed, pack_range(begin, mid), std::memory_order_relaxed))
+			{
+				*out_index = mid;
+
+				// Only the owner ever grows a range, and thieves leave empty ranges alone.
+				pool->m_ranges[worker].packed.store(pack_range(mid + 1, end), std::memory_order_relaxed);
+
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+static void run_workgroups(thread_pool* pool, dispatch_job* job, uint32_t worker) noexcept
+{
+	spvcpu::module_init_info info = job->init_info;
+
+	const uint32_t* const group_count = info.workgroup_count;
+
+	while (job->error.load(std::memory_order_relaxed) == spvcpu::result::success)
+	{
+		uint32_t index;
+
+		if (!pop_own(pool->m_ranges + worker, &index) && !steal(pool, worker, &index))
+			return;
+
+		info.workgroup_id[0] = index % group_count[0];
+		info.workgroup_id[1] = (index / group_count[0]) % group_count[1];
+		info.workgroup_id[2] = index / (group_count[0] * group_count[1]);
+
+		if (spvcpu::result rst = spvcpu::run_workgroup(job->module, &info, job->lane_count); rst != spvcpu::result::success)
+		{
+			spvcpu::result expected = spvcpu::result::success;
+
+			job->error.compare_exchange_strong(expected, rst);
+		}
+	}
+}
+
+static void worker_main(thread_pool* pool, uint32_t worker) noexcept
+{
+	uint64_t generation = 0;
+
+	while (true)
+	{
+		dispatch_job* job;
+
+		{
+			std::unique_lock<std::mutex> lock(pool->m_mutex);
+
+			pool->m_start.wait(lock, [&]() { return pool->m_stop || pool->m_generation != generation; });
+
+			if (pool->m_stop)
+				return;
+
+			generation = pool->m_generation;
+
+			job = pool->m_job;
+		}
+
+		run_workgroups(pool, job, worker);
+
+		{
+			std::lock_guard<std::mutex> lock(pool->m_mutex);
+
+			if (--pool->m_active == 0)
+				pool->m_done.notify_one();
+		}
+	}
+}
+
+static void destroy_thread_pool(thread_pool* pool, uint32_t started_threads) noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(pool->m_mutex);
+
+		pool->m_stop = true;
+	}
+
+	pool->m_start.notify_all();
+
+	for (uint32_t i = 0; i != started_threads; ++i)
+		pool->m_threads[i].join();
+
+	delete[] pool->m_threads;
+
+	delete[] pool->m_ranges;
+
+	delete pool;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::create_thread_pool(uint32_t thread_count, void** out_pool) noexcept
+{
+	if (thread_count == 0)
+		thread_count = std::thread::hardware_concurrency();
+
+	if (thread_count == 0)
+		thread_count = 1;
+
+	thread_pool* const pool = new(std::nothrow) thread_pool{};
+
+	if (pool == nullptr)
+		return result::no_memory;
+
+	pool->m_thread_count = thread_count;
+
+	pool->m_ranges = new(std::nothrow) work_range[thread_count];
+
+	pool->m_threads = new(std::nothrow) std::thread[thread_count - 1];
+
+	if (pool->m_ranges == nullptr || pool->m_threads == nullptr)
+	{
+		destroy_thread_pool(pool, 0);
+
+		return result::no_memory;
+	}
+
+	for (uint32_t i = 0; i != thread_count - 1; ++i)
+	{
+		try
+		{
+			pool->m_threads[i] = std::thread(worker_main, pool, i + 1);
+		}
+		catch (const std::system_error&)
+		{
+			destroy_thread_pool(pool, i);
+
+			return result::thread_creation_failed;
+		}
+	}
+
+	*out_pool = pool;
+
+	return result::success;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::free_thread_pool(void* pool) noexcept
+{
+	thread_pool* const p = static_cast<thread_pool*>(pool);
+
+	destroy_thread_pool(p, p->m_thread_count - 1);
+
+	return result::success;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::dispatch(void* pool, const void* module, const module_init_info* init_info, uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z, uint32_t lane_count) noexcept
+{
+	thread_pool* const p = static_cast<thread_pool*>(pool);
+
+	const uint64_t group_count = static_cast<uint64_t>(group_count_x) * group_count_y * group_count_z;
+
+	if (group_count > UINT32_MAX)
+		return result::too_many_workgroups;
+
+	if (group_count == 0)
+		return result::success;
+
+	dispatch_job job{ module, *init_info, lane_count, result::success };
+
+	job.init_info.workgroup_count[0] = group_count_x;
+	job.init_info.workgroup_count[1] = group_count_y;
+	job.init_info.workgroup_count[2] = group_count_z;
+
+	// Start out with an even split of the workgroups. With a single thread, this
+	// leaves worker 0 running all of them in order.
+	const uint64_t thread_count = p->m_thread_count;
+
+	for (uint32_t w = 0; w != thread_count; ++w)
+		p->m_ranges[w].packed.store(pack_range(static_cast<uint32_t>(group_count * w / thread_count), static_cast<uint32_t>(group_count * (w + 1) / thread_count)), std::memory_order_relaxed);
+
+	if (thread_count > 1)
+	{
+		{
+			std::lock_guard<std::mutex> lock(p->m_mutex);
+
+			p->m_job = &job;
+
+			p->m_active = static_cast<uint32_t>(thread_count - 1);
+
+			++p->m_generation;
+		}
+
+		p->m_start.notify_all();
+	}
+
+	run_workgroups(p, &job, 0);
+
+	if (thread_count > 1)
+	{
+		std::unique_lock<std::mutex> lock(p->m_mutex);
+
+		p->m_done.wait(lock, [&]() { return p->m_active == 0; });
+	}
+
+	return job.error.load(std::memory_order_relaxed);
+}
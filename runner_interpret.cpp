@@ -0,0 +1,2853 @@
+#include "runner_program.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+enum class image_numeric : uint8_t
+{
+	none,
+	sfloat,
+	unorm,
+	snorm,
+	uint,
+	sint,
+};
+
+struct image_format_info
+{
+	uint8_t channels;
+
+	uint8_t channel_bytes;
+
+	image_numeric numeric;
+};
+
+// Indexed by ImageFormat. Packed formats (R11fG11fB10f, Rgb10A2, Rgb10a2ui) are
+// not supported and have zero channels.
+static constexpr image_format_info image_formats[]{
+	{ 0, 0, image_numeric::none   }, // Unknown
+	{ 4, 4, image_numeric::sfloat }, // Rgba32f
+	{ 4, 2, image_numeric::sfloat }, // Rgba16f
+	{ 1, 4, image_numeric::sfloat }, // R32f
+	{ 4, 1, image_numeric::unorm  }, // Rgba8
+	{ 4, 1, image_numeric::snorm  }, // Rgba8Snorm
+	{ 2, 4, image_numeric::sfloat }, // Rg32f
+	{ 2, 2, image_numeric::sfloat }, // Rg16f
+	{ 0, 0, image_numeric::none   }, // R11fG11fB10f
+	{ 1, 2, image_numeric::sfloat }, // R16f
+	{ 4, 2, image_numeric::unorm  }, // Rgba16
+	{ 0, 0, image_numeric::none   }, // Rgb10A2
+	{ 2, 2, image_numeric::unorm  }, // Rg16
+	{ 2, 1, image_numeric::unorm  }, // Rg8
+	{ 1, 2, image_numeric::unorm  }, // R16
+	{ 1, 1, image_numeric::unorm  }, // R8
+	{ 4, 2, image_numeric::snorm  }, // Rgba16Snorm
+	{ 2, 2, image_numeric::snorm  }, // Rg16Snorm
+	{ 2, 1, image_numeric::snorm  }, // Rg8Snorm
+	{ 1, 2, image_numeric::snorm  }, // R16Snorm
+	{ 1, 1, image_numeric::snorm  }, // R8Snorm
+	{ 4, 4, image_numeric::sint   }, // Rgba32i
+	{ 4, 2, image_numeric::sint   }, // Rgba16i
+	{ 4, 1, image_numeric::sint   }, // Rgba8i
+	{ 1, 4, image_numeric::sint   }, // R32i
+	{ 2, 4, image_numeric::sint   }, // Rg32i
+	{ 2, 2, image_numeric::sint   }, // Rg16i
+	{ 2, 1, image_numeric::sint   }, // Rg8i
+	{ 1, 2, image_numeric::sint   }, // R16i
+	{ 1, 1, image_numeric::sint   }, // R8i
+	{ 4, 4, image_numeric::uint   }, // Rgba32ui
+	{ 4, 2, image_numeric::uint   }, // Rgba16ui
+	{ 4, 1, image_numeric::uint   }, // Rgba8ui
+	{ 1, 4, image_numeric::uint   }, // R32ui
+	{ 0, 0, image_numeric::none   }, // Rgb10a2ui
+	{ 2, 4, image_numeric::uint   }, // Rg32ui
+	{ 2, 2, image_numeric::uint   }, // Rg16ui
+	{ 2, 1, image_numeric::uint   }, // Rg8ui
+	{ 1, 2, image_numeric::uint   }, // R16ui
+	{ 1, 1, image_numeric::uint   }, // R8ui
+	{ 1, 8, image_numeric::uint   }, // R64ui
+	{ 1, 8, image_numeric::sint   }, // R64i
+};
+
+// GLSL.std.450 instruction numbers handled by the interpreter.
+enum class glsl_op : uint16_t
+{
+	Round         = 1,
+	RoundEven     = 2,
+	Trunc         = 3,
+	FAbs          = 4,
+	SAbs          = 5,
+	FSign         = 6,
+	SSign         = 7,
+	Floor         = 8,
+	Ceil          = 9,
+	Fract         = 10,
+	Radians       = 11,
+	Degrees       = 12,
+	Sin           = 13,
+	Cos           = 14,
+	Tan           = 15,
+	Asin          = 16,
+	Acos          = 17,
+	Atan          = 18,
+	Sinh          = 19,
+	Cosh          = 20,
+	Tanh          = 21,
+	Asinh         = 22,
+	Acosh         = 23,
+	Atanh         = 24,
+	Atan2         = 25,
+	Pow           = 26,
+	Exp           = 27,
+	Log           = 28,
+	Exp2          = 29,
+	Log2          = 30,
+	Sqrt          = 31,
+	InverseSqrt   = 32,
+	FMin          = 37,
+	UMin          = 38,
+	SMin          = 39,
+	FMax          = 40,
+	UMax          = 41,
+	SMax          = 42,
+	FClamp        = 43,
+	UClamp        = 44,
+	SClamp        = 45,
+	FMix          = 46,
+	Step          = 48,
+	SmoothStep    = 49,
+	Fma           = 50,
+	Ldexp         = 53,
+	PackSnorm4x8  = 54,
+	PackUnorm4x8  = 55,
+	PackSnorm2x16 = 56,
+	PackUnorm2x16 = 57,
+	UnpackSnorm2x16 = 60,
+	UnpackUnorm2x16 = 61,
+	UnpackSnorm4x8  = 63,
+	UnpackUnorm4x8  = 64,
+	Length        = 66,
+	Distance      = 67,
+	Cross         = 68,
+	Normalize     = 69,
+	FaceForward   = 70,
+	Reflect       = 71,
+	Refract       = 72,
+	FindILsb      = 73,
+	FindSMsb      = 74,
+	FindUMsb      = 75,
+	NMin          = 79,
+	NMax          = 80,
+	NClamp        = 81,
+};
+
+static uint32_t kind_bits(scalar_kind kind) noexcept
+{
+	switch (kind)
+	{
+	case scalar_kind::i8:  return 8;
+	case scalar_kind::i16: return 16;
+	case scalar_kind::i64: return 64;
+	case scalar_kind::f64: return 64;
+	default:               return 32;
+	}
+}
+
+static uint32_t kind_words(scalar_kind kind) noexcept
+{
+	return kind == scalar_kind::i64 || kind == scalar_kind::f64 ? 2 : 1;
+}
+
+static uint32_t operand_count(const insn& i) noexcept
+{
+	return i.length - insn_words;
+}
+
+// Register accessors and the generic handlers are templated on the type used to
+// address a value in the register file. Single invocations use plain pointers.
+// Lane batches use lane_ptr, since each register word there holds one word per
+// lane, so consecutive words of a lane's value are Lanes words apart.
+template<uint32_t Lanes>
+struct lane_ptr
+{
+	uint32_t* words;
+
+	uint32_t& operator[](uint32_t i) const noexcept
+	{
+		return words[i * Lanes];
+	}
+
+	lane_ptr operator+(uint32_t offset) const noexcept
+	{
+		return { words + offset * Lanes };
+	}
+
+	lane_ptr& operator+=(uint32_t offset) noexcept
+	{
+		words += offset * Lanes;
+
+		return *this;
+	}
+};
+
+static void copy_regs(uint32_t* dst, const uint32_t* src, uint32_t words) noexcept
+{
+	memcpy(dst, src, words * 4);
+}
+
+static void copy_to_regs(uint32_t* dst, const void* src, uint32_t words) noexcept
+{
+	memcpy(dst, src, words * 4);
+}
+
+static void copy_from_regs(void* dst, const uint32_t* src, uint32_t words) noexcept
+{
+	memcpy(dst, src, words * 4);
+}
+
+static void clear_regs(uint32_t* dst, uint32_t words) noexcept
+{
+	memset(dst, 0, words * 4);
+}
+
+template<uint32_t Lanes>
+static void copy_regs(lane_ptr<Lanes> dst, lane_ptr<Lanes> src, uint32_t words) noexcept
+{
+	for (uint32_t i = 0; i != words; ++i)
+		dst[i] = src[i];
+}
+
+template<uint32_t Lanes>
+static void copy_to_regs(lane_ptr<Lanes> dst, const void* src, uint32_t words) noexcept
+{
+	for (uint32_t i = 0; i != words; ++i)
+		memcpy(&dst[i], static_cast<const uint8_t*>(src) + i * 4, 4);
+}
+
+template<uint32_t Lanes>
+static void copy_from_regs(void* dst, lane_ptr<Lanes> src, uint32_t words) noexcept
+{
+	for (uint32_t i = 0; i != words; ++i)
+		memcpy(static_cast<uint8_t*>(dst) + i * 4, &src[i], 4);
+}
+
+template<uint32_t Lanes>
+static void clear_regs(lane_ptr<Lanes> dst, uint32_t words) noexcept
+{
+	for (uint32_t i = 0; i != words; ++i)
+		dst[i] = 0;
+}
+
+template<typename R>
+static uint64_t load_u(R r, scalar_kind kind, uint32_t i) noexcept
+{
+	if (kind == scalar_kind::i64 || kind == scalar_kind::f64)
+		return r[i * 2] | (static_cast<uint64_t>(r[i * 2 + 1]) << 32);
+
+	return r[i];
+}
+
+template<typename R>
+static int64_t load_s(R r, scalar_kind kind, uint32_t i) noexcept
+{
+	switch (kind)
+	{
+	case scalar_kind::i8:  return static_cast<int8_t>(r[i]);
+	case scalar_kind::i16: return static_cast<int16_t>(r[i]);
+	case scalar_kind::i32: return static_cast<int32_t>(r[i]);
+	case scalar_kind::i64: return static_cast<int64_t>(load_u(r, kind, i));
+	default:               return r[i];
+	}
+}
+
+template<typename R>
+static double load_f(R r, scalar_kind kind, uint32_t i) noexcept
+{
+	if (kind == scalar_kind::f64)
+	{
+		const uint64_t bits = load_u(r, kind, i);
+
+		double d;
+
+		memcpy(&d, &bits, sizeof(d));
+
+		return d;
+	}
+
+	const uint32_t bits = r[i];
+
+	float f;
+
+	memcpy(&f, &bits, sizeof(f));
+
+	return f;
+}
+
+template<typename R>
+static void store_u(R r, scalar_kind kind, uint32_t i, uint64_t value) noexcept
+{
+	switch (kind)
+	{
+	case scalar_kind::boolean:
+		r[i] = value != 0;
+		break;
+
+	case scalar_kind::i8:
+		r[i] = static_cast<uint32_t>(value & 0xFF);
+		break;
+
+	case scalar_kind::i16:
+		r[i] = static_cast<uint32_t>(value & 0xFFFF);
+		break;
+
+	case scalar_kind::i64:
+	case scalar_kind::f64:
+		r[i * 2] = static_cast<uint32_t>(value);
+		r[i * 2 + 1] = static_cast<uint32_t>(value >> 32);
+		break;
+
+	default:
+		r[i] = static_cast<uint32_t>(value);
+		break;
+	}
+}
+
+template<typename R>
+static void store_f(R r, scalar_kind kind, uint32_t i, double value) noexcept
+{
+	if (kind == scalar_kind::f64)
+	{
+		uint64_t bits;
+
+		memcpy(&bits, &value, sizeof(bits));
+
+		store_u(r, kind, i, bits);
+	}
+	else
+	{
+		const float f = static_cast<float>(value);
+
+		uint32_t bits;
+
+		memcpy(&bits, &f, sizeof(bits));
+
+		r[i] = bits;
+	}
+}
+
+template<typename R>
+static uint8_t* load_pointer(R r) noexcept
+{
+	return reinterpret_cast<uint8_t*>(static_cast<uintptr_t>(r[0] | (static_cast<uint64_t>(r[1]) << 32)));
+}
+
+template<typename R>
+static void store_pointer(R r, const void* ptr) noexcept
+{
+	const uint64_t value = reinterpret_cast<uintptr_t>(ptr);
+
+	r[0] = static_cast<uint32_t>(value);
+
+	r[1] = static_cast<uint32_t>(value >> 32);
+}
+
+static uint64_t sign_mask(scalar_kind kind) noexcept
+{
+	return 1ull << (kind_bits(kind) - 1);
+}
+
+static uint64_t value_mask(scalar_kind kind) noexcept
+{
+	return kind_bits(kind) == 64 ? ~0ull : (1ull << kind_bits(kind)) - 1;
+}
+
+static float half_to_float(uint16_t h) noexcept
+{
+	const uint32_t sign = (h & 0x8000u) << 16;
+
+	const uint32_t exponent = (h >> 10) & 0x1F;
+
+	const uint32_t mantissa = h & 0x3FF;
+
+	uint32_t bits;
+
+	if (exponent == 0x1F)
+	{
+		bits = sign | 0x7F800000u | (mantissa << 13);
+	}
+	else if (exponent != 0)
+	{
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	else if (mantissa != 0)
+	{
+		const float f = std::ldexp(static_cast<float>(mantissa), -24);
+
+		return sign != 0 ? -f : f;
+	}
+	else
+	{
+		bits = sign;
+	}
+
+	float f;
+
+	memcpy(&f, &bits, sizeof(f));
+
+	return f;
+}
+
+static uint16_t float_to_half(float f) noexcept
+{
+	uint32_t bits;
+
+	memcpy(&bits, &f, sizeof(bits));
+
+	const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+
+	const int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+
+	const uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (((bits >> 23) & 0xFF) == 0xFF)
+		return sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0);
+
+	if (exponent >= 0x1F)
+		return sign | 0x7C00;
+
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+			return sign;
+
+		const uint32_t full = mantissa | 0x800000;
+
+		const uint32_t shift = static_cast<uint32_t>(14 - exponent);
+
+		uint32_t half = full >> shift;
+
+		const uint32_t remainder = full & ((1u << shift) - 1);
+
+		const uint32_t halfway = 1u << (shift - 1);
+
+		if (remainder > halfway || (remainder == halfway && (half & 1)))
+			++half;
+
+		return sign | static_cast<uint16_t>(half);
+	}
+
+	uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+
+	const uint32_t remainder = mantissa & 0x1FFF;
+
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+		++half;
+
+	return sign | static_cast<uint16_t>(half);
+}
+
+template<typename R>
+static void load_from_memory(const cpu_program* program, uint32_t node_index, const uint8_t* src, R dst) noexcept
+{
+	const layout_node& node = program->m_layout_nodes[node_index];
+
+	if (node.is_trivial)
+	{
+		copy_to_regs(dst, src, node.register_words);
+
+		return;
+	}
+
+	switch (node.kind)
+	{
+	case layout_kind::scalar:
+	{
+		if (node.scalar == scalar_kind::i8)
+			dst[0] = src[0];
+		else if (node.scalar == scalar_kind::i16)
+			dst[0] = src[0] | (static_cast<uint32_t>(src[1]) << 8);
+		else
+			copy_to_regs(dst, src, node.register_words);
+
+		break;
+	}
+	case layout_kind::vector:
+	case layout_kind::matrix:
+	case layout_kind::array:
+	{
+		const uint32_t element_words = program->m_layout_nodes[node.element].register_words;
+
+		for (uint32_t i = 0; i != node.count; ++i)
+			load_from_memory(program, node.element, src + static_cast<uint64_t>(i) * node.stride, dst + i * element_words);
+
+		break;
+	}
+	case layout_kind::structure:
+	{
+		for (uint32_t i = 0; i != node.count; ++i)
+		{
+			const layout_member& member = program->m_layout_members[node.element + i];
+
+			load_from_memory(program, member.node, src + member.memory_offset, dst + member.register_offset);
+		}
+
+		break;
+	}
+	default:
+	{
+		break;
+	}
+	}
+}
+
+template<typename R>
+static void store_to_memory(const cpu_program* program, uint32_t node_index, R src, uint8_t* dst) noexcept
+{
+	const layout_node& node = program->m_layout_nodes[node_index];
+
+	if (node.is_trivial)
+	{
+		copy_from_regs(dst, src, node.register_words);
+
+		return;
+	}
+
+	switch (node.kind)
+	{
+	case layout_kind::scalar:
+	{
+		if (node.scalar == scalar_kind::i8)
+		{
+			dst[0] = static_cast<uint8_t>(src[0]);
+		}
+		else if (node.scalar == scalar_kind::i16)
+		{
+			dst[0] = static_cast<uint8_t>(src[0]);
+
+			dst[1] = static_cast<uint8_t>(src[0] >> 8);
+		}
+		else
+		{
+			copy_from_regs(dst, src, node.register_words);
+		}
+
+		break;
+	}
+	case layout_kind::vector:
+	case layout_kind::matrix:
+	case layout_kind::array:
+	{
+		const uint32_t element_words = program->m_layout_nodes[node.element].register_words;
+
+		for (uint32_t i = 0; i != node.count; ++i)
+			store_to_memory(program, node.element, src + i * element_words, dst + static_cast<uint64_t>(i) * node.stride);
+
+		break;
+	}
+	case layout_kind::structure:
+	{
+		for (uint32_t i = 0; i != node.count; ++i)
+		{
+			const layout_member& member = program->m_layout_members[node.element + i];
+
+			store_to_memory(program, member.node, src + member.register_offset, dst + member.memory_offset);
+		}
+
+		break;
+	}
+	default:
+	{
+		break;
+	}
+	}
+}
+
+template<typename R>
+static bool execute_unary(Op opcode, scalar_kind kind, scalar_kind src_kind, uint32_t i, R a, R d) noexcept
+{
+	switch (opcode)
+	{
+	case Op::SNegate:     store_u(d, kind, i, 0 - load_u(a, src_kind, i)); break;
+	case Op::FNegate:     store_f(d, kind, i, -load_f(a, src_kind, i)); break;
+	case Op::Not:         store_u(d, kind, i, ~load_u(a, src_kind, i)); break;
+	case Op::LogicalNot:  store_u(d, kind, i, a[i] == 0); break;
+	case Op::IsNan:       store_u(d, kind, i, std::isnan(load_f(a, src_kind, i))); break;
+	case Op::IsInf:       store_u(d, kind, i, std::isinf(load_f(a, src_kind, i))); break;
+	case Op::IsFinite:    store_u(d, kind, i, std::isfinite(load_f(a, src_kind, i))); break;
+	case Op::ConvertSToF: store_f(d, kind, i, static_cast<double>(load_s(a, src_kind, i))); break;
+	case Op::ConvertUToF: store_f(d, kind, i, static_cast<double>(load_u(a, src_kind, i))); break;
+	case Op::UConvert:    store_u(d, kind, i, load_u(a, src_kind, i)); break;
+	case Op::SConvert:    store_u(d, kind, i, static_cast<uint64_t>(load_s(a, src_kind, i))); break;
+	case Op::FConvert:    store_f(d, kind, i, load_f(a, src_kind, i)); break;
+	case Op::ConvertFToU:
+	{
+		const double f = load_f(a, src_kind, i);
+
+		store_u(d, kind, i, f <= 0.0 || std::isnan(f) ? 0 : f >= 18446744073709551615.0 ? ~0ull : static_cast<uint64_t>(f));
+
+		break;
+	}
+	case Op::ConvertFToS:
+	{
+		const double f = load_f(a, src_kind, i);
+
+		store_u(d, kind, i, static_cast<uint64_t>(std::isnan(f) ? 0 : f <= -9223372036854775808.0 ? INT64_MIN : f >= 9223372036854775807.0 ? INT64_MAX : static_cast<int64_t>(f)));
+
+		break;
+	}
+	case Op::BitReverse:
+	{
+		const uint64_t v = load_u(a, src_kind, i);
+
+		uint64_t r = 0;
+
+		for (uint32_t b = 0; b != kind_bits(src_kind); ++b)
+			r |= ((v >> b) & 1) << (kind_bits(src_kind) - 1 - b);
+
+		store_u(d, kind, i, r);
+
+		break;
+	}
+	case Op::BitCount:
+	{
+		uint64_t v = load_u(a, src_kind, i);
+
+		uint64_t n = 0;
+
+		for (; v != 0; v &= v - 1)
+			++n;
+
+		store_u(d, kind, i, n);
+
+		break;
+	}
+	default:
+	{
+		return false;
+	}
+	}
+
+	return true;
+}
+
+template<typename R>
+static bool execute_binary(Op opcode, scalar_kind kind, scalar_kind src_kind, uint32_t i, R a, R b, R d) noexcept
+{
+	switch (opcode)
+	{
+	case Op::IAdd: store_u(d, kind, i, load_u(a, kind, i) + load_u(b, src_kind, i)); break;
+	case Op::ISub: store_u(d, kind, i, load_u(a, kind, i) - load_u(b, src_kind, i)); break;
+	case Op::IMul: store_u(d, kind, i, load_u(a, kind, i) * load_u(b, src_kind, i)); break;
+	case Op::UDiv:
+	{
+		const uint64_t divisor = load_u(b, src_kind, i);
+
+		store_u(d, kind, i, divisor == 0 ? 0 : load_u(a, kind, i) / divisor);
+
+		break;
+	}
+	case Op::UMod:
+	{
+		const uint64_t divisor = load_u(b, src_kind, i);
+
+		store_u(d, kind, i, divisor == 0 ? 0 : load_u(a, kind, i) % divisor);
+
+		break;
+	}
+	case Op::SDiv:
+	case Op::SRem:
+	case Op::SMod:
+	{
+		const int64_t dividend = load_s(a, kind, i);
+
+		const int64_t divisor = load_s(b, src_kind, i);
+
+		// Division by zero and overflow are undefined in SPIR-V. Produce 0 instead
+		// of trapping.
+		if (divisor == 0 || (divisor == -1 && dividend == INT64_MIN))
+		{
+			store_u(d, kind, i, 0);
+
+			break;
+		}
+
+		int64_t r;
+
+		if (opcode == Op::SDiv)
+		{
+			r = dividend / divisor;
+		}
+		else
+		{
+			r = dividend % divisor;
+
+			if (opcode == Op::SMod && r != 0 && ((r < 0) != (divisor < 0)))
+				r += divisor;
+		}
+
+		store_u(d, kind, i, static_cast<uint64_t>(r));
+
+		break;
+	}
+	case Op::FAdd: store_f(d, kind, i, load_f(a, kind, i) + load_f(b, kind, i)); break;
+	case Op::FSub: store_f(d, kind, i, load_f(a, kind, i) - load_f(b, kind, i)); break;
+	case Op::FMul:
+	{
+		if (kind == scalar_kind::f32)
+			store_f(d, kind, i, static_cast<float>(load_f(a, kind, i)) * static_cast<float>(load_f(b, kind, i)));
+		else
+			store_f(d, kind, i, load_f(a, kind, i) * load_f(b, kind, i));
+
+		break;
+	}
+	case Op::FDiv: store_f(d, kind, i, load_f(a, kind, i) / load_f(b, kind, i)); break;
+	case Op::FRem: store_f(d, kind, i, std::fmod(load_f(a, kind, i), load_f(b, kind, i))); break;
+	case Op::FMod:
+	{
+		const double x = load_f(a, kind, i);
+
+		const double y = load_f(b, kind, i);
+
+		store_f(d, kind, i, x - y * std::floor(x / y));
+
+		break;
+	}
+	case Op::ShiftRightLogical:
+		store_u(d, kind, i, load_u(a, kind, i) >> (load_u(b, src_kind, i) & (kind_bits(kind) - 1)));
+		break;
+
+	case Op::ShiftRightArithmetic:
+		store_u(d, kind, i, static_cast<uint64_t>(load_s(a, kind, i) >> (load_u(b, src_kind, i) & (kind_bits(kind) - 1))));
+		break;
+
+	case Op::ShiftLeftLogical:
+		store_u(d, kind, i, load_u(a, kind, i) << (load_u(b, src_kind, i) & (kind_bits(kind) - 1)));
+		break;
+
+	case Op::BitwiseOr:  store_u(d, kind, i, load_u(a, kind, i) | load_u(b, kind, i)); break;
+	case Op::BitwiseXor: store_u(d, kind, i, load_u(a, kind, i) ^ load_u(b, kind, i)); break;
+	case Op::BitwiseAnd: store_u(d, kind, i, load_u(a, kind, i) & load_u(b, kind, i)); break;
+
+	case Op::LogicalEqual:    d[i] = (a[i] != 0) == (b[i] != 0); break;
+	case Op::LogicalNotEqual: d[i] = (a[i] != 0) != (b[i] != 0); break;
+	case Op::LogicalOr:       d[i] = a[i] != 0 || b[i] != 0; break;
+	case Op::LogicalAnd:      d[i] = a[i] != 0 && b[i] != 0; break;
+
+	case Op::IEqual:            d[i] = load_u(a, kind, i) == load_u(b, src_kind, i); break;
+	case Op::INotEqual:         d[i] = load_u(a, kind, i) != load_u(b, src_kind, i); break;
+	case Op::UGreaterThan:      d[i] = load_u(a, kind, i) >  load_u(b, src_kind, i); break;
+	case Op::UGreaterThanEqual: d[i] = load_u(a, kind, i) >= load_u(b, src_kind, i); break;
+	case Op::ULessThan:         d[i] = load_u(a, kind, i) <  load_u(b, src_kind, i); break;
+	case Op::ULessThanEqual:    d[i] = load_u(a, kind, i) <= load_u(b, src_kind, i); break;
+	case Op::SGreaterThan:      d[i] = load_s(a, kind, i) >  load_s(b, src_kind, i); break;
+	case Op::SGreaterThanEqual: d[i] = load_s(a, kind, i) >= load_s(b, src_kind, i); break;
+	case Op::SLessThan:         d[i] = load_s(a, kind, i) <  load_s(b, src_kind, i); break;
+	case Op::SLessThanEqual:    d[i] = load_s(a, kind, i) <= load_s(b, src_kind, i); break;
+
+	case Op::FOrdEqual:              d[i] = load_f(a, kind, i) == load_f(b, kind, i); break;
+	case Op::FOrdLessThan:           d[i] = load_f(a, kind, i) <  load_f(b, kind, i); break;
+	case Op::FOrdGreaterThan:        d[i] = load_f(a, kind, i) >  load_f(b, kind, i); break;
+	case Op::FOrdLessThanEqual:      d[i] = load_f(a, kind, i) <= load_f(b, kind, i); break;
+	case Op::FOrdGreaterThanEqual:   d[i] = load_f(a, kind, i) >= load_f(b, kind, i); break;
+	case Op::FUnordNotEqual:         d[i] = load_f(a, kind, i) != load_f(b, kind, i); break;
+	case Op::FUnordEqual:            d[i] = !(load_f(a, kind, i) <  load_f(b, kind, i) || load_f(a, kind, i) > load_f(b, kind, i)); break;
+	case Op::FOrdNotEqual:           d[i] = load_f(a, kind, i) <  load_f(b, kind, i) || load_f(a, kind, i) > load_f(b, kind, i); break;
+	case Op::FUnordLessThan:         d[i] = !(load_f(a, kind, i) >= load_f(b, kind, i)); break;
+	case Op::FUnordGreaterThan:      d[i] = !(load_f(a, kind, i) <= load_f(b, kind, i)); break;
+	case Op::FUnordLessThanEqual:    d[i] = !(load_f(a, kind, i) >  load_f(b, kind, i)); break;
+	case Op::FUnordGreaterThanEqual: d[i] = !(load_f(a, kind, i) <  load_f(b, kind, i)); break;
+
+	default: return false;
+	}
+
+	return true;
+}
+
+static uint32_t find_msb(uint64_t v) noexcept
+{
+	uint32_t n = ~0u;
+
+	for (; v != 0; v >>= 1)
+		++n;
+
+	return n;
+}
+
+static double clamp(double x, double lo, double hi) noexcept
+{
+	return x < lo ? lo : x > hi ? hi : x;
+}
+
+template<typename R>
+static spvcpu::result execute_glsl(const insn& i, const uint32_t* operands, invocation_state* state) noexcept
+{
+	const R regs{ state->m_registers };
+
+	const R d = regs + operands[0];
+
+	const uint32_t argc = operand_count(i) - 1;
+
+	const R a = argc > 0 ? regs + operands[1] : R{};
+
+	const R b = argc > 1 ? regs + operands[2] : R{};
+
+	const R c = argc > 2 ? regs + operands[3] : R{};
+
+	const scalar_kind k = i.kind;
+
+	const scalar_kind s = i.src_kind;
+
+	const uint32_t n = i.count;
+
+	switch (static_cast<glsl_op>(i.aux))
+	{
+	case glsl_op::Round:       for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::round(load_f(a, s, j))); break;
+	case glsl_op::RoundEven:   for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::nearbyint(load_f(a, s, j))); break;
+	case glsl_op::Trunc:       for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::trunc(load_f(a, s, j))); break;
+	case glsl_op::FAbs:        for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::fabs(load_f(a, s, j))); break;
+	case glsl_op::SAbs:        for (uint32_t j = 0; j != n; ++j) store_u(d, k, j, static_cast<uint64_t>(load_s(a, s, j) < 0 ? 0 - load_u(a, s, j) : load_u(a, s, j))); break;
+	case glsl_op::Floor:       for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::floor(load_f(a, s, j))); break;
+	case glsl_op::Ceil:        for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::ceil(load_f(a, s, j))); break;
+	case glsl_op::Fract:       for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, load_f(a, s, j) - std::floor(load_f(a, s, j))); break;
+	case glsl_op::Radians:     for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, load_f(a, s, j) * 0.017453292519943295); break;
+	case glsl_op::Degrees:     for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, load_f(a, s, j) * 57.29577951308232); break;
+	case glsl_op::Sin:         for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::sin(load_f(a, s, j))); break;
+	case glsl_op::Cos:         for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::cos(load_f(a, s, j))); break;
+	case glsl_op::Tan:         for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::tan(load_f(a, s, j))); break;
+	case glsl_op::Asin:        for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::asin(load_f(a, s, j))); break;
+	case glsl_op::Acos:        for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::acos(load_f(a, s, j))); break;
+	case glsl_op::Atan:        for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::atan(load_f(a, s, j))); break;
+	case glsl_op::Sinh:        for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::sinh(load_f(a, s, j))); break;
+	case glsl_op::Cosh:        for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::cosh(load_f(a, s, j))); break;
+	case glsl_op::Tanh:        for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::tanh(load_f(a, s, j))); break;
+	case glsl_op::Asinh:       for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::asinh(load_f(a, s, j))); break;
+	case glsl_op::Acosh:       for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::acosh(load_f(a, s, j))); break;
+	case glsl_op::Atanh:       for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::atanh(load_f(a, s, j))); break;
+	case glsl_op::Atan2:       for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::atan2(load_f(a, s, j), load_f(b, s, j))); break;
+	case glsl_op::Pow:         for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::pow(load_f(a, s, j), load_f(b, s, j))); break;
+	case glsl_op::Exp:         for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::exp(load_f(a, s, j))); break;
+	case glsl_op::Log:         for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::log(load_f(a, s, j))); break;
+	case glsl_op::Exp2:        for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::exp2(load_f(a, s, j))); break;
+	case glsl_op::Log2:        for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::log2(load_f(a, s, j))); break;
+	case glsl_op::Sqrt:        for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, std::sqrt(load_f(a, s, j))); break;
+	case glsl_op::InverseSqrt: for (uint32_t j = 0; j != n; ++j) store_f(d, k, j, 1.0 / std::sqrt(load_f(a, s, j))); break;
+	case glsl_op::FSign:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const double x = load_f(a, s, j);
+
+			store_f(d, k, j, x > 0.0 ? 1.0 : x < 0.0 ? -1.0 : x);
+		}
+
+		break;
+	}
+	case glsl_op::SSign:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const int64_t x = load_s(a, s, j);
+
+			store_u(d, k, j, static_cast<uint64_t>(x > 0 ? 1 : x < 0 ? -1 : 0));
+		}
+
+		break;
+	}
+	case glsl_op::FMin:
+	case glsl_op::NMin:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const double x = load_f(a, s, j), y = load_f(b, s, j);
+
+			store_f(d, k, j, std::isnan(x) ? y : std::isnan(y) ? x : y < x ? y : x);
+		}
+
+		break;
+	}
+	case glsl_op::FMax:
+	case glsl_op::NMax:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const double x = load_f(a, s, j), y = load_f(b, s, j);
+
+			store_f(d, k, j, std::isnan(x) ? y : std::isnan(y) ? x : x < y ? y : x);
+		}
+
+		break;
+	}
+	case glsl_op::UMin: for (uint32_t j = 0; j != n; ++j) store_u(d, k, j, load_u(b, s, j) < load_u(a, s, j) ? load_u(b, s, j) : load_u(a, s, j)); break;
+	case glsl_op::UMax: for (uint32_t j = 0; j != n; ++j) store_u(d, k, j, load_u(a, s, j) < load_u(b, s, j) ? load_u(b, s, j) : load_u(a, s, j)); break;
+	case glsl_op::SMin: for (uint32_t j = 0; j != n; ++j) store_u(d, k, j, load_s(b, s, j) < load_s(a, s, j) ? load_u(b, s, j) : load_u(a, s, j)); break;
+	case glsl_op::SMax: for (uint32_t j = 0; j != n; ++j) store_u(d, k, j, load_s(a, s, j) < load_s(b, s, j) ? load_u(b, s, j) : load_u(a, s, j)); break;
+	case glsl_op::FClamp:
+	case glsl_op::NClamp:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const double x = load_f(a, s, j), lo = load_f(b, s, j), hi = load_f(c, s, j);
+
+			const double m = std::isnan(x) ? lo : x < lo ? lo : x;
+
+			store_f(d, k, j, hi < m ? hi : m);
+		}
+
+		break;
+	}
+	case glsl_op::UClamp:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const uint64_t x = load_u(a, s, j), lo = load_u(b, s, j), hi = load_u(c, s, j);
+
+			const uint64_t m = x < lo ? lo : x;
+
+			store_u(d, k, j, hi < m ? hi : m);
+		}
+
+		break;
+	}
+	case glsl_op::SClamp:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const int64_t x = load_s(a, s, j), lo = load_s(b, s, j), hi = load_s(c, s, j);
+
+			const int64_t m = x < lo ? lo : x;
+
+			store_u(d, k, j, static_cast<uint64_t>(hi < m ? hi : m));
+		}
+
+		break;
+	}
+	case glsl_op::FMix:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const double x = load_f(a, s, j), y = load_f(b, s, j), t = load_f(c, s, j);
+
+			store_f(d, k, j, x * (1.0 - t) + y * t);
+		}
+
+		break;
+	}
+	case glsl_op::Step:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+			store_f(d, k, j, load_f(b, s, j) < load_f(a, s, j) ? 0.0 : 1.0);
+
+		break;
+	}
+	case glsl_op::SmoothStep:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const double e0 = load_f(a, s, j), e1 = load_f(b, s, j), x = load_f(c, s, j);
+
+			const double t = clamp((x - e0) / (e1 - e0), 0.0, 1.0);
+
+			store_f(d, k, j, t * t * (3.0 - 2.0 * t));
+		}
+
+		break;
+	}
+	case glsl_op::Fma:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+			store_f(d, k, j, std::fma(load_f(a, s, j), load_f(b, s, j), load_f(c, s, j)));
+
+		break;
+	}
+	case glsl_op::Ldexp:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+			store_f(d, k, j, std::ldexp(load_f(a, s, j), static_cast<int>(load_s(b, scalar_kind::i32, j))));
+
+		break;
+	}
+	case glsl_op::PackSnorm4x8:
+	case glsl_op::PackUnorm4x8:
+	case glsl_op::PackSnorm2x16:
+	case glsl_op::PackUnorm2x16:
+	{
+		const bool is_snorm = static_cast<glsl_op>(i.aux) == glsl_op::PackSnorm4x8 || static_cast<glsl_op>(i.aux) == glsl_op::PackSnorm2x16;
+
+		const uint32_t bits = n == 4 ? 8 : 16;
+
+		const double scale = is_snorm ? (1u << (bits - 1)) - 1 : (1u << bits) - 1;
+
+		uint32_t packed = 0;
+
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const double x = is_snorm ? clamp(load_f(a, s, j), -1.0, 1.0) : clamp(load_f(a, s, j), 0.0, 1.0);
+
+			const int32_t v = static_cast<int32_t>(std::round(x * scale));
+
+			packed |= (static_cast<uint32_t>(v) & ((1u << bits) - 1)) << (j * bits);
+		}
+
+		d[0] = packed;
+
+		break;
+	}
+	case glsl_op::UnpackSnorm2x16:
+	case glsl_op::UnpackUnorm2x16:
+	case glsl_op::UnpackSnorm4x8:
+	case glsl_op::UnpackUnorm4x8:
+	{
+		const glsl_op op = static_cast<glsl_op>(i.aux);
+
+		const bool is_snorm = op == glsl_op::UnpackSnorm2x16 || op == glsl_op::UnpackSnorm4x8;
+
+		const uint32_t bits = op == glsl_op::UnpackSnorm4x8 || op == glsl_op::UnpackUnorm4x8 ? 8 : 16;
+
+		const uint32_t out_count = 32 / bits;
+
+		for (uint32_t j = 0; j != out_count; ++j)
+		{
+			const uint32_t raw = (a[0] >> (j * bits)) & ((1u << bits) - 1);
+
+			if (is_snorm)
+			{
+				const int32_t v = static_cast<int32_t>(raw << (32 - bits)) >> (32 - bits);
+
+				store_f(d, k, j, clamp(v / static_cast<double>((1u << (bits - 1)) - 1), -1.0, 1.0));
+			}
+			else
+			{
+				store_f(d, k, j, raw / static_cast<double>((1u << bits) - 1));
+			}
+		}
+
+		break;
+	}
+	case glsl_op::Length:
+	case glsl_op::Distance:
+	{
+		double sum = 0.0;
+
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const double x = static_cast<glsl_op>(i.aux) == glsl_op::Length ? load_f(a, s, j) : load_f(a, s, j) - load_f(b, s, j);
+
+			sum += x * x;
+		}
+
+		store_f(d, k, 0, std::sqrt(sum));
+
+		break;
+	}
+	case glsl_op::Cross:
+	{
+		const double x0 = load_f(a, s, 0), x1 = load_f(a, s, 1), x2 = load_f(a, s, 2);
+
+		const double y0 = load_f(b, s, 0), y1 = load_f(b, s, 1), y2 = load_f(b, s, 2);
+
+		store_f(d, k, 0, x1 * y2 - y1 * x2);
+
+		store_f(d, k, 1, x2 * y0 - y2 * x0);
+
+		store_f(d, k, 2, x0 * y1 - y0 * x1);
+
+		break;
+	}
+	case glsl_op::Normalize:
+	{
+		double sum = 0.0;
+
+		for (uint32_t j = 0; j != n; ++j)
+			sum += load_f(a, s, j) * load_f(a, s, j);
+
+		const double length = std::sqrt(sum);
+
+		for (uint32_t j = 0; j != n; ++j)
+			store_f(d, k, j, load_f(a, s, j) / length);
+
+		break;
+	}
+	case glsl_op::FaceForward:
+	{
+		double dot = 0.0;
+
+		for (uint32_t j = 0; j != n; ++j)
+			dot += load_f(c, s, j) * load_f(b, s, j);
+
+		for (uint32_t j = 0; j != n; ++j)
+			store_f(d, k, j, dot < 0.0 ? load_f(a, s, j) : -load_f(a, s, j));
+
+		break;
+	}
+	case glsl_op::Reflect:
+	{
+		double dot = 0.0;
+
+		for (uint32_t j = 0; j != n; ++j)
+			dot += load_f(b, s, j) * load_f(a, s, j);
+
+		for (uint32_t j = 0; j != n; ++j)
+			store_f(d, k, j, load_f(a, s, j) - 2.0 * dot * load_f(b, s, j));
+
+		break;
+	}
+	case glsl_op::Refract:
+	{
+		const double eta = load_f(c, s, 0);
+
+		double dot = 0.0;
+
+		for (uint32_t j = 0; j != n; ++j)
+			dot += load_f(b, s, j) * load_f(a, s, j);
+
+		const double kk = 1.0 - eta * eta * (1.0 - dot * dot);
+
+		for (uint32_t j = 0; j != n; ++j)
+			store_f(d, k, j, kk < 0.0 ? 0.0 : eta * load_f(a, s, j) - (eta * dot + std::sqrt(kk)) * load_f(b, s, j));
+
+		break;
+	}
+	case glsl_op::FindILsb:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const uint64_t v = load_u(a, s, j);
+
+			store_u(d, k, j, v == 0 ? ~0ull : find_msb(v & (0 - v)));
+		}
+
+		break;
+	}
+	case glsl_op::FindSMsb:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const int64_t v = load_s(a, s, j);
+
+			store_u(d, k, j, find_msb(static_cast<uint64_t>(v < 0 ? ~v : v)) | (v == -1 || v == 0 ? ~0ull : 0));
+		}
+
+		break;
+	}
+	case glsl_op::FindUMsb:
+	{
+		for (uint32_t j = 0; j != n; ++j)
+		{
+			const uint64_t v = load_u(a, s, j);
+
+			store_u(d, k, j, v == 0 ? ~0ull : find_msb(v));
+		}
+
+		break;
+	}
+	default:
+	{
+		return spvcpu::result::unhandled_ext_inst;
+	}
+	}
+
+	return spvcpu::result::success;
+}
+
+template<typename R>
+static spvcpu::result execute_atomic(const insn& i, const uint32_t* operands, invocation_state* state) noexcept
+{
+	const R regs{ state->m_registers };
+
+	const bool is_store = i.opcode == Op::AtomicStore;
+
+	uint8_t* const ptr = load_pointer(regs + operands[is_store ? 0 : 1]);
+
+	const bool has_value = operand_count(i) > 2 || is_store;
+
+	const R v = has_value ? regs + operands[is_store ? 1 : 2] : R{};
+
+	const scalar_kind k = i.kind;
+
+	if (kind_bits(k) == 64)
+	{
+		std::atomic<uint64_t>* const a = reinterpret_cast<std::atomic<uint64_t>*>(ptr);
+
+		const uint64_t value = has_value ? load_u(v, k, 0) : 0;
+
+		uint64_t prev;
+
+		switch (i.opcode)
+		{
+		case Op::AtomicLoad:       prev = a->load(); break;
+		case Op::AtomicStore:      a->store(value); return spvcpu::result::success;
+		case Op::AtomicExchange:   prev = a->exchange(value); break;
+		case Op::AtomicIIncrement: prev = a->fetch_add(1); break;
+		case Op::AtomicIDecrement: prev = a->fetch_sub(1); break;
+		case Op::AtomicIAdd:       prev = a->fetch_add(value); break;
+		case Op::AtomicISub:       prev = a->fetch_sub(value); break;
+		case Op::AtomicAnd:        prev = a->fetch_and(value); break;
+		case Op::AtomicOr:         prev = a->fetch_or(value); break;
+		case Op::AtomicXor:        prev = a->fetch_xor(value); break;
+		case Op::AtomicCompareExchange:
+		{
+			prev = load_u(regs + operands[3], k, 0);
+
+			a->compare_exchange_strong(prev, value);
+
+			break;
+		}
+		default:
+		{
+			prev = a->load();
+
+			uint64_t desired;
+
+			do
+			{
+				const bool take_value = i.opcode == Op::AtomicUMin ? value < prev :
+				                        i.opcode == Op::AtomicUMax ? value > prev :
+				                        i.opcode == Op::AtomicSMin ? static_cast<int64_t>(value) < static_cast<int64_t>(prev) :
+				                                                     static_cast<int64_t>(value) > static_cast<int64_t>(prev);
+
+				desired = take_value ? value : prev;
+			}
+			while (!a->compare_exchange_weak(prev, desired));
+
+			break;
+		}
+		}
+
+		store_u(regs + operands[0], k, 0, prev);
+	}
+	else
+	{
+		std::atomic<uint32_t>* const a = reinterpret_cast<std::atomic<uint32_t>*>(ptr);
+
+		const uint32_t value = has_value ? v[0] : 0;
+
+		uint32_t prev;
+
+		switch (i.opcode)
+		{
+		case Op::AtomicLoad:       prev = a->load(); break;
+		case Op::AtomicStore:      a->store(value); return spvcpu::result::success;
+		case Op::AtomicExchange:   prev = a->exchange(value); break;
+		case Op::AtomicIIncrement: prev = a->fetch_add(1); break;
+		case Op::AtomicIDecrement: prev = a->fetch_sub(1); break;
+		case Op::AtomicIAdd:       prev = a->fetch_add(value); break;
+		case Op::AtomicISub:       prev = a->fetch_sub(value); break;
+		case Op::AtomicAnd:        prev = a->fetch_and(value); break;
+		case Op::AtomicOr:         prev = a->fetch_or(value); break;
+		case Op::AtomicXor:        prev = a->fetch_xor(value); break;
+		case Op::AtomicCompareExchange:
+		{
+			prev = regs[operands[3]];
+
+			a->compare_exchange_strong(prev, value);
+
+			break;
+		}
+		default:
+		{
+			prev = a->load();
+
+			uint32_t desired;
+
+			do
+			{
+				const bool take_value = i.opcode == Op::AtomicUMin ? value < prev :
+				                        i.opcode == Op::AtomicUMax ? value > prev :
+				                        i.opcode == Op::AtomicSMin ? static_cast<int32_t>(value) < static_cast<int32_t>(prev) :
+				                                                     static_cast<int32_t>(value) > static_cast<int32_t>(prev);
+
+				desired = take_value ? value : prev;
+			}
+			while (!a->compare_exchange_weak(prev, desired));
+
+			break;
+		}
+		}
+
+		regs[operands[0]] = prev;
+	}
+
+	return spvcpu::result::success;
+}
+
+// Subgroup operations are executed with a subgroup size of 1, meaning every
+// invocation is the only active invocation in its subgroup.
+template<typename R>
+static spvcpu::result execute_group(const insn& i, const uint32_t* operands, invocation_state* state) noexcept
+{
+	const R regs{ state->m_registers };
+
+	const R d = regs + operands[0];
+
+	const R a = operand_count(i) > 1 ? regs + operands[1] : R{};
+
+	switch (i.opcode)
+	{
+	case Op::GroupNonUniformElect:
+	case Op::GroupNonUniformAllEqual:
+	{
+		d[0] = 1;
+
+		break;
+	}
+	case Op::GroupNonUniformAll:
+	case Op::GroupNonUniformAny:
+	{
+		d[0] = a[0] != 0;
+
+		break;
+	}
+	case Op::GroupNonUniformBroadcast:
+	case Op::GroupNonUniformBroadcastFirst:
+	case Op::GroupNonUniformShuffle:
+	case Op::GroupNonUniformShuffleXor:
+	case Op::GroupNonUniformShuffleUp:
+	case Op::GroupNonUniformShuffleDown:
+	case Op::GroupNonUniformQuadBroadcast:
+	case Op::GroupNonUniformQuadSwap:
+	{
+		copy_regs(d, a, i.count * kind_words(i.src_kind));
+
+		break;
+	}
+	case Op::GroupNonUniformBallot:
+	{
+		d[0] = a[0] != 0;
+		d[1] = 0;
+		d[2] = 0;
+		d[3] = 0;
+
+		break;
+	}
+	case Op::GroupNonUniformInverseBallot:
+	{
+		d[0] = a[0] & 1;
+
+		break;
+	}
+	case Op::GroupNonUniformBallotBitExtract:
+	{
+		const uint64_t index = load_u(regs + operands[2], scalar_kind::i32, 0);
+
+		d[0] = index < 128 && ((a[index >> 5] >> (index & 31)) & 1) != 0;
+
+		break;
+	}
+	case Op::GroupNonUniformBallotBitCount:
+	{
+		const GroupOperation op = static_cast<GroupOperation>(i.aux);
+
+		d[0] = op == GroupOperation::ExclusiveScan ? 0 : a[0] & 1;
+
+		break;
+	}
+	case Op::GroupNonUniformBallotFindLSB:
+	case Op::GroupNonUniformBallotFindMSB:
+	{
+		uint32_t found = ~0u;
+
+		for (uint32_t w = 0; w != 4; ++w)
+		{
+			for (uint32_t bit = 0; bit != 32; ++bit)
+			{
+				if ((a[w] >> bit) & 1)
+				{
+					found = w * 32 + bit;
+
+					if (i.opcode == Op::GroupNonUniformBallotFindLSB)
+						break;
+				}
+			}
+
+			if (found != ~0u && i.opcode == Op::GroupNonUniformBallotFindLSB)
+				break;
+		}
+
+		d[0] = found;
+
+		break;
+	}
+	default:
+	{
+		// Arithmetic group operations. Reductions and inclusive scans over a single
+		// invocation yield its own value, exclusive scans the identity.
+		if (static_cast<GroupOperation>(i.aux) != GroupOperation::ExclusiveScan)
+		{
+			copy_regs(d, a, i.count * kind_words(i.src_kind));
+
+			break;
+		}
+
+		const scalar_kind k = i.src_kind;
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			switch (i.opcode)
+			{
+			case Op::GroupNonUniformIMul:       store_u(d, k, j, 1); break;
+			case Op::GroupNonUniformFMul:       store_f(d, k, j, 1.0); break;
+			case Op::GroupNonUniformFMin:       store_f(d, k, j, INFINITY); break;
+			case Op::GroupNonUniformFMax:       store_f(d, k, j, -INFINITY); break;
+			case Op::GroupNonUniformUMin:       store_u(d, k, j, ~0ull); break;
+			case Op::GroupNonUniformSMin:       store_u(d, k, j, value_mask(k) & ~sign_mask(k)); break;
+			case Op::GroupNonUniformSMax:       store_u(d, k, j, sign_mask(k)); break;
+			case Op::GroupNonUniformBitwiseAnd: store_u(d, k, j, ~0ull); break;
+			case Op::GroupNonUniformLogicalAnd: store_u(d, k, j, 1); break;
+			default:                            store_u(d, k, j, 0); break;
+			}
+		}
+
+		break;
+	}
+	}
+
+	return spvcpu::result::success;
+}
+
+template<typename R>
+static uint8_t* image_texel(const spvcpu::image_binding* image, const image_format_info& format, R coord, scalar_kind coord_kind, uint32_t coord_cnt) noexcept
+{
+	uint64_t offset = 0;
+
+	for (uint32_t j = 0; j != coord_cnt && j != 3; ++j)
+	{
+		const int64_t c = load_s(coord, coord_kind, j);
+
+		if (c < 0 || c >= image->extent[j])
+			return nullptr;
+
+		const uint64_t pitch = j == 0 ? format.channels * format.channel_bytes : j == 1 ? image->row_pitch : image->slice_pitch;
+
+		offset += static_cast<uint64_t>(c) * pitch;
+	}
+
+	return static_cast<uint8_t*>(image->data) + offset;
+}
+
+template<typename R>
+static spvcpu::result execute_image(const insn& i, const uint32_t* operands, invocation_state* state) noexcept
+{
+	const R regs{ state->m_registers };
+
+	if (i.opcode == Op::ImageQuerySize)
+	{
+		const spvcpu::image_binding* image = reinterpret_cast<const spvcpu::image_binding*>(load_pointer(regs + operands[1]));
+
+		for (uint32_t j = 0; j != i.count; ++j)
+			store_u(regs + operands[0], i.kind, j, image->extent[j]);
+
+		return spvcpu::result::success;
+	}
+
+	if (i.aux >= _countof(image_formats) || image_formats[i.aux].channels == 0)
+		return spvcpu::result::unhandled_image_format;
+
+	const image_format_info& format = image_formats[i.aux];
+
+	const bool is_read = i.opcode == Op::ImageRead;
+
+	const spvcpu::image_binding* image = reinterpret_cast<const spvcpu::image_binding*>(load_pointer(regs + operands[is_read ? 1 : 0]));
+
+	const R coord = regs + operands[is_read ? 2 : 1];
+
+	uint8_t* const texel = image_texel(image, format, coord, i.src_kind, operands[3]);
+
+	const bool is_float = i.kind == scalar_kind::f32 || i.kind == scalar_kind::f64;
+
+	if (is_read)
+	{
+		const R d = regs + operands[0];
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			if (texel == nullptr || j >= format.channels)
+			{
+				if (is_float)
+					store_f(d, i.kind, j, j == 3 && texel != nullptr ? 1.0 : 0.0);
+				else
+					store_u(d, i.kind, j, j == 3 && texel != nullptr ? 1 : 0);
+
+				continue;
+			}
+
+			uint64_t raw = 0;
+
+			memcpy(&raw, texel + j * format.channel_bytes, format.channel_bytes);
+
+			const uint32_t bits = format.channel_bytes * 8;
+
+			switch (format.numeric)
+			{
+			case image_numeric::sfloat:
+			{
+				if (format.channel_bytes == 2)
+				{
+					store_f(d, i.kind, j, half_to_float(static_cast<uint16_t>(raw)));
+				}
+				else
+				{
+					uint32_t bits32 = static_cast<uint32_t>(raw);
+
+					float f;
+
+					memcpy(&f, &bits32, sizeof(f));
+
+					store_f(d, i.kind, j, f);
+				}
+
+				break;
+			}
+			case image_numeric::unorm:
+			{
+				store_f(d, i.kind, j, raw / static_cast<double>((1ull << bits) - 1));
+
+				break;
+			}
+			case image_numeric::snorm:
+			{
+				const int64_t v = static_cast<int64_t>(raw << (64 - bits)) >> (64 - bits);
+
+				store_f(d, i.kind, j, clamp(v / static_cast<double>((1ull << (bits - 1)) - 1), -1.0, 1.0));
+
+				break;
+			}
+			case image_numeric::sint:
+			{
+				store_u(d, i.kind, j, bits == 64 ? raw : static_cast<uint64_t>(static_cast<int64_t>(raw << (64 - bits)) >> (64 - bits)));
+
+				break;
+			}
+			default:
+			{
+				store_u(d, i.kind, j, raw);
+
+				break;
+			}
+			}
+		}
+	}
+	else
+	{
+		if (texel == nullptr)
+			return spvcpu::result::success;
+
+		const R src = regs + operands[2];
+
+		for (uint32_t j = 0; j != format.channels && j != i.count; ++j)
+		{
+			const uint32_t bits = format.channel_bytes * 8;
+
+			uint64_t raw;
+
+			switch (format.numeric)
+			{
+			case image_numeric::sfloat:
+			{
+				if (format.channel_bytes == 2)
+				{
+					raw = float_to_half(static_cast<float>(load_f(src, i.kind, j)));
+				}
+				else
+				{
+					const float f = static_cast<float>(load_f(src, i.kind, j));
+
+					uint32_t bits32;
+
+					memcpy(&bits32, &f, sizeof(bits32));
+
+					raw = bits32;
+				}
+
+				break;
+			}
+			case image_numeric::unorm:
+			{
+				raw = static_cast<uint64_t>(std::round(clamp(load_f(src, i.kind, j), 0.0, 1.0) * static_cast<double>((1ull << bits) - 1)));
+
+				break;
+			}
+			case image_numeric::snorm:
+			{
+				raw = static_cast<uint64_t>(static_cast<int64_t>(std::round(clamp(load_f(src, i.kind, j), -1.0, 1.0) * static_cast<double>((1ull << (bits - 1)) - 1))));
+
+				break;
+			}
+			default:
+			{
+				raw = load_u(src, i.kind, j);
+
+				break;
+			}
+			}
+
+			memcpy(texel + j * format.channel_bytes, &raw, format.channel_bytes);
+		}
+	}
+
+	return spvcpu::result::success;
+}
+
+// Executes instructions without a specialized handler. Branches and calls set
+// *next_pc, which the caller initializes to the word offset of the following
+// instruction.
+template<typename R>
+static spvcpu::result execute_generic(const insn& i, const uint32_t* op, invocation_state* state, uint32_t* next_pc) noexcept
+{
+	const cpu_program* const program = state->m_program;
+
+	const R regs{ state->m_registers };
+
+	switch (i.opcode)
+	{
+	case Op::SNegate:
+	case Op::FNegate:
+	case Op::Not:
+	case Op::LogicalNot:
+	case Op::IsNan:
+	case Op::IsInf:
+	case Op::IsFinite:
+	case Op::ConvertFToU:
+	case Op::ConvertFToS:
+	case Op::ConvertSToF:
+	case Op::ConvertUToF:
+	case Op::UConvert:
+	case Op::SConvert:
+	case Op::FConvert:
+	case Op::BitReverse:
+	case Op::BitCount:
+	{
+		const R a = regs + op[1];
+
+		const R d = regs + op[0];
+
+		for (uint32_t j = 0; j != i.count; ++j)
+			execute_unary(i.opcode, i.kind, i.src_kind, j, a, d);
+
+		break;
+	}
+	case Op::Any:
+	case Op::All:
+	{
+		const R a = regs + op[1];
+
+		bool value = i.opcode == Op::All;
+
+		for (uint32_t j = 0; j != i.count; ++j)
+			value = i.opcode == Op::All ? value && a[j] != 0 : value || a[j] != 0;
+
+		regs[op[0]] = value;
+
+		break;
+	}
+	case Op::IAdd:
+	case Op::ISub:
+	case Op::IMul:
+	case Op::UDiv:
+	case Op::SDiv:
+	case Op::UMod:
+	case Op::SRem:
+	case Op::SMod:
+	case Op::FAdd:
+	case Op::FSub:
+	case Op::FMul:
+	case Op::FDiv:
+	case Op::FRem:
+	case Op::FMod:
+	case Op::ShiftRightLogical:
+	case Op::ShiftRightArithmetic:
+	case Op::ShiftLeftLogical:
+	case Op::BitwiseOr:
+	case Op::BitwiseXor:
+	case Op::BitwiseAnd:
+	case Op::LogicalEqual:
+	case Op::LogicalNotEqual:
+	case Op::LogicalOr:
+	case Op::LogicalAnd:
+	case Op::IEqual:
+	case Op::INotEqual:
+	case Op::UGreaterThan:
+	case Op::SGreaterThan:
+	case Op::UGreaterThanEqual:
+	case Op::SGreaterThanEqual:
+	case Op::ULessThan:
+	case Op::SLessThan:
+	case Op::ULessThanEqual:
+	case Op::SLessThanEqual:
+	case Op::FOrdEqual:
+	case Op::FUnordEqual:
+	case Op::FOrdNotEqual:
+	case Op::FUnordNotEqual:
+	case Op::FOrdLessThan:
+	case Op::FUnordLessThan:
+	case Op::FOrdGreaterThan:
+	case Op::FUnordGreaterThan:
+	case Op::FOrdLessThanEqual:
+	case Op::FUnordLessThanEqual:
+	case Op::FOrdGreaterThanEqual:
+	case Op::FUnordGreaterThanEqual:
+	{
+		const R a = regs + op[1];
+
+		const R b = regs + op[2];
+
+		const R d = regs + op[0];
+
+		for (uint32_t j = 0; j != i.count; ++j)
+			execute_binary(i.opcode, i.kind, i.src_kind, j, a, b, d);
+
+		break;
+	}
+	case Op::Select:
+	{
+		const R cond = regs + op[1];
+
+		const R a = regs + op[2];
+
+		const R b = regs + op[3];
+
+		const R d = regs + op[0];
+
+		const uint32_t words = op[4];
+
+		for (uint32_t j = 0; j != i.count; ++j)
+			copy_regs(d + j * words, (cond[j] != 0 ? a : b) + j * words, words);
+
+		break;
+	}
+	case Op::Bitcast:
+	{
+		// Narrow integer components occupy a full register word each, so pack
+		// the source into its memory representation before reinterpreting it.
+		uint8_t bytes[32];
+
+		const uint32_t src_bytes = kind_bits(i.src_kind) / 8;
+
+		const uint32_t dst_bytes = kind_bits(i.kind) / 8;
+
+		const R a = regs + op[1];
+
+		const R d = regs + op[0];
+
+		for (uint32_t j = 0; j != i.aux; ++j)
+		{
+			const uint64_t v = load_u(a, i.src_kind, j);
+
+			memcpy(bytes + j * src_bytes, &v, src_bytes);
+		}
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			uint64_t v = 0;
+
+			memcpy(&v, bytes + j * dst_bytes, dst_bytes);
+
+			store_u(d, i.kind, j, v);
+		}
+
+		break;
+	}
+	case Op::CopyObject:
+	{
+		copy_regs(regs + op[0], regs + op[1], op[2]);
+
+		break;
+	}
+	case Op::VectorTimesScalar:
+	case Op::MatrixTimesScalar:
+	{
+		const R v = regs + op[1];
+
+		const double s = load_f(regs + op[2], i.kind, 0);
+
+		const R d = regs + op[0];
+
+		for (uint32_t j = 0; j != i.count; ++j)
+			store_f(d, i.kind, j, load_f(v, i.kind, j) * s);
+
+		break;
+	}
+	case Op::Dot:
+	{
+		const R a = regs + op[1];
+
+		const R b = regs + op[2];
+
+		double sum = 0.0;
+
+		for (uint32_t j = 0; j != i.count; ++j)
+			sum += load_f(a, i.kind, j) * load_f(b, i.kind, j);
+
+		store_f(regs + op[0], i.kind, 0, sum);
+
+		break;
+	}
+	case Op::VectorTimesMatrix:
+	{
+		// result[c] = sum over r of v[r] * m[c][r]; count is the number of columns, aux the number of rows.
+		const R v = regs + op[1];
+
+		const R m = regs + op[2];
+
+		const R d = regs + op[0];
+
+		for (uint32_t c = 0; c != i.count; ++c)
+		{
+			double sum = 0.0;
+
+			for (uint32_t r = 0; r != i.aux; ++r)
+				sum += load_f(v, i.kind, r) * load_f(m, i.kind, c * i.aux + r);
+
+			store_f(d, i.kind, c, sum);
+		}
+
+		break;
+	}
+	case Op::MatrixTimesVector:
+	{
+		// result[r] = sum over c of m[c][r] * v[c]; count is the number of rows, aux the number of columns.
+		const R m = regs + op[1];
+
+		const R v = regs + op[2];
+
+		const R d = regs + op[0];
+
+		for (uint32_t r = 0; r != i.count; ++r)
+		{
+			double sum = 0.0;
+
+			for (uint32_t c = 0; c != i.aux; ++c)
+				sum += load_f(m, i.kind, c * i.count + r) * load_f(v, i.kind, c);
+
+			store_f(d, i.kind, r, sum);
+		}
+
+		break;
+	}
+	case Op::MatrixTimesMatrix:
+	{
+		const R a = regs + op[1];
+
+		const R b = regs + op[2];
+
+		const R d = regs + op[0];
+
+		const uint32_t rows = i.count;
+
+		const uint32_t inner = i.aux;
+
+		for (uint32_t c = 0; c != op[3]; ++c)
+		{
+			for (uint32_t r = 0; r != rows; ++r)
+			{
+				double sum = 0.0;
+
+				for (uint32_t k = 0; k != inner; ++k)
+					sum += load_f(a, i.kind, k * rows + r) * load_f(b, i.kind, c * inner + k);
+
+				store_f(d, i.kind, c * rows + r, sum);
+			}
+		}
+
+		break;
+	}
+	case Op::OuterProduct:
+	{
+		const R a = regs + op[1];
+
+		const R b = regs + op[2];
+
+		const R d = regs + op[0];
+
+		for (uint32_t c = 0; c != i.aux; ++c)
+			for (uint32_t r = 0; r != i.count; ++r)
+				store_f(d, i.kind, c * i.count + r, load_f(a, i.kind, r) * load_f(b, i.kind, c));
+
+		break;
+	}
+	case Op::Transpose:
+	{
+		// count and aux are the number of rows and columns of the source.
+		const R m = regs + op[1];
+
+		const R d = regs + op[0];
+
+		const uint32_t words = kind_words(i.kind);
+
+		for (uint32_t c = 0; c != i.aux; ++c)
+			for (uint32_t r = 0; r != i.count; ++r)
+				copy_regs(d + (r * i.aux + c) * words, m + (c * i.count + r) * words, words);
+
+		break;
+	}
+	case Op::CompositeExtract:
+	{
+		copy_regs(regs + op[0], regs + op[1] + op[2], op[3]);
+
+		break;
+	}
+	case Op::CompositeInsert:
+	{
+		const R d = regs + op[0];
+
+		copy_regs(d, regs + op[2], op[5]);
+
+		copy_regs(d + op[3], regs + op[1], op[4]);
+
+		break;
+	}
+	case Op::CompositeConstruct:
+	{
+		R d = regs + op[0];
+
+		for (uint32_t j = 1; j + 1 < operand_count(i); j += 2)
+		{
+			copy_regs(d, regs + op[j], op[j + 1]);
+
+			d += op[j + 1];
+		}
+
+		break;
+	}
+	case Op::VectorShuffle:
+	{
+		const R a = regs + op[1];
+
+		const R b = regs + op[2];
+
+		const R d = regs + op[0];
+
+		const uint32_t words = kind_words(i.kind);
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			const uint32_t index = op[4 + j];
+
+			if (index == ~0u)
+				clear_regs(d + j * words, words);
+			else if (index < op[3])
+				copy_regs(d + j * words, a + index * words, words);
+			else
+				copy_regs(d + j * words, b + (index - op[3]) * words, words);
+		}
+
+		break;
+	}
+	case Op::VectorExtractDynamic:
+	{
+		const uint64_t index = load_u(regs + op[2], i.src_kind, 0);
+
+		const uint32_t words = kind_words(i.kind);
+
+		const R d = regs + op[0];
+
+		if (index < i.count)
+			copy_regs(d, regs + op[1] + static_cast<uint32_t>(index) * words, words);
+		else
+			clear_regs(d, words);
+
+		break;
+	}
+	case Op::VectorInsertDynamic:
+	{
+		const uint64_t index = load_u(regs + op[3], i.src_kind, 0);
+
+		const uint32_t words = kind_words(i.kind);
+
+		const R d = regs + op[0];
+
+		copy_regs(d, regs + op[1], i.count * words);
+
+		if (index < i.count)
+			copy_regs(d + static_cast<uint32_t>(index) * words, regs + op[2], words);
+
+		break;
+	}
+	case Op::Load:
+	{
+		load_from_memory(program, op[2], load_pointer(regs + op[1]), regs + op[0]);
+
+		break;
+	}
+	case Op::Store:
+	{
+		store_to_memory(program, op[2], regs + op[1], load_pointer(regs + op[0]));
+
+		break;
+	}
+	case Op::AccessChain:
+	{
+		uint8_t* ptr = load_pointer(regs + op[1]);
+
+		for (uint32_t j = 3; j + 3 < operand_count(i); j += 4)
+			ptr += op[j] + load_s(regs + op[j + 1], static_cast<scalar_kind>(op[j + 3]), 0) * static_cast<int64_t>(op[j + 2]);
+
+		store_pointer(regs + op[0], ptr + op[2]);
+
+		break;
+	}
+	case Op::CopyMemory:
+	{
+		load_from_memory(program, op[3], load_pointer(regs + op[1]), state->m_scratch);
+
+		store_to_memory(program, op[2], state->m_scratch, load_pointer(regs + op[0]));
+
+		break;
+	}
+	case Op::ArrayLength:
+	{
+		const uint64_t bytes = state->m_variable_bytes[op[1]];
+
+		regs[op[0]] = bytes < op[2] || op[3] == 0 ? 0 : static_cast<uint32_t>((bytes - op[2]) / op[3]);
+
+		break;
+	}
+	case Op::Branch:
+	{
+		state->m_prev_block = op[0];
+
+		*next_pc = op[1];
+
+		break;
+	}
+	case Op::BranchConditional:
+	{
+		state->m_prev_block = op[0];
+
+		*next_pc = regs[op[1]] != 0 ? op[2] : op[3];
+
+		break;
+	}
+	case Op::Switch:
+	{
+		state->m_prev_block = op[0];
+
+		const uint64_t selector = load_u(regs + op[1], i.src_kind, 0);
+
+		*next_pc = op[2];
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			const uint32_t* const target = op + 3 + j * 3;
+
+			if (((target[0] | (static_cast<uint64_t>(target[1]) << 32)) & value_mask(i.src_kind)) == selector)
+			{
+				*next_pc = target[2];
+
+				break;
+			}
+		}
+
+		break;
+	}
+	case Op::Phi:
+	{
+		// All phis of a block are evaluated together so that they observe the
+		// values from before the block was entered.
+		uint32_t* scratch = state->m_scratch;
+
+		const uint32_t* curr = op;
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			const uint32_t words = curr[1];
+
+			const uint32_t pair_cnt = curr[2];
+
+			for (uint32_t p = 0; p != pair_cnt; ++p)
+			{
+				if (curr[4 + p * 2] == state->m_prev_block)
+				{
+					copy_from_regs(scratch, regs + curr[3 + p * 2], words);
+
+					break;
+				}
+			}
+
+			scratch += words;
+
+			curr += 3 + pair_cnt * 2;
+		}
+
+		scratch = state->m_scratch;
+
+		curr = op;
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			copy_to_regs(regs + curr[0], scratch, curr[1]);
+
+			scratch += curr[1];
+
+			curr += 3 + curr[2] * 2;
+		}
+
+		break;
+	}
+	case Op::Return:
+	case Op::ReturnValue:
+	{
+		if (state->m_frame_cnt == 0)
+		{
+			state->m_status = spvcpu::execution_status::finished;
+
+			break;
+		}
+
+		const call_frame& frame = state->m_frames[--state->m_frame_cnt];
+
+		if (i.opcode == Op::ReturnValue)
+			copy_regs(regs + frame.result_slot, regs + op[0], op[1]);
+
+		*next_pc = frame.return_pc;
+
+		break;
+	}
+	case Op::Kill:
+	{
+		state->m_status = spvcpu::execution_status::finished;
+
+		break;
+	}
+	case Op::FunctionCall:
+	{
+		// Recursion is not allowed in shaders, so parameters and locals of the
+		// callee can live in statically allocated registers.
+		for (uint32_t j = 0; j != i.count; ++j)
+			copy_regs(regs + op[3 + j * 3 + 1], regs + op[3 + j * 3], op[3 + j * 3 + 2]);
+
+		state->m_frames[state->m_frame_cnt++] = { *next_pc, op[0] };
+
+		*next_pc = op[1];
+
+		break;
+	}
+	case Op::ExtInst:
+	{
+		if (spvcpu::result rst = execute_glsl<R>(i, op, state); rst != spvcpu::result::success)
+			return rst;
+
+		break;
+	}
+	case Op::AtomicLoad:
+	case Op::AtomicStore:
+	case Op::AtomicExchange:
+	case Op::AtomicCompareExchange:
+	case Op::AtomicIIncrement:
+	case Op::AtomicIDecrement:
+	case Op::AtomicIAdd:
+	case Op::AtomicISub:
+	case Op::AtomicSMin:
+	case Op::AtomicUMin:
+	case Op::AtomicSMax:
+	case Op::AtomicUMax:
+	case Op::AtomicAnd:
+	case Op::AtomicOr:
+	case Op::AtomicXor:
+	{
+		if (spvcpu::result rst = execute_atomic<R>(i, op, state); rst != spvcpu::result::success)
+			return rst;
+
+		break;
+	}
+	case Op::ControlBarrier:
+	case Op::MemoryBarrier:
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (i.opcode == Op::ControlBarrier && i.aux != 0 && state->m_suspend_at_barrier)
+			state->m_status = spvcpu::execution_status::barrier;
+
+		break;
+	}
+	case Op::ImageRead:
+	case Op::ImageWrite:
+	case Op::ImageQuerySize:
+	{
+		if (spvcpu::result rst = execute_image<R>(i, op, state); rst != spvcpu::result::success)
+			return rst;
+
+		break;
+	}
+	default:
+	{
+		if (i.opcode >= Op::GroupNonUniformElect && i.opcode <= Op::GroupNonUniformQuadSwap)
+		{
+			if (spvcpu::result rst = execute_group<R>(i, op, state); rst != spvcpu::result::success)
+				return rst;
+
+			break;
+		}
+
+		return spvcpu::result::unhandled_opcode;
+	}
+	}
+
+	return spvcpu::result::success;
+}
+
+static float as_f32(uint32_t bits) noexcept
+{
+	float f;
+
+	memcpy(&f, &bits, sizeof(f));
+
+	return f;
+}
+
+static uint32_t from_f32(float f) noexcept
+{
+	uint32_t bits;
+
+	memcpy(&bits, &f, sizeof(bits));
+
+	return bits;
+}
+
+static int32_t as_s32(uint32_t bits) noexcept
+{
+	return static_cast<int32_t>(bits);
+}
+
+// With SPVCPU_THREADED_DISPATCH, each handler ends in its own indirect jump to
+// the next instruction's handler, whose address (relative to handler_generic) is
+// stored in insn::dispatch by thread_program. This gives every handler its own
+// branch history, instead of funneling all of them through a single switch.
+#if defined(SPVCPU_THREADED_DISPATCH) && !defined(__GNUC__)
+#error SPVCPU_THREADED_DISPATCH requires support for computed goto
+#endif
+
+#if defined(SPVCPU_THREADED_DISPATCH)
+	#define HANDLER(name) handler_##name:
+
+	#define DISPATCH() goto *(static_cast<const char*>(&&handler_generic) + i->dispatch)
+
+	#define NEXT_INSN() do { pc = next_pc; if (single_step) goto done; FETCH(); DISPATCH(); } while (false)
+#else
+	#define HANDLER(name) case handler_kind::name:
+
+	#define NEXT_INSN() break
+#endif
+
+#define FETCH() do { i = reinterpret_cast<const insn*>(code + pc); op = code + pc + insn_words; next_pc = pc + i->length; } while (false)
+
+#define UNARY_32(expr) { const uint32_t* const a = regs + op[1]; uint32_t* const d = regs + op[0]; for (uint32_t j = 0; j != i->count; ++j) { const uint32_t x = a[j]; d[j] = (expr); } NEXT_INSN(); }
+
+#define BINARY_32(expr) { const uint32_t* const a = regs + op[1]; const uint32_t* const b = regs + op[2]; uint32_t* const d = regs + op[0]; for (uint32_t j = 0; j != i->count; ++j) { const uint32_t x = a[j], y = b[j]; d[j] = (expr); } NEXT_INSN(); }
+
+// Runs the interpreter loop. If out_dispatch is not null, nothing is executed
+// and the dispatch offset of each handler_kind is written to it instead.
+static spvcpu::result run(invocation_state* state, bool single_step, int32_t* out_dispatch) noexcept
+{
+#if defined(SPVCPU_THREADED_DISPATCH)
+	if (out_dispatch != nullptr)
+	{
+		const void* const labels[]{
+			&&handler_generic, &&handler_copy_words, &&handler_select, &&handler_load_trivial,
+			&&handler_store_trivial, &&handler_access_chain, &&handler_branch, &&handler_branch_conditional,
+			&&handler_phi, &&handler_logical_not, &&handler_logical_and, &&handler_logical_or,
+			&&handler_fnegate_f32, &&handler_convert_s32_to_f32, &&handler_convert_u32_to_f32, &&handler_convert_f32_to_s32,
+			&&handler_convert_f32_to_u32, &&handler_iadd_32, &&handler_isub_32, &&handler_imul_32,
+			&&handler_and_32, &&handler_or_32, &&handler_xor_32, &&handler_shl_32,
+			&&handler_shr_32, &&handler_sar_32, &&handler_ieq_32, &&handler_ine_32,
+			&&handler_ult_32, &&handler_ule_32, &&handler_ugt_32, &&handler_uge_32,
+			&&handler_slt_32, &&handler_sle_32, &&handler_sgt_32, &&handler_sge_32,
+			&&handler_fadd_f32, &&handler_fsub_f32, &&handler_fmul_f32, &&handler_fdiv_f32,
+			&&handler_foeq_f32, &&handler_folt_f32, &&handler_fole_f32, &&handler_fogt_f32,
+			&&handler_foge_f32, &&handler_vector_times_scalar_f32,
+		};
+
+		static_assert(sizeof(labels) / sizeof(*labels) == static_cast<uint32_t>(handler_kind::vector_times_scalar_f32) + 1);
+
+		for (uint32_t j = 0; j != sizeof(labels) / sizeof(*labels); ++j)
+			out_dispatch[j] = static_cast<int32_t>(static_cast<const char*>(labels[j]) - static_cast<const char*>(labels[0]));
+
+		return spvcpu::result::success;
+	}
+#else
+	(void) out_dispatch;
+#endif
+
+	const uint32_t* const code = state->m_program->m_code.data();
+
+	uint32_t* const regs = state->m_registers;
+
+	uint32_t pc = state->m_pc;
+
+	const insn* i;
+
+	const uint32_t* op;
+
+	uint32_t next_pc;
+
+	if (state->m_status != spvcpu::execution_status::running)
+		return spvcpu::result::success;
+
+#if defined(SPVCPU_THREADED_DISPATCH)
+	FETCH();
+
+	DISPATCH();
+#else
+	for (;;)
+	{
+		FETCH();
+
+		switch (i->handler)
+		{
+#endif
+
+		HANDLER(generic)
+		HANDLER(phi)
+		{
+			if (spvcpu::result rst = execute_generic<uint32_t*>(*i, op, state, &next_pc); rst != spvcpu::result::success)
+			{
+				state->m_pc = pc;
+
+				return rst;
+			}
+
+			if (state->m_status != spvcpu::execution_status::running)
+			{
+				pc = next_pc;
+
+				goto done;
+			}
+
+			NEXT_INSN();
+		}
+		HANDLER(copy_words)
+		{
+			memcpy(regs + op[0], regs + op[1], op[2] * 4);
+
+			NEXT_INSN();
+		}
+		HANDLER(select)
+		{
+			const uint32_t* const cond = regs + op[1];
+
+			const uint32_t words = op[4];
+
+			for (uint32_t j = 0; j != i->count; ++j)
+				memcpy(regs + op[0] + j * words, regs + (cond[j] != 0 ? op[2] : op[3]) + j * words, words * 4);
+
+			NEXT_INSN();
+		}
+		HANDLER(load_trivial)
+		{
+			memcpy(regs + op[0], load_pointer(regs + op[1]), op[2] * 4);
+
+			NEXT_INSN();
+		}
+		HANDLER(store_trivial)
+		{
+			memcpy(load_pointer(regs + op[0]), regs + op[1], op[2] * 4);
+
+			NEXT_INSN();
+		}
+		HANDLER(access_chain)
+		{
+			uint8_t* ptr = load_pointer(regs + op[1]);
+
+			for (uint32_t j = 3; j + 3 < operand_count(*i); j += 4)
+				ptr += op[j] + load_s(regs + op[j + 1], static_cast<scalar_kind>(op[j + 3]), 0) * static_cast<int64_t>(op[j + 2]);
+
+			store_pointer(regs + op[0], ptr + op[2]);
+
+			NEXT_INSN();
+		}
+		HANDLER(branch)
+		{
+			state->m_prev_block = op[0];
+
+			next_pc = op[1];
+
+			NEXT_INSN();
+		}
+		HANDLER(branch_conditional)
+		{
+			state->m_prev_block = op[0];
+
+			next_pc = regs[op[1]] != 0 ? op[2] : op[3];
+
+			NEXT_INSN();
+		}
+		HANDLER(logical_not)        UNARY_32(x == 0)
+		HANDLER(logical_and)        BINARY_32(x != 0 && y != 0)
+		HANDLER(logical_or)         BINARY_32(x != 0 || y != 0)
+		HANDLER(fnegate_f32)        UNARY_32(x ^ 0x80000000u)
+		HANDLER(convert_s32_to_f32) UNARY_32(from_f32(static_cast<float>(as_s32(x))))
+		HANDLER(convert_u32_to_f32) UNARY_32(from_f32(static_cast<float>(x)))
+		HANDLER(convert_f32_to_s32)
+		{
+			const uint32_t* const a = regs + op[1];
+
+			uint32_t* const d = regs + op[0];
+
+			for (uint32_t j = 0; j != i->count; ++j)
+			{
+				const float f = as_f32(a[j]);
+
+				d[j] = static_cast<uint32_t>(f != f ? 0 : f <= -2147483648.0f ? INT32_MIN : f >= 2147483647.0f ? INT32_MAX : static_cast<int32_t>(f));
+			}
+
+			NEXT_INSN();
+		}
+		HANDLER(convert_f32_to_u32)
+		{
+			const uint32_t* const a = regs + op[1];
+
+			uint32_t* const d = regs + op[0];
+
+			for (uint32_t j = 0; j != i->count; ++j)
+			{
+				const float f = as_f32(a[j]);
+
+				d[j] = f != f || f <= 0.0f ? 0 : f >= 4294967295.0f ? UINT32_MAX : static_cast<uint32_t>(f);
+			}
+
+			NEXT_INSN();
+		}
+		HANDLER(iadd_32)  BINARY_32(x + y)
+		HANDLER(isub_32)  BINARY_32(x - y)
+		HANDLER(imul_32)  BINARY_32(x * y)
+		HANDLER(and_32)   BINARY_32(x & y)
+		HANDLER(or_32)    BINARY_32(x | y)
+		HANDLER(xor_32)   BINARY_32(x ^ y)
+		HANDLER(shl_32)   BINARY_32(x << (y & 31))
+		HANDLER(shr_32)   BINARY_32(x >> (y & 31))
+		HANDLER(sar_32)   BINARY_32(static_cast<uint32_t>(as_s32(x) >> (y & 31)))
+		HANDLER(ieq_32)   BINARY_32(x == y)
+		HANDLER(ine_32)   BINARY_32(x != y)
+		HANDLER(ult_32)   BINARY_32(x < y)
+		HANDLER(ule_32)   BINARY_32(x <= y)
+		HANDLER(ugt_32)   BINARY_32(x > y)
+		HANDLER(uge_32)   BINARY_32(x >= y)
+		HANDLER(slt_32)   BINARY_32(as_s32(x) < as_s32(y))
+		HANDLER(sle_32)   BINARY_32(as_s32(x) <= as_s32(y))
+		HANDLER(sgt_32)   BINARY_32(as_s32(x) > as_s32(y))
+		HANDLER(sge_32)   BINARY_32(as_s32(x) >= as_s32(y))
+		HANDLER(fadd_f32) BINARY_32(from_f32(as_f32(x) + as_f32(y)))
+		HANDLER(fsub_f32) BINARY_32(from_f32(as_f32(x) - as_f32(y)))
+		HANDLER(fmul_f32) BINARY_32(from_f32(as_f32(x) * as_f32(y)))
+		HANDLER(fdiv_f32) BINARY_32(from_f32(as_f32(x) / as_f32(y)))
+		HANDLER(foeq_f32) BINARY_32(as_f32(x) == as_f32(y))
+		HANDLER(folt_f32) BINARY_32(as_f32(x) < as_f32(y))
+		HANDLER(fole_f32) BINARY_32(as_f32(x) <= as_f32(y))
+		HANDLER(fogt_f32) BINARY_32(as_f32(x) > as_f32(y))
+		HANDLER(foge_f32) BINARY_32(as_f32(x) >= as_f32(y))
+		HANDLER(vector_times_scalar_f32)
+		{
+			const uint32_t* const v = regs + op[1];
+
+			const float s = as_f32(regs[op[2]]);
+
+			uint32_t* const d = regs + op[0];
+
+			for (uint32_t j = 0; j != i->count; ++j)
+				d[j] = from_f32(as_f32(v[j]) * s);
+
+			NEXT_INSN();
+		}
+
+#if !defined(SPVCPU_THREADED_DISPATCH)
+		}
+
+		pc = next_pc;
+
+		if (single_step)
+			break;
+	}
+#endif
+
+done:
+
+	state->m_pc = pc;
+
+	return spvcpu::result::success;
+}
+
+#undef HANDLER
+
+#undef DISPATCH
+
+#undef NEXT_INSN
+
+#undef FETCH
+
+#undef UNARY_32
+
+#undef BINARY_32
+
+spvcpu::result execute(invocation_state* state, bool single_step) noexcept
+{
+#if defined(SPVCPU_JIT)
+	if (!single_step)
+		return execute_native(state);
+#endif
+
+	return run(state, single_step, nullptr);
+}
+
+void thread_program(cpu_program* program) noexcept
+{
+#if defined(SPVCPU_THREADED_DISPATCH)
+	int32_t dispatch[static_cast<uint32_t>(handler_kind::vector_times_scalar_f32) + 1];
+
+	run(nullptr, false, dispatch);
+
+	uint32_t* const code = program->m_code.data();
+
+	for (uint32_t pc = 0; pc != program->m_code.size(); pc += reinterpret_cast<const insn*>(code + pc)->length)
+	{
+		insn* const i = reinterpret_cast<insn*>(code + pc);
+
+		i->dispatch = dispatch[static_cast<uint32_t>(i->handler)];
+	}
+#else
+	(void) program;
+#endif
+}
+
+// Lane-batched execution. Each lane is an invocation with its own pc, call frames
+// and private memory, while registers are interleaved across lanes in a shared
+// register file, so that component j of a value occupies Lanes consecutive
+// words, one per lane. Every step executes the instruction at the lowest pc of
+// any running lane for all lanes currently at that pc. SPIR-V orders blocks so
+// that a construct's merge block follows the construct, which means lanes that
+// diverged at a branch reconverge once the trailing lanes reach the merge block.
+
+// Writes the lanes of src selected by mask to dst.
+template<uint32_t Lanes>
+static void blend_lanes(uint32_t* dst, const uint32_t* src, uint32_t mask) noexcept
+{
+#if defined(__AVX512F__)
+	if constexpr (Lanes % 16 == 0)
+	{
+		for (uint32_t l = 0; l != Lanes; l += 16)
+			_mm512_mask_storeu_epi32(dst + l, static_cast<__mmask16>(mask >> l), _mm512_loadu_si512(src + l));
+
+		return;
+	}
+#endif
+#if defined(__AVX2__)
+	if constexpr (Lanes % 8 == 0)
+	{
+		const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+		for (uint32_t l = 0; l != Lanes; l += 8)
+		{
+			const __m256i lane_mask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(mask >> l)), lane_bits), lane_bits);
+
+			_mm256_maskstore_epi32(reinterpret_cast<int*>(dst + l), lane_mask, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + l)));
+		}
+
+		return;
+	}
+#endif
+	for (uint32_t l = 0; l != Lanes; ++l)
+		if ((mask >> l) & 1)
+			dst[l] = src[l];
+}
+
+// Computes one component of a 32-bit binary handler for all lanes at once.
+// Returns false if the handler has no vector implementation for the target.
+template<uint32_t Lanes>
+static bool simd_binary_32(handler_kind handler, const uint32_t* a, const uint32_t* b, uint32_t* r) noexcept
+{
+#if defined(__AVX512F__)
+	if constexpr (Lanes % 16 == 0)
+	{
+		for (uint32_t l = 0; l != Lanes; l += 16)
+		{
+			const __m512 fa = _mm512_loadu_ps(a + l), fb = _mm512_loadu_ps(b + l);
+
+			const __m512i ia = _mm512_loadu_si512(a + l), ib = _mm512_loadu_si512(b + l);
+
+			switch (handler)
+			{
+			case handler_kind::fadd_f32: _mm512_storeu_ps(r + l, _mm512_add_ps(fa, fb)); break;
+			case handler_kind::fsub_f32: _mm512_storeu_ps(r + l, _mm512_sub_ps(fa, fb)); break;
+			case handler_kind::fmul_f32: _mm512_storeu_ps(r + l, _mm512_mul_ps(fa, fb)); break;
+			case handler_kind::fdiv_f32: _mm512_storeu_ps(r + l, _mm512_div_ps(fa, fb)); break;
+			case handler_kind::iadd_32:  _mm512_storeu_si512(r + l, _mm512_add_epi32(ia, ib)); break;
+			case handler_kind::isub_32:  _mm512_storeu_si512(r + l, _mm512_sub_epi32(ia, ib)); break;
+			case handler_kind::imul_32:  _mm512_storeu_si512(r + l, _mm512_mullo_epi32(ia, ib)); break;
+			case handler_kind::and_32:   _mm512_storeu_si512(r + l, _mm512_and_si512(ia, ib)); break;
+			case handler_kind::or_32:    _mm512_storeu_si512(r + l, _mm512_or_si512(ia, ib)); break;
+			case handler_kind::xor_32:   _mm512_storeu_si512(r + l, _mm512_xor_si512(ia, ib)); break;
+			default:                     return false;
+			}
+		}
+
+		return true;
+	}
+#endif
+#if defined(__AVX2__)
+	if constexpr (Lanes % 8 == 0)
+	{
+		for (uint32_t l = 0; l != Lanes; l += 8)
+		{
+			const __m256 fa = _mm256_loadu_ps(reinterpret_cast<const float*>(a + l)), fb = _mm256_loadu_ps(reinterpret_cast<const float*>(b + l));
+
+			const __m256i ia = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + l)), ib = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + l));
+
+			float* const fr = reinterpret_cast<float*>(r + l);
+
+			__m256i* const ir = reinterpret_cast<__m256i*>(r + l);
+
+			switch (handler)
+			{
+			case handler_kind::fadd_f32: _mm256_storeu_ps(fr, _mm256_add_ps(fa, fb)); break;
+			case handler_kind::fsub_f32: _mm256_storeu_ps(fr, _mm256_sub_ps(fa, fb)); break;
+			case handler_kind::fmul_f32: _mm256_storeu_ps(fr, _mm256_mul_ps(fa, fb)); break;
+			case handler_kind::fdiv_f32: _mm256_storeu_ps(fr, _mm256_div_ps(fa, fb)); break;
+			case handler_kind::iadd_32:  _mm256_storeu_si256(ir, _mm256_add_epi32(ia, ib)); break;
+			case handler_kind::isub_32:  _mm256_storeu_si256(ir, _mm256_sub_epi32(ia, ib)); break;
+			case handler_kind::imul_32:  _mm256_storeu_si256(ir, _mm256_mullo_epi32(ia, ib)); break;
+			case handler_kind::and_32:   _mm256_storeu_si256(ir, _mm256_and_si256(ia, ib)); break;
+			case handler_kind::or_32:    _mm256_storeu_si256(ir, _mm256_or_si256(ia, ib)); break;
+			case handler_kind::xor_32:   _mm256_storeu_si256(ir, _mm256_xor_si256(ia, ib)); break;
+			default:                     return false;
+			}
+		}
+
+		return true;
+	}
+#endif
+	(void) handler;
+	(void) a;
+	(void) b;
+	(void) r;
+
+	return false;
+}
+
+#define LANES_UNARY_32(expr) { const uint32_t* const a = regs + op[1] * Lanes; uint32_t* const d = regs + op[0] * Lanes; for (uint32_t j = 0; j != i.count * Lanes; j += Lanes) { uint32_t r[Lanes]; for (uint32_t l = 0; l != Lanes; ++l) { const uint32_t x = a[j + l]; r[l] = (expr); } blend_lanes<Lanes>(d + j, r, mask); } break; }
+
+#define LANES_BINARY_32(expr) { const uint32_t* const a = regs + op[1] * Lanes; const uint32_t* const b = regs + op[2] * Lanes; uint32_t* const d = regs + op[0] * Lanes; for (uint32_t j = 0; j != i.count * Lanes; j += Lanes) { uint32_t r[Lanes]; if (!simd_binary_32<Lanes>(i.handler, a + j, b + j, r)) for (uint32_t l = 0; l != Lanes; ++l) { const uint32_t x = a[j + l], y = b[j + l]; r[l] = (expr); } blend_lanes<Lanes>(d + j, r, mask); } break; }
+
+template<uint32_t Lanes>
+static spvcpu::result execute_lanes(invocation_state* const* lanes) noexcept
+{
+	const uint32_t* const code = lanes[0]->m_program->m_code.data();
+
+	uint32_t* const regs = lanes[0]->m_registers;
+
+	uint32_t running = 0;
+
+	for (uint32_t l = 0; l != Lanes; ++l)
+		if (lanes[l]->m_status == spvcpu::execution_status::running)
+			running |= 1u << l;
+
+	while (running != 0)
+	{
+		uint32_t pc = ~0u;
+
+		uint32_t mask = 0;
+
+		for (uint32_t l = 0; l != Lanes; ++l)
+		{
+			if (((running >> l) & 1) == 0)
+				continue;
+
+			if (lanes[l]->m_pc < pc)
+			{
+				pc = lanes[l]->m_pc;
+
+				mask = 0;
+			}
+
+			if (lanes[l]->m_pc == pc)
+				mask |= 1u << l;
+		}
+
+		const insn& i = *reinterpret_cast<const insn*>(code + pc);
+
+		const uint32_t* const op = code + pc + insn_words;
+
+		const uint32_t next_pc = pc + i.length;
+
+		switch (i.handler)
+		{
+		case handler_kind::copy_words:
+		{
+			for (uint32_t w = 0; w != op[2]; ++w)
+				blend_lanes<Lanes>(regs + (op[0] + w) * Lanes, regs + (op[1] + w) * Lanes, mask);
+
+			break;
+		}
+		case handler_kind::select:
+		{
+			const uint32_t words = op[4];
+
+			for (uint32_t j = 0; j != i.count; ++j)
+			{
+				const uint32_t* const cond = regs + (op[1] + j) * Lanes;
+
+				for (uint32_t w = 0; w != words; ++w)
+				{
+					uint32_t r[Lanes];
+
+					for (uint32_t l = 0; l != Lanes; ++l)
+						r[l] = regs[((cond[l] != 0 ? op[2] : op[3]) + j * words + w) * Lanes + l];
+
+					blend_lanes<Lanes>(regs + (op[0] + j * words + w) * Lanes, r, mask);
+				}
+			}
+
+			break;
+		}
+		case handler_kind::load_trivial:
+		case handler_kind::store_trivial:
+		case handler_kind::access_chain:
+		{
+			// Memory accesses go to a different address in every lane.
+			for (uint32_t l = 0; l != Lanes; ++l)
+			{
+				if (((mask >> l) & 1) == 0)
+					continue;
+
+				const lane_ptr<Lanes> lane{ regs + l };
+
+				if (i.handler == handler_kind::load_trivial)
+				{
+					copy_to_regs(lane + op[0], load_pointer(lane + op[1]), op[2]);
+				}
+				else if (i.handler == handler_kind::store_trivial)
+				{
+					copy_from_regs(load_pointer(lane + op[0]), lane + op[1], op[2]);
+				}
+				else
+				{
+					uint8_t* ptr = load_pointer(lane + op[1]);
+
+					for (uint32_t j = 3; j + 3 < operand_count(i); j += 4)
+						ptr += op[j] + load_s(lane + op[j + 1], static_cast<scalar_kind>(op[j + 3]), 0) * static_cast<int64_t>(op[j + 2]);
+
+					store_pointer(lane + op[0], ptr + op[2]);
+				}
+			}
+
+			break;
+		}
+		case handler_kind::branch:
+		case handler_kind::branch_conditional:
+		{
+			for (uint32_t l = 0; l != Lanes; ++l)
+			{
+				if (((mask >> l) & 1) == 0)
+					continue;
+
+				lanes[l]->m_prev_block = op[0];
+
+				if (i.handler == handler_kind::branch)
+					lanes[l]->m_pc = op[1];
+				else
+					lanes[l]->m_pc = regs[op[1] * Lanes + l] != 0 ? op[2] : op[3];
+			}
+
+			continue;
+		}
+		case handler_kind::logical_not:        LANES_UNARY_32(x == 0)
+		case handler_kind::logical_and:        LANES_BINARY_32(x != 0 && y != 0)
+		case handler_kind::logical_or:         LANES_BINARY_32(x != 0 || y != 0)
+		case handler_kind::fnegate_f32:        LANES_UNARY_32(x ^ 0x80000000u)
+		case handler_kind::convert_s32_to_f32: LANES_UNARY_32(from_f32(static_cast<float>(as_s32(x))))
+		case handler_kind::convert_u32_to_f32: LANES_UNARY_32(from_f32(static_cast<float>(x)))
+		case handler_kind::convert_f32_to_s32: LANES_UNARY_32(static_cast<uint32_t>(as_f32(x) != as_f32(x) ? 0 : as_f32(x) <= -2147483648.0f ? INT32_MIN : as_f32(x) >= 2147483647.0f ? INT32_MAX : static_cast<int32_t>(as_f32(x))))
+		case handler_kind::convert_f32_to_u32: LANES_UNARY_32(as_f32(x) != as_f32(x) || as_f32(x) <= 0.0f ? 0 : as_f32(x) >= 4294967295.0f ? UINT32_MAX : static_cast<uint32_t>(as_f32(x)))
+		case handler_kind::iadd_32:  LANES_BINARY_32(x + y)
+		case handler_kind::isub_32:  LANES_BINARY_32(x - y)
+		case handler_kind::imul_32:  LANES_BINARY_32(x * y)
+		case handler_kind::and_32:   LANES_BINARY_32(x & y)
+		case handler_kind::or_32:    LANES_BINARY_32(x | y)
+		case handler_kind::xor_32:   LANES_BINARY_32(x ^ y)
+		case handler_kind::shl_32:   LANES_BINARY_32(x << (y & 31))
+		case handler_kind::shr_32:   LANES_BINARY_32(x >> (y & 31))
+		case handler_kind::sar_32:   LANES_BINARY_32(static_cast<uint32_t>(as_s32(x) >> (y & 31)))
+		case handler_kind::ieq_32:   LANES_BINARY_32(x == y)
+		case handler_kind::ine_32:   LANES_BINARY_32(x != y)
+		case handler_kind::ult_32:   LANES_BINARY_32(x < y)
+		case handler_kind::ule_32:   LANES_BINARY_32(x <= y)
+		case handler_kind::ugt_32:   LANES_BINARY_32(x > y)
+		case handler_kind::uge_32:   LANES_BINARY_32(x >= y)
+		case handler_kind::slt_32:   LANES_BINARY_32(as_s32(x) < as_s32(y))
+		case handler_kind::sle_32:   LANES_BINARY_32(as_s32(x) <= as_s32(y))
+		case handler_kind::sgt_32:   LANES_BINARY_32(as_s32(x) > as_s32(y))
+		case handler_kind::sge_32:   LANES_BINARY_32(as_s32(x) >= as_s32(y))
+		case handler_kind::fadd_f32: LANES_BINARY_32(from_f32(as_f32(x) + as_f32(y)))
+		case handler_kind::fsub_f32: LANES_BINARY_32(from_f32(as_f32(x) - as_f32(y)))
+		case handler_kind::fmul_f32: LANES_BINARY_32(from_f32(as_f32(x) * as_f32(y)))
+		case handler_kind::fdiv_f32: LANES_BINARY_32(from_f32(as_f32(x) / as_f32(y)))
+		case handler_kind::foeq_f32: LANES_BINARY_32(as_f32(x) == as_f32(y))
+		case handler_kind::folt_f32: LANES_BINARY_32(as_f32(x) < as_f32(y))
+		case handler_kind::fole_f32: LANES_BINARY_32(as_f32(x) <= as_f32(y))
+		case handler_kind::fogt_f32: LANES_BINARY_32(as_f32(x) > as_f32(y))
+		case handler_kind::foge_f32: LANES_BINARY_32(as_f32(x) >= as_f32(y))
+		case handler_kind::vector_times_scalar_f32:
+		{
+			const uint32_t* const s = regs + op[2] * Lanes;
+
+			for (uint32_t j = 0; j != i.count; ++j)
+			{
+				const uint32_t* const v = regs + (op[1] + j) * Lanes;
+
+				uint32_t r[Lanes];
+
+				for (uint32_t l = 0; l != Lanes; ++l)
+					r[l] = from_f32(as_f32(v[l]) * as_f32(s[l]));
+
+				blend_lanes<Lanes>(regs + (op[0] + j) * Lanes, r, mask);
+			}
+
+			break;
+		}
+		default:
+		{
+			for (uint32_t l = 0; l != Lanes; ++l)
+			{
+				if (((mask >> l) & 1) == 0)
+					continue;
+
+				invocation_state* const lane = lanes[l];
+
+				uint32_t lane_next_pc = next_pc;
+
+				if (spvcpu::result rst = execute_generic<lane_ptr<Lanes>>(i, op, lane, &lane_next_pc); rst != spvcpu::result::success)
+					return rst;
+
+				lane->m_pc = lane_next_pc;
+
+				if (lane->m_status != spvcpu::execution_status::running)
+					running &= ~(1u << l);
+			}
+
+			continue;
+		}
+		}
+
+		for (uint32_t l = 0; l != Lanes; ++l)
+			if ((mask >> l) & 1)
+				lanes[l]->m_pc = next_pc;
+	}
+
+	return spvcpu::result::success;
+}
+
+#undef LANES_UNARY_32
+
+#undef LANES_BINARY_32
+
+spvcpu::result execute_lanes(invocation_state* const* lanes, uint32_t lane_count) noexcept
+{
+	switch (lane_count)
+	{
+	case 8:  return execute_lanes<8>(lanes);
+	case 16: return execute_lanes<16>(lanes);
+	default: return spvcpu::result::unsupported_lane_count;
+	}
+}
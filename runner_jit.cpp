@@ -0,0 +1,2044 @@
+#include "runner_program.hpp"
+
+#if defined(SPVCPU_JIT)
+
+#if !defined(__linux__) || !defined(__x86_64__)
+#error SPVCPU_JIT is only supported on x86-64 Linux
+#endif
+
+#include <cpuid.h>
+#include <cstddef>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "x64_encoder.hpp"
+
+// Native code translates each instruction on its own. Values live in the
+// register file, addressed relative to reg_registers, unless allocate_registers
+// assigned them a machine register. The following registers are callee-saved
+// in the System V ABI and hold the same values for the whole run.
+static constexpr gpr reg_registers = gpr::rbx;
+
+static constexpr gpr reg_state = gpr::r12;
+
+static constexpr gpr reg_result = gpr::r13;
+
+// Registers handed out by allocate_registers, caller-saved ones first so that
+// the entry stub has to save as few registers as possible. rax, rcx, rdx and
+// xmm0 to xmm2 are temporaries within the translation of a single instruction.
+static constexpr gpr allocatable_gprs[]{ gpr::rsi, gpr::rdi, gpr::r8, gpr::r9, gpr::r10, gpr::r11, gpr::rbp, gpr::r14, gpr::r15 };
+
+static constexpr xmm allocatable_xmms[]{ xmm::xmm3, xmm::xmm4, xmm::xmm5, xmm::xmm6, xmm::xmm7, xmm::xmm8, xmm::xmm9, xmm::xmm10, xmm::xmm11, xmm::xmm12, xmm::xmm13, xmm::xmm14, xmm::xmm15 };
+
+static constexpr gpr callee_saved_gprs[]{ gpr::rbp, gpr::r14, gpr::r15 };
+
+// Location of a register word in native code. Locations below location_xmm
+// are general purpose registers, those from location_xmm on xmm registers.
+static constexpr uint8_t location_xmm = 16;
+
+static constexpr uint8_t location_memory = 0xFF;
+
+// Signature of the entry stub at the start of native_code::m_code, which sets
+// up the registers above and jumps to start.
+using native_entry = void (*)(invocation_state* state, uint32_t* registers, const uint8_t* start, spvcpu::result* out_result);
+
+// Instructions copying more words than this are left to the interpreter
+// instead of being unrolled.
+static constexpr uint32_t max_unrolled_words = 32;
+
+// Instruction set extensions used for vector and matrix instructions, chosen
+// once from CPUID. Without AVX, everything is encoded as SSE.
+struct native_target
+{
+	bool use_vex;
+
+	// Widest vector register in bytes, 16, 32 (AVX) or 64 (AVX-512F).
+	uint32_t vector_bytes;
+};
+
+static uint64_t read_xcr0() noexcept
+{
+	uint32_t lo;
+
+	uint32_t hi;
+
+	__asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+
+	return lo | static_cast<uint64_t>(hi) << 32;
+}
+
+static native_target detect_native_target() noexcept
+{
+	uint32_t a, b, c, d;
+
+	if (__get_cpuid(1, &a, &b, &c, &d) == 0)
+		return { false, 16 };
+
+	// AVX additionally requires the OS to save ymm state, as indicated by
+	// OSXSAVE and the SSE and AVX bits of XCR0.
+	if ((c & bit_AVX) == 0 || (c & bit_OSXSAVE) == 0 || (read_xcr0() & 0x06) != 0x06)
+		return { false, 16 };
+
+	if (__get_cpuid_count(7, 0, &a, &b, &c, &d) == 0)
+		return { true, 32 };
+
+	// AVX-512 needs the opmask and both halves of the zmm state saved as well.
+	if ((b & bit_AVX512F) == 0 || (read_xcr0() & 0xE6) != 0xE6)
+		return { true, 32 };
+
+	return { true, 64 };
+}
+
+static const native_target& get_native_target() noexcept
+{
+	static const native_target target = detect_native_target();
+
+	return target;
+}
+
+struct native_fixup
+{
+	// Offset of the rel32 displacement in the generated code.
+	uint32_t code_offset;
+
+	// Instruction the displacement refers to.
+	uint32_t target_pc;
+};
+
+// Range of instructions over which a single-word value is kept in a machine
+// register. The value is defined by the instruction at start and last read by
+// the one at end.
+struct live_interval
+{
+	uint32_t slot;
+
+	uint32_t start;
+
+	uint32_t end;
+
+	uint8_t location;
+
+	bool is_float;
+};
+
+struct register_allocation
+{
+	// Location of every register word.
+	simple_vec<uint8_t> m_locations;
+
+	// Intervals that were assigned a register, ordered by start.
+	simple_vec<live_interval> m_intervals;
+
+	// General purpose registers holding values, by register number. Those that
+	// are callee-saved have to be saved by the entry stub.
+	bool m_uses_gpr[16];
+};
+
+// Everything needed while translating the instruction stream.
+struct native_builder
+{
+	x64_encoder enc;
+
+	native_target target;
+
+	simple_vec<native_fixup> fixups;
+
+	// native_code::m_relocations of the code being built.
+	simple_vec<uint32_t>* relocations;
+
+	bool ok;
+
+	register_allocation alloc;
+};
+
+static mem_operand reg_word(uint32_t slot) noexcept
+{
+	return { reg_registers, static_cast<int32_t>(slot * 4) };
+}
+
+static mem_operand state_field(size_t offset) noexcept
+{
+	return { reg_state, static_cast<int32_t>(offset) };
+}
+
+static uint8_t location_of(const native_builder* b, uint32_t slot) noexcept
+{
+	return b->alloc.m_locations[slot];
+}
+
+static gpr location_gpr(uint8_t location) noexcept
+{
+	return static_cast<gpr>(location);
+}
+
+static xmm location_xmm_reg(uint8_t location) noexcept
+{
+	return static_cast<xmm>(location - location_xmm);
+}
+
+// Steps the interpreter until the invocation stops running or reaches an
+// instruction at which native code can be entered with all values in the
+// register file.
+static spvcpu::result step_to_native_entry(invocation_state* state) noexcept
+{
+	const native_code& native = state->m_program->m_native;
+
+	while (state->m_status == spvcpu::execution_status::running && native.m_offsets[state->m_pc] == ~0u)
+	{
+		if (spvcpu::result rst = execute(state, true); rst != spvcpu::result::success)
+			return rst;
+	}
+
+	return spvcpu::result::success;
+}
+
+// Called by native code for instructions without a native translation. Executes
+// the instruction at pc through the interpreter and returns the address at
+// which native execution resumes, which is the exit stub once the invocation has
+// stopped running.
+static const uint8_t* native_fallback(invocation_state* state, uint32_t pc, spvcpu::result* out_result) noexcept
+{
+	const native_code& native = state->m_program->m_native;
+
+	state->m_pc = pc;
+
+	spvcpu::result rst = execute(state, true);
+
+	if (rst == spvcpu::result::success)
+		rst = step_to_native_entry(state);
+
+	if (rst != spvcpu::result::success)
+	{
+		*out_result = rst;
+
+		return native.m_code + native.m_exit_offset;
+	}
+
+	if (state->m_status != spvcpu::execution_status::running)
+		return native.m_code + native.m_exit_offset;
+
+	return native.m_code + native.m_offsets[state->m_pc];
+}
+
+static void emit_fallback(native_builder* b, uint32_t pc) noexcept
+{
+	x64_encoder* const enc = &b->enc;
+
+	enc->mov_r64_r64(gpr::rdi, reg_state);
+
+	enc->mov_r32_imm32(gpr::rsi, pc);
+
+	enc->mov_r64_r64(gpr::rdx, reg_result);
+
+	// The address of native_fallback is filled in by link_native.
+	enc->mov_r64_imm64(gpr::rax, 0);
+
+	if (!b->relocations->append(enc->size() - 8))
+		b->ok = false;
+
+	// The interpreter may use legacy SSE encodings, which are slow while the
+	// upper halves of ymm / zmm registers are dirty.
+	if (enc->m_use_vex)
+		enc->vzeroupper();
+
+	enc->call_r64(gpr::rax);
+
+	enc->jmp_r64(gpr::rax);
+}
+
+// Copies words from src to dst, using rcx as temporary.
+static void emit_copy(x64_encoder* enc, mem_operand dst, mem_operand src, uint32_t words) noexcept
+{
+	uint32_t w = 0;
+
+	for (; w + 2 <= words; w += 2)
+	{
+		enc->mov_r64_m(gpr::rcx, { src.base, src.disp + static_cast<int32_t>(w * 4) });
+
+		enc->mov_m_r64({ dst.base, dst.disp + static_cast<int32_t>(w * 4) }, gpr::rcx);
+	}
+
+	if (w != words)
+	{
+		enc->mov_r32_m(gpr::rcx, { src.base, src.disp + static_cast<int32_t>(w * 4) });
+
+		enc->mov_m_r32({ dst.base, dst.disp + static_cast<int32_t>(w * 4) }, gpr::rcx);
+	}
+}
+
+// Writes the register holding slot back to the register file.
+static void emit_spill(native_builder* b, uint32_t slot) noexcept
+{
+	const uint8_t location = location_of(b, slot);
+
+	if (location < location_xmm)
+		b->enc.mov_m_r32(reg_word(slot), location_gpr(location));
+	else
+		b->enc.movss_m_x(reg_word(slot), location_xmm_reg(location));
+}
+
+static void emit_reload(native_builder* b, uint32_t slot) noexcept
+{
+	const uint8_t location = location_of(b, slot);
+
+	if (location < location_xmm)
+		b->enc.mov_r32_m(location_gpr(location), reg_word(slot));
+	else
+		b->enc.movss_x_m(location_xmm_reg(location), reg_word(slot));
+}
+
+// The following helpers access single register words wherever they are
+// located. Values in registers of the other class are moved over through rdx
+// or xmm2.
+static void load_word(native_builder* b, gpr dst, uint32_t slot) noexcept
+{
+	const uint8_t location = location_of(b, slot);
+
+	if (location == location_memory)
+		b->enc.mov_r32_m(dst, reg_word(slot));
+	else if (location >= location_xmm)
+		b->enc.movd_r32_x(dst, location_xmm_reg(location));
+	else if (location_gpr(location) != dst)
+		b->enc.mov_r32_r32(dst, location_gpr(location));
+}
+
+static void store_word(native_builder* b, uint32_t slot, gpr src) noexcept
+{
+	const uint8_t location = location_of(b, slot);
+
+	if (location == location_memory)
+		b->enc.mov_m_r32(reg_word(slot), src);
+	else if (location >= location_xmm)
+		b->enc.movd_x_r32(location_xmm_reg(location), src);
+	else if (location_gpr(location) != src)
+		b->enc.mov_r32_r32(location_gpr(location), src);
+}
+
+static void load_float(native_builder* b, xmm dst, uint32_t slot) noexcept
+{
+	const uint8_t location = location_of(b, slot);
+
+	if (location == location_memory)
+		b->enc.movss_x_m(dst, reg_word(slot));
+	else if (location < location_xmm)
+		b->enc.movd_x_r32(dst, location_gpr(location));
+	else if (location_xmm_reg(location) != dst)
+		b->enc.movaps_x_x(dst, location_xmm_reg(location));
+}
+
+static void store_float(native_builder* b, uint32_t slot, xmm src) noexcept
+{
+	const uint8_t location = location_of(b, slot);
+
+	if (location == location_memory)
+		b->enc.movss_m_x(reg_word(slot), src);
+	else if (location < location_xmm)
+		b->enc.movd_r32_x(location_gpr(location), src);
+	else if (location_xmm_reg(location) != src)
+		b->enc.movaps_x_x(location_xmm_reg(location), src);
+}
+
+// Returns a gpr holding slot, which is either its allocated register or rdx.
+static gpr word_gpr(native_builder* b, uint32_t slot) noexcept
+{
+	const uint8_t location = location_of(b, slot);
+
+	if (location < location_xmm)
+		return location_gpr(location);
+
+	load_word(b, gpr::rdx, slot);
+
+	return gpr::rdx;
+}
+
+// Returns an xmm register holding slot, which is either its allocated register
+// or xmm2.
+static xmm word_xmm(native_builder* b, uint32_t slot) noexcept
+{
+	const uint8_t location = location_of(b, slot);
+
+	if (location != location_memory && location >= location_xmm)
+		return location_xmm_reg(location);
+
+	load_float(b, xmm::xmm2, slot);
+
+	return xmm::xmm2;
+}
+
+// Returns the memory operand of slot for instructions that can only read it
+// from the register file, writing back its register first.
+static mem_operand word_memory(native_builder* b, uint32_t slot) noexcept
+{
+	if (location_of(b, slot) != location_memory)
+		emit_spill(b, slot);
+
+	return reg_word(slot);
+}
+
+static void alu_word(native_builder* b, alu_op op, gpr dst, uint32_t slot) noexcept
+{
+	if (location_of(b, slot) == location_memory)
+		b->enc.alu_r32_m(op, dst, reg_word(slot));
+	else
+		b->enc.alu_r32_r32(op, dst, word_gpr(b, slot));
+}
+
+static void imul_word(native_builder* b, gpr dst, uint32_t slot) noexcept
+{
+	if (location_of(b, slot) == location_memory)
+		b->enc.imul_r32_m(dst, reg_word(slot));
+	else
+		b->enc.imul_r32_r32(dst, word_gpr(b, slot));
+}
+
+static void cmov_word(native_builder* b, cond cc, gpr dst, uint32_t slot) noexcept
+{
+	if (location_of(b, slot) == location_memory)
+		b->enc.cmovcc_r32_m(cc, dst, reg_word(slot));
+	else
+		b->enc.cmovcc_r32_r32(cc, dst, word_gpr(b, slot));
+}
+
+// Sets ZF if slot is zero.
+static void test_word(native_builder* b, uint32_t slot) noexcept
+{
+	if (location_of(b, slot) == location_memory)
+	{
+		b->enc.cmp_m32_imm8(reg_word(slot), 0);
+	}
+	else
+	{
+		const gpr r = word_gpr(b, slot);
+
+		b->enc.test_r32_r32(r, r);
+	}
+}
+
+static void float_op_word(native_builder* b, simd_op op, xmm dst, uint32_t slot) noexcept
+{
+	if (location_of(b, slot) == location_memory)
+		b->enc.ss_x_m(op, dst, reg_word(slot));
+	else
+		b->enc.ss_x_x(op, dst, word_xmm(b, slot));
+}
+
+static void ucomiss_word(native_builder* b, xmm dst, uint32_t slot) noexcept
+{
+	if (location_of(b, slot) == location_memory)
+		b->enc.ucomiss_x_m(dst, reg_word(slot));
+	else
+		b->enc.ucomiss_x_x(dst, word_xmm(b, slot));
+}
+
+// Copies words from src to dst. Values spanning multiple words are never held
+// in registers, so only single words need to consider their location.
+static void copy_words(native_builder* b, uint32_t dst, uint32_t src, uint32_t words) noexcept
+{
+	if (words != 1)
+	{
+		emit_copy(&b->enc, reg_word(dst), reg_word(src), words);
+
+		return;
+	}
+
+	const uint8_t dst_location = location_of(b, dst);
+
+	const uint8_t src_location = location_of(b, src);
+
+	if (dst_location != location_memory && dst_location >= location_xmm)
+	{
+		load_float(b, location_xmm_reg(dst_location), src);
+	}
+	else if (src_location != location_memory && src_location >= location_xmm)
+	{
+		store_float(b, dst, location_xmm_reg(src_location));
+	}
+	else if (dst_location != location_memory)
+	{
+		load_word(b, location_gpr(dst_location), src);
+	}
+	else
+	{
+		load_word(b, gpr::rcx, src);
+
+		store_word(b, dst, gpr::rcx);
+	}
+}
+
+static void copy_from_memory(native_builder* b, uint32_t dst, mem_operand src, uint32_t words) noexcept
+{
+	const uint8_t location = words == 1 ? location_of(b, dst) : location_memory;
+
+	if (location == location_memory)
+		emit_copy(&b->enc, reg_word(dst), src, words);
+	else if (location < location_xmm)
+		b->enc.mov_r32_m(location_gpr(location), src);
+	else
+		b->enc.movss_x_m(location_xmm_reg(location), src);
+}
+
+static void copy_to_memory(native_builder* b, mem_operand dst, uint32_t src, uint32_t words) noexcept
+{
+	const uint8_t location = words == 1 ? location_of(b, src) : location_memory;
+
+	if (location == location_memory)
+		emit_copy(&b->enc, dst, reg_word(src), words);
+	else if (location < location_xmm)
+		b->enc.mov_m_r32(dst, location_gpr(location));
+	else
+		b->enc.movss_m_x(dst, location_xmm_reg(location));
+}
+
+// Returns the widest vector in bytes that fits into the remaining floats, or 0
+// if less than four remain.
+static uint32_t vector_width(uint32_t vector_bytes, uint32_t remaining_floats) noexcept
+{
+	uint32_t width = vector_bytes;
+
+	while (width != 0 && remaining_floats * 4 < width)
+		width = width == 16 ? 0 : width / 2;
+
+	return width;
+}
+
+// Applies op to the count floats at a and b, storing the results to dst.
+// Operands are loaded into registers first, since legacy SSE encodings require
+// aligned memory operands, while register words are only 4-byte aligned.
+static void emit_packed_f32(native_builder* b, simd_op op, uint32_t dst, uint32_t a, uint32_t b_slot, bool is_scalar_b, uint32_t count) noexcept
+{
+	x64_encoder* const enc = &b->enc;
+
+	const uint32_t vector_bytes = b->target.vector_bytes;
+
+	uint32_t j = 0;
+
+	if (is_scalar_b && vector_width(vector_bytes, count) != 0)
+		enc->vbroadcastss_x_m(vector_bytes, xmm::xmm1, word_memory(b, b_slot));
+
+	while (const uint32_t width = vector_width(vector_bytes, count - j))
+	{
+		enc->vmovups_x_m(width, xmm::xmm0, reg_word(a + j));
+
+		if (!is_scalar_b)
+			enc->vmovups_x_m(width, xmm::xmm1, reg_word(b_slot + j));
+
+		enc->vps_x_x_x(op, width, xmm::xmm0, xmm::xmm0, xmm::xmm1);
+
+		enc->vmovups_m_x(width, reg_word(dst + j), xmm::xmm0);
+
+		j += width / 4;
+	}
+
+	for (; j != count; ++j)
+	{
+		load_float(b, xmm::xmm0, a + j);
+
+		float_op_word(b, op, xmm::xmm0, is_scalar_b ? b_slot : b_slot + j);
+
+		store_float(b, dst + j, xmm::xmm0);
+	}
+}
+
+// Computes rows results as sum over c of m[c * stride + r] * v[c], with m and v
+// being float words, and stores them as floats to dst. Products are
+// accumulated in double and in the same order as by the interpreter, so that
+// results are identical. Rows are processed in packed chunks of as many doubles
+// as fit into a vector, with the remaining row done in scalar code. All
+// operands span multiple words and are thus in memory.
+static void emit_matrix_times_vector_f32(x64_encoder* enc, uint32_t vector_bytes, uint32_t dst, uint32_t m, uint32_t v, uint32_t rows, uint32_t columns, uint32_t stride) noexcept
+{
+	uint32_t r = 0;
+
+	while (rows - r >= 2)
+	{
+		uint32_t width = vector_bytes;
+
+		while ((rows - r) * 8 < width)
+			width /= 2;
+
+		enc->xorps_x_x(xmm::xmm0, xmm::xmm0);
+
+		for (uint32_t c = 0; c != columns; ++c)
+		{
+			enc->vcvtps2pd_x_m(width, xmm::xmm1, reg_word(m + c * stride + r));
+
+			enc->vbroadcastss_x_m(width == 64 ? 32 : 16, xmm::xmm2, reg_word(v + c));
+
+			enc->vcvtps2pd_x_x(width, xmm::xmm2, xmm::xmm2);
+
+			enc->vpd_x_x_x(simd_op::mul, width, xmm::xmm1, xmm::xmm1, xmm::xmm2);
+
+			enc->vpd_x_x_x(simd_op::add, width, xmm::xmm0, xmm::xmm0, xmm::xmm1);
+		}
+
+		enc->vcvtpd2ps_x_x(width, xmm::xmm0, xmm::xmm0);
+
+		if (width == 16)
+			enc->movsd_m_x(reg_word(dst + r), xmm::xmm0);
+		else
+			enc->vmovups_m_x(width / 2, reg_word(dst + r), xmm::xmm0);
+
+		r += width / 8;
+	}
+
+	if (r != rows)
+	{
+		enc->xorps_x_x(xmm::xmm0, xmm::xmm0);
+
+		for (uint32_t c = 0; c != columns; ++c)
+		{
+			enc->cvtss2sd_x_m(xmm::xmm1, reg_word(m + c * stride + r));
+
+			enc->cvtss2sd_x_m(xmm::xmm2, reg_word(v + c));
+
+			enc->sd_x_x(simd_op::mul, xmm::xmm1, xmm::xmm2);
+
+			enc->sd_x_x(simd_op::add, xmm::xmm0, xmm::xmm1);
+		}
+
+		enc->cvtsd2ss_x_x(xmm::xmm0, xmm::xmm0);
+
+		enc->movss_m_x(reg_word(dst + r), xmm::xmm0);
+	}
+}
+
+// Stores sum over j of a[j * a_stride] * b[j] for count values of j as float to
+// dst, accumulating sequentially in double like the interpreter. a and b are
+// vectors and thus in memory.
+static void emit_dot_f32(native_builder* b, uint32_t dst, uint32_t a, uint32_t a_stride, uint32_t b_slot, uint32_t count) noexcept
+{
+	x64_encoder* const enc = &b->enc;
+
+	enc->xorps_x_x(xmm::xmm0, xmm::xmm0);
+
+	for (uint32_t j = 0; j != count; ++j)
+	{
+		enc->cvtss2sd_x_m(xmm::xmm1, reg_word(a + j * a_stride));
+
+		enc->cvtss2sd_x_m(xmm::xmm2, reg_word(b_slot + j));
+
+		enc->sd_x_x(simd_op::mul, xmm::xmm1, xmm::xmm2);
+
+		enc->sd_x_x(simd_op::add, xmm::xmm0, xmm::xmm1);
+	}
+
+	enc->cvtsd2ss_x_x(xmm::xmm0, xmm::xmm0);
+
+	store_float(b, dst, xmm::xmm0);
+}
+
+// Stores the zero-extended condition flag cc of the last comparison to dst.
+static void emit_store_flag(native_builder* b, cond cc, uint32_t dst) noexcept
+{
+	b->enc.setcc_r8(cc, gpr::rax);
+
+	b->enc.movzx_r32_r8(gpr::rax, gpr::rax);
+
+	store_word(b, dst, gpr::rax);
+}
+
+static void emit_jump(native_builder* b, uint32_t target_pc) noexcept
+{
+	if (!b->fixups.append({ b->enc.jmp_rel32(), target_pc }))
+		b->ok = false;
+}
+
+static uint32_t phi_words(const insn& i, const uint32_t* op) noexcept
+{
+	uint32_t words = 0;
+
+	for (uint32_t j = 0; j != i.count; ++j)
+	{
+		words += op[1] * (op[2] + 1);
+
+		op += 3 + op[2] * 2;
+	}
+
+	return words;
+}
+
+static bool is_native_generic(const insn& i) noexcept
+{
+	if (i.kind != scalar_kind::f32)
+		return false;
+
+	return i.opcode == Op::MatrixTimesScalar || i.opcode == Op::Dot || i.opcode == Op::VectorTimesMatrix || i.opcode == Op::MatrixTimesVector || i.opcode == Op::MatrixTimesMatrix;
+}
+
+// Returns whether emit_native translates the instruction instead of leaving it
+// to the interpreter.
+static bool has_native_translation(const insn& i, const uint32_t* op) noexcept
+{
+	switch (i.handler)
+	{
+	case handler_kind::generic:
+		return is_native_generic(i);
+
+	case handler_kind::copy_words:
+	case handler_kind::load_trivial:
+	case handler_kind::store_trivial:
+		return op[2] <= max_unrolled_words;
+
+	case handler_kind::select:
+		return i.count * op[4] <= max_unrolled_words;
+
+	case handler_kind::access_chain:
+	{
+		const uint32_t operand_cnt = i.length - insn_words;
+
+		for (uint32_t j = 3; j + 3 < operand_cnt; j += 4)
+			if (op[j + 2] > INT32_MAX)
+				return false;
+
+		return true;
+	}
+
+	case handler_kind::phi:
+		return phi_words(i, op) <= max_unrolled_words * 2;
+
+	case handler_kind::convert_f32_to_s32:
+	case handler_kind::convert_f32_to_u32:
+		// Need saturation, which is left to the interpreter.
+		return false;
+
+	default:
+		return true;
+	}
+}
+
+// Emits native code for the instruction at pc, which must have a native
+// translation as reported by has_native_translation.
+static void emit_native(native_builder* b, const insn& i, const uint32_t* op, uint32_t pc) noexcept
+{
+	x64_encoder* const enc = &b->enc;
+
+	const uint32_t next_pc = pc + i.length;
+
+	const uint32_t operand_cnt = i.length - insn_words;
+
+	switch (i.handler)
+	{
+	case handler_kind::copy_words:
+	{
+		copy_words(b, op[0], op[1], op[2]);
+
+		break;
+	}
+	case handler_kind::select:
+	{
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			for (uint32_t w = 0; w != op[4]; ++w)
+			{
+				const uint32_t word = j * op[4] + w;
+
+				load_word(b, gpr::rax, op[3] + word);
+
+				test_word(b, op[1] + j);
+
+				cmov_word(b, cond::ne, gpr::rax, op[2] + word);
+
+				store_word(b, op[0] + word, gpr::rax);
+			}
+		}
+
+		break;
+	}
+	case handler_kind::load_trivial:
+	{
+		enc->mov_r64_m(gpr::rax, reg_word(op[1]));
+
+		copy_from_memory(b, op[0], { gpr::rax, 0 }, op[2]);
+
+		break;
+	}
+	case handler_kind::store_trivial:
+	{
+		enc->mov_r64_m(gpr::rax, reg_word(op[0]));
+
+		copy_to_memory(b, { gpr::rax, 0 }, op[1], op[2]);
+
+		break;
+	}
+	case handler_kind::access_chain:
+	{
+		enc->mov_r64_m(gpr::rax, reg_word(op[1]));
+
+		int64_t constant_offset = op[2];
+
+		for (uint32_t j = 3; j + 3 < operand_cnt; j += 4)
+		{
+			constant_offset += op[j];
+
+			const uint32_t index = op[j + 1];
+
+			const scalar_kind index_kind = static_cast<scalar_kind>(op[j + 3]);
+
+			if (index_kind == scalar_kind::i64)
+				enc->mov_r64_m(gpr::rcx, reg_word(index));
+			else
+				load_word(b, gpr::rcx, index);
+
+			switch (index_kind)
+			{
+			case scalar_kind::i8:  enc->movsx_r64_r8(gpr::rcx, gpr::rcx); break;
+			case scalar_kind::i16: enc->movsx_r64_r16(gpr::rcx, gpr::rcx); break;
+			case scalar_kind::i32: enc->movsxd_r64_r32(gpr::rcx, gpr::rcx); break;
+			default:               break;
+			}
+
+			if (op[j + 2] != 1)
+				enc->imul_r64_r64_imm32(gpr::rcx, gpr::rcx, static_cast<int32_t>(op[j + 2]));
+
+			enc->alu_r64_r64(alu_op::add, gpr::rax, gpr::rcx);
+		}
+
+		if (constant_offset > INT32_MAX)
+		{
+			enc->mov_r64_imm64(gpr::rcx, static_cast<uint64_t>(constant_offset));
+
+			enc->alu_r64_r64(alu_op::add, gpr::rax, gpr::rcx);
+		}
+		else if (constant_offset != 0)
+		{
+			enc->alu_r64_imm32(alu_op::add, gpr::rax, static_cast<int32_t>(constant_offset));
+		}
+
+		enc->mov_m_r64(reg_word(op[0]), gpr::rax);
+
+		break;
+	}
+	case handler_kind::branch:
+	{
+		enc->mov_m_imm32(state_field(offsetof(invocation_state, m_prev_block)), op[0]);
+
+		if (op[1] != next_pc)
+			emit_jump(b, op[1]);
+
+		break;
+	}
+	case handler_kind::branch_conditional:
+	{
+		enc->mov_m_imm32(state_field(offsetof(invocation_state, m_prev_block)), op[0]);
+
+		test_word(b, op[1]);
+
+		if (!b->fixups.append({ enc->jcc_rel32(cond::ne), op[2] }))
+			b->ok = false;
+
+		if (op[3] != next_pc)
+			emit_jump(b, op[3]);
+
+		break;
+	}
+	case handler_kind::phi:
+	{
+		// As in the interpreter, the values selected by all phis go through
+		// scratch before any of them is written, so that each phi observes the
+		// values from before the block was entered.
+		enc->mov_r32_m(gpr::rax, state_field(offsetof(invocation_state, m_prev_block)));
+
+		enc->mov_r64_m(gpr::rdx, state_field(offsetof(invocation_state, m_scratch)));
+
+		const uint32_t* curr = op;
+
+		uint32_t scratch_words = 0;
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			const uint32_t words = curr[1];
+
+			const uint32_t pair_cnt = curr[2];
+
+			uint32_t done_fixups[max_unrolled_words * 2];
+
+			uint32_t done_cnt = 0;
+
+			for (uint32_t p = 0; p != pair_cnt; ++p)
+			{
+				enc->cmp_r32_imm32(gpr::rax, curr[4 + p * 2]);
+
+				const uint32_t skip = enc->jcc_rel32(cond::ne);
+
+				copy_to_memory(b, { gpr::rdx, static_cast<int32_t>(scratch_words * 4) }, curr[3 + p * 2], words);
+
+				if (p + 1 != pair_cnt)
+					done_fixups[done_cnt++] = enc->jmp_rel32();
+
+				enc->patch_rel32(skip, enc->size());
+			}
+
+			for (uint32_t k = 0; k != done_cnt; ++k)
+				enc->patch_rel32(done_fixups[k], enc->size());
+
+			scratch_words += words;
+
+			curr += 3 + pair_cnt * 2;
+		}
+
+		curr = op;
+
+		scratch_words = 0;
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			copy_from_memory(b, curr[0], { gpr::rdx, static_cast<int32_t>(scratch_words * 4) }, curr[1]);
+
+			scratch_words += curr[1];
+
+			curr += 3 + curr[2] * 2;
+		}
+
+		break;
+	}
+	case handler_kind::logical_not:
+	{
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			test_word(b, op[1] + j);
+
+			emit_store_flag(b, cond::e, op[0] + j);
+		}
+
+		break;
+	}
+	case handler_kind::logical_and:
+	{
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			test_word(b, op[1] + j);
+
+			enc->setcc_r8(cond::ne, gpr::rcx);
+
+			test_word(b, op[2] + j);
+
+			enc->setcc_r8(cond::ne, gpr::rax);
+
+			enc->alu_r8_r8(alu_op::and_, gpr::rax, gpr::rcx);
+
+			enc->movzx_r32_r8(gpr::rax, gpr::rax);
+
+			store_word(b, op[0] + j, gpr::rax);
+		}
+
+		break;
+	}
+	case handler_kind::logical_or:
+	{
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			load_word(b, gpr::rax, op[1] + j);
+
+			alu_word(b, alu_op::or_, gpr::rax, op[2] + j);
+
+			emit_store_flag(b, cond::ne, op[0] + j);
+		}
+
+		break;
+	}
+	case handler_kind::fnegate_f32:
+	{
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			load_word(b, gpr::rax, op[1] + j);
+
+			enc->alu_r32_imm32(alu_op::xor_, gpr::rax, 0x80000000u);
+
+			store_word(b, op[0] + j, gpr::rax);
+		}
+
+		break;
+	}
+	case handler_kind::convert_s32_to_f32:
+	case handler_kind::convert_u32_to_f32:
+	{
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			// Clearing the destination first breaks cvtsi2ss's dependency on its
+			// previous value.
+			enc->xorps_x_x(xmm::xmm0, xmm::xmm0);
+
+			if (i.handler == handler_kind::convert_s32_to_f32)
+			{
+				if (location_of(b, op[1] + j) == location_memory)
+					enc->cvtsi2ss_x_m32(xmm::xmm0, reg_word(op[1] + j));
+				else
+					enc->cvtsi2ss_x_r32(xmm::xmm0, word_gpr(b, op[1] + j));
+			}
+			else
+			{
+				// Moving to a 32-bit register zero-extends, making the value
+				// non-negative as a 64-bit integer.
+				load_word(b, gpr::rax, op[1] + j);
+
+				enc->cvtsi2ss_x_r64(xmm::xmm0, gpr::rax);
+			}
+
+			store_float(b, op[0] + j, xmm::xmm0);
+		}
+
+		break;
+	}
+	case handler_kind::iadd_32:
+	case handler_kind::isub_32:
+	case handler_kind::and_32:
+	case handler_kind::or_32:
+	case handler_kind::xor_32:
+	case handler_kind::imul_32:
+	{
+		alu_op alu = alu_op::add;
+
+		if (i.handler == handler_kind::isub_32)
+			alu = alu_op::sub;
+		else if (i.handler == handler_kind::and_32)
+			alu = alu_op::and_;
+		else if (i.handler == handler_kind::or_32)
+			alu = alu_op::or_;
+		else if (i.handler == handler_kind::xor_32)
+			alu = alu_op::xor_;
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			load_word(b, gpr::rax, op[1] + j);
+
+			if (i.handler == handler_kind::imul_32)
+				imul_word(b, gpr::rax, op[2] + j);
+			else
+				alu_word(b, alu, gpr::rax, op[2] + j);
+
+			store_word(b, op[0] + j, gpr::rax);
+		}
+
+		break;
+	}
+	case handler_kind::shl_32:
+	case handler_kind::shr_32:
+	case handler_kind::sar_32:
+	{
+		// x86 shifts mask their count to 5 bits, matching the interpreter's & 31.
+		const shift_op shift = i.handler == handler_kind::shl_32 ? shift_op::shl : i.handler == handler_kind::shr_32 ? shift_op::shr : shift_op::sar;
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			load_word(b, gpr::rcx, op[2] + j);
+
+			load_word(b, gpr::rax, op[1] + j);
+
+			enc->shift_r32_cl(shift, gpr::rax);
+
+			store_word(b, op[0] + j, gpr::rax);
+		}
+
+		break;
+	}
+	case handler_kind::ieq_32:
+	case handler_kind::ine_32:
+	case handler_kind::ult_32:
+	case handler_kind::ule_32:
+	case handler_kind::ugt_32:
+	case handler_kind::uge_32:
+	case handler_kind::slt_32:
+	case handler_kind::sle_32:
+	case handler_kind::sgt_32:
+	case handler_kind::sge_32:
+	{
+		static constexpr cond conditions[]{ cond::e, cond::ne, cond::b, cond::be, cond::a, cond::ae, cond::l, cond::le, cond::g, cond::ge };
+
+		const cond cc = conditions[static_cast<uint32_t>(i.handler) - static_cast<uint32_t>(handler_kind::ieq_32)];
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			load_word(b, gpr::rax, op[1] + j);
+
+			alu_word(b, alu_op::cmp, gpr::rax, op[2] + j);
+
+			emit_store_flag(b, cc, op[0] + j);
+		}
+
+		break;
+	}
+	case handler_kind::fadd_f32:
+	case handler_kind::fsub_f32:
+	case handler_kind::fmul_f32:
+	case handler_kind::fdiv_f32:
+	{
+		static constexpr simd_op ops[]{ simd_op::add, simd_op::sub, simd_op::mul, simd_op::div };
+
+		const simd_op simd = ops[static_cast<uint32_t>(i.handler) - static_cast<uint32_t>(handler_kind::fadd_f32)];
+
+		emit_packed_f32(b, simd, op[0], op[1], op[2], false, i.count);
+
+		break;
+	}
+	case handler_kind::foeq_f32:
+	{
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			load_float(b, xmm::xmm0, op[1] + j);
+
+			ucomiss_word(b, xmm::xmm0, op[2] + j);
+
+			// Unordered operands set ZF as well as PF.
+			enc->setcc_r8(cond::e, gpr::rax);
+
+			enc->setcc_r8(cond::np, gpr::rcx);
+
+			enc->alu_r8_r8(alu_op::and_, gpr::rax, gpr::rcx);
+
+			enc->movzx_r32_r8(gpr::rax, gpr::rax);
+
+			store_word(b, op[0] + j, gpr::rax);
+		}
+
+		break;
+	}
+	case handler_kind::folt_f32:
+	case handler_kind::fole_f32:
+	case handler_kind::fogt_f32:
+	case handler_kind::foge_f32:
+	{
+		// Unordered operands set CF, so only "above" conditions are false for
+		// them. Less-than comparisons are done with swapped operands.
+		const bool is_swapped = i.handler == handler_kind::folt_f32 || i.handler == handler_kind::fole_f32;
+
+		const cond cc = i.handler == handler_kind::folt_f32 || i.handler == handler_kind::fogt_f32 ? cond::a : cond::ae;
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			load_float(b, xmm::xmm0, op[is_swapped ? 2 : 1] + j);
+
+			ucomiss_word(b, xmm::xmm0, op[is_swapped ? 1 : 2] + j);
+
+			emit_store_flag(b, cc, op[0] + j);
+		}
+
+		break;
+	}
+	case handler_kind::vector_times_scalar_f32:
+	{
+		emit_packed_f32(b, simd_op::mul, op[0], op[1], op[2], true, i.count);
+
+		break;
+	}
+	case handler_kind::generic:
+	{
+		switch (i.opcode)
+		{
+		case Op::MatrixTimesScalar:
+		{
+			emit_packed_f32(b, simd_op::mul, op[0], op[1], op[2], true, i.count);
+
+			break;
+		}
+		case Op::Dot:
+		{
+			emit_dot_f32(b, op[0], op[1], 1, op[2], i.count);
+
+			break;
+		}
+		case Op::VectorTimesMatrix:
+		{
+			// Every component of the result is the dot product of the vector
+			// with a column.
+			for (uint32_t c = 0; c != i.count; ++c)
+				emit_dot_f32(b, op[0] + c, op[2] + c * i.aux, 1, op[1], i.aux);
+
+			break;
+		}
+		case Op::MatrixTimesVector:
+		{
+			emit_matrix_times_vector_f32(enc, b->target.vector_bytes, op[0], op[1], op[2], i.count, i.aux, i.count);
+
+			break;
+		}
+		case Op::MatrixTimesMatrix:
+		{
+			// Every column of the result is the left matrix times a column of the right one.
+			for (uint32_t c = 0; c != op[3]; ++c)
+				emit_matrix_times_vector_f32(enc, b->target.vector_bytes, op[0] + c * i.count, op[1], op[2] + c * i.aux, i.count, i.aux, i.count);
+
+			break;
+		}
+		default:
+		{
+			break;
+		}
+		}
+
+		break;
+	}
+	default:
+	{
+		break;
+	}
+	}
+}
+
+// Per-pc properties of the instruction stream, as computed by analyze_control_flow.
+static constexpr uint8_t pc_native = 1;
+
+// Native code can be entered here from the interpreter, i.e. with all values in
+// the register file.
+static constexpr uint8_t pc_entry = 2;
+
+// The preceding instruction's native code falls through to this one.
+static constexpr uint8_t pc_fallthrough = 4;
+
+// Target of a native branch.
+static constexpr uint8_t pc_branch_target = 8;
+
+struct back_edge
+{
+	uint32_t from;
+
+	uint32_t to;
+};
+
+struct slot_usage
+{
+	// Instruction writing the slot as a single-word value, or ~0u.
+	uint32_t def_pc;
+
+	uint32_t first_use;
+
+	uint32_t last_use;
+
+	// Positive if the value is mostly used as float, negative if it is mostly
+	// used as integer.
+	int32_t float_votes;
+
+	// The slot is part of a value spanning multiple words, is written by the
+	// interpreter or otherwise cannot be kept in a register.
+	bool is_excluded;
+};
+
+struct liveness_scan
+{
+	simple_vec<slot_usage> usage;
+
+	// Slots in order of their definition, and thus of their intervals' start.
+	simple_vec<uint32_t> def_order;
+
+	// Instruction terminating each block, by block id, or ~0u.
+	simple_vec<uint32_t> terminator_pcs;
+
+	simple_vec<back_edge> back_edges;
+
+	bool ok;
+};
+
+static void exclude_words(liveness_scan* s, uint32_t slot, uint32_t words) noexcept
+{
+	for (uint32_t w = 0; w != words && slot + w < s->usage.size(); ++w)
+		s->usage[slot + w].is_excluded = true;
+}
+
+static void note_def(liveness_scan* s, uint32_t slot, uint32_t words, uint32_t pc, int32_t float_vote) noexcept
+{
+	if (words != 1 || slot >= s->usage.size())
+	{
+		exclude_words(s, slot, words);
+
+		return;
+	}
+
+	slot_usage& u = s->usage[slot];
+
+	if (u.def_pc != ~0u)
+	{
+		u.is_excluded = true;
+
+		return;
+	}
+
+	u.def_pc = pc;
+
+	u.float_votes += float_vote * 2;
+
+	if (!s->def_order.append(slot))
+		s->ok = false;
+}
+
+static void note_use(liveness_scan* s, uint32_t slot, uint32_t words, uint32_t pc, int32_t float_vote) noexcept
+{
+	if (words != 1 || slot >= s->usage.size())
+	{
+		exclude_words(s, slot, words);
+
+		return;
+	}
+
+	slot_usage& u = s->usage[slot];
+
+	if (pc < u.first_use)
+		u.first_use = pc;
+
+	if (pc > u.last_use || u.last_use == ~0u)
+		u.last_use = pc;
+
+	u.float_votes += float_vote;
+}
+
+// Records the words read and written by the instruction at pc. Operands of
+// instructions left to the interpreter are not decoded; any of their operand
+// words that could be a slot is conservatively treated as being read.
+static void scan_operands(liveness_scan* s, const insn& i, const uint32_t* op, uint32_t pc, bool is_native) noexcept
+{
+	const uint32_t operand_cnt = i.length - insn_words;
+
+	if (!is_native)
+	{
+		for (uint32_t j = 0; j != operand_cnt; ++j)
+			if (op[j] < s->usage.size())
+				note_use(s, op[j], 1, pc, 0);
+
+		return;
+	}
+
+	switch (i.handler)
+	{
+	case handler_kind::copy_words:
+	{
+		note_def(s, op[0], op[2], pc, 0);
+
+		note_use(s, op[1], op[2], pc, 0);
+
+		break;
+	}
+	case handler_kind::select:
+	{
+		note_def(s, op[0], i.count * op[4], pc, 0);
+
+		note_use(s, op[1], i.count, pc, -1);
+
+		note_use(s, op[2], i.count * op[4], pc, 0);
+
+		note_use(s, op[3], i.count * op[4], pc, 0);
+
+		break;
+	}
+	case handler_kind::load_trivial:
+	{
+		note_def(s, op[0], op[2], pc, 0);
+
+		note_use(s, op[1], 2, pc, 0);
+
+		break;
+	}
+	case handler_kind::store_trivial:
+	{
+		note_use(s, op[0], 2, pc, 0);
+
+		note_use(s, op[1], op[2], pc, 0);
+
+		break;
+	}
+	case handler_kind::access_chain:
+	{
+		note_def(s, op[0], 2, pc, 0);
+
+		note_use(s, op[1], 2, pc, 0);
+
+		for (uint32_t j = 3; j + 3 < operand_cnt; j += 4)
+			note_use(s, op[j + 1], static_cast<scalar_kind>(op[j + 3]) == scalar_kind::i64 ? 2 : 1, pc, -1);
+
+		break;
+	}
+	case handler_kind::branch:
+	{
+		break;
+	}
+	case handler_kind::branch_conditional:
+	{
+		note_use(s, op[1], 1, pc, -1);
+
+		break;
+	}
+	case handler_kind::phi:
+	{
+		// A phi reads its operands on entry from the respective parent block,
+		// so they are counted as used by that block's terminator, and by the
+		// phi itself if the parent block comes first. If the terminator is not
+		// known, the operand is kept in memory.
+		const uint32_t* curr = op;
+
+		for (uint32_t j = 0; j != i.count; ++j)
+		{
+			note_def(s, curr[0], curr[1], pc, 0);
+
+			for (uint32_t p = 0; p != curr[2]; ++p)
+			{
+				const uint32_t parent = curr[4 + p * 2];
+
+				const uint32_t parent_pc = parent < s->terminator_pcs.size() ? s->terminator_pcs[parent] : ~0u;
+
+				if (parent_pc == ~0u)
+					exclude_words(s, curr[3 + p * 2], curr[1]);
+				else
+					note_use(s, curr[3 + p * 2], curr[1], parent_pc < pc ? pc : parent_pc, 0);
+			}
+
+			curr += 3 + curr[2] * 2;
+		}
+
+		break;
+	}
+	case handler_kind::logical_not:
+	case handler_kind::fnegate_f32:
+	case handler_kind::convert_s32_to_f32:
+	case handler_kind::convert_u32_to_f32:
+	{
+		const bool is_float_result = i.handler != handler_kind::logical_not;
+
+		note_def(s, op[0], i.count, pc, is_float_result ? 1 : -1);
+
+		note_use(s, op[1], i.count, pc, i.handler == handler_kind::fnegate_f32 ? 1 : -1);
+
+		break;
+	}
+	case handler_kind::fadd_f32:
+	case handler_kind::fsub_f32:
+	case handler_kind::fmul_f32:
+	case handler_kind::fdiv_f32:
+	case handler_kind::foeq_f32:
+	case handler_kind::folt_f32:
+	case handler_kind::fole_f32:
+	case handler_kind::fogt_f32:
+	case handler_kind::foge_f32:
+	{
+		const bool is_float_result = static_cast<uint32_t>(i.handler) < static_cast<uint32_t>(handler_kind::foeq_f32);
+
+		note_def(s, op[0], i.count, pc, is_float_result ? 1 : -1);
+
+		note_use(s, op[1], i.count, pc, 1);
+
+		note_use(s, op[2], i.count, pc, 1);
+
+		break;
+	}
+	case handler_kind::vector_times_scalar_f32:
+	{
+		note_def(s, op[0], i.count, pc, 1);
+
+		note_use(s, op[1], i.count, pc, 1);
+
+		note_use(s, op[2], 1, pc, 1);
+
+		break;
+	}
+	case handler_kind::generic:
+	{
+		const uint32_t count = i.count;
+
+		const uint32_t aux = i.aux;
+
+		switch (i.opcode)
+		{
+		case Op::MatrixTimesScalar:
+			note_def(s, op[0], count, pc, 1);
+			note_use(s, op[1], count, pc, 1);
+			note_use(s, op[2], 1, pc, 1);
+			break;
+
+		case Op::Dot:
+			note_def(s, op[0], 1, pc, 1);
+			note_use(s, op[1], count, pc, 1);
+			note_use(s, op[2], count, pc, 1);
+			break;
+
+		case Op::VectorTimesMatrix:
+			note_def(s, op[0], count, pc, 1);
+			note_use(s, op[1], aux, pc, 1);
+			note_use(s, op[2], count * aux, pc, 1);
+			break;
+
+		case Op::MatrixTimesVector:
+			note_def(s, op[0], count, pc, 1);
+			note_use(s, op[1], count * aux, pc, 1);
+			note_use(s, op[2], aux, pc, 1);
+			break;
+
+		default:
+			note_def(s, op[0], count * op[3], pc, 1);
+			note_use(s, op[1], count * aux, pc, 1);
+			note_use(s, op[2], aux * op[3], pc, 1);
+			break;
+		}
+
+		break;
+	}
+	default:
+	{
+		// Integer arithmetic, shifts, comparisons and logical and / or.
+		note_def(s, op[0], i.count, pc, -1);
+
+		note_use(s, op[1], i.count, pc, -1);
+
+		note_use(s, op[2], i.count, pc, -1);
+
+		break;
+	}
+	}
+}
+
+static void add_branch_target(simple_vec<uint8_t>* flags, liveness_scan* s, uint32_t pc, uint32_t target, bool is_native) noexcept
+{
+	(*flags)[target] |= pc_entry | (is_native ? pc_branch_target : 0);
+
+	if (target <= pc && !s->back_edges.append({ pc, target }))
+		s->ok = false;
+}
+
+// Determines which instructions are translated, where native code can be
+// entered from the interpreter, which blocks end where and which branches
+// close loops.
+static void analyze_control_flow(const cpu_program* program, simple_vec<uint8_t>* flags, liveness_scan* s) noexcept
+{
+	const uint32_t* const code = program->m_code.data();
+
+	const uint32_t code_words = program->m_code.size();
+
+	bool prev_falls_through = false;
+
+	for (uint32_t pc = 0; pc != code_words; pc += reinterpret_cast<const insn*>(code + pc)->length)
+	{
+		const insn& i = *reinterpret_cast<const insn*>(code + pc);
+
+		const uint32_t* const op = code + pc + insn_words;
+
+		const uint32_t next_pc = pc + i.length;
+
+		const bool is_native = has_native_translation(i, op);
+
+		uint8_t f = (*flags)[pc];
+
+		if (is_native)
+			f |= pc_native;
+
+		// Execution continues from the interpreter after fallbacks, and blocks
+		// following a terminator may be entered through a fallback as well.
+		if (prev_falls_through)
+			f |= pc_fallthrough;
+		else
+			f |= pc_entry;
+
+		(*flags)[pc] = f;
+
+		prev_falls_through = is_native;
+
+		if (i.handler == handler_kind::branch)
+		{
+			add_branch_target(flags, s, pc, op[1], true);
+
+			prev_falls_through = op[1] == next_pc;
+		}
+		else if (i.handler == handler_kind::branch_conditional)
+		{
+			add_branch_target(flags, s, pc, op[2], true);
+
+			add_branch_target(flags, s, pc, op[3], true);
+
+			prev_falls_through = op[3] == next_pc;
+		}
+		else if (i.handler == handler_kind::generic && i.opcode == Op::Switch)
+		{
+			add_branch_target(flags, s, pc, op[2], false);
+
+			for (uint32_t j = 0; j != i.count; ++j)
+				add_branch_target(flags, s, pc, op[3 + j * 3 + 2], false);
+		}
+
+		if ((i.handler == handler_kind::branch || i.handler == handler_kind::branch_conditional || (i.handler == handler_kind::generic && i.opcode == Op::Switch)) && op[0] < s->terminator_pcs.size())
+			s->terminator_pcs[op[0]] = pc;
+	}
+}
+
+// Assigns machine registers to single-word values with a linear scan over their
+// live intervals. An interval reaches from a value's definition to its last
+// use and is extended over every loop it is live into. Values that do not get
+// a register stay in their slot of the register file, which thus doubles as
+// spill slot. Values in registers are written back to the register file before
+// each fallback to the interpreter and loaded again where native code is
+// entered from it, see compile_native.
+static spvcpu::result allocate_registers(const cpu_program* program, simple_vec<uint8_t>* flags, register_allocation* alloc) noexcept
+{
+	const uint32_t* const code = program->m_code.data();
+
+	const uint32_t code_words = program->m_code.size();
+
+	const uint32_t register_words = program->m_register_words;
+
+	liveness_scan s;
+
+	s.ok = true;
+
+	if (!s.usage.initialize(register_words + 1) || !s.usage.append_n({ ~0u, ~0u, ~0u, 0, false }, register_words))
+		return spvcpu::result::no_memory;
+
+	if (!s.def_order.initialize(64) || !s.back_edges.initialize(16))
+		return spvcpu::result::no_memory;
+
+	if (!s.terminator_pcs.initialize(program->m_id_bound + 1) || !s.terminator_pcs.append_n(~0u, program->m_id_bound))
+		return spvcpu::result::no_memory;
+
+	if (!alloc->m_locations.initialize(register_words + 1) || !alloc->m_locations.append_n(location_memory, register_words) || !alloc->m_intervals.initialize(64))
+		return spvcpu::result::no_memory;
+
+	memset(alloc->m_uses_gpr, 0, sizeof(alloc->m_uses_gpr));
+
+	analyze_control_flow(program, flags, &s);
+
+	for (uint32_t pc = 0; pc != code_words; pc += reinterpret_cast<const insn*>(code + pc)->length)
+		scan_operands(&s, *reinterpret_cast<const insn*>(code + pc), code + pc + insn_words, pc, ((*flags)[pc] & pc_native) != 0);
+
+	if (!s.ok)
+		return spvcpu::result::no_memory;
+
+#if defined(SPVCPU_JIT_REGISTER_ALLOCATION)
+	simple_vec<live_interval> intervals;
+
+	if (!intervals.initialize(s.def_order.size() + 1))
+		return spvcpu::result::no_memory;
+
+	for (uint32_t j = 0; j != s.def_order.size(); ++j)
+	{
+		const uint32_t slot = s.def_order[j];
+
+		const slot_usage& u = s.usage[slot];
+
+		// Reads before the definition would come from a previous loop iteration
+		// or from a path not passing the definition.
+		if (u.is_excluded || (u.first_use != ~0u && u.first_use < u.def_pc))
+			continue;
+
+		const uint32_t end = u.last_use == ~0u ? u.def_pc : u.last_use;
+
+		if (!intervals.append({ slot, u.def_pc, end, location_memory, u.float_votes > 0 }))
+			return spvcpu::result::no_memory;
+	}
+
+	// A value live into a loop, i.e. defined before its header and read at or
+	// after it, has to survive until the branch back to the header.
+	for (bool changed = true; changed; )
+	{
+		changed = false;
+
+		for (uint32_t e = 0; e != s.back_edges.size(); ++e)
+		{
+			const back_edge edge = s.back_edges[e];
+
+			for (uint32_t j = 0; j != intervals.size(); ++j)
+			{
+				live_interval& iv = intervals[j];
+
+				if (iv.start < edge.to && iv.end >= edge.to && iv.end < edge.from)
+				{
+					iv.end = edge.from;
+
+					changed = true;
+				}
+			}
+		}
+	}
+
+	// Intervals currently holding a register, per register class.
+	live_interval* active[2][sizeof(allocatable_xmms) / sizeof(allocatable_xmms[0])];
+
+	uint32_t active_cnt[2]{};
+
+	for (uint32_t j = 0; j != intervals.size(); ++j)
+	{
+		live_interval* const iv = &intervals[j];
+
+		const uint32_t cls = iv->is_float ? 1 : 0;
+
+		const uint32_t capacity = iv->is_float ? sizeof(allocatable_xmms) / sizeof(allocatable_xmms[0]) : sizeof(allocatable_gprs) / sizeof(allocatable_gprs[0]);
+
+		// Intervals ending where this one starts can hand over their register,
+		// since instructions read all operands before writing their result.
+		bool is_taken[sizeof(allocatable_xmms) / sizeof(allocatable_xmms[0])]{};
+
+		uint32_t kept = 0;
+
+		for (uint32_t k = 0; k != active_cnt[cls]; ++k)
+		{
+			if (active[cls][k]->end > iv->start)
+				active[cls][kept++] = active[cls][k];
+		}
+
+		active_cnt[cls] = kept;
+
+		for (uint32_t k = 0; k != kept; ++k)
+		{
+			for (uint32_t r = 0; r != capacity; ++r)
+			{
+				const uint8_t location = iv->is_float ? static_cast<uint8_t>(location_xmm + static_cast<uint8_t>(allocatable_xmms[r])) : static_cast<uint8_t>(allocatable_gprs[r]);
+
+				if (active[cls][k]->location == location)
+					is_taken[r] = true;
+			}
+		}
+
+		if (kept != capacity)
+		{
+			uint32_t r = 0;
+
+			while (is_taken[r])
+				++r;
+
+			iv->location = iv->is_float ? static_cast<uint8_t>(location_xmm + static_cast<uint8_t>(allocatable_xmms[r])) : static_cast<uint8_t>(allocatable_gprs[r]);
+
+			active[cls][active_cnt[cls]++] = iv;
+
+			continue;
+		}
+
+		// All registers are taken, so the interval ending last stays in memory.
+		uint32_t victim = 0;
+
+		for (uint32_t k = 1; k != kept; ++k)
+		{
+			if (active[cls][k]->end > active[cls][victim]->end)
+				victim = k;
+		}
+
+		if (active[cls][victim]->end > iv->end)
+		{
+			iv->location = active[cls][victim]->location;
+
+			active[cls][victim]->location = location_memory;
+
+			active[cls][victim] = iv;
+		}
+	}
+
+	for (uint32_t j = 0; j != intervals.size(); ++j)
+	{
+		const live_interval& iv = intervals[j];
+
+		if (iv.location == location_memory)
+			continue;
+
+		alloc->m_locations[iv.slot] = iv.location;
+
+		if (iv.location < location_xmm)
+			alloc->m_uses_gpr[iv.location] = true;
+
+		if (!alloc->m_intervals.append(iv))
+			return spvcpu::result::no_memory;
+	}
+#endif // SPVCPU_JIT_REGISTER_ALLOCATION
+
+	return spvcpu::result::success;
+}
+
+// Tracks which intervals are live while instructions are emitted in order.
+struct live_tracker
+{
+	const live_interval* by_location[32];
+
+	uint32_t next;
+};
+
+// Advances tracker to pc and returns the slots live into it, i.e. defined before
+// and read at or after pc, in out_slots.
+static uint32_t live_into(live_tracker* tracker, const register_allocation* alloc, uint32_t pc, uint32_t* out_slots) noexcept
+{
+	while (tracker->next != alloc->m_intervals.size() && alloc->m_intervals[tracker->next].start < pc)
+	{
+		const live_interval* const iv = &alloc->m_intervals[tracker->next];
+
+		tracker->by_location[iv->location] = iv;
+
+		++tracker->next;
+	}
+
+	uint32_t cnt = 0;
+
+	for (uint32_t l = 0; l != 32; ++l)
+	{
+		const live_interval* const iv = tracker->by_location[l];
+
+		if (iv != nullptr && iv->end >= pc)
+			out_slots[cnt++] = iv->slot;
+	}
+
+	return cnt;
+}
+
+// Reload code for an entry that is placed after the translation of all
+// instructions, since the preceding instruction falls through to the entry's
+// instruction.
+struct entry_stub
+{
+	uint32_t pc;
+
+	uint32_t first_slot;
+
+	uint32_t slot_cnt;
+};
+
+native_code::~native_code() noexcept
+{
+	if (m_code != nullptr)
+		munmap(m_code, m_bytes);
+}
+
+spvcpu::result compile_native(cpu_program* program) noexcept
+{
+	const uint32_t* const code = program->m_code.data();
+
+	const uint32_t code_words = program->m_code.size();
+
+	native_code& native = program->m_native;
+
+	native_builder b;
+
+	b.target = get_native_target();
+
+	b.ok = true;
+
+	simple_vec<uint8_t> flags;
+
+	// Offset of the code reached by native branches for each instruction, which
+	// follows the reload code of the instruction's entry.
+	simple_vec<uint32_t> branch_offsets;
+
+	simple_vec<entry_stub> stubs;
+
+	simple_vec<uint32_t> stub_slots;
+
+	if (!flags.initialize(code_words + 1) || !flags.append_n(0, code_words))
+		return spvcpu::result::no_memory;
+
+	b.relocations = &native.m_relocations;
+
+	if (!b.enc.initialize(code_words * 8 + 64, b.target.use_vex) || !b.fixups.initialize(64) || !native.m_offsets.initialize(code_words + 1) || !native.m_offsets.append_n(~0u, code_words) || !native.m_relocations.initialize(64))
+		return spvcpu::result::no_memory;
+
+	if (!branch_offsets.initialize(code_words + 1) || !branch_offsets.append_n(~0u, code_words) || !stubs.initialize(16) || !stub_slots.initialize(64))
+		return spvcpu::result::no_memory;
+
+	if (spvcpu::result rst = allocate_registers(program, &flags, &b.alloc); rst != spvcpu::result::success)
+		return rst;
+
+	x64_encoder& enc = b.enc;
+
+	// Entry stub. Callee-saved registers used by the register allocator are
+	// saved in addition to the fixed ones. Together with the return address,
+	// an even number of pushes leaves the stack misaligned for calls to
+	// native_fallback, which is corrected by an additional adjustment.
+	uint32_t saved_cnt = 3;
+
+	enc.push(reg_registers);
+	enc.push(reg_state);
+	enc.push(reg_result);
+
+	for (const gpr r : callee_saved_gprs)
+	{
+		if (b.alloc.m_uses_gpr[static_cast<uint8_t>(r)])
+		{
+			enc.push(r);
+
+			++saved_cnt;
+		}
+	}
+
+	const bool is_stack_adjusted = saved_cnt % 2 == 0;
+
+	if (is_stack_adjusted)
+		enc.alu_r64_imm32(alu_op::sub, gpr::rsp, 8);
+
+	enc.mov_r64_r64(reg_state, gpr::rdi);
+	enc.mov_r64_r64(reg_registers, gpr::rsi);
+	enc.mov_r64_r64(reg_result, gpr::rcx);
+	enc.jmp_r64(gpr::rdx);
+
+	native.m_exit_offset = enc.size();
+
+	if (b.target.use_vex)
+		enc.vzeroupper();
+
+	if (is_stack_adjusted)
+		enc.alu_r64_imm32(alu_op::add, gpr::rsp, 8);
+
+	for (uint32_t j = sizeof(callee_saved_gprs) / sizeof(callee_saved_gprs[0]); j != 0; --j)
+	{
+		if (b.alloc.m_uses_gpr[static_cast<uint8_t>(callee_saved_gprs[j - 1])])
+			enc.pop(callee_saved_gprs[j - 1]);
+	}
+
+	enc.pop(reg_result);
+	enc.pop(reg_state);
+	enc.pop(reg_registers);
+	enc.ret();
+
+	live_tracker tracker{};
+
+	uint32_t live_slots[32];
+
+	for (uint32_t pc = 0; pc != code_words; pc += reinterpret_cast<const insn*>(code + pc)->length)
+	{
+		const insn& i = *reinterpret_cast<const insn*>(code + pc);
+
+		const uint32_t* const op = code + pc + insn_words;
+
+		const uint8_t f = flags[pc];
+
+		const uint32_t live_cnt = live_into(&tracker, &b.alloc, pc, live_slots);
+
+		if ((f & pc_native) == 0)
+		{
+			// Code reached natively holds values in registers, which have to be
+			// written back for the interpreter. The entry from the interpreter
+			// skips this, as is the case for chains of fallbacks.
+			branch_offsets[pc] = enc.size();
+
+			if ((f & (pc_fallthrough | pc_branch_target)) != 0)
+			{
+				for (uint32_t j = 0; j != live_cnt; ++j)
+					emit_spill(&b, live_slots[j]);
+			}
+
+			native.m_offsets[pc] = enc.size();
+
+			emit_fallback(&b, pc);
+
+			continue;
+		}
+
+		if ((f & pc_entry) != 0)
+		{
+			// Values read by phis are used by the parent block's terminator,
+			// which is not part of their interval, so they are reloaded
+			// separately. Live values are reloaded last in case they share a
+			// register with such an operand.
+			const uint32_t first_slot = stub_slots.size();
+
+			if (i.handler == handler_kind::phi)
+			{
+				const uint32_t* curr = op;
+
+				for (uint32_t j = 0; j != i.count; ++j)
+				{
+					for (uint32_t p = 0; p != curr[2]; ++p)
+					{
+						if (curr[1] == 1 && b.alloc.m_locations[curr[3 + p * 2]] != location_memory && !stub_slots.append(curr[3 + p * 2]))
+							return spvcpu::result::no_memory;
+					}
+
+					curr += 3 + curr[2] * 2;
+				}
+			}
+
+			for (uint32_t j = 0; j != live_cnt; ++j)
+			{
+				if (!stub_slots.append(live_slots[j]))
+					return spvcpu::result::no_memory;
+			}
+
+			const uint32_t slot_cnt = stub_slots.size() - first_slot;
+
+			if (slot_cnt != 0 && (f & pc_fallthrough) != 0)
+			{
+				if (!stubs.append({ pc, first_slot, slot_cnt }))
+					return spvcpu::result::no_memory;
+			}
+			else
+			{
+				native.m_offsets[pc] = enc.size();
+
+				for (uint32_t j = 0; j != slot_cnt; ++j)
+					emit_reload(&b, stub_slots[first_slot + j]);
+			}
+		}
+
+		branch_offsets[pc] = enc.size();
+
+		emit_native(&b, i, op, pc);
+	}
+
+	for (uint32_t j = 0; j != stubs.size(); ++j)
+	{
+		const entry_stub& stub = stubs[j];
+
+		native.m_offsets[stub.pc] = enc.size();
+
+		for (uint32_t k = 0; k != stub.slot_cnt; ++k)
+			emit_reload(&b, stub_slots[stub.first_slot + k]);
+
+		emit_jump(&b, stub.pc);
+	}
+
+	if (!b.ok || enc.m_failed)
+		return spvcpu::result::no_memory;
+
+	for (uint32_t j = 0; j != b.fixups.size(); ++j)
+		enc.patch_rel32(b.fixups[j].code_offset, branch_offsets[b.fixups[j].target_pc]);
+
+	const uint64_t page_bytes = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+	const uint64_t bytes = (enc.size() + page_bytes - 1) & ~(page_bytes - 1);
+
+	void* const pages = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (pages == MAP_FAILED)
+		return spvcpu::result::no_memory;
+
+	memcpy(pages, enc.m_bytes.data(), enc.size());
+
+	native.m_code = static_cast<uint8_t*>(pages);
+
+	native.m_bytes = bytes;
+
+	return link_native(&native);
+}
+
+uint32_t native_code_variant() noexcept
+{
+	const native_target& target = get_native_target();
+
+	uint32_t variant = target.vector_bytes | (target.use_vex ? 0x100 : 0);
+
+#if defined(SPVCPU_JIT_REGISTER_ALLOCATION)
+	variant |= 0x200;
+#endif
+
+	return variant;
+}
+
+spvcpu::result link_native(native_code* native) noexcept
+{
+	const uint64_t fallback_address = reinterpret_cast<uintptr_t>(&native_fallback);
+
+	for (uint32_t j = 0; j != native->m_relocations.size(); ++j)
+		memcpy(native->m_code + native->m_relocations[j], &fallback_address, sizeof(fallback_address));
+
+	// Code is written while the pages are only writable and then switched to
+	// being only executable, so that no page is ever writable and executable
+	// at the same time.
+	if (mprotect(native->m_code, native->m_bytes, PROT_READ | PROT_EXEC) != 0)
+		return spvcpu::result::no_memory;
+
+	return spvcpu::result::success;
+}
+
+spvcpu::result execute_native(invocation_state* state) noexcept
+{
+	if (spvcpu::result rst = step_to_native_entry(state); rst != spvcpu::result::success)
+		return rst;
+
+	if (state->m_status != spvcpu::execution_status::running)
+		return spvcpu::result::success;
+
+	const native_code& native = state->m_program->m_native;
+
+	spvcpu::result rst = spvcpu::result::success;
+
+	reinterpret_cast<native_entry>(native.m_code)(state, state->m_registers, native.m_code + native.m_offsets[state->m_pc], &rst);
+
+	return rst;
+}
+
+#endif // SPVCPU_JIT
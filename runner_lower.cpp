@@ -0,0 +1,2710 @@
+#include "runner_program.hpp"
+
+#include <cstring>
+#include <initializer_list>
+
+#include "spird_defs.hpp"
+#include "spird_accessor.hpp"
+#include "id_data.hpp"
+
+// Operand encoding of the bytecode produced by lower_program. Every instruction
+// starts with an insn header, which is followed by its operands. Values are
+// referenced by their register slot, i.e. their word offset in the register file.
+// R is the slot of the result, other slots are named after their role. Branch
+// targets and callees are the word offsets of their first instruction.
+//
+// Unary ops (negation, conversions, ...)        [R, a]
+// Binary ops (arithmetic, comparisons, ...)     [R, a, b]
+// Select                                        [R, cond, a, b, words per selected component]
+// Bitcast                                       [R, a]
+// CopyObject (and CompositeExtract)             [R, a, words]
+// VectorTimesScalar / MatrixTimesScalar         [R, v, s]
+// Dot                                           [R, a, b]
+// VectorTimesMatrix / MatrixTimesVector         [R, a, b]
+// MatrixTimesMatrix                             [R, a, b, columns of b]
+// OuterProduct                                  [R, a, b]
+// Transpose                                     [R, m]
+// CompositeInsert                               [R, object, composite, word offset, object words, composite words]
+// CompositeConstruct                            [R, (constituent, words)...]
+// VectorShuffle                                 [R, a, b, components of a, indices...]
+// VectorExtractDynamic                          [R, v, index]
+// VectorInsertDynamic                           [R, v, component, index]
+// Load                                          [R, pointer, node]   (load_trivial: [R, pointer, words])
+// Store                                         [pointer, value, node]   (store_trivial: [pointer, value, words])
+// AccessChain                                   [R, base, final offset, (offset, index, stride, index kind)...]
+// CopyMemory                                    [target, source, target node, source node]
+// ArrayLength                                   [R, variable index, member offset, stride]
+// Branch                                        [block id, target]
+// BranchConditional                             [block id, cond, true target, false target]
+// Switch                                        [block id, selector, default target, (literal lo, literal hi, target)...]
+// Return / Kill / Unreachable                   []
+// ReturnValue                                   [value, words]
+// Phi (all phis at the start of a block)        [(R, words, pair count, (value, parent block id)...)...]
+// FunctionCall                                  [R or 0, callee, return words, (argument, parameter, words)...]
+// ExtInst (GLSL.std.450 only)                   [R, arguments...]
+// Atomic*                                       [R, pointer, values...]  (AtomicStore: [pointer, value])
+// ControlBarrier / MemoryBarrier                []   (aux: 1 for a ControlBarrier whose execution scope includes the workgroup)
+// GroupNonUniform*                              [R, arguments...]
+// ImageRead                                     [R, image, coordinate, coordinate components]
+// ImageWrite                                    [image, coordinate, texel, coordinate components]
+// ImageQuerySize(Lod)                           [R, image]
+
+static constexpr uint32_t glsl_std_450_name_words[]{ 0x4C534C47, 0x6474732E, 0x3035342E, 0x00000000 }; // "GLSL.std.450"
+
+struct type_info
+{
+	type_data data;
+
+	uint32_t register_words;
+
+	uint32_t register_node;
+
+	uint32_t explicit_node;
+};
+
+struct decoration_entry
+{
+	uint32_t next;
+
+	uint32_t member;
+
+	Decoration decoration;
+
+	uint32_t value;
+};
+
+struct function_record
+{
+	uint32_t id;
+
+	uint32_t pc;
+
+	uint32_t param_beg;
+
+	uint32_t param_cnt;
+};
+
+struct fixup
+{
+	uint32_t operand_index;
+
+	uint32_t id;
+
+	// Index of the callee's parameter to insert, or ~0u to insert the callee's pc.
+	uint32_t param_index;
+};
+
+struct pending_entry_point
+{
+	uint32_t function_id;
+
+	uint32_t name_offset;
+
+	uint32_t local_size[3];
+};
+
+static bool has_explicit_layout(StorageClass storage_class) noexcept
+{
+	return storage_class == StorageClass::Uniform ||
+	       storage_class == StorageClass::StorageBuffer ||
+	       storage_class == StorageClass::PushConstant ||
+	       storage_class == StorageClass::PhysicalStorageBuffer ||
+	       storage_class == StorageClass::ShaderRecordBufferKHR;
+}
+
+static bool is_binding_backed(StorageClass storage_class) noexcept
+{
+	return storage_class == StorageClass::Uniform ||
+	       storage_class == StorageClass::StorageBuffer ||
+	       storage_class == StorageClass::PushConstant;
+}
+
+static uint32_t scalar_words(scalar_kind kind) noexcept
+{
+	return kind == scalar_kind::i64 || kind == scalar_kind::f64 ? 2 : 1;
+}
+
+static uint32_t scalar_memory_bytes(scalar_kind kind) noexcept
+{
+	switch (kind)
+	{
+	case scalar_kind::i8:  return 1;
+	case scalar_kind::i16: return 2;
+	case scalar_kind::i64: return 8;
+	case scalar_kind::f64: return 8;
+	default:               return 4;
+	}
+}
+
+struct program_builder
+{
+private:
+
+	cpu_program* m_program;
+
+	const void* m_spird;
+
+	spird::enum_location m_insn_loc;
+
+	spird::elem_view_cache m_insn_views;
+
+	uint32_t m_id_bound;
+
+	simple_vec<uint32_t> m_result_types;
+
+	simple_vec<uint32_t> m_type_indices;
+
+	simple_vec<type_info> m_types;
+
+	simple_vec<uint32_t> m_pointer_nodes;
+
+	simple_vec<uint32_t> m_variable_indices;
+
+	simple_vec<uint32_t> m_label_pcs;
+
+	simple_vec<uint32_t> m_function_indices;
+
+	simple_vec<uint32_t> m_name_offsets;
+
+	simple_vec<uint32_t> m_first_decorations;
+
+	simple_vec<decoration_entry> m_decorations;
+
+	simple_vec<function_record> m_functions;
+
+	simple_vec<uint32_t> m_params;
+
+	simple_vec<fixup> m_label_fixups;
+
+	simple_vec<fixup> m_function_fixups;
+
+	simple_vec<pending_entry_point> m_entry_points;
+
+	// Non-zero for ids whose value is already known during lowering, i.e. all
+	// constants except those computed by OpSpecConstantOp.
+	simple_vec<uint8_t> m_constant_ids;
+
+	uint32_t m_glsl_set_id;
+
+	uint32_t m_curr_block;
+
+	uint32_t m_phi_insn;
+
+	uint32_t m_phi_words;
+
+	bool m_in_function;
+
+	bool m_prologue_closed;
+
+	bool m_has_invalid_slot;
+
+	// Index into cpu_program::m_code of the most recently emitted instruction.
+	uint32_t m_curr_insn;
+
+	const uint32_t* m_word_end;
+
+	spvcpu::result allocate_per_id(simple_vec<uint32_t>& vec, uint32_t fill) noexcept
+	{
+		if (!vec.initialize(m_id_bound) || !vec.append_n(fill, m_id_bound))
+			return spvcpu::result::no_memory;
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result check_id(uint32_t id) const noexcept
+	{
+		return id != 0 && id < m_id_bound ? spvcpu::result::success : spvcpu::result::id_not_found;
+	}
+
+	const type_info* get_type(uint32_t type_id) const noexcept
+	{
+		if (type_id == 0 || type_id >= m_id_bound || m_type_indices[type_id] == ~0u)
+			return nullptr;
+
+		return &m_types[m_type_indices[type_id]];
+	}
+
+	const type_info* get_value_type(uint32_t id) const noexcept
+	{
+		if (id == 0 || id >= m_id_bound)
+			return nullptr;
+
+		return get_type(m_result_types[id]);
+	}
+
+	static scalar_kind kind_of_scalar(spird::arg_type type, const raw_type_data::int_data_t& int_data, const raw_type_data::float_data_t& float_data) noexcept
+	{
+		if (type == spird::arg_type::BOOL)
+			return scalar_kind::boolean;
+
+		if (type == spird::arg_type::INT)
+		{
+			switch (int_data.width)
+			{
+			case 8:  return scalar_kind::i8;
+			case 16: return scalar_kind::i16;
+			case 32: return scalar_kind::i32;
+			case 64: return scalar_kind::i64;
+			default: return scalar_kind::none;
+			}
+		}
+
+		if (type == spird::arg_type::FLOAT)
+		{
+			switch (float_data.width)
+			{
+			case 32: return scalar_kind::f32;
+			case 64: return scalar_kind::f64;
+			default: return scalar_kind::none;
+			}
+		}
+
+		return scalar_kind::none;
+	}
+
+	static scalar_kind kind_of(const type_info* type) noexcept
+	{
+		if (type == nullptr)
+			return scalar_kind::none;
+
+		const raw_type_data& data = type->data.m_data;
+
+		switch (type->data.m_type)
+		{
+		case spird::arg_type::BOOL:
+		case spird::arg_type::INT:
+		case spird::arg_type::FLOAT:
+			return kind_of_scalar(type->data.m_type, data.int_data, data.float_data);
+
+		case spird::arg_type::VECTOR:
+			return kind_of_scalar(data.vector_data.component_type, data.vector_data.int_component, data.vector_data.float_component);
+
+		case spird::arg_type::MATRIX:
+			return kind_of_scalar(data.matrix_data.column_data.component_type, data.matrix_data.column_data.int_component, data.matrix_data.column_data.float_component);
+
+		default:
+			return scalar_kind::none;
+		}
+	}
+
+	static uint32_t count_of(const type_info* type) noexcept
+	{
+		if (type == nullptr)
+			return 0;
+
+		switch (type->data.m_type)
+		{
+		case spird::arg_type::BOOL:
+		case spird::arg_type::INT:
+		case spird::arg_type::FLOAT:
+			return 1;
+
+		case spird::arg_type::VECTOR:
+			return type->data.m_data.vector_data.component_count;
+
+		case spird::arg_type::MATRIX:
+			return type->data.m_data.matrix_data.column_count * type->data.m_data.matrix_data.column_data.component_count;
+
+		default:
+			return 0;
+		}
+	}
+
+	scalar_kind value_kind(uint32_t id) const noexcept
+	{
+		return kind_of(get_value_type(id));
+	}
+
+	uint32_t value_count(uint32_t id) const noexcept
+	{
+		return count_of(get_value_type(id));
+	}
+
+	uint32_t value_words(uint32_t id) const noexcept
+	{
+		const type_info* type = get_value_type(id);
+
+		return type == nullptr ? 0 : type->register_words;
+	}
+
+	bool find_decoration(uint32_t id, uint32_t member, Decoration decoration, uint32_t* out_value) const noexcept
+	{
+		for (uint32_t i = m_first_decorations[id]; i != ~0u; i = m_decorations[i].next)
+		{
+			if (m_decorations[i].member == member && m_decorations[i].decoration == decoration)
+			{
+				if (out_value != nullptr)
+					*out_value = m_decorations[i].value;
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	spvcpu::result add_string(const char* str, uint32_t* out_offset) noexcept
+	{
+		*out_offset = m_program->m_strings.size();
+
+		do
+		{
+			if (!m_program->m_strings.append(*str))
+				return spvcpu::result::no_memory;
+		}
+		while (*str++ != '\0');
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result allocate_register(uint32_t id, uint32_t words) noexcept
+	{
+		if (words == 0 || m_program->m_register_offsets[id] != ~0u)
+			return spvcpu::result::success;
+
+		m_program->m_register_offsets[id] = m_program->m_initial_registers.size();
+
+		if (!m_program->m_initial_registers.append_n(0, words))
+			return spvcpu::result::no_memory;
+
+		return spvcpu::result::success;
+	}
+
+	uint32_t* initial_value(uint32_t id) noexcept
+	{
+		return m_program->m_initial_registers.data() + m_program->m_register_offsets[id];
+	}
+
+	uint32_t allocate_memory(uint32_t bytes) noexcept
+	{
+		const uint32_t offset = m_program->m_memory_bytes;
+
+		m_program->m_memory_bytes += (bytes + 15) & ~15u;
+
+		return offset;
+	}
+
+	// Returns the register slot holding the value of id. Ids without a register
+	// are only detected once lowering is complete, which keeps the emission of
+	// operands free of error handling.
+	uint32_t slot(uint32_t id) noexcept
+	{
+		const uint32_t offset = m_program->m_register_offsets[id];
+
+		if (offset == ~0u)
+			m_has_invalid_slot = true;
+
+		return offset;
+	}
+
+	insn* curr_insn() noexcept
+	{
+		return reinterpret_cast<insn*>(m_program->m_code.data() + m_curr_insn);
+	}
+
+	spvcpu::result emit_handler(handler_kind h, Op opcode, scalar_kind kind, scalar_kind src_kind, uint32_t count, uint32_t aux, std::initializer_list<uint32_t> operands) noexcept
+	{
+		if (count > UINT16_MAX || aux > UINT16_MAX)
+			return spvcpu::result::instruction_wordcount_mismatch;
+
+		insn i;
+		i.handler = h;
+		i.opcode = opcode;
+		i.kind = kind;
+		i.src_kind = src_kind;
+		i.count = static_cast<uint16_t>(count);
+		i.aux = static_cast<uint16_t>(aux);
+		i.unused = 0;
+		i.length = insn_words;
+		i.dispatch = 0;
+
+		m_curr_insn = m_program->m_code.size();
+
+		if (!m_program->m_code.append_n(0, insn_words))
+			return spvcpu::result::no_memory;
+
+		memcpy(curr_insn(), &i, sizeof(i));
+
+		return emit_operands(operands);
+	}
+
+	spvcpu::result emit(Op opcode, scalar_kind kind, scalar_kind src_kind, uint32_t count, uint32_t aux, std::initializer_list<uint32_t> operands) noexcept
+	{
+		return emit_handler(handler_kind::generic, opcode, kind, src_kind, count, aux, operands);
+	}
+
+	spvcpu::result emit_operands(std::initializer_list<uint32_t> operands) noexcept
+	{
+		for (uint32_t operand : operands)
+			if (!m_program->m_code.append(operand))
+				return spvcpu::result::no_memory;
+
+		curr_insn()->length += static_cast<uint32_t>(operands.size());
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result emit_label_operand(uint32_t label_id) noexcept
+	{
+		if (spvcpu::result rst = check_id(label_id); rst != spvcpu::result::success)
+			return rst;
+
+		if (!m_label_fixups.append({ m_program->m_code.size(), label_id, ~0u }))
+			return spvcpu::result::no_memory;
+
+		return emit_operands({ ~0u });
+	}
+
+	spvcpu::result emit_function_operand(uint32_t function_id, uint32_t param_index) noexcept
+	{
+		if (spvcpu::result rst = check_id(function_id); rst != spvcpu::result::success)
+			return rst;
+
+		if (!m_function_fixups.append({ m_program->m_code.size(), function_id, param_index }))
+			return spvcpu::result::no_memory;
+
+		return emit_operands({ ~0u });
+	}
+
+	spvcpu::result add_layout_node(const layout_node& node, uint32_t* out_node) noexcept
+	{
+		*out_node = m_program->m_layout_nodes.size();
+
+		if (!m_program->m_layout_nodes.append(node))
+			return spvcpu::result::no_memory;
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result build_vector_node(scalar_kind kind, uint32_t count, bool is_explicit, uint32_t component_stride, uint32_t* out_node) noexcept
+	{
+		layout_node component;
+		component.kind = layout_kind::scalar;
+		component.scalar = kind;
+		component.register_words = scalar_words(kind);
+		component.memory_bytes = is_explicit ? scalar_memory_bytes(kind) : component.register_words * 4;
+		component.is_trivial = component.memory_bytes == component.register_words * 4;
+		component.unused = 0;
+		component.stride = 0;
+		component.count = 1;
+		component.element = ~0u;
+
+		uint32_t component_node;
+
+		if (spvcpu::result rst = add_layout_node(component, &component_node); rst != spvcpu::result::success)
+			return rst;
+
+		if (count == 1)
+		{
+			*out_node = component_node;
+
+			return spvcpu::result::success;
+		}
+
+		if (component_stride == 0)
+			component_stride = component.memory_bytes;
+
+		layout_node vector;
+		vector.kind = layout_kind::vector;
+		vector.scalar = kind;
+		vector.register_words = component.register_words * count;
+		vector.memory_bytes = component_stride * (count - 1) + component.memory_bytes;
+		vector.is_trivial = component.is_trivial && component_stride == component.memory_bytes;
+		vector.unused = 0;
+		vector.stride = component_stride;
+		vector.count = count;
+		vector.element = component_node;
+
+		return add_layout_node(vector, out_node);
+	}
+
+	spvcpu::result build_layout_node(uint32_t type_id, bool is_explicit, uint32_t matrix_stride, bool is_row_major, uint32_t* out_node) noexcept
+	{
+		const type_info* type = get_type(type_id);
+
+		if (type == nullptr)
+			return spvcpu::result::id_not_found;
+
+		const uint32_t cached = is_explicit ? type->explicit_node : type->register_node;
+
+		if (cached != ~0u && matrix_stride == 0)
+		{
+			*out_node = cached;
+
+			return spvcpu::result::success;
+		}
+
+		const raw_type_data& data = type->data.m_data;
+
+		const scalar_kind kind = kind_of(type);
+
+		uint32_t node_index;
+
+		switch (type->data.m_type)
+		{
+		case spird::arg_type::BOOL:
+		case spird::arg_type::INT:
+		case spird::arg_type::FLOAT:
+		{
+			if (kind == scalar_kind::none)
+				return spvcpu::result::incompatible_types;
+
+			if (spvcpu::result rst = build_vector_node(kind, 1, is_explicit, 0, &node_index); rst != spvcpu::result::success)
+				return rst;
+
+			break;
+		}
+		case spird::arg_type::VECTOR:
+		{
+			if (kind == scalar_kind::none)
+				return spvcpu::result::incompatible_types;
+
+			if (spvcpu::result rst = build_vector_node(kind, data.vector_data.component_count, is_explicit, 0, &node_index); rst != spvcpu::result::success)
+				return rst;
+
+			break;
+		}
+		case spird::arg_type::MATRIX:
+		{
+			if (kind == scalar_kind::none)
+				return spvcpu::result::incompatible_types;
+
+			const uint32_t rows = data.matrix_data.column_data.component_count;
+
+			const uint32_t cols = data.matrix_data.column_count;
+
+			const uint32_t component_bytes = is_explicit ? scalar_memory_bytes(kind) : scalar_words(kind) * 4;
+
+			if (matrix_stride == 0 || !is_explicit)
+			{
+				matrix_stride = component_bytes * (is_row_major ? cols : rows);
+
+				is_row_major = false;
+			}
+
+			uint32_t column_node;
+
+			if (spvcpu::result rst = build_vector_node(kind, rows, is_explicit, is_row_major ? matrix_stride : 0, &column_node); rst != spvcpu::result::success)
+				return rst;
+
+			const layout_node& column = m_program->m_layout_nodes[column_node];
+
+			layout_node matrix;
+			matrix.kind = layout_kind::matrix;
+			matrix.scalar = kind;
+			matrix.register_words = column.register_words * cols;
+			matrix.stride = is_row_major ? component_bytes : matrix_stride;
+			matrix.memory_bytes = is_row_major ? matrix_stride * rows : matrix_stride * cols;
+			matrix.is_trivial = column.is_trivial && matrix.stride == column.register_words * 4;
+			matrix.unused = 0;
+			matrix.count = cols;
+			matrix.element = column_node;
+
+			if (spvcpu::result rst = add_layout_node(matrix, &node_index); rst != spvcpu::result::success)
+				return rst;
+
+			break;
+		}
+		case spird::arg_type::ARRAY:
+		case spird::arg_type::RUNTIMEARRAY:
+		{
+			const bool is_runtime = type->data.m_type == spird::arg_type::RUNTIMEARRAY;
+
+			const uint32_t element_type_id = is_runtime ? data.runtime_array_data.element_id : data.array_data.element_id;
+
+			uint32_t element_node;
+
+			if (spvcpu::result rst = build_layout_node(element_type_id, is_explicit, matrix_stride, is_row_major, &element_node); rst != spvcpu::result::success)
+				return rst;
+
+			const layout_node& element = m_program->m_layout_nodes[element_node];
+
+			uint32_t stride = element.register_words * 4;
+
+			if (is_explicit && !find_decoration(type_id, ~0u, Decoration::ArrayStride, &stride))
+				stride = element.memory_bytes;
+
+			layout_node array;
+			array.kind = is_runtime ? layout_kind::runtime_array : layout_kind::array;
+			array.scalar = scalar_kind::none;
+			array.count = is_runtime ? 0 : static_cast<uint32_t>(data.array_data.length);
+			array.register_words = element.register_words * array.count;
+			array.memory_bytes = stride * array.count;
+			array.stride = stride;
+			array.is_trivial = element.is_trivial && stride == element.register_words * 4;
+			array.unused = 0;
+			array.element = element_node;
+
+			if (spvcpu::result rst = add_layout_node(array, &node_index); rst != spvcpu::result::success)
+				return rst;
+
+			break;
+		}
+		case spird::arg_type::STRUCT:
+		{
+			const uint32_t member_cnt = data.struct_data.element_count;
+
+			const uint32_t member_beg = m_program->m_layout_members.size();
+
+			if (!m_program->m_layout_members.append_n({}, member_cnt))
+				return spvcpu::result::no_memory;
+
+			bool is_trivial = true;
+
+			uint32_t register_words = 0;
+
+			uint32_t memory_bytes = 0;
+
+			for (uint32_t i = 0; i != member_cnt; ++i)
+			{
+				uint32_t member_matrix_stride = 0;
+
+				find_decoration(type_id, i, Decoration::MatrixStride, &member_matrix_stride);
+
+				const bool member_row_major = find_decoration(type_id, i, Decoration::RowMajor, nullptr);
+
+				uint32_t member_node;
+
+				if (spvcpu::result rst = build_layout_node(data.struct_data.elements[i], is_explicit, member_matrix_stride, member_row_major, &member_node); rst != spvcpu::result::success)
+					return rst;
+
+				const layout_node& member = m_program->m_layout_nodes[member_node];
+
+				uint32_t memory_offset = register_words * 4;
+
+				if (is_explicit && !find_decoration(type_id, i, Decoration::Offset, &memory_offset))
+					memory_offset = memory_bytes;
+
+				if (!member.is_trivial || memory_offset != register_words * 4)
+					is_trivial = false;
+
+				m_program->m_layout_members[member_beg + i] = { member_node, memory_offset, register_words };
+
+				register_words += member.register_words;
+
+				if (memory_offset + member.memory_bytes > memory_bytes)
+					memory_bytes = memory_offset + member.memory_bytes;
+			}
+
+			layout_node structure;
+			structure.kind = layout_kind::structure;
+			structure.scalar = scalar_kind::none;
+			structure.register_words = register_words;
+			structure.memory_bytes = is_explicit ? memory_bytes : register_words * 4;
+			structure.is_trivial = is_trivial && structure.memory_bytes == register_words * 4;
+			structure.unused = 0;
+			structure.stride = 0;
+			structure.count = member_cnt;
+			structure.element = member_beg;
+
+			if (spvcpu::result rst = add_layout_node(structure, &node_index); rst != spvcpu::result::success)
+				return rst;
+
+			break;
+		}
+		case spird::arg_type::POINTER:
+		case spird::arg_type::IMAGE:
+		case spird::arg_type::SAMPLER:
+		case spird::arg_type::SAMPLEDIMAGE:
+		{
+			layout_node opaque;
+			opaque.kind = layout_kind::opaque;
+			opaque.scalar = scalar_kind::none;
+			opaque.register_words = 2;
+			opaque.memory_bytes = 8;
+			opaque.is_trivial = true;
+			opaque.unused = 0;
+			opaque.stride = 0;
+			opaque.count = 1;
+			opaque.element = ~0u;
+
+			if (spvcpu::result rst = add_layout_node(opaque, &node_index); rst != spvcpu::result::success)
+				return rst;
+
+			break;
+		}
+		default:
+		{
+			return spvcpu::result::incompatible_types;
+		}
+		}
+
+		if (matrix_stride == 0)
+		{
+			type_info& mutable_type = m_types[m_type_indices[type_id]];
+
+			if (is_explicit)
+				mutable_type.explicit_node = node_index;
+			else
+				mutable_type.register_node = node_index;
+		}
+
+		*out_node = node_index;
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result pointee_node(uint32_t pointer_type_id, uint32_t* out_node, StorageClass* out_storage_class) noexcept
+	{
+		const type_info* type = get_type(pointer_type_id);
+
+		if (type == nullptr || type->data.m_type != spird::arg_type::POINTER)
+			return spvcpu::result::incompatible_types;
+
+		const StorageClass storage_class = static_cast<StorageClass>(type->data.m_data.pointer_data.storage_class);
+
+		if (out_storage_class != nullptr)
+			*out_storage_class = storage_class;
+
+		return build_layout_node(type->data.m_data.pointer_data.pointee_id, has_explicit_layout(storage_class), 0, false, out_node);
+	}
+
+	spvcpu::result add_type(uint32_t id, const type_data& data, uint32_t register_words) noexcept
+	{
+		type_info info;
+		info.data = data;
+		info.register_words = register_words;
+		info.register_node = ~0u;
+		info.explicit_node = ~0u;
+
+		m_type_indices[id] = m_types.size();
+
+		if (!m_types.append(info))
+			return spvcpu::result::no_memory;
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result lower_type(Op opcode, const uint32_t* word, uint32_t wordcount) noexcept
+	{
+		// word[1] is the result id for all type declarations
+		const uint32_t id = word[1];
+
+		type_data data;
+
+		memset(&data, 0, sizeof(data));
+
+		uint32_t register_words = 0;
+
+		switch (opcode)
+		{
+		case Op::TypeVoid:
+		{
+			data.m_type = spird::arg_type::VOID;
+
+			break;
+		}
+		case Op::TypeBool:
+		{
+			data.m_type = spird::arg_type::BOOL;
+
+			register_words = 1;
+
+			break;
+		}
+		case Op::TypeInt:
+		{
+			if (wordcount < 4)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (word[2] != 8 && word[2] != 16 && word[2] != 32 && word[2] != 64)
+				return spvcpu::result::incompatible_types;
+
+			data.m_type = spird::arg_type::INT;
+
+			data.m_data.int_data.width = static_cast<uint8_t>(word[2]);
+
+			data.m_data.int_data.is_signed = word[3] != 0;
+
+			register_words = word[2] == 64 ? 2 : 1;
+
+			break;
+		}
+		case Op::TypeFloat:
+		{
+			if (wordcount < 3)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (word[2] != 32 && word[2] != 64)
+				return spvcpu::result::unhandled_float_width;
+
+			data.m_type = spird::arg_type::FLOAT;
+
+			data.m_data.float_data.width = static_cast<uint8_t>(word[2]);
+
+			register_words = word[2] == 64 ? 2 : 1;
+
+			break;
+		}
+		case Op::TypeVector:
+		{
+			if (wordcount < 4)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			const type_info* component = get_type(word[2]);
+
+			if (component == nullptr)
+				return spvcpu::result::id_not_found;
+
+			data.m_type = spird::arg_type::VECTOR;
+
+			data.m_data.vector_data.component_type = component->data.m_type;
+
+			if (component->data.m_type == spird::arg_type::INT)
+				data.m_data.vector_data.int_component = component->data.m_data.int_data;
+			else if (component->data.m_type == spird::arg_type::FLOAT)
+				data.m_data.vector_data.float_component = component->data.m_data.float_data;
+			else if (component->data.m_type != spird::arg_type::BOOL)
+				return spvcpu::result::incompatible_types;
+
+			data.m_data.vector_data.component_count = static_cast<uint8_t>(word[3]);
+
+			register_words = component->register_words * word[3];
+
+			break;
+		}
+		case Op::TypeMatrix:
+		{
+			if (wordcount < 4)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			const type_info* column = get_type(word[2]);
+
+			if (column == nullptr)
+				return spvcpu::result::id_not_found;
+
+			if (column->data.m_type != spird::arg_type::VECTOR)
+				return spvcpu::result::incompatible_types;
+
+			data.m_type = spird::arg_type::MATRIX;
+
+			data.m_data.matrix_data.column_data = column->data.m_data.vector_data;
+
+			data.m_data.matrix_data.column_count = static_cast<uint8_t>(word[3]);
+
+			register_words = column->register_words * word[3];
+
+			break;
+		}
+		case Op::TypeImage:
+		{
+			if (wordcount < 9)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			const type_info* sampled = get_type(word[2]);
+
+			if (sampled == nullptr)
+				return spvcpu::result::id_not_found;
+
+			data.m_type = spird::arg_type::IMAGE;
+
+			data.m_data.image_data.sample_type = sampled->data.m_type;
+
+			if (sampled->data.m_type == spird::arg_type::INT)
+				data.m_data.image_data.sample_int = sampled->data.m_data.int_data;
+			else if (sampled->data.m_type == spird::arg_type::FLOAT)
+				data.m_data.image_data.sample_float = sampled->data.m_data.float_data;
+
+			data.m_data.image_data.dim = static_cast<uint8_t>(word[3]);
+
+			data.m_data.image_data.depth = static_cast<uint8_t>(word[4]);
+
+			data.m_data.image_data.arrayed = static_cast<uint8_t>(word[5]);
+
+			data.m_data.image_data.ms = static_cast<uint8_t>(word[6]);
+
+			data.m_data.image_data.sampled = static_cast<uint8_t>(word[7]);
+
+			data.m_data.image_data.format = static_cast<uint8_t>(word[8]);
+
+			data.m_data.image_data.access_qualifier = wordcount > 9 ? static_cast<uint8_t>(word[9]) : 0xFF;
+
+			register_words = 2;
+
+			break;
+		}
+		case Op::TypeSampler:
+		{
+			data.m_type = spird::arg_type::SAMPLER;
+
+			register_words = 2;
+
+			break;
+		}
+		case Op::TypeSampledImage:
+		{
+			const type_info* image = get_type(word[2]);
+
+			if (image == nullptr || image->data.m_type != spird::arg_type::IMAGE)
+				return spvcpu::result::incompatible_types;
+
+			data.m_type = spird::arg_type::SAMPLEDIMAGE;
+
+			data.m_data.sampled_image_data = image->data.m_data.image_data;
+
+			register_words = 2;
+
+			break;
+		}
+		case Op::TypeArray:
+		{
+			if (wordcount < 4)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			const type_info* element = get_type(word[2]);
+
+			if (element == nullptr)
+				return spvcpu::result::id_not_found;
+
+			if (spvcpu::result rst = check_id(word[3]); rst != spvcpu::result::success)
+				return rst;
+
+			if (m_constant_ids[word[3]] == 0)
+				return spvcpu::result::expected_constant;
+
+			const uint32_t* length_value = initial_value(word[3]);
+
+			uint64_t length = length_value[0];
+
+			if (value_words(word[3]) == 2)
+				length |= static_cast<uint64_t>(length_value[1]) << 32;
+
+			data.m_type = spird::arg_type::ARRAY;
+
+			data.m_data.array_data.element_id = word[2];
+
+			data.m_data.array_data.length = length;
+
+			register_words = static_cast<uint32_t>(element->register_words * length);
+
+			break;
+		}
+		case Op::TypeRuntimeArray:
+		{
+			if (get_type(word[2]) == nullptr)
+				return spvcpu::result::id_not_found;
+
+			data.m_type = spird::arg_type::RUNTIMEARRAY;
+
+			data.m_data.runtime_array_data.element_id = word[2];
+
+			break;
+		}
+		case Op::TypeStruct:
+		{
+			data.m_type = spird::arg_type::STRUCT;
+
+			data.m_data.struct_data.element_count = wordcount - 2;
+
+			data.m_data.struct_data.elements = word + 2;
+
+			for (uint32_t i = 2; i != wordcount; ++i)
+			{
+				const type_info* member = get_type(word[i]);
+
+				if (member == nullptr)
+					return spvcpu::result::id_not_found;
+
+				register_words += member->register_words;
+			}
+
+			break;
+		}
+		case Op::TypePointer:
+		{
+			if (wordcount < 4)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			data.m_type = spird::arg_type::POINTER;
+
+			data.m_data.pointer_data.storage_class = word[2];
+
+			data.m_data.pointer_data.pointee_id = word[3];
+
+			register_words = 2;
+
+			break;
+		}
+		case Op::TypeFunction:
+		{
+			data.m_type = spird::arg_type::FUNCTION;
+
+			data.m_data.function_data.return_type_id = word[2];
+
+			data.m_data.function_data.argc = static_cast<uint8_t>(wordcount - 3);
+
+			data.m_data.function_data.argv_ids = word + 3;
+
+			break;
+		}
+		case Op::TypeForwardPointer:
+		{
+			return spvcpu::result::success;
+		}
+		default:
+		{
+			return spvcpu::result::unhandled_opcode;
+		}
+		}
+
+		return add_type(id, data, register_words);
+	}
+
+	spvcpu::result lower_constant(Op opcode, uint32_t rtype, uint32_t rst, const uint32_t* operands, uint32_t operand_cnt) noexcept
+	{
+		const type_info* type = get_type(rtype);
+
+		if (type == nullptr)
+			return spvcpu::result::id_not_found;
+
+		if (spvcpu::result r = allocate_register(rst, type->register_words); r != spvcpu::result::success)
+			return r;
+
+		switch (opcode)
+		{
+		case Op::ConstantTrue:
+		case Op::SpecConstantTrue:
+		{
+			initial_value(rst)[0] = 1;
+
+			break;
+		}
+		case Op::ConstantFalse:
+		case Op::SpecConstantFalse:
+		case Op::ConstantNull:
+		case Op::Undef:
+		{
+			break;
+		}
+		case Op::Constant:
+		case Op::SpecConstant:
+		{
+			const scalar_kind kind = kind_of(type);
+
+			if (kind == scalar_kind::none || operand_cnt < scalar_words(kind))
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			uint32_t* value = initial_value(rst);
+
+			value[0] = operands[0];
+
+			if (kind == scalar_kind::i8)
+				value[0] &= 0xFF;
+			else if (kind == scalar_kind::i16)
+				value[0] &= 0xFFFF;
+			else if (scalar_words(kind) == 2)
+				value[1] = operands[1];
+
+			break;
+		}
+		case Op::ConstantComposite:
+		{
+			uint32_t offset = 0;
+
+			for (uint32_t i = 0; i != operand_cnt; ++i)
+			{
+				if (spvcpu::result r = check_id(operands[i]); r != spvcpu::result::success)
+					return r;
+
+				const uint32_t words = value_words(operands[i]);
+
+				if (offset + words > type->register_words || m_constant_ids[operands[i]] == 0)
+					return spvcpu::result::incompatible_types;
+
+				memcpy(initial_value(rst) + offset, initial_value(operands[i]), words * 4);
+
+				offset += words;
+			}
+
+			break;
+		}
+		case Op::SpecConstantComposite:
+		{
+			// Constituents may be results of OpSpecConstantOp, which are only known once
+			// the prologue has run, so construct the composite in the prologue as well.
+			return lower_code(Op::CompositeConstruct, rtype, rst, operands, operand_cnt);
+		}
+		case Op::SpecConstantOp:
+		{
+			if (operand_cnt < 1)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			return lower_code(static_cast<Op>(operands[0]), rtype, rst, operands + 1, operand_cnt - 1);
+		}
+		default:
+		{
+			return spvcpu::result::unknown_constant_instruction;
+		}
+		}
+
+		m_constant_ids[rst] = 1;
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result lower_variable(uint32_t rtype, uint32_t rst, const uint32_t* operands, uint32_t operand_cnt) noexcept
+	{
+		if (operand_cnt < 1)
+			return spvcpu::result::instruction_wordcount_mismatch;
+
+		if (spvcpu::result r = allocate_register(rst, 2); r != spvcpu::result::success)
+			return r;
+
+		program_variable var;
+		var.id = rst;
+		var.storage_class = static_cast<StorageClass>(operands[0]);
+		var.memory_offset = ~0u;
+		var.descriptor_set = 0;
+		var.binding = 0;
+		var.builtin = ~0u;
+		var.initializer = 0;
+		var.is_image = false;
+
+		if (spvcpu::result r = pointee_node(rtype, &var.node, nullptr); r != spvcpu::result::success)
+			return r;
+
+		const type_info* pointee = get_type(get_type(rtype)->data.m_data.pointer_data.pointee_id);
+
+		find_decoration(rst, ~0u, Decoration::DescriptorSet, &var.descriptor_set);
+
+		find_decoration(rst, ~0u, Decoration::Binding, &var.binding);
+
+		find_decoration(rst, ~0u, Decoration::BuiltIn, &var.builtin);
+
+		if (var.storage_class == StorageClass::UniformConstant)
+		{
+			if (pointee->data.m_type != spird::arg_type::IMAGE)
+				return spvcpu::result::incompatible_types;
+
+			if (pointee->data.m_data.image_data.format == static_cast<uint8_t>(ImageFormat::Unknown))
+				return spvcpu::result::unhandled_image_format;
+
+			var.is_image = true;
+		}
+
+		if (!is_binding_backed(var.storage_class))
+			var.memory_offset = allocate_memory(m_program->m_layout_nodes[var.node].memory_bytes);
+
+		m_pointer_nodes[rst] = var.node;
+
+		m_variable_indices[rst] = m_program->m_variables.size();
+
+		if (!m_program->m_variables.append(var))
+			return spvcpu::result::no_memory;
+
+		if (operand_cnt > 1)
+		{
+			if (spvcpu::result r = check_id(operands[1]); r != spvcpu::result::success)
+				return r;
+
+			// Global initializers are applied when the invocation is initialized.
+			// Function variables are (re-)initialized whenever their declaration
+			// is executed.
+			if (m_in_function)
+				return emit_store(rst, operands[1]);
+
+			m_program->m_variables[m_program->m_variables.size() - 1].initializer = operands[1];
+		}
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result lower_access_chain(uint32_t rst, const uint32_t* operands, uint32_t operand_cnt) noexcept
+	{
+		if (operand_cnt < 1)
+			return spvcpu::result::instruction_wordcount_mismatch;
+
+		const uint32_t base = operands[0];
+
+		if (spvcpu::result r = check_id(base); r != spvcpu::result::success)
+			return r;
+
+		uint32_t node = m_pointer_nodes[base];
+
+		if (node == ~0u)
+			return spvcpu::result::incompatible_types;
+
+		if (spvcpu::result r = allocate_register(rst, 2); r != spvcpu::result::success)
+			return r;
+
+		if (spvcpu::result r = emit_handler(handler_kind::access_chain, Op::AccessChain, scalar_kind::none, scalar_kind::none, 0, 0, { slot(rst), slot(base) }); r != spvcpu::result::success)
+			return r;
+
+		const uint32_t final_offset_operand = m_program->m_code.size();
+
+		if (spvcpu::result r = emit_operands({ 0 }); r != spvcpu::result::success)
+			return r;
+
+		uint32_t offset = 0;
+
+		for (uint32_t i = 1; i != operand_cnt; ++i)
+		{
+			const uint32_t index = operands[i];
+
+			if (spvcpu::result r = check_id(index); r != spvcpu::result::success)
+				return r;
+
+			const layout_node current = m_program->m_layout_nodes[node];
+
+			const bool is_constant = m_constant_ids[index] != 0;
+
+			uint64_t constant_index = 0;
+
+			if (is_constant)
+			{
+				constant_index = initial_value(index)[0];
+
+				if (value_words(index) == 2)
+					constant_index |= static_cast<uint64_t>(initial_value(index)[1]) << 32;
+			}
+
+			if (current.kind == layout_kind::structure)
+			{
+				if (!is_constant || constant_index >= current.count)
+					return spvcpu::result::expected_constant;
+
+				const layout_member& member = m_program->m_layout_members[current.element + static_cast<uint32_t>(constant_index)];
+
+				offset += member.memory_offset;
+
+				node = member.node;
+			}
+			else if (current.kind == layout_kind::vector || current.kind == layout_kind::matrix || current.kind == layout_kind::array || current.kind == layout_kind::runtime_array)
+			{
+				if (is_constant)
+				{
+					offset += static_cast<uint32_t>(constant_index) * current.stride;
+				}
+				else
+				{
+					if (spvcpu::result r = emit_operands({ offset, slot(index), current.stride, static_cast<uint32_t>(value_kind(index)) }); r != spvcpu::result::success)
+						return r;
+
+					offset = 0;
+				}
+
+				node = current.element;
+			}
+			else
+			{
+				return spvcpu::result::incompatible_types;
+			}
+		}
+
+		m_program->m_code[final_offset_operand] = offset;
+
+		m_pointer_nodes[rst] = node;
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result composite_offset(uint32_t type_id, const uint32_t* indices, uint32_t index_cnt, uint32_t* out_offset, uint32_t* out_type_id) const noexcept
+	{
+		uint32_t offset = 0;
+
+		for (uint32_t i = 0; i != index_cnt; ++i)
+		{
+			const type_info* type = get_type(type_id);
+
+			if (type == nullptr)
+				return spvcpu::result::id_not_found;
+
+			const raw_type_data& data = type->data.m_data;
+
+			switch (type->data.m_type)
+			{
+			case spird::arg_type::VECTOR:
+			{
+				if (indices[i] >= data.vector_data.component_count)
+					return spvcpu::result::incompatible_types;
+
+				offset += indices[i] * (type->register_words / data.vector_data.component_count);
+
+				// The component type has no id of its own here, so stop and report
+				// the composite itself; callers only need offsets of scalars.
+				*out_offset = offset;
+
+				*out_type_id = 0;
+
+				return i + 1 == index_cnt ? spvcpu::result::success : spvcpu::result::incompatible_types;
+			}
+			case spird::arg_type::MATRIX:
+			{
+				if (indices[i] >= data.matrix_data.column_count)
+					return spvcpu::result::incompatible_types;
+
+				const uint32_t column_words = type->register_words / data.matrix_data.column_count;
+
+				offset += indices[i] * column_words;
+
+				if (i + 1 == index_cnt)
+				{
+					*out_offset = offset;
+
+					*out_type_id = 0;
+
+					return spvcpu::result::success;
+				}
+
+				if (indices[i + 1] >= data.matrix_data.column_data.component_count)
+					return spvcpu::result::incompatible_types;
+
+				offset += indices[i + 1] * (column_words / data.matrix_data.column_data.component_count);
+
+				*out_offset = offset;
+
+				*out_type_id = 0;
+
+				return i + 2 == index_cnt ? spvcpu::result::success : spvcpu::result::incompatible_types;
+			}
+			case spird::arg_type::ARRAY:
+			{
+				if (indices[i] >= data.array_data.length)
+					return spvcpu::result::incompatible_types;
+
+				const type_info* element = get_type(data.array_data.element_id);
+
+				offset += indices[i] * element->register_words;
+
+				type_id = data.array_data.element_id;
+
+				break;
+			}
+			case spird::arg_type::STRUCT:
+			{
+				if (indices[i] >= data.struct_data.element_count)
+					return spvcpu::result::incompatible_types;
+
+				for (uint32_t j = 0; j != indices[i]; ++j)
+					offset += get_type(data.struct_data.elements[j])->register_words;
+
+				type_id = data.struct_data.elements[indices[i]];
+
+				break;
+			}
+			default:
+			{
+				return spvcpu::result::incompatible_types;
+			}
+			}
+		}
+
+		*out_offset = offset;
+
+		*out_type_id = type_id;
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result lower_image_format(uint32_t image_id, uint32_t* out_format) const noexcept
+	{
+		const type_info* type = get_value_type(image_id);
+
+		if (type == nullptr || type->data.m_type != spird::arg_type::IMAGE)
+			return spvcpu::result::incompatible_types;
+
+		if (type->data.m_data.image_data.format == static_cast<uint8_t>(ImageFormat::Unknown))
+			return spvcpu::result::unhandled_image_format;
+
+		*out_format = type->data.m_data.image_data.format;
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result lower_code(Op opcode, uint32_t rtype, uint32_t rst, const uint32_t* operands, uint32_t operand_cnt) noexcept
+	{
+		const type_info* type = get_type(rtype);
+
+		if (rst != 0)
+		{
+			if (type == nullptr)
+				return spvcpu::result::untyped_result;
+
+			if (spvcpu::result r = allocate_register(rst, type->register_words); r != spvcpu::result::success)
+				return r;
+		}
+
+		if (opcode != Op::Phi)
+			m_phi_insn = ~0u;
+
+		const scalar_kind kind = kind_of(type);
+
+		const uint32_t count = count_of(type);
+
+		#define CHECK_OPERANDS(n) if (operand_cnt < (n)) return spvcpu::result::instruction_wordcount_mismatch; for (uint32_t i_ = 0; i_ != (n); ++i_) if (operands[i_] == 0 || operands[i_] >= m_id_bound) return spvcpu::result::id_not_found
+
+		switch (opcode)
+		{
+		case Op::SNegate:
+		case Op::FNegate:
+		case Op::Not:
+		case Op::LogicalNot:
+		case Op::IsNan:
+		case Op::IsInf:
+		case Op::IsFinite:
+		case Op::ConvertFToU:
+		case Op::ConvertFToS:
+		case Op::ConvertSToF:
+		case Op::ConvertUToF:
+		case Op::UConvert:
+		case Op::SConvert:
+		case Op::FConvert:
+		case Op::BitReverse:
+		case Op::BitCount:
+		case Op::Any:
+		case Op::All:
+		{
+			CHECK_OPERANDS(1);
+
+			// Any and All reduce over their operand's components
+			const uint32_t insn_count = opcode == Op::Any || opcode == Op::All ? value_count(operands[0]) : count;
+
+			return emit_handler(unary_handler(opcode, kind, value_kind(operands[0])), opcode, kind, value_kind(operands[0]), insn_count, 0, { slot(rst), slot(operands[0]) });
+		}
+		case Op::IAdd:
+		case Op::ISub:
+		case Op::IMul:
+		case Op::UDiv:
+		case Op::SDiv:
+		case Op::UMod:
+		case Op::SRem:
+		case Op::SMod:
+		case Op::FAdd:
+		case Op::FSub:
+		case Op::FMul:
+		case Op::FDiv:
+		case Op::FRem:
+		case Op::FMod:
+		case Op::ShiftRightLogical:
+		case Op::ShiftRightArithmetic:
+		case Op::ShiftLeftLogical:
+		case Op::BitwiseOr:
+		case Op::BitwiseXor:
+		case Op::BitwiseAnd:
+		case Op::LogicalEqual:
+		case Op::LogicalNotEqual:
+		case Op::LogicalOr:
+		case Op::LogicalAnd:
+		case Op::IEqual:
+		case Op::INotEqual:
+		case Op::UGreaterThan:
+		case Op::SGreaterThan:
+		case Op::UGreaterThanEqual:
+		case Op::SGreaterThanEqual:
+		case Op::ULessThan:
+		case Op::SLessThan:
+		case Op::ULessThanEqual:
+		case Op::SLessThanEqual:
+		case Op::FOrdEqual:
+		case Op::FUnordEqual:
+		case Op::FOrdNotEqual:
+		case Op::FUnordNotEqual:
+		case Op::FOrdLessThan:
+		case Op::FUnordLessThan:
+		case Op::FOrdGreaterThan:
+		case Op::FUnordGreaterThan:
+		case Op::FOrdLessThanEqual:
+		case Op::FUnordLessThanEqual:
+		case Op::FOrdGreaterThanEqual:
+		case Op::FUnordGreaterThanEqual:
+		{
+			CHECK_OPERANDS(2);
+
+			return emit_handler(binary_handler(opcode, value_kind(operands[0]), value_kind(operands[1])), opcode, value_kind(operands[0]), value_kind(operands[1]), count, 0, { slot(rst), slot(operands[0]), slot(operands[1]) });
+		}
+		case Op::Select:
+		{
+			CHECK_OPERANDS(3);
+
+			const uint32_t condition_count = value_count(operands[0]);
+
+			if (condition_count > 1)
+				return emit_handler(handler_kind::select, opcode, kind, scalar_kind::boolean, condition_count, 0, { slot(rst), slot(operands[0]), slot(operands[1]), slot(operands[2]), scalar_words(kind) });
+
+			return emit_handler(handler_kind::select, opcode, kind, scalar_kind::boolean, 1, 0, { slot(rst), slot(operands[0]), slot(operands[1]), slot(operands[2]), type->register_words });
+		}
+		case Op::Bitcast:
+		{
+			CHECK_OPERANDS(1);
+
+			const scalar_kind src_kind = value_kind(operands[0]);
+
+			// Bitcasts between types without narrow components do not change the
+			// register representation.
+			if (scalar_words(kind) * count == value_words(operands[0]) && kind != scalar_kind::i8 && kind != scalar_kind::i16 && src_kind != scalar_kind::i8 && src_kind != scalar_kind::i16)
+				return emit_handler(handler_kind::copy_words, Op::CopyObject, kind, kind, count, 0, { slot(rst), slot(operands[0]), type->register_words });
+
+			return emit(opcode, kind, src_kind, count, value_count(operands[0]), { slot(rst), slot(operands[0]) });
+		}
+		case Op::CopyObject:
+		case Op::CopyLogical:
+		{
+			CHECK_OPERANDS(1);
+
+			m_pointer_nodes[rst] = m_pointer_nodes[operands[0]];
+
+			return emit_handler(handler_kind::copy_words, Op::CopyObject, kind, kind, count, 0, { slot(rst), slot(operands[0]), type->register_words });
+		}
+		case Op::VectorTimesScalar:
+		case Op::MatrixTimesScalar:
+		case Op::Dot:
+		case Op::OuterProduct:
+		{
+			CHECK_OPERANDS(2);
+
+			const uint32_t insn_count = opcode == Op::Dot || opcode == Op::OuterProduct ? value_count(operands[0]) : count;
+
+			const uint32_t insn_aux = opcode == Op::OuterProduct ? value_count(operands[1]) : 0;
+
+			const handler_kind h = opcode == Op::VectorTimesScalar && kind == scalar_kind::f32 ? handler_kind::vector_times_scalar_f32 : handler_kind::generic;
+
+			return emit_handler(h, opcode, kind, kind, insn_count, insn_aux, { slot(rst), slot(operands[0]), slot(operands[1]) });
+		}
+		case Op::VectorTimesMatrix:
+		{
+			CHECK_OPERANDS(2);
+
+			return emit(opcode, kind, kind, count, value_count(operands[0]), { slot(rst), slot(operands[0]), slot(operands[1]) });
+		}
+		case Op::MatrixTimesVector:
+		{
+			CHECK_OPERANDS(2);
+
+			return emit(opcode, kind, kind, count, value_count(operands[1]), { slot(rst), slot(operands[0]), slot(operands[1]) });
+		}
+		case Op::MatrixTimesMatrix:
+		{
+			CHECK_OPERANDS(2);
+
+			const type_info* lhs = get_value_type(operands[0]);
+
+			const type_info* rhs = get_value_type(operands[1]);
+
+			if (lhs->data.m_type != spird::arg_type::MATRIX || rhs->data.m_type != spird::arg_type::MATRIX)
+				return spvcpu::result::incompatible_types;
+
+			const uint32_t rows = lhs->data.m_data.matrix_data.column_data.component_count;
+
+			return emit(opcode, kind, kind, rows, lhs->data.m_data.matrix_data.column_count, { slot(rst), slot(operands[0]), slot(operands[1]), rhs->data.m_data.matrix_data.column_count });
+		}
+		case Op::Transpose:
+		{
+			CHECK_OPERANDS(1);
+
+			const type_info* src = get_value_type(operands[0]);
+
+			if (src->data.m_type != spird::arg_type::MATRIX)
+				return spvcpu::result::incompatible_types;
+
+			return emit(opcode, kind, kind, src->data.m_data.matrix_data.column_data.component_count, src->data.m_data.matrix_data.column_count, { slot(rst), slot(operands[0]) });
+		}
+		case Op::CompositeExtract:
+		{
+			CHECK_OPERANDS(1);
+
+			uint32_t offset, member_type;
+
+			if (spvcpu::result r = composite_offset(m_result_types[operands[0]], operands + 1, operand_cnt - 1, &offset, &member_type); r != spvcpu::result::success)
+				return r;
+
+			// Slots are word offsets, so extracting a member is a copy from the
+			// composite's slot displaced by the member's offset.
+			return emit_handler(handler_kind::copy_words, Op::CopyObject, kind, kind, count, 0, { slot(rst), slot(operands[0]) + offset, type->register_words });
+		}
+		case Op::CompositeInsert:
+		{
+			CHECK_OPERANDS(2);
+
+			uint32_t offset, member_type;
+
+			if (spvcpu::result r = composite_offset(m_result_types[operands[1]], operands + 2, operand_cnt - 2, &offset, &member_type); r != spvcpu::result::success)
+				return r;
+
+			return emit(opcode, kind, kind, count, 0, { slot(rst), slot(operands[0]), slot(operands[1]), offset, value_words(operands[0]), type->register_words });
+		}
+		case Op::CompositeConstruct:
+		{
+			if (spvcpu::result r = emit(opcode, kind, kind, count, 0, { slot(rst) }); r != spvcpu::result::success)
+				return r;
+
+			for (uint32_t i = 0; i != operand_cnt; ++i)
+			{
+				if (spvcpu::result r = check_id(operands[i]); r != spvcpu::result::success)
+					return r;
+
+				if (spvcpu::result r = emit_operands({ slot(operands[i]), value_words(operands[i]) }); r != spvcpu::result::success)
+					return r;
+			}
+
+			return spvcpu::result::success;
+		}
+		case Op::VectorShuffle:
+		{
+			CHECK_OPERANDS(2);
+
+			if (spvcpu::result r = emit(opcode, kind, kind, operand_cnt - 2, 0, { slot(rst), slot(operands[0]), slot(operands[1]), value_count(operands[0]) }); r != spvcpu::result::success)
+				return r;
+
+			for (uint32_t i = 2; i != operand_cnt; ++i)
+				if (spvcpu::result r = emit_operands({ operands[i] }); r != spvcpu::result::success)
+					return r;
+
+			return spvcpu::result::success;
+		}
+		case Op::VectorExtractDynamic:
+		{
+			CHECK_OPERANDS(2);
+
+			return emit(opcode, kind, value_kind(operands[1]), value_count(operands[0]), 0, { slot(rst), slot(operands[0]), slot(operands[1]) });
+		}
+		case Op::VectorInsertDynamic:
+		{
+			CHECK_OPERANDS(3);
+
+			return emit(opcode, kind, value_kind(operands[2]), count, 0, { slot(rst), slot(operands[0]), slot(operands[1]), slot(operands[2]) });
+		}
+		case Op::Load:
+		{
+			CHECK_OPERANDS(1);
+
+			if (m_pointer_nodes[operands[0]] == ~0u)
+				return spvcpu::result::incompatible_types;
+
+			const layout_node& node = m_program->m_layout_nodes[m_pointer_nodes[operands[0]]];
+
+			if (node.is_trivial)
+				return emit_handler(handler_kind::load_trivial, opcode, kind, kind, count, 0, { slot(rst), slot(operands[0]), node.register_words });
+
+			return emit(opcode, kind, kind, count, 0, { slot(rst), slot(operands[0]), m_pointer_nodes[operands[0]] });
+		}
+		case Op::Store:
+		{
+			CHECK_OPERANDS(2);
+
+			return emit_store(operands[0], operands[1]);
+		}
+		case Op::AccessChain:
+		case Op::InBoundsAccessChain:
+		{
+			return lower_access_chain(rst, operands, operand_cnt);
+		}
+		case Op::CopyMemory:
+		{
+			CHECK_OPERANDS(2);
+
+			const uint32_t target_node = m_pointer_nodes[operands[0]];
+
+			const uint32_t source_node = m_pointer_nodes[operands[1]];
+
+			if (target_node == ~0u || source_node == ~0u)
+				return spvcpu::result::incompatible_types;
+
+			const uint32_t words = m_program->m_layout_nodes[source_node].register_words;
+
+			if (words > m_program->m_scratch_words)
+				m_program->m_scratch_words = words;
+
+			return emit(opcode, scalar_kind::none, scalar_kind::none, 0, 0, { slot(operands[0]), slot(operands[1]), target_node, source_node });
+		}
+		case Op::ArrayLength:
+		{
+			CHECK_OPERANDS(1);
+
+			if (operand_cnt < 2)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			const uint32_t variable_index = m_variable_indices[operands[0]];
+
+			if (variable_index == ~0u)
+				return spvcpu::result::incompatible_types;
+
+			const layout_node& structure = m_program->m_layout_nodes[m_program->m_variables[variable_index].node];
+
+			if (structure.kind != layout_kind::structure || operands[1] >= structure.count)
+				return spvcpu::result::incompatible_types;
+
+			const layout_member& member = m_program->m_layout_members[structure.element + operands[1]];
+
+			return emit(opcode, kind, kind, 1, 0, { slot(rst), variable_index, member.memory_offset, m_program->m_layout_nodes[member.node].stride });
+		}
+		case Op::Branch:
+		{
+			if (operand_cnt < 1)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (spvcpu::result r = emit_handler(handler_kind::branch, opcode, scalar_kind::none, scalar_kind::none, 0, 0, { m_curr_block }); r != spvcpu::result::success)
+				return r;
+
+			return emit_label_operand(operands[0]);
+		}
+		case Op::BranchConditional:
+		{
+			CHECK_OPERANDS(1);
+
+			if (operand_cnt < 3)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (spvcpu::result r = emit_handler(handler_kind::branch_conditional, opcode, scalar_kind::none, scalar_kind::none, 0, 0, { m_curr_block, slot(operands[0]) }); r != spvcpu::result::success)
+				return r;
+
+			if (spvcpu::result r = emit_label_operand(operands[1]); r != spvcpu::result::success)
+				return r;
+
+			return emit_label_operand(operands[2]);
+		}
+		case Op::Switch:
+		{
+			CHECK_OPERANDS(1);
+
+			if (operand_cnt < 2)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			const scalar_kind selector_kind = value_kind(operands[0]);
+
+			const uint32_t literal_words = scalar_words(selector_kind);
+
+			if ((operand_cnt - 2) % (literal_words + 1) != 0)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (spvcpu::result r = emit(opcode, scalar_kind::none, selector_kind, (operand_cnt - 2) / (literal_words + 1), 0, { m_curr_block, slot(operands[0]) }); r != spvcpu::result::success)
+				return r;
+
+			if (spvcpu::result r = emit_label_operand(operands[1]); r != spvcpu::result::success)
+				return r;
+
+			for (uint32_t i = 2; i != operand_cnt; i += literal_words + 1)
+			{
+				if (spvcpu::result r = emit_operands({ operands[i], literal_words == 2 ? operands[i + 1] : 0 }); r != spvcpu::result::success)
+					return r;
+
+				if (spvcpu::result r = emit_label_operand(operands[i + literal_words]); r != spvcpu::result::success)
+					return r;
+			}
+
+			return spvcpu::result::success;
+		}
+		case Op::Return:
+		case Op::Kill:
+		case Op::TerminateInvocation:
+		case Op::Unreachable:
+		{
+			return emit(opcode == Op::Return ? Op::Return : Op::Kill, scalar_kind::none, scalar_kind::none, 0, 0, {});
+		}
+		case Op::ReturnValue:
+		{
+			CHECK_OPERANDS(1);
+
+			return emit(opcode, scalar_kind::none, scalar_kind::none, 0, 0, { slot(operands[0]), value_words(operands[0]) });
+		}
+		case Op::Phi:
+		{
+			if (operand_cnt & 1)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (m_phi_insn == ~0u)
+			{
+				m_phi_words = 0;
+
+				if (spvcpu::result r = emit_handler(handler_kind::phi, opcode, scalar_kind::none, scalar_kind::none, 0, 0, {}); r != spvcpu::result::success)
+					return r;
+
+				m_phi_insn = m_curr_insn;
+			}
+
+			if (spvcpu::result r = emit_operands({ slot(rst), type->register_words, operand_cnt / 2 }); r != spvcpu::result::success)
+				return r;
+
+			for (uint32_t i = 0; i != operand_cnt; i += 2)
+			{
+				if (spvcpu::result r = check_id(operands[i]); r != spvcpu::result::success)
+					return r;
+
+				if (spvcpu::result r = emit_operands({ slot(operands[i]), operands[i + 1] }); r != spvcpu::result::success)
+					return r;
+			}
+
+			m_phi_words += type->register_words;
+
+			if (m_phi_words > m_program->m_scratch_words)
+				m_program->m_scratch_words = m_phi_words;
+
+			++curr_insn()->count;
+
+			return spvcpu::result::success;
+		}
+		case Op::FunctionCall:
+		{
+			CHECK_OPERANDS(1);
+
+			if (spvcpu::result r = emit(opcode, scalar_kind::none, scalar_kind::none, operand_cnt - 1, 0, { type->register_words == 0 ? 0 : slot(rst) }); r != spvcpu::result::success)
+				return r;
+
+			if (spvcpu::result r = emit_function_operand(operands[0], ~0u); r != spvcpu::result::success)
+				return r;
+
+			if (spvcpu::result r = emit_operands({ type->register_words }); r != spvcpu::result::success)
+				return r;
+
+			for (uint32_t i = 1; i != operand_cnt; ++i)
+			{
+				if (spvcpu::result r = check_id(operands[i]); r != spvcpu::result::success)
+					return r;
+
+				if (spvcpu::result r = emit_operands({ slot(operands[i]) }); r != spvcpu::result::success)
+					return r;
+
+				if (spvcpu::result r = emit_function_operand(operands[0], i - 1); r != spvcpu::result::success)
+					return r;
+
+				if (spvcpu::result r = emit_operands({ value_words(operands[i]) }); r != spvcpu::result::success)
+					return r;
+			}
+
+			return spvcpu::result::success;
+		}
+		case Op::ExtInst:
+		{
+			if (operand_cnt < 2)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (operands[0] != m_glsl_set_id)
+				return spvcpu::result::unhandled_ext_inst;
+
+			scalar_kind arg_kind = scalar_kind::none;
+
+			uint32_t arg_count = 0;
+
+			if (operand_cnt > 2)
+			{
+				if (spvcpu::result r = check_id(operands[2]); r != spvcpu::result::success)
+					return r;
+
+				arg_kind = value_kind(operands[2]);
+
+				arg_count = value_count(operands[2]);
+			}
+
+			if (spvcpu::result r = emit(opcode, kind, arg_kind, arg_count, operands[1], { slot(rst) }); r != spvcpu::result::success)
+				return r;
+
+			for (uint32_t i = 2; i != operand_cnt; ++i)
+			{
+				if (spvcpu::result r = check_id(operands[i]); r != spvcpu::result::success)
+					return r;
+
+				if (spvcpu::result r = emit_operands({ slot(operands[i]) }); r != spvcpu::result::success)
+					return r;
+			}
+
+			return spvcpu::result::success;
+		}
+		case Op::AtomicLoad:
+		case Op::AtomicIIncrement:
+		case Op::AtomicIDecrement:
+		{
+			CHECK_OPERANDS(1);
+
+			return emit(opcode, kind, kind, 1, 0, { slot(rst), slot(operands[0]) });
+		}
+		case Op::AtomicStore:
+		{
+			CHECK_OPERANDS(1);
+
+			if (operand_cnt < 4)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			return emit(opcode, value_kind(operands[3]), scalar_kind::none, 1, 0, { slot(operands[0]), slot(operands[3]) });
+		}
+		case Op::AtomicExchange:
+		case Op::AtomicIAdd:
+		case Op::AtomicISub:
+		case Op::AtomicSMin:
+		case Op::AtomicUMin:
+		case Op::AtomicSMax:
+		case Op::AtomicUMax:
+		case Op::AtomicAnd:
+		case Op::AtomicOr:
+		case Op::AtomicXor:
+		{
+			CHECK_OPERANDS(1);
+
+			if (operand_cnt < 4)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			return emit(opcode, kind, kind, 1, 0, { slot(rst), slot(operands[0]), slot(operands[3]) });
+		}
+		case Op::AtomicCompareExchange:
+		case Op::AtomicCompareExchangeWeak:
+		{
+			CHECK_OPERANDS(1);
+
+			if (operand_cnt < 6)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			return emit(Op::AtomicCompareExchange, kind, kind, 1, 0, { slot(rst), slot(operands[0]), slot(operands[4]), slot(operands[5]) });
+		}
+		case Op::ControlBarrier:
+		{
+			CHECK_OPERANDS(1);
+
+			// Scopes are practically always constants. Anything else is
+			// conservatively treated as synchronizing the whole workgroup.
+			const bool is_workgroup = m_constant_ids[operands[0]] == 0 || initial_value(operands[0])[0] <= static_cast<uint32_t>(Scope::Workgroup);
+
+			return emit(opcode, scalar_kind::none, scalar_kind::none, 0, is_workgroup ? 1 : 0, {});
+		}
+		case Op::MemoryBarrier:
+		{
+			return emit(opcode, scalar_kind::none, scalar_kind::none, 0, 0, {});
+		}
+		case Op::GroupNonUniformElect:
+		{
+			return emit(opcode, kind, kind, 1, 0, { slot(rst) });
+		}
+		case Op::GroupNonUniformAll:
+		case Op::GroupNonUniformAny:
+		case Op::GroupNonUniformAllEqual:
+		case Op::GroupNonUniformBroadcastFirst:
+		case Op::GroupNonUniformBallot:
+		case Op::GroupNonUniformInverseBallot:
+		case Op::GroupNonUniformBallotFindLSB:
+		case Op::GroupNonUniformBallotFindMSB:
+		{
+			CHECK_OPERANDS(2);
+
+			return emit(opcode, kind, value_kind(operands[1]), value_count(operands[1]), 0, { slot(rst), slot(operands[1]) });
+		}
+		case Op::GroupNonUniformBroadcast:
+		case Op::GroupNonUniformBallotBitExtract:
+		case Op::GroupNonUniformShuffle:
+		case Op::GroupNonUniformShuffleXor:
+		case Op::GroupNonUniformShuffleUp:
+		case Op::GroupNonUniformShuffleDown:
+		case Op::GroupNonUniformQuadBroadcast:
+		case Op::GroupNonUniformQuadSwap:
+		{
+			CHECK_OPERANDS(2);
+
+			if (operand_cnt < 3)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			return emit(opcode, kind, value_kind(operands[1]), value_count(operands[1]), 0, { slot(rst), slot(operands[1]), slot(operands[2]) });
+		}
+		case Op::GroupNonUniformBallotBitCount:
+		case Op::GroupNonUniformIAdd:
+		case Op::GroupNonUniformFAdd:
+		case Op::GroupNonUniformIMul:
+		case Op::GroupNonUniformFMul:
+		case Op::GroupNonUniformSMin:
+		case Op::GroupNonUniformUMin:
+		case Op::GroupNonUniformFMin:
+		case Op::GroupNonUniformSMax:
+		case Op::GroupNonUniformUMax:
+		case Op::GroupNonUniformFMax:
+		case Op::GroupNonUniformBitwiseAnd:
+		case Op::GroupNonUniformBitwiseOr:
+		case Op::GroupNonUniformBitwiseXor:
+		case Op::GroupNonUniformLogicalAnd:
+		case Op::GroupNonUniformLogicalOr:
+		case Op::GroupNonUniformLogicalXor:
+		{
+			if (operand_cnt < 3)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (spvcpu::result r = check_id(operands[2]); r != spvcpu::result::success)
+				return r;
+
+			return emit(opcode, kind, value_kind(operands[2]), value_count(operands[2]), operands[1], { slot(rst), slot(operands[2]) });
+		}
+		case Op::ImageRead:
+		{
+			CHECK_OPERANDS(2);
+
+			uint32_t format;
+
+			if (spvcpu::result r = lower_image_format(operands[0], &format); r != spvcpu::result::success)
+				return r;
+
+			return emit(opcode, kind, value_kind(operands[1]), count, format, { slot(rst), slot(operands[0]), slot(operands[1]), value_count(operands[1]) });
+		}
+		case Op::ImageWrite:
+		{
+			CHECK_OPERANDS(3);
+
+			uint32_t format;
+
+			if (spvcpu::result r = lower_image_format(operands[0], &format); r != spvcpu::result::success)
+				return r;
+
+			return emit(opcode, value_kind(operands[2]), value_kind(operands[1]), value_count(operands[2]), format, { slot(operands[0]), slot(operands[1]), slot(operands[2]), value_count(operands[1]) });
+		}
+		case Op::ImageQuerySize:
+		case Op::ImageQuerySizeLod:
+		{
+			CHECK_OPERANDS(1);
+
+			return emit(Op::ImageQuerySize, kind, kind, count, 0, { slot(rst), slot(operands[0]) });
+		}
+		default:
+		{
+			return spvcpu::result::unhandled_opcode;
+		}
+		}
+
+		#undef CHECK_OPERANDS
+	}
+
+	spvcpu::result decode_result(const uint32_t* word, uint32_t wordcount, uint32_t* out_rtype, uint32_t* out_rst) noexcept
+	{
+		spird::elem_view op_data;
+
+		if (spvcpu::result rst = m_insn_views.get(m_spird, m_insn_loc, *word & 0xFFFF, &op_data); rst != spvcpu::result::success)
+			return rst;
+
+		// Result type and result id, if present, always make up the first two
+		// arguments, so they can be located without decoding the remaining ones.
+		uint32_t rtype = 0;
+
+		uint32_t rst = 0;
+
+		for (uint32_t arg = 0; arg != op_data.argc && arg != 2 && arg + 1 < wordcount; ++arg)
+		{
+			if (op_data.arg_types[arg] == spird::arg_type::RTYPE)
+				rtype = word[1 + arg];
+			else if ((op_data.arg_flags[arg] & spird::arg_flags::result) == spird::arg_flags::result)
+				rst = word[1 + arg];
+		}
+
+		if (rst >= m_id_bound)
+			return spvcpu::result::id_not_found;
+
+		*out_rtype = rtype;
+
+		*out_rst = rst;
+
+		return spvcpu::result::success;
+	}
+
+	// Assigns registers to the results of all instructions in function bodies.
+	// This happens before any function is lowered, so that every operand,
+	// including forward references from OpPhi, can be resolved to its slot as it
+	// is emitted. Since all constants are declared before the first function,
+	// they end up forming a contiguous pool at the start of the register file.
+	spvcpu::result allocate_function_registers(const uint32_t* word) noexcept
+	{
+		m_program->m_pool_words = m_program->m_initial_registers.size();
+
+		while (word < m_word_end)
+		{
+			const uint32_t wordcount = *word >> 16;
+
+			if (wordcount == 0)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (word + wordcount > m_word_end)
+				return spvcpu::result::instruction_past_data_end;
+
+			uint32_t rtype;
+
+			uint32_t rst;
+
+			if (spvcpu::result r = decode_result(word, wordcount, &rtype, &rst); r != spvcpu::result::success)
+				return r;
+
+			if (rst != 0 && static_cast<Op>(*word & 0xFFFF) != Op::Function)
+			{
+				const type_info* type = get_type(rtype);
+
+				if (type != nullptr)
+					if (spvcpu::result r = allocate_register(rst, type->register_words); r != spvcpu::result::success)
+						return r;
+			}
+
+			word += wordcount;
+		}
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result emit_store(uint32_t pointer_id, uint32_t value_id) noexcept
+	{
+		if (spvcpu::result r = check_id(pointer_id); r != spvcpu::result::success)
+			return r;
+
+		if (spvcpu::result r = check_id(value_id); r != spvcpu::result::success)
+			return r;
+
+		const uint32_t node_index = m_pointer_nodes[pointer_id];
+
+		if (node_index == ~0u)
+			return spvcpu::result::incompatible_types;
+
+		const layout_node& node = m_program->m_layout_nodes[node_index];
+
+		if (node.is_trivial)
+			return emit_handler(handler_kind::store_trivial, Op::Store, scalar_kind::none, scalar_kind::none, 0, 0, { slot(pointer_id), slot(value_id), node.register_words });
+
+		return emit(Op::Store, scalar_kind::none, scalar_kind::none, 0, 0, { slot(pointer_id), slot(value_id), node_index });
+	}
+
+	static handler_kind unary_handler(Op opcode, scalar_kind kind, scalar_kind src_kind) noexcept
+	{
+		if (opcode == Op::LogicalNot)
+			return handler_kind::logical_not;
+
+		if (opcode == Op::FNegate && kind == scalar_kind::f32)
+			return handler_kind::fnegate_f32;
+
+		if (opcode == Op::ConvertSToF && kind == scalar_kind::f32 && src_kind == scalar_kind::i32)
+			return handler_kind::convert_s32_to_f32;
+
+		if (opcode == Op::ConvertUToF && kind == scalar_kind::f32 && src_kind == scalar_kind::i32)
+			return handler_kind::convert_u32_to_f32;
+
+		if (opcode == Op::ConvertFToS && kind == scalar_kind::i32 && src_kind == scalar_kind::f32)
+			return handler_kind::convert_f32_to_s32;
+
+		if (opcode == Op::ConvertFToU && kind == scalar_kind::i32 && src_kind == scalar_kind::f32)
+			return handler_kind::convert_f32_to_u32;
+
+		return handler_kind::generic;
+	}
+
+	static handler_kind binary_handler(Op opcode, scalar_kind kind, scalar_kind src_kind) noexcept
+	{
+		if (kind == scalar_kind::boolean)
+		{
+			switch (opcode)
+			{
+			case Op::LogicalEqual:    return handler_kind::ieq_32;
+			case Op::LogicalNotEqual: return handler_kind::ine_32;
+			case Op::LogicalOr:       return handler_kind::logical_or;
+			case Op::LogicalAnd:      return handler_kind::logical_and;
+			default:                  return handler_kind::generic;
+			}
+		}
+
+		if (kind == scalar_kind::i32 && src_kind == scalar_kind::i32)
+		{
+			switch (opcode)
+			{
+			case Op::IAdd:                 return handler_kind::iadd_32;
+			case Op::ISub:                 return handler_kind::isub_32;
+			case Op::IMul:                 return handler_kind::imul_32;
+			case Op::BitwiseAnd:           return handler_kind::and_32;
+			case Op::BitwiseOr:            return handler_kind::or_32;
+			case Op::BitwiseXor:           return handler_kind::xor_32;
+			case Op::ShiftLeftLogical:     return handler_kind::shl_32;
+			case Op::ShiftRightLogical:    return handler_kind::shr_32;
+			case Op::ShiftRightArithmetic: return handler_kind::sar_32;
+			case Op::IEqual:               return handler_kind::ieq_32;
+			case Op::INotEqual:            return handler_kind::ine_32;
+			case Op::ULessThan:            return handler_kind::ult_32;
+			case Op::ULessThanEqual:       return handler_kind::ule_32;
+			case Op::UGreaterThan:         return handler_kind::ugt_32;
+			case Op::UGreaterThanEqual:    return handler_kind::uge_32;
+			case Op::SLessThan:            return handler_kind::slt_32;
+			case Op::SLessThanEqual:       return handler_kind::sle_32;
+			case Op::SGreaterThan:         return handler_kind::sgt_32;
+			case Op::SGreaterThanEqual:    return handler_kind::sge_32;
+			default:                       return handler_kind::generic;
+			}
+		}
+
+		if (kind == scalar_kind::f32)
+		{
+			switch (opcode)
+			{
+			case Op::FAdd:                 return handler_kind::fadd_f32;
+			case Op::FSub:                 return handler_kind::fsub_f32;
+			case Op::FMul:                 return handler_kind::fmul_f32;
+			case Op::FDiv:                 return handler_kind::fdiv_f32;
+			case Op::FOrdEqual:            return handler_kind::foeq_f32;
+			case Op::FOrdLessThan:         return handler_kind::folt_f32;
+			case Op::FOrdLessThanEqual:    return handler_kind::fole_f32;
+			case Op::FOrdGreaterThan:      return handler_kind::fogt_f32;
+			case Op::FOrdGreaterThanEqual: return handler_kind::foge_f32;
+			default:                       return handler_kind::generic;
+			}
+		}
+
+		return handler_kind::generic;
+	}
+
+	spvcpu::result close_prologue() noexcept
+	{
+		if (m_prologue_closed)
+			return spvcpu::result::success;
+
+		m_prologue_closed = true;
+
+		return emit(Op::Return, scalar_kind::none, scalar_kind::none, 0, 0, {});
+	}
+
+	spvcpu::result resolve_label_fixups() noexcept
+	{
+		for (uint32_t i = 0; i != m_label_fixups.size(); ++i)
+		{
+			const fixup& f = m_label_fixups[i];
+
+			if (m_label_pcs[f.id] == ~0u)
+				return spvcpu::result::id_not_found;
+
+			m_program->m_code[f.operand_index] = m_label_pcs[f.id];
+		}
+
+		free(m_label_fixups.steal());
+
+		if (!m_label_fixups.initialize(64))
+			return spvcpu::result::no_memory;
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result resolve_function_fixups() noexcept
+	{
+		for (uint32_t i = 0; i != m_function_fixups.size(); ++i)
+		{
+			const fixup& f = m_function_fixups[i];
+
+			const uint32_t function_index = m_function_indices[f.id];
+
+			if (function_index == ~0u)
+				return spvcpu::result::id_not_found;
+
+			const function_record& function = m_functions[function_index];
+
+			if (f.param_index == ~0u)
+			{
+				m_program->m_code[f.operand_index] = function.pc;
+			}
+			else
+			{
+				if (f.param_index >= function.param_cnt)
+					return spvcpu::result::instruction_wordcount_mismatch;
+
+				m_program->m_code[f.operand_index] = m_program->m_register_offsets[m_params[function.param_beg + f.param_index]];
+			}
+		}
+
+		return spvcpu::result::success;
+	}
+
+	spvcpu::result lower_instruction(Op opcode, const uint32_t* word, uint32_t wordcount, uint32_t rtype, uint32_t rst) noexcept
+	{
+		const uint32_t* args = word + 1 + (rtype != 0) + (rst != 0);
+
+		const uint32_t arg_cnt = wordcount - 1 - (rtype != 0) - (rst != 0);
+
+		switch (opcode)
+		{
+		case Op::Nop:
+		case Op::SourceContinued:
+		case Op::Source:
+		case Op::SourceExtension:
+		case Op::String:
+		case Op::Line:
+		case Op::NoLine:
+		case Op::ModuleProcessed:
+		case Op::Capability:
+		case Op::Extension:
+		case Op::MemoryModel:
+		case Op::MemberName:
+		case Op::DecorateString:
+		case Op::MemberDecorateString:
+		case Op::DecorateId:
+		case Op::ExecutionModeId:
+		case Op::SelectionMerge:
+		case Op::LoopMerge:
+		case Op::LifetimeStart:
+		case Op::LifetimeStop:
+		{
+			return spvcpu::result::success;
+		}
+		case Op::Name:
+		{
+			if (wordcount < 3)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (spvcpu::result r = check_id(word[1]); r != spvcpu::result::success)
+				return r;
+
+			return add_string(reinterpret_cast<const char*>(word + 2), &m_name_offsets[word[1]]);
+		}
+		case Op::ExtInstImport:
+		{
+			if (wordcount == 2 + _countof(glsl_std_450_name_words) && memcmp(args, glsl_std_450_name_words, sizeof(glsl_std_450_name_words)) == 0)
+				m_glsl_set_id = rst;
+
+			return spvcpu::result::success;
+		}
+		case Op::EntryPoint:
+		{
+			if (wordcount < 4)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			pending_entry_point entry;
+			entry.function_id = word[2];
+			entry.local_size[0] = 1;
+			entry.local_size[1] = 1;
+			entry.local_size[2] = 1;
+
+			if (spvcpu::result r = add_string(reinterpret_cast<const char*>(word + 3), &entry.name_offset); r != spvcpu::result::success)
+				return r;
+
+			if (!m_entry_points.append(entry))
+				return spvcpu::result::no_memory;
+
+			return spvcpu::result::success;
+		}
+		case Op::ExecutionMode:
+		{
+			if (wordcount < 3)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (static_cast<ExecutionMode>(word[2]) != ExecutionMode::LocalSize)
+				return spvcpu::result::success;
+
+			if (wordcount < 6)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			for (uint32_t i = 0; i != m_entry_points.size(); ++i)
+			{
+				if (m_entry_points[i].function_id == word[1])
+				{
+					m_entry_points[i].local_size[0] = word[3];
+					m_entry_points[i].local_size[1] = word[4];
+					m_entry_points[i].local_size[2] = word[5];
+				}
+			}
+
+			return spvcpu::result::success;
+		}
+		case Op::Decorate:
+		case Op::MemberDecorate:
+		{
+			const uint32_t min_words = opcode == Op::Decorate ? 3 : 4;
+
+			if (wordcount < min_words)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (spvcpu::result r = check_id(word[1]); r != spvcpu::result::success)
+				return r;
+
+			decoration_entry entry;
+			entry.next = m_first_decorations[word[1]];
+			entry.member = opcode == Op::Decorate ? ~0u : word[2];
+			entry.decoration = static_cast<Decoration>(word[min_words - 1]);
+			entry.value = wordcount > min_words ? word[min_words] : 0;
+
+			m_first_decorations[word[1]] = m_decorations.size();
+
+			if (!m_decorations.append(entry))
+				return spvcpu::result::no_memory;
+
+			if (opcode == Op::Decorate && entry.decoration == Decoration::BuiltIn && static_cast<Builtin>(entry.value) == Builtin::WorkgroupSize)
+				m_program->m_workgroup_size_id = word[1];
+
+			return spvcpu::result::success;
+		}
+		case Op::DecorationGroup:
+		case Op::GroupDecorate:
+		case Op::GroupMemberDecorate:
+		{
+			return spvcpu::result::unhandled_opcode;
+		}
+		case Op::TypeVoid:
+		case Op::TypeBool:
+		case Op::TypeInt:
+		case Op::TypeFloat:
+		case Op::TypeVector:
+		case Op::TypeMatrix:
+		case Op::TypeImage:
+		case Op::TypeSampler:
+		case Op::TypeSampledImage:
+		case Op::TypeArray:
+		case Op::TypeRuntimeArray:
+		case Op::TypeStruct:
+		case Op::TypePointer:
+		case Op::TypeFunction:
+		case Op::TypeForwardPointer:
+		{
+			return lower_type(opcode, word, wordcount);
+		}
+		case Op::ConstantTrue:
+		case Op::ConstantFalse:
+		case Op::Constant:
+		case Op::ConstantComposite:
+		case Op::ConstantNull:
+		case Op::SpecConstantTrue:
+		case Op::SpecConstantFalse:
+		case Op::SpecConstant:
+		case Op::SpecConstantComposite:
+		case Op::SpecConstantOp:
+		{
+			return lower_constant(opcode, rtype, rst, args, arg_cnt);
+		}
+		case Op::Undef:
+		{
+			return allocate_register(rst, get_type(rtype) == nullptr ? 0 : get_type(rtype)->register_words);
+		}
+		case Op::Variable:
+		{
+			return lower_variable(rtype, rst, args, arg_cnt);
+		}
+		case Op::Function:
+		{
+			if (!m_prologue_closed)
+			{
+				if (spvcpu::result r = close_prologue(); r != spvcpu::result::success)
+					return r;
+
+				if (spvcpu::result r = allocate_function_registers(word); r != spvcpu::result::success)
+					return r;
+			}
+
+			if (m_in_function)
+				return spvcpu::result::unhandled_opcode;
+
+			m_in_function = true;
+
+			m_function_indices[rst] = m_functions.size();
+
+			if (!m_functions.append({ rst, m_program->m_code.size(), m_params.size(), 0 }))
+				return spvcpu::result::no_memory;
+
+			++m_program->m_function_count;
+
+			return spvcpu::result::success;
+		}
+		case Op::FunctionParameter:
+		{
+			if (!m_in_function)
+				return spvcpu::result::unhandled_opcode;
+
+			const type_info* type = get_type(rtype);
+
+			if (type == nullptr)
+				return spvcpu::result::id_not_found;
+
+			if (type->data.m_type == spird::arg_type::POINTER)
+				if (spvcpu::result r = pointee_node(rtype, &m_pointer_nodes[rst], nullptr); r != spvcpu::result::success)
+					return r;
+
+			if (!m_params.append(rst))
+				return spvcpu::result::no_memory;
+
+			++m_functions[m_functions.size() - 1].param_cnt;
+
+			return allocate_register(rst, type->register_words);
+		}
+		case Op::FunctionEnd:
+		{
+			if (!m_in_function)
+				return spvcpu::result::unhandled_opcode;
+
+			m_in_function = false;
+
+			return resolve_label_fixups();
+		}
+		case Op::Label:
+		{
+			if (!m_in_function)
+				return spvcpu::result::unhandled_opcode;
+
+			m_label_pcs[rst] = m_program->m_code.size();
+
+			m_curr_block = rst;
+
+			m_phi_insn = ~0u;
+
+			return spvcpu::result::success;
+		}
+		default:
+		{
+			if (!m_in_function)
+				return spvcpu::result::unhandled_opcode;
+
+			return lower_code(opcode, rtype, rst, args, arg_cnt);
+		}
+		}
+	}
+
+public:
+
+	program_builder(cpu_program* program, const void* spird) noexcept : m_program{ program }, m_spird{ spird } {}
+
+	spvcpu::result build(const uint32_t* words, uint32_t word_cnt) noexcept
+	{
+		m_id_bound = words[3];
+
+		if (spvcpu::result rst = spird::get_enum_location(m_spird, spird::enum_id::Instruction, &m_insn_loc); rst != spvcpu::result::success)
+			return rst;
+
+		if (!m_program->m_code.initialize(4096) ||
+		    !m_program->m_initial_registers.initialize(4096) ||
+		    !m_program->m_layout_nodes.initialize(256) ||
+		    !m_program->m_layout_members.initialize(256) ||
+		    !m_program->m_variables.initialize(64) ||
+		    !m_program->m_entry_points.initialize(4) ||
+		    !m_program->m_strings.initialize(1024) ||
+		    !m_program->m_id_names.initialize(m_id_bound) ||
+		    !m_types.initialize(256) ||
+		    !m_decorations.initialize(256) ||
+		    !m_functions.initialize(16) ||
+		    !m_params.initialize(64) ||
+		    !m_label_fixups.initialize(64) ||
+		    !m_function_fixups.initialize(16) ||
+		    !m_entry_points.initialize(4) ||
+		    !m_constant_ids.initialize(m_id_bound) ||
+		    !m_constant_ids.append_n(0, m_id_bound))
+			return spvcpu::result::no_memory;
+
+		if (spvcpu::result rst = allocate_per_id(m_program->m_register_offsets, ~0u); rst != spvcpu::result::success)
+			return rst;
+
+		if (spvcpu::result rst = allocate_per_id(m_result_types, 0); rst != spvcpu::result::success)
+			return rst;
+
+		if (spvcpu::result rst = allocate_per_id(m_type_indices, ~0u); rst != spvcpu::result::success)
+			return rst;
+
+		if (spvcpu::result rst = allocate_per_id(m_pointer_nodes, ~0u); rst != spvcpu::result::success)
+			return rst;
+
+		if (spvcpu::result rst = allocate_per_id(m_variable_indices, ~0u); rst != spvcpu::result::success)
+			return rst;
+
+		if (spvcpu::result rst = allocate_per_id(m_label_pcs, ~0u); rst != spvcpu::result::success)
+			return rst;
+
+		if (spvcpu::result rst = allocate_per_id(m_function_indices, ~0u); rst != spvcpu::result::success)
+			return rst;
+
+		if (spvcpu::result rst = allocate_per_id(m_name_offsets, ~0u); rst != spvcpu::result::success)
+			return rst;
+
+		if (spvcpu::result rst = allocate_per_id(m_first_decorations, ~0u); rst != spvcpu::result::success)
+			return rst;
+
+		m_program->m_id_bound = m_id_bound;
+		m_program->m_register_words = 0;
+		m_program->m_memory_bytes = 0;
+		m_program->m_scratch_words = 0;
+		m_program->m_pool_words = 0;
+		m_program->m_function_count = 0;
+		m_program->m_workgroup_size_id = 0;
+
+		m_glsl_set_id = 0;
+		m_curr_block = 0;
+		m_phi_insn = ~0u;
+		m_phi_words = 0;
+		m_in_function = false;
+		m_prologue_closed = false;
+		m_has_invalid_slot = false;
+		m_curr_insn = 0;
+
+		const uint32_t* const word_end = words + word_cnt;
+
+		m_word_end = word_end;
+
+		for (const uint32_t* word = words + 5; word < word_end;)
+		{
+			const uint32_t wordcount = *word >> 16;
+
+			const Op opcode = static_cast<Op>(*word & 0xFFFF);
+
+			if (wordcount == 0)
+				return spvcpu::result::instruction_wordcount_mismatch;
+
+			if (word + wordcount > word_end)
+				return spvcpu::result::instruction_past_data_end;
+
+			uint32_t rtype;
+
+			uint32_t rst;
+
+			if (spvcpu::result r = decode_result(word, wordcount, &rtype, &rst); r != spvcpu::result::success)
+				return r;
+
+			if (rst != 0)
+				m_result_types[rst] = rtype;
+
+			if (spvcpu::result r = lower_instruction(opcode, word, wordcount, rtype, rst); r != spvcpu::result::success)
+				return r;
+
+			word += wordcount;
+		}
+
+		if (m_in_function)
+			return spvcpu::result::instruction_past_data_end;
+
+		if (spvcpu::result rst = close_prologue(); rst != spvcpu::result::success)
+			return rst;
+
+		if (spvcpu::result rst = resolve_function_fixups(); rst != spvcpu::result::success)
+			return rst;
+
+		if (m_has_invalid_slot)
+			return spvcpu::result::id_not_found;
+
+		for (uint32_t i = 0; i != m_entry_points.size(); ++i)
+		{
+			const pending_entry_point& pending = m_entry_points[i];
+
+			if (pending.function_id >= m_id_bound || m_function_indices[pending.function_id] == ~0u)
+				return spvcpu::result::id_not_found;
+
+			entry_point_info entry;
+			entry.name_offset = pending.name_offset;
+			entry.function_pc = m_functions[m_function_indices[pending.function_id]].pc;
+			entry.local_size[0] = pending.local_size[0];
+			entry.local_size[1] = pending.local_size[1];
+			entry.local_size[2] = pending.local_size[2];
+
+			if (!m_program->m_entry_points.append(entry))
+				return spvcpu::result::no_memory;
+		}
+
+		// Strings are not appended to anymore, so pointers into them stay valid.
+		for (uint32_t id = 0; id != m_id_bound; ++id)
+			if (!m_program->m_id_names.append(m_name_offsets[id] == ~0u ? nullptr : m_program->m_strings.data() + m_name_offsets[id]))
+				return spvcpu::result::no_memory;
+
+		m_program->m_register_words = m_program->m_initial_registers.size();
+
+		if (m_program->m_function_count == 0)
+			m_program->m_pool_words = m_program->m_register_words;
+
+		return spvcpu::result::success;
+	}
+};
+
+static constexpr uint32_t reverse_endianness(uint32_t n) noexcept
+{
+	return ((n >> 24) & 0x000000FF) | ((n >> 8) & 0x0000FF00) | ((n << 8) & 0x00FF0000) | ((n << 24) & 0xFF000000);
+}
+
+spvcpu::result lower_program(uint64_t spirv_bytes, const void* spirv, const void* spird, cpu_program* out_program) noexcept
+{
+	if (spirv_bytes < 20)
+		return spvcpu::result::shader_too_small;
+
+	if (spirv_bytes & 3)
+		return spvcpu::result::shader_size_not_divisible_by_four;
+
+	const uint32_t* words = static_cast<const uint32_t*>(spirv);
+
+	if (words[0] == reverse_endianness(spirv::magic_number))
+		return spvcpu::result::wrong_endianness;
+
+	if (words[0] != spirv::magic_number)
+		return spvcpu::result::wrong_magic;
+
+	if (words[3] > spirv::max_id_bound)
+		return spvcpu::result::too_many_ids;
+
+	program_builder builder(out_program, spird);
+
+	return builder.build(words, static_cast<uint32_t>(spirv_bytes >> 2));
+}
@@ -0,0 +1,370 @@
+#ifndef RUNNER_PROGRAM_HPP_INCLUDE_GUARD
+#define RUNNER_PROGRAM_HPP_INCLUDE_GUARD
+
+#include <cstdint>
+
+#include "spv_defs.hpp"
+#include "spv_result.hpp"
+#include "spv_runner.hpp"
+#include "simple_vec.hpp"
+
+// Component type of a value in the register file. Every component occupies one
+// 32-bit word, except for 64-bit components, which occupy two. Integers narrower
+// than 32 bits are kept zero-extended to a full word.
+enum class scalar_kind : uint8_t
+{
+	none,
+	boolean,
+	i8,
+	i16,
+	i32,
+	i64,
+	f32,
+	f64,
+};
+
+enum class layout_kind : uint8_t
+{
+	scalar,
+	vector,
+	matrix,
+	array,
+	runtime_array,
+	structure,
+	opaque,
+};
+
+// Describes how a value of some type is laid out in memory, as opposed to in the
+// register file. Types in storage classes with explicit layout (Uniform,
+// StorageBuffer, PushConstant) follow their Offset, ArrayStride and
+// MatrixStride decorations. All other storage classes use the register layout.
+struct layout_node
+{
+	layout_kind kind;
+
+	scalar_kind scalar;
+
+	// Set if the memory representation is identical to the register representation,
+	// meaning that loads and stores can be done with a single memcpy.
+	bool is_trivial;
+
+	uint8_t unused;
+
+	// Bytes occupied in memory. 0 for runtime arrays.
+	uint32_t memory_bytes;
+
+	uint32_t register_words;
+
+	// Byte distance between consecutive components, columns or elements.
+	uint32_t stride;
+
+	// Number of components, columns, elements or members.
+	uint32_t count;
+
+	// Layout of the component, column or element. For structures this is instead
+	// the index of the first member in cpu_program::m_layout_members.
+	uint32_t element;
+};
+
+struct layout_member
+{
+	uint32_t node;
+
+	uint32_t memory_offset;
+
+	uint32_t register_offset;
+};
+
+// Specialized implementation selected for an instruction when it is lowered.
+// Handlers other than generic operate on fixed-width 32-bit components and
+// avoid re-examining the instruction's opcode and component kinds at runtime.
+// Everything else goes through generic, which dispatches on insn::opcode.
+enum class handler_kind : uint16_t
+{
+	generic,
+	copy_words,
+	select,
+	load_trivial,
+	store_trivial,
+	access_chain,
+	branch,
+	branch_conditional,
+	phi,
+	logical_not,
+	logical_and,
+	logical_or,
+	fnegate_f32,
+	convert_s32_to_f32,
+	convert_u32_to_f32,
+	convert_f32_to_s32,
+	convert_f32_to_u32,
+	iadd_32,
+	isub_32,
+	imul_32,
+	and_32,
+	or_32,
+	xor_32,
+	shl_32,
+	shr_32,
+	sar_32,
+	ieq_32,
+	ine_32,
+	ult_32,
+	ule_32,
+	ugt_32,
+	uge_32,
+	slt_32,
+	sle_32,
+	sgt_32,
+	sge_32,
+	fadd_f32,
+	fsub_f32,
+	fmul_f32,
+	fdiv_f32,
+	foeq_f32,
+	folt_f32,
+	fole_f32,
+	fogt_f32,
+	foge_f32,
+	vector_times_scalar_f32,
+};
+
+// Header of an instruction in cpu_program::m_code. Its operands directly follow
+// it. Which operands are present depends on opcode; see runner_lower.cpp for
+// the encoding of each instruction.
+struct insn
+{
+	handler_kind handler;
+
+	Op opcode;
+
+	// Component type of the result. For comparisons this is the operand type.
+	scalar_kind kind;
+
+	// Component type of the source operand for conversions, shifts and dynamic indexing.
+	scalar_kind src_kind;
+
+	// Number of components processed by the instruction.
+	uint16_t count;
+
+	// Additional per-opcode information, such as the GLSL.std.450 instruction
+	// number for OpExtInst or the number of rows for matrix operations.
+	uint16_t aux;
+
+	uint16_t unused;
+
+	// Length of the instruction in words, including this header.
+	uint32_t length;
+
+	// Byte offset of the instruction's handler from the first handler in the
+	// threaded interpreter loop. Filled in by thread_program and only used when
+	// built with SPVCPU_THREADED_DISPATCH.
+	int32_t dispatch;
+};
+
+static_assert(sizeof(insn) == 20);
+
+static constexpr uint32_t insn_words = sizeof(insn) / sizeof(uint32_t);
+
+struct program_variable
+{
+	uint32_t id;
+
+	StorageClass storage_class;
+
+	// Layout of the variable's pointee.
+	uint32_t node;
+
+	// Offset into invocation_state::m_memory for variables not backed by a binding.
+	uint32_t memory_offset;
+
+	uint32_t descriptor_set;
+
+	uint32_t binding;
+
+	// ~0u if the variable is not decorated as BuiltIn.
+	uint32_t builtin;
+
+	// Id of a constant initializer, or 0.
+	uint32_t initializer;
+
+	// Set for UniformConstant variables holding an image.
+	bool is_image;
+};
+
+struct entry_point_info
+{
+	uint32_t name_offset;
+
+	uint32_t function_pc;
+
+	uint32_t local_size[3];
+};
+
+#if defined(SPVCPU_JIT)
+// x86-64 machine code generated from a program's instruction stream by
+// compile_native. The code starts with an entry stub, followed by the
+// translations of all instructions in instruction stream order and the code
+// reloading register-allocated values at entries reached by fallthrough.
+struct native_code
+{
+	uint8_t* m_code;
+
+	// Size of the executable mapping at m_code.
+	uint64_t m_bytes;
+
+	// Offset into m_code of the stub returning from native code.
+	uint32_t m_exit_offset;
+
+	// Offset into m_code at which native code can be entered with all values in
+	// the register file, for each word of cpu_program::m_code starting such an
+	// instruction. All other words hold ~0u, and the interpreter steps up to the
+	// next instruction with an entry.
+	simple_vec<uint32_t> m_offsets;
+
+	// Offset into m_code of every 64-bit immediate holding the address of the
+	// interpreter fallback, which is only known once the code is mapped for
+	// execution. See link_native.
+	simple_vec<uint32_t> m_relocations;
+
+	~native_code() noexcept;
+};
+#endif
+
+struct cpu_program
+{
+	uint32_t m_id_bound;
+
+	uint32_t m_register_words;
+
+	uint32_t m_memory_bytes;
+
+	uint32_t m_scratch_words;
+
+	uint32_t m_function_count;
+
+	// Number of words at the start of the register file holding constants and
+	// other module-scope values. Only these need to be initialized for a new
+	// invocation; everything after them is written before it is read.
+	uint32_t m_pool_words;
+
+	// Id of the constant decorated with the WorkgroupSize builtin, or 0.
+	uint32_t m_workgroup_size_id;
+
+	// Instruction stream. Starts with the prologue evaluating specialization
+	// constant instructions, followed by the bodies of all functions.
+	simple_vec<uint32_t> m_code;
+
+	// Register file image holding the values of all constants.
+	simple_vec<uint32_t> m_initial_registers;
+
+	// Register slot of each id, or ~0u if the id has no value.
+	simple_vec<uint32_t> m_register_offsets;
+
+	simple_vec<layout_node> m_layout_nodes;
+
+	simple_vec<layout_member> m_layout_members;
+
+	simple_vec<program_variable> m_variables;
+
+	simple_vec<entry_point_info> m_entry_points;
+
+	simple_vec<char> m_strings;
+
+	simple_vec<const char*> m_id_names;
+
+#if defined(SPVCPU_JIT)
+	native_code m_native;
+#endif
+};
+
+struct call_frame
+{
+	uint32_t return_pc;
+
+	// Register slot receiving the callee's return value.
+	uint32_t result_slot;
+};
+
+struct invocation_state
+{
+	const cpu_program* m_program;
+
+	// Register file of the invocation. For an invocation executed as a lane of a
+	// batch, this instead points at the lane's first word in the batch's shared,
+	// lane-interleaved register file.
+	uint32_t* m_registers;
+
+	uint8_t* m_memory;
+
+	uint32_t* m_scratch;
+
+	call_frame* m_frames;
+
+	uint32_t m_frame_cnt;
+
+	uint32_t m_pc;
+
+	uint32_t m_prev_block;
+
+	spvcpu::execution_status m_status;
+
+	// Set for invocations run as part of a workgroup. Barriers with Workgroup
+	// execution scope then stop execution with m_status set to barrier instead
+	// of being no-ops.
+	bool m_suspend_at_barrier;
+
+	uint32_t m_local_size[3];
+
+	spvcpu::image_binding* m_images;
+
+	// Size in bytes of the buffer bound to each entry of cpu_program::m_variables.
+	uint64_t* m_variable_bytes;
+};
+
+spvcpu::result lower_program(uint64_t spirv_bytes, const void* spirv, const void* spird, cpu_program* out_program) noexcept;
+
+spvcpu::result execute(invocation_state* state, bool single_step) noexcept;
+
+// Executes lane_count (8 or 16) invocations together until none of them is
+// running anymore, i.e. all have either finished or reached a barrier. lanes[l]->m_registers must equal lanes[0]->m_registers + l, with the
+// batch register file holding lane_count words for every register word.
+spvcpu::result execute_lanes(invocation_state* const* lanes, uint32_t lane_count) noexcept;
+
+// Stores the address of each instruction's handler in its insn::dispatch. Must
+// be called on a newly lowered program before it is executed.
+void thread_program(cpu_program* program) noexcept;
+
+#if defined(SPVCPU_JIT)
+// Translates program's instruction stream to native code. Instructions without
+// a native translation call back into the interpreter. Must be called on a newly
+// lowered program, after thread_program.
+spvcpu::result compile_native(cpu_program* program) noexcept;
+
+// Runs the invocation in native code until it stops running. Only called by
+// execute, for programs compiled by compile_native.
+spvcpu::result execute_native(invocation_state* state) noexcept;
+
+// Identifies the instruction set extensions and options native code is
+// generated for on this machine. Native code stored in the module cache is only
+// reused by a process with the same variant.
+uint32_t native_code_variant() noexcept;
+
+// Fills in m_relocations in native->m_code, which must be mapped writable, and
+// then makes the mapping executable instead.
+spvcpu::result link_native(native_code* native) noexcept;
+#endif
+
+// Looks for program compiled from spirv in cache_directory and, if present,
+// loads it into out_program, which must be empty. The program still has to be
+// passed to thread_program. Any failure, including a missing or outdated cache
+// entry, is reported as false, with out_program left in a state only fit for
+// deletion.
+bool load_cached_program(const char* cache_directory, uint64_t spirv_bytes, const void* spirv, const void* spird, cpu_program* out_program) noexcept;
+
+// Stores program, which was created from spirv, in cache_directory for use by
+// load_cached_program. Failures are ignored, since they only cost a later
+// recompilation.
+void store_cached_program(const char* cache_directory, uint64_t spirv_bytes, const void* spirv, const void* spird, const cpu_program* program) noexcept;
+
+#endif // RUNNER_PROGRAM_HPP_INCLUDE_GUARD
@@ -91,6 +91,46 @@ public:
 		return true;
 	}
 
+	[[nodiscard]] bool append_n(const T& t, uint32_t count) noexcept
+	{
+		if (m_used + count > m_capacity)
+		{
+			uint32_t new_capacity = m_capacity == 0 ? 1 : m_capacity;
+
+			while (new_capacity < m_used + count)
+				new_capacity *= 2;
+
+			if (!reserve(new_capacity))
+				return false;
+		}
+
+		for (uint32_t i = 0; i != count; ++i)
+			m_data[m_used++] = t;
+
+		return true;
+	}
+
+	// Appends count elements copied bytewise from ts, so T must be trivially copyable.
+	[[nodiscard]] bool append_range(const T* ts, uint32_t count) noexcept
+	{
+		if (m_used + count > m_capacity)
+		{
+			uint32_t new_capacity = m_capacity == 0 ? 1 : m_capacity;
+
+			while (new_capacity < m_used + count)
+				new_capacity *= 2;
+
+			if (!reserve(new_capacity))
+				return false;
+		}
+
+		::memcpy(m_data + m_used, ts, count * sizeof(T));
+
+		m_used += count;
+
+		return true;
+	}
+
 	uint32_t size() const noexcept
 	{
 		return m_used;
@@ -124,7 +164,7 @@ public:
 	void clear() noexcept
 	{
 		for (uint32_t i = 0; i != m_used; ++i)
-			m_data[i].~TYPE();
+			m_data[i].~T();
 
 		m_used = 0;
 	}
@@ -146,6 +186,15 @@ public:
 	{
 		::memset(m_data, 0xFF, m_capacity * sizeof(T));
 	}
+
+	void swap(simple_vec& other) noexcept
+	{
+		std::swap(m_data, other.m_data);
+
+		std::swap(m_used, other.m_used);
+
+		std::swap(m_capacity, other.m_capacity);
+	}
 };
 
 template<typename T>
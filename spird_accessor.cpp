@@ -1,8 +1,12 @@
 #include "spird_accessor.hpp"
 
+#include <cstring>
+
 #include "spird_hashing.hpp"
 
-#include <cstring>
+#if defined(SPVCPU_EMBEDDED_SPIRD)
+#include "spird_embedded.hpp"
+#endif
 
 static constexpr const char* const enum_name_strings[]
 {
@@ -55,7 +59,7 @@ spvcpu::result spird::get_enum_location(const void* spird, spird::enum_id enum_i
 
 	const spird::file_header* file_header = static_cast<const spird::file_header*>(spird);
 
-	if (file_header->version != 17)
+	if (file_header->version != spird::file_version)
 		return spvcpu::result::spirv_data_unknown_version;
 
 	if (static_cast<uint32_t>(enum_id) >= file_header->unnamed_table_count)
@@ -76,105 +80,141 @@ spvcpu::result spird::get_enum_location(const void* spird, const char* enum_name
 
 	const spird::file_header* file_header = static_cast<const spird::file_header*>(spird);
 
-	if (file_header->version != 17)
+	if (file_header->version != spird::file_version)
 		return spvcpu::result::spirv_data_unknown_version;
 
-	const char* curr_name = static_cast<const char*>(spird) + sizeof(spird::file_header);
-
-	uint32_t enum_index = 0;
+	const spird::name_hash_header* name_hash_header = reinterpret_cast<const spird::name_hash_header*>(raw_data + file_header->name_hash_byte);
 
-	while (curr_name < static_cast<const char*>(spird) + file_header->first_table_header_byte)
-	{
-		if (strcmp(enum_name, curr_name) == 0)
-			goto FOUND;
+	if (name_hash_header->name_count == 0)
+		return spvcpu::result::spirv_data_enumeration_not_found;
 
-		++enum_index;
+	const uint16_t* seeds = reinterpret_cast<const uint16_t*>(name_hash_header + 1);
 
-		curr_name += strlen(curr_name) + 1;
-	}
+	const spird::name_hash_slot* slots = reinterpret_cast<const spird::name_hash_slot*>(seeds + name_hash_header->bucket_count);
 
-	return spvcpu::result::spirv_data_enumeration_not_found;
+	const spird::name_hash_slot& slot = slots[perfect_hash_slot(hash_name(enum_name, static_cast<uint32_t>(strlen(enum_name))), name_hash_header->name_count, seeds)];
 
-	FOUND:
+	if (strcmp(enum_name, static_cast<const char*>(spird) + slot.name_offset) != 0)
+		return spvcpu::result::spirv_data_enumeration_not_found;
 
-	out_location->m_name_beg = curr_name - static_cast<const char*>(spird);
+	out_location->m_name_beg = slot.name_offset;
 
-	out_location->m_table_header_beg = file_header->first_table_header_byte + (file_header->unnamed_table_count + enum_index) * sizeof(spird::table_header);
+	out_location->m_table_header_beg = file_header->first_table_header_byte + (file_header->unnamed_table_count + slot.enum_index) * sizeof(spird::table_header);
 
 	out_location->m_table_header = *reinterpret_cast<const spird::table_header*>(raw_data + out_location->m_table_header_beg);
 
 	return spvcpu::result::success;
 }
 
-spvcpu::result spird::get_elem_data(const void* spird, const spird::enum_location& location, uint32_t id, spird::elem_data* out_data) noexcept
+spvcpu::result spird::get_elem_view(const void* spird, const spird::enum_location& location, uint32_t id, spird::elem_view* out_view) noexcept
 {
 	const uint8_t* raw_data = static_cast<const uint8_t*>(spird);
 
-	const spird::elem_index* table = reinterpret_cast<const spird::elem_index*>(raw_data + location.m_table_header.offset);
-
-	uint32_t hash = hash_knuth(id, location.m_table_header.size);
+	uint32_t offset;
 
-	const uint32_t initial_hash = hash;
+	if (id < location.m_table_header.direct_count)
+	{
+		offset = reinterpret_cast<const uint32_t*>(raw_data + location.m_table_header.offset)[id];
 
-	while (table[hash].id != id)
+		if (offset == 0)
+			return spvcpu::result::unknown_opcode;
+	}
+	else
 	{
-		++hash;
+		const spird::elem_index* sparse = reinterpret_cast<const spird::elem_index*>(raw_data + location.m_table_header.offset + location.m_table_header.direct_count * sizeof(uint32_t));
+
+		uint32_t lo = 0;
 
-		if (hash >= location.m_table_header.size)
-			hash -= location.m_table_header.size;
+		uint32_t hi = location.m_table_header.sparse_count;
 
-		if (hash == initial_hash)
+		while (lo != hi)
+		{
+			const uint32_t mid = (lo + hi) >> 1;
+
+			if (sparse[mid].id < id)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo == location.m_table_header.sparse_count || sparse[lo].id != id)
 			return spvcpu::result::unknown_opcode;
-	}
 
-	uint32_t offset = table[hash].byte_offset;
+		offset = sparse[lo].byte_offset;
+	}
 
-	const char* entry = reinterpret_cast<const char*>(raw_data + offset);
+	const spird::elem_record* record = reinterpret_cast<const spird::elem_record*>(raw_data + offset);
 
-	uint32_t argc = static_cast<uint32_t>(*entry++);
+	const char* strings = static_cast<const char*>(spird) + static_cast<const spird::file_header*>(spird)->string_pool_byte;
 
-	if (argc > 256)
-		return spvcpu::result::too_many_instruction_args;
+	const uint32_t argc = record->argc;
 
-	out_data->name = reinterpret_cast<const char*>(entry);
+	const uint8_t* arrays = reinterpret_cast<const uint8_t*>(record + 1);
 
-	entry += strlen(entry) + 1;
+	out_view->name = strings + record->name;
 
-	out_data->argc = argc;
+	out_view->argc = argc;
 
-	for (uint32_t i = 0; i != argc; ++i)
-	{
-		out_data->arg_flags[i] = static_cast<spird::arg_flags>(*entry++);
+	out_view->arg_flags = reinterpret_cast<const spird::arg_flags*>(arrays);
 
-		out_data->arg_types[i] = static_cast<spird::arg_type>(*entry++);
+	out_view->arg_types = reinterpret_cast<const spird::arg_type*>(arrays + argc);
 
-		out_data->arg_names[i] = entry[0] == '\0' ? nullptr : entry;
+	out_view->arg_name_offsets = reinterpret_cast<const uint32_t*>(arrays + ((argc * 2 + 3) & ~3u));
 
-		entry += strlen(entry) + 1;
-	}
+	out_view->strings = strings;
 
-	uint8_t cnt = *entry++;
+	out_view->capabilities = reinterpret_cast<const uint16_t*>(out_view->arg_name_offsets + argc);
 
-	if (cnt == 0)
+	if (record->implies_or_depends == 0)
 	{
-		out_data->implies_or_depends = implies_or_depends_mode::none;
+		out_view->implies_or_depends = implies_or_depends_mode::none;
+
+		out_view->capability_cnt = 0;
 	}
 	else
 	{
-		out_data->implies_or_depends = cnt & 0x80 ? implies_or_depends_mode::implies : implies_or_depends_mode::depends;
+		out_view->implies_or_depends = record->implies_or_depends & 0x80 ? implies_or_depends_mode::implies : implies_or_depends_mode::depends;
+
+		out_view->capability_cnt = record->implies_or_depends & 0x7F;
+	}
+
+	return spvcpu::result::success;
+}
 
-		cnt &= 0x7F;
+spvcpu::result spird::elem_view_cache::fill(const void* spird, const spird::enum_location& location, uint32_t elem_id, spird::elem_view* out_view) noexcept
+{
+	if (m_views.data() == nullptr && !m_views.initialize(64))
+		return spvcpu::result::no_memory;
 
-		out_data->capability_cnt = cnt;
+	if (elem_id >= m_slot_count)
+	{
+		uint32_t new_slot_count = m_slot_count == 0 ? 512 : m_slot_count;
 
-		for (uint8_t i = 0; i != cnt; ++i)
-		{
-			uint16_t lo = static_cast<uint8_t>(*entry++);
+		while (new_slot_count <= elem_id)
+			new_slot_count *= 2;
 
-			uint16_t hi = static_cast<uint8_t>(*entry++);
+		uint16_t* new_slots = static_cast<uint16_t*>(realloc(m_slots, new_slot_count * sizeof(uint16_t)));
 
-			out_data->capabilities[i] = lo | (hi << 8);
-		}
+		if (new_slots == nullptr)
+			return spvcpu::result::no_memory;
+
+		memset(new_slots + m_slot_count, 0, (new_slot_count - m_slot_count) * sizeof(uint16_t));
+
+		m_slots = new_slots;
+
+		m_slot_count = new_slot_count;
+	}
+
+	if (spvcpu::result rst = get_elem_view(spird, location, elem_id, out_view); rst != spvcpu::result::success)
+		return rst;
+
+	// Further views are not cached once all slot indices are used up.
+	if (m_views.size() < 0xFFFF)
+	{
+		if (!m_views.append(*out_view))
+			return spvcpu::result::no_memory;
+
+		m_slots[elem_id] = static_cast<uint16_t>(m_views.size());
 	}
 
 	return spvcpu::result::success;
@@ -229,3 +269,12 @@ spvcpu::result spird::get_named_enum_data(const void* spird, spird::named_enum_d
 
 	return spvcpu::result::success;
 }
+
+const void* spird::get_embedded_data() noexcept
+{
+#if defined(SPVCPU_EMBEDDED_SPIRD)
+	return spird::embedded_bytes;
+#else
+	return nullptr;
+#endif
+}
@@ -3,6 +3,7 @@
 
 #include <cstdint>
 
+#include "simple_vec.hpp"
 #include "spird_defs.hpp"
 #include "spv_result.hpp"
 
@@ -24,23 +25,33 @@ namespace spird
 		uint32_t m_table_header_beg;
 	};
 
-	struct elem_data
+	// Describes an element by pointing directly into the spird data, so it
+	// stays valid for as long as that does.
+	struct elem_view
 	{
 		const char* name;
 
 		uint32_t argc;
 
-		spird::arg_type arg_types[256];
+		const spird::arg_type* arg_types;
 
-		spird::arg_flags arg_flags[256];
+		const spird::arg_flags* arg_flags;
+
+		const uint32_t* arg_name_offsets;
+
+		const char* strings;
 
-		const char* arg_names[256];
-		
 		implies_or_depends_mode implies_or_depends;
 
 		uint8_t capability_cnt;
 
-		uint16_t capabilities[127];
+		const uint16_t* capabilities;
+
+		// Returns nullptr for unnamed arguments.
+		const char* arg_name(uint32_t arg) const noexcept
+		{
+			return arg_name_offsets[arg] == 0 ? nullptr : strings + arg_name_offsets[arg];
+		}
 	};
 
 	struct enum_data
@@ -59,13 +70,64 @@ namespace spird
 
 	spvcpu::result get_enum_location(const void* spird, enum_id enum_id, enum_location* out_location) noexcept;
 
-	spvcpu::result get_enum_location(const void* spird, const char* enum_name, enum_location* out_location) noexcept;
+	spvcpu::result get_elem_view(const void* spird, const enum_location& location, uint32_t elem_id, elem_view* out_view) noexcept;
+
+	// Keeps the views of elements of a single enumeration after looking them
+	// up through get_elem_view on first use, so that repeated ids cost a single
+	// array access. Only a few dozen distinct opcodes appear in most modules,
+	// which makes this worthwhile for instructions. Ids must be below 65536,
+	// and all lookups must pass the same spird and location.
+	struct elem_view_cache
+	{
+	private:
+
+		// Index + 1 into m_views of each id's view, or 0 if it has not been
+		// looked up yet. Indexed directly by id, and grown to the next power of
+		// two above the largest id looked up so far instead of covering all
+		// 65536 ids up front, which keeps it small for core opcodes.
+		uint16_t* m_slots;
+
+		uint32_t m_slot_count;
+
+		simple_vec<elem_view> m_views;
+
+		spvcpu::result fill(const void* spird, const enum_location& location, uint32_t elem_id, elem_view* out_view) noexcept;
+
+	public:
 
-	spvcpu::result get_elem_data(const void* spird, const enum_location& location, uint32_t elem_id, elem_data* out_data) noexcept;
+		elem_view_cache() noexcept : m_slots{ nullptr }, m_slot_count{ 0 } {}
+
+		~elem_view_cache() noexcept
+		{
+			free(m_slots);
+		}
+
+		elem_view_cache(const elem_view_cache&) = delete;
+
+		elem_view_cache& operator=(const elem_view_cache&) = delete;
+
+		spvcpu::result get(const void* spird, const enum_location& location, uint32_t elem_id, elem_view* out_view) noexcept
+		{
+			if (elem_id < m_slot_count && m_slots[elem_id] != 0)
+			{
+				*out_view = m_views[m_slots[elem_id] - 1];
+
+				return spvcpu::result::success;
+			}
+
+			return fill(spird, location, elem_id, out_view);
+		}
+	};
+
+	spvcpu::result get_enum_location(const void* spird, const char* enum_name, enum_location* out_location) noexcept;
 
 	spvcpu::result get_enum_data(const void* spird, const enum_location& location, enum_data* out_data) noexcept;
 
 	spvcpu::result get_named_enum_data(const void* spird, named_enum_data* out_data) noexcept;
+
+	// Returns the spird data compiled into the library if it was built with
+	// SPVCPU_EMBEDDED_SPIRD, and nullptr otherwise.
+	const void* get_embedded_data() noexcept;
 }
 
 #endif // SPV_DATA_ACCESSOR_HPP_INCLUDE_GUARD
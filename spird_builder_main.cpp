@@ -1,7 +1,7 @@
 #include "spird_builder_strings.hpp"
 #include "spird_defs.hpp"
-#include "spird_hashing.hpp"
 #include "spird_names.hpp"
+#include "spird_hashing.hpp"
 
 #include <cstdio>
 #include <cstdint>
@@ -14,6 +14,13 @@
 #define fseek _fseeki64
 #endif
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 static const char* prog_name;
 
 __declspec(noreturn) static void panic(const char* msg, ...) noexcept
@@ -45,7 +52,8 @@ private:
 	{
 		if (m_used + additional > m_capacity)
 		{
-			m_capacity *= 2;
+			while (m_used + additional > m_capacity)
+				m_capacity *= 2;
 
 			m_data = static_cast<uint8_t*>(realloc(m_data, m_capacity));
 
@@ -74,6 +82,21 @@ public:
 		m_data[m_used++] = static_cast<uint8_t>(v >> 8);
 	}
 
+	void append_u32(uint32_t v) noexcept
+	{
+		grow(4);
+
+		memcpy(m_data + m_used, &v, 4);
+
+		m_used += 4;
+	}
+
+	void align(uint32_t alignment) noexcept
+	{
+		while (m_used % alignment != 0)
+			append_u8(0);
+	}
+
 	void append_str(const char* str, uint8_t bytes) noexcept
 	{
 		grow(bytes + 1);
@@ -85,6 +108,15 @@ public:
 		m_data[m_used - 1] = '\0';
 	}
 
+	void append_bytes(const void* bytes, uint32_t count) noexcept
+	{
+		grow(count);
+
+		memcpy(m_data + m_used, bytes, count);
+
+		m_used += count;
+	}
+
 	uint32_t size() const noexcept
 	{
 		return m_used;
@@ -129,11 +161,18 @@ struct enum_info
 {
 	spird::enum_flags flags;
 
-	uint16_t hashtable_entries;
+	uint16_t direct_count;
+
+	uint32_t sparse_count;
 
 	uint32_t data_bytes;
 
-	spird::elem_index* hashtable;
+	// Offsets of the elements with ids below direct_count, indexed by id.
+	// Ids without an element have an offset of ~0u.
+	uint32_t* direct;
+
+	// The remaining elements, sorted by id.
+	spird::elem_index* sparse;
 	
 	const void* data;
 };
@@ -146,6 +185,28 @@ static enum_info s_enum_infos[spird::enum_id_count + spird::max_named_enum_count
 
 static output_data s_output;
 
+// Names of all elements and arguments, referenced from the element records in
+// s_output by their offset. Starts with an empty string, so that offset 0
+// denotes an unnamed argument.
+static output_data s_strings;
+
+// Returns the offset of str in s_strings, appending it only if it is not
+// already present, possibly as the tail of a longer string.
+static uint32_t intern_string(const char* str, uint8_t bytes) noexcept
+{
+	const uint8_t* strings = s_strings.data();
+
+	for (uint32_t i = 0; i + bytes < s_strings.size(); ++i)
+		if (strings[i + bytes] == '\0' && memcmp(strings + i, str, bytes) == 0)
+			return i;
+
+	const uint32_t offset = s_strings.size();
+
+	s_strings.append_str(str, bytes);
+
+	return offset;
+}
+
 static const char* s_enum_names[spird::max_named_enum_count];
 
 static uint32_t s_named_enum_count = 0;
@@ -221,75 +282,102 @@ static const char* skip_whitespace(const char* str) noexcept
 
 }
 
-static void create_hashtable(uint16_t elem_count, const spird::elem_index* elems, uint16_t* out_table_size, spird::elem_index** out_table) noexcept
+static int compare_elem_ids(const void* lhs, const void* rhs) noexcept
 {
-	uint32_t table_size = (elem_count * 3) >> 1;
+	const uint32_t lhs_id = static_cast<const spird::elem_index*>(lhs)->id;
 
-	if (table_size > 0xFFFF)
-		panic("Size of table is greater than maximum of 0xFFFF.\n");
+	const uint32_t rhs_id = static_cast<const spird::elem_index*>(rhs)->id;
 
-	spird::elem_index* table = static_cast<spird::elem_index*>(malloc(table_size * sizeof(spird::elem_index)));
-
-	if (table == nullptr)
-		panic("malloc failed.\n");
+	return lhs_id < rhs_id ? -1 : lhs_id > rhs_id ? 1 : 0;
+}
 
-	memset(table, 0xFF, table_size * sizeof(spird::elem_index));
+// Splits elems into a directly indexed range of ids starting at 0 and a sorted
+// list of the remaining ids. The direct range is extended as far as at least
+// half of its ids are in use, which covers the dense core of most enums while
+// leaving sparse vendor ranges and high bitmask values to the sorted list.
+static void create_index(uint32_t elem_count, spird::elem_index* elems, enum_info* out_info) noexcept
+{
+	qsort(elems, elem_count, sizeof(spird::elem_index), compare_elem_ids);
 
-	uint16_t* offsets = static_cast<uint16_t*>(malloc(table_size * sizeof(uint16_t)));
+	for (uint32_t i = 1; i < elem_count; ++i)
+		if (elems[i].id == elems[i - 1].id)
+			panic("Element id %d is defined more than once.\n", elems[i].id);
 
-	if (offsets == nullptr)
-		panic("malloc failed.\n");
+	uint32_t direct_count = 0;
 
-	memset(offsets, 0x00, table_size * sizeof(uint16_t));
+	uint32_t direct_elem_count = 0;
 
-	for (uint32_t i = 0; i != elem_count; ++i)
+	for (uint32_t i = 0; i != elem_count && elems[i].id < 0xFFFF; ++i)
 	{
-		spird::elem_index elem = elems[i];
+		if ((i + 1) * 2 >= elems[i].id + 1)
+		{
+			direct_count = elems[i].id + 1;
 
-		uint32_t hash = hash_knuth(elem.id, table_size);
+			direct_elem_count = i + 1;
+		}
+	}
 
-		uint16_t offset = 0;
+	uint32_t* direct = static_cast<uint32_t*>(malloc((direct_count == 0 ? 1 : direct_count) * sizeof(uint32_t)));
 
-		while (table[hash].id != ~0u)
-		{
-			if (offset > offsets[hash])
-			{
-				uint16_t tmp_off = offsets[hash];
+	if (direct == nullptr)
+		panic("malloc failed.\n");
 
-				offsets[hash] = offset;
+	memset(direct, 0xFF, direct_count * sizeof(uint32_t));
 
-				offset = tmp_off;
+	for (uint32_t i = 0; i != direct_elem_count; ++i)
+		direct[elems[i].id] = elems[i].byte_offset;
 
-				spird::elem_index tmp_ind = table[hash];
+	const uint32_t sparse_count = elem_count - direct_elem_count;
 
-				table[hash] = elem;
+	spird::elem_index* sparse = static_cast<spird::elem_index*>(malloc((sparse_count == 0 ? 1 : sparse_count) * sizeof(spird::elem_index)));
 
-				elem = tmp_ind;
-			}
+	if (sparse == nullptr)
+		panic("malloc failed.\n");
 
-			++hash;
+	memcpy(sparse, elems + direct_elem_count, sparse_count * sizeof(spird::elem_index));
 
-			if (hash == table_size)
-				hash = 0;
+	out_info->direct_count = static_cast<uint16_t>(direct_count);
 
-			++offset;
-		}
+	out_info->sparse_count = sparse_count;
 
-		table[hash] = elem;
+	out_info->direct = direct;
 
-		offsets[hash] = offset;
-	}
+	out_info->sparse = sparse;
+}
+
+static uint32_t index_bytes(const enum_info& info) noexcept
+{
+	return info.direct_count * sizeof(uint32_t) + info.sparse_count * sizeof(spird::elem_index);
+}
+
+// Appends the index of info, turning element offsets relative to the element
+// data into file offsets. Absent ids in the direct range get an offset of 0.
+static void append_index(output_data& file, enum_info& info, uint32_t data_offset) noexcept
+{
+	for (uint32_t i = 0; i != info.direct_count; ++i)
+		info.direct[i] = info.direct[i] == ~0u ? 0 : info.direct[i] + data_offset;
 
-	*out_table_size = table_size;
+	for (uint32_t i = 0; i != info.sparse_count; ++i)
+		info.sparse[i].byte_offset += data_offset;
 
-	*out_table = table;
+	file.append_bytes(info.direct, info.direct_count * sizeof(uint32_t));
+
+	file.append_bytes(info.sparse, info.sparse_count * sizeof(spird::elem_index));
 }
 
-static bool parse_args(int argc, const char** argv, const char** out_input_filename, const char** out_output_filename) noexcept
+static bool parse_args(int argc, const char** argv, const char** out_input_filename, const char** out_output_filename, const char** out_header_filename) noexcept
 {
-	if (argc != 3)
+	if (argc == 5 && strcmp(argv[3], "--header") == 0)
+	{
+		*out_header_filename = argv[4];
+	}
+	else if (argc == 3)
+	{
+		*out_header_filename = nullptr;
+	}
+	else
 	{
-		fprintf(stderr, "Usage: %s inputfile outputfile\n", prog_name);
+		fprintf(stderr, "Usage: %s inputfile outputfile [--header headerfile]\n", prog_name);
 
 		if (argc == 2 && strcmp(argv[1], "--help") == 0)
 			fputs(extended_help_string, stderr);
@@ -753,34 +841,82 @@ void parse_enum(const char*& curr) noexcept
 
 		index_count++;
 
+		s_output.append_u32(intern_string(elem.name, elem.name_bytes));
+
 		s_output.append_u8(elem.argc);
 
-		s_output.append_str(elem.name, elem.name_bytes);
+		s_output.append_u8(elem.implies_or_depends_count);
+
+		s_output.append_u16(0);
 
 		for (uint8_t i = 0; i != elem.argc; ++i)
-		{
 			s_output.append_u8(static_cast<uint8_t>(elem.arg_flags[i]));
 
+		for (uint8_t i = 0; i != elem.argc; ++i)
 			s_output.append_u8(static_cast<uint8_t>(elem.arg_types[i]));
 
-			s_output.append_str(elem.arg_names[i], elem.arg_name_bytes[i]);
-		}
+		s_output.align(4);
 
-		s_output.append_u8(elem.implies_or_depends_count);
+		for (uint8_t i = 0; i != elem.argc; ++i)
+			s_output.append_u32(elem.arg_name_bytes[i] == 0 ? 0 : intern_string(elem.arg_names[i], elem.arg_name_bytes[i]));
 
 		for (uint8_t i = 0; i != (elem.implies_or_depends_count & 0x7F); ++i)
 			s_output.append_u16(elem.implies_or_depends[i]);
+
+		s_output.align(4);
 	}
 
 	curr = skip_whitespace(curr + 1);
 
 	out_info.data_bytes = s_output.data() + s_output.size() - out_info.data;
 
-	create_hashtable(index_count, s_data_indices, &out_info.hashtable_entries, &out_info.hashtable);
+	create_index(index_count, s_data_indices, &out_info);
 }
 
-char* read_input(const char* input_filename) noexcept
+#if defined(__linux__)
+// Maps the input file instead of copying it. This only works if the file's
+// size is not a multiple of the page size, since the zeroed remainder of its
+// last page then provides the null-terminator. Returns nullptr if the file
+// has to be read instead.
+static const char* map_input(const char* input_filename) noexcept
 {
+	const int fd = open(input_filename, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return nullptr;
+
+	struct stat input_stat;
+
+	if (fstat(fd, &input_stat) != 0 || input_stat.st_size == 0 || input_stat.st_size % sysconf(_SC_PAGESIZE) == 0)
+	{
+		close(fd);
+
+		return nullptr;
+	}
+
+	void* input = mmap(nullptr, static_cast<size_t>(input_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if (input == MAP_FAILED)
+		return nullptr;
+
+	// The input is parsed front to back exactly once.
+	madvise(input, static_cast<size_t>(input_stat.st_size), MADV_SEQUENTIAL);
+
+	return static_cast<const char*>(input);
+}
+#endif
+
+// Returns the null-terminated contents of the input file. These are never
+// freed, since they are used until the program exits.
+const char* read_input(const char* input_filename) noexcept
+{
+#if defined(__linux__)
+	if (const char* mapped_input = map_input(input_filename); mapped_input != nullptr)
+		return mapped_input;
+#endif
+
 	FILE* input_file;
 
 	if (fopen_s(&input_file, input_filename, "rb") != 0)
@@ -814,19 +950,13 @@ char* read_input(const char* input_filename) noexcept
 	return input;
 }
 
-void write_output(const char* output_filename) noexcept
+// Assembles the complete .spird file from the parsed enums into file.
+void build_file(output_data& file) noexcept
 {
-	output_data& od = s_output;
-
-	FILE* output_file;
-
-	if (fopen_s(&output_file, output_filename, "wb") != 0)
-		panic("Could not open file %s for writing.\n", output_filename);
-
 	uint32_t enum_count = 0;
 
 	for (uint32_t i = spird::enum_id_count; i != 0; --i)
-		if (s_enum_infos[i - 1].hashtable_entries != 0)
+		if (s_enum_infos[i - 1].direct_count + s_enum_infos[i - 1].sparse_count != 0)
 		{
 			enum_count = i;
 
@@ -837,8 +967,14 @@ void write_output(const char* output_filename) noexcept
 
 	uint32_t table_name_idx = 0;
 
+	uint32_t table_name_hashes[spird::max_named_enum_count]{};
+
+	spird::name_hash_slot table_name_slots[spird::max_named_enum_count];
+
 	for (uint32_t i = 0; i != s_named_enum_count; ++i)
 	{
+		const uint32_t table_name_beg = table_name_idx;
+
 		for (uint32_t j = 0; !is_whitespace(s_enum_names[i][j]) && s_enum_names[i][j] != '\0' && s_enum_names[i][j] != enum_flag_char; ++j)
 		{
 			if (table_name_idx >= sizeof(table_name_buf))
@@ -847,12 +983,29 @@ void write_output(const char* output_filename) noexcept
 			table_name_buf[table_name_idx++] = s_enum_names[i][j];
 		}
 
+		table_name_hashes[i] = hash_name(table_name_buf + table_name_beg, table_name_idx - table_name_beg);
+
+		table_name_slots[i].name_offset = static_cast<uint16_t>(sizeof(spird::file_header) + table_name_beg);
+
+		table_name_slots[i].enum_index = static_cast<uint16_t>(i);
+
 		if (table_name_idx >= sizeof(table_name_buf))
 			panic("Total table name characters exceed maximum of %d.\n", sizeof(table_name_buf));
 
 		table_name_buf[table_name_idx++] = '\0';
 	}
 
+	spird::name_hash_header name_hash_header;
+	name_hash_header.name_count = static_cast<uint16_t>(s_named_enum_count);
+	name_hash_header.bucket_count = static_cast<uint16_t>(perfect_hash_bucket_count(s_named_enum_count));
+
+	uint16_t name_hash_seeds[perfect_hash_bucket_count(spird::max_named_enum_count)];
+
+	uint16_t name_hash_indices[spird::max_named_enum_count];
+
+	if (!create_perfect_hash(s_named_enum_count, table_name_hashes, name_hash_seeds, name_hash_indices))
+		panic("Could not create hash table for enum names. Check for duplicate names.\n");
+
 	while (table_name_idx & 0x7)
 	{
 		if (table_name_idx >= sizeof(table_name_buf))
@@ -861,18 +1014,7 @@ void write_output(const char* output_filename) noexcept
 		table_name_buf[table_name_idx++] = '\0';
 	}
 
-	spird::file_header file_header;
-	file_header.version = 17;
-	file_header.unnamed_table_count = enum_count;
-	file_header.first_table_header_byte = table_name_idx + sizeof(spird::file_header);
-
-	if (fwrite(&file_header, 1, sizeof(file_header), output_file) != sizeof(file_header))
-		panic("Could not write to file %s.\n", output_filename);
-
-	if (fwrite(table_name_buf, 1, table_name_idx, output_file) != table_name_idx)
-		panic("Could not write to file %s.\n", output_filename);
-
-	uint32_t hashtable_offset = sizeof(spird::file_header) + sizeof(spird::table_header) * (enum_count + s_named_enum_count) + table_name_idx;
+	uint32_t index_offset = sizeof(spird::file_header) + sizeof(spird::table_header) * (enum_count + s_named_enum_count) + table_name_idx;
 
 	spird::table_header table_headers[spird::enum_id_count + spird::max_named_enum_count];
 	
@@ -880,15 +1022,17 @@ void write_output(const char* output_filename) noexcept
 
 	for (uint32_t i = 0; i != enum_count; ++i)
 	{
-		if (s_enum_infos[i].hashtable_entries != 0)
+		if (s_enum_infos[i].direct_count + s_enum_infos[i].sparse_count != 0)
 		{
 			table_headers[i].flags = s_enum_infos[i].flags;
 
-			table_headers[i].offset = hashtable_offset;
+			table_headers[i].offset = index_offset;
 
-			table_headers[i].size = s_enum_infos[i].hashtable_entries;
+			table_headers[i].direct_count = s_enum_infos[i].direct_count;
 
-			hashtable_offset += table_headers[i].size * sizeof(spird::elem_index);
+			table_headers[i].sparse_count = s_enum_infos[i].sparse_count;
+
+			index_offset += index_bytes(s_enum_infos[i]);
 		}
 	}
 	
@@ -896,66 +1040,114 @@ void write_output(const char* output_filename) noexcept
 	{
 		table_headers[enum_count + i].flags = s_enum_infos[spird::enum_id_count + i].flags;
 
-		table_headers[enum_count + i].offset = hashtable_offset;
+		table_headers[enum_count + i].offset = index_offset;
+
+		table_headers[enum_count + i].direct_count = s_enum_infos[spird::enum_id_count + i].direct_count;
 
-		table_headers[enum_count + i].size = s_enum_infos[spird::enum_id_count + i].hashtable_entries;
+		table_headers[enum_count + i].sparse_count = s_enum_infos[spird::enum_id_count + i].sparse_count;
 
-		hashtable_offset += table_headers[enum_count + i].size * sizeof(spird::elem_index);
+		index_offset += index_bytes(s_enum_infos[spird::enum_id_count + i]);
 	}
 
-	if (fwrite(table_headers, 1, (enum_count + s_named_enum_count) * sizeof(spird::table_header), output_file) != (enum_count + s_named_enum_count) * sizeof(spird::table_header))
-		panic("Could not write to file %s.\n", output_filename);
+	spird::file_header file_header;
+	file_header.version = spird::file_version;
+	file_header.unnamed_table_count = enum_count;
+	file_header.first_table_header_byte = table_name_idx + sizeof(spird::file_header);
+	file_header.string_pool_byte = index_offset + s_output.size();
+	file_header.name_hash_byte = (file_header.string_pool_byte + s_strings.size() + 1) & ~1u;
+
+	file.append_bytes(&file_header, sizeof(file_header));
+
+	file.append_bytes(table_name_buf, table_name_idx);
+
+	file.append_bytes(table_headers, (enum_count + s_named_enum_count) * sizeof(spird::table_header));
 
-	const uint32_t data_offset = hashtable_offset;
+	const uint32_t data_offset = index_offset;
 
 	for (uint32_t i = 0; i != enum_count; ++i)
-	{
-		if (s_enum_infos[i].hashtable_entries == 0)
-			continue;
+		append_index(file, s_enum_infos[i], data_offset);
+
+	for (uint32_t i = 0; i != s_named_enum_count; ++i)
+		append_index(file, s_enum_infos[spird::enum_id_count + i], data_offset);
 
-		for (uint32_t j = 0; j != s_enum_infos[i].hashtable_entries; ++j)
-			if (s_enum_infos[i].hashtable[j].id != ~0u)
-				s_enum_infos[i].hashtable[j].byte_offset += data_offset;
+	file.append_bytes(s_output.data(), s_output.size());
 
-		if (fwrite(s_enum_infos[i].hashtable, 1, s_enum_infos[i].hashtable_entries * sizeof(spird::elem_index), output_file) != s_enum_infos[i].hashtable_entries * sizeof(spird::elem_index))
-			panic("Could not write to file %s.\n", output_filename);
-	}
+	file.append_bytes(s_strings.data(), s_strings.size());
+
+	file.align(2);
+
+	file.append_bytes(&name_hash_header, sizeof(name_hash_header));
+
+	file.append_bytes(name_hash_seeds, name_hash_header.bucket_count * sizeof(uint16_t));
 
 	for (uint32_t i = 0; i != s_named_enum_count; ++i)
-	{
-		for (uint32_t j = 0; j != s_enum_infos[spird::enum_id_count + i].hashtable_entries; ++j)
-			if (s_enum_infos[spird::enum_id_count + i].hashtable[j].id != ~0u)
-				s_enum_infos[spird::enum_id_count + i].hashtable[j].byte_offset += data_offset;
+		file.append_bytes(table_name_slots + name_hash_indices[i], sizeof(spird::name_hash_slot));
+}
 
-		if (fwrite(s_enum_infos[spird::enum_id_count + i].hashtable, 1, s_enum_infos[spird::enum_id_count + i].hashtable_entries * sizeof(spird::elem_index), output_file) != s_enum_infos[spird::enum_id_count + i].hashtable_entries * sizeof(spird::elem_index))
-			panic("Could not write to file %s.\n", output_filename);
-	}
+void write_output(const char* output_filename, const output_data& file) noexcept
+{
+	FILE* output_file;
 
-	if (fwrite(s_output.data(), 1, s_output.size(), output_file) != s_output.size())
+	if (fopen_s(&output_file, output_filename, "wb") != 0)
+		panic("Could not open file %s for writing.\n", output_filename);
+
+	if (fwrite(file.data(), 1, file.size(), output_file) != file.size())
 		panic("Could not write to file %s.\n", output_filename);
 
 	fclose(output_file);
 }
 
+// Writes a C++ header holding the contents of file as a constexpr array.
+// Building the library against it removes the need for loading a .spird file
+// at runtime.
+void write_header(const char* header_filename, const output_data& file) noexcept
+{
+	FILE* header_file;
+
+	if (fopen_s(&header_file, header_filename, "wb") != 0)
+		panic("Could not open file %s for writing.\n", header_filename);
+
+	fputs("// Generated by spird-builder. Do not edit.\n\n#ifndef SPIRD_EMBEDDED_HPP_INCLUDE_GUARD\n#define SPIRD_EMBEDDED_HPP_INCLUDE_GUARD\n\n#include <cstdint>\n\nnamespace spird\n{\n", header_file);
+
+	fprintf(header_file, "\tstatic constexpr uint32_t embedded_bytes_count = %u;\n\n\talignas(8) static constexpr uint8_t embedded_bytes[embedded_bytes_count]\n\t{", file.size());
+
+	for (uint32_t i = 0; i != file.size(); ++i)
+		fprintf(header_file, i % 16 == 0 ? "\n\t\t0x%02X," : " 0x%02X,", file.data()[i]);
+
+	fputs("\n\t};\n}\n\n#endif // SPIRD_EMBEDDED_HPP_INCLUDE_GUARD\n", header_file);
+
+	if (ferror(header_file))
+		panic("Could not write to file %s.\n", header_filename);
+
+	fclose(header_file);
+}
+
 int main(int argc, const char** argv)
 {
 	prog_name = argv[0];
 
-	const char* input_filename, * output_filename;
-
-	bool no_implies_and_depends;
+	const char* input_filename, * output_filename, * header_filename;
 
-	if (!parse_args(argc, argv, &input_filename, &output_filename))
+	if (!parse_args(argc, argv, &input_filename, &output_filename, &header_filename))
 		return 1;
 
-	char* input_data = read_input(input_filename);
+	const char* input_data = read_input(input_filename);
+
+	s_strings.append_u8(0);
 
 	const char* curr = skip_whitespace(input_data);
 
 	while(*curr != '\0')
 		parse_enum(curr);
 
-	write_output(output_filename);
+	output_data file;
+
+	build_file(file);
+
+	write_output(output_filename, file);
+
+	if (header_filename != nullptr)
+		write_header(header_filename, file);
 
 	return 0;
 }
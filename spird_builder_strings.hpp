@@ -59,17 +59,18 @@ outputfile:
 File that receives the built SPIR-V instruction data.
 The format (in pseudo-c) is:
 
-struct argument
-{
-	uint8_t spirv_insn_argtype;
-	char argument_name[];
-};
-
 struct instruction
 {
+	uint32_t name_offset;
 	uint8_t argument_count;
-	char instruction_name[];
-	argument arguments[
+	uint8_t capability_count;
+	uint16_t unused;
+	uint8_t argument_flags[argument_count];
+	uint8_t argument_types[argument_count];
+	(padding to a multiple of 4 bytes)
+	uint32_t argument_name_offsets[argument_count];
+	uint16_t capabilities[capability_count];
+	(padding to a multiple of 4 bytes)
 };
 
 struct instruction_index
@@ -78,17 +79,28 @@ struct instruction_index
 	uint32_t instruction_offset;
 }
 
-uint32_t instruction_hashtable_size;
+uint32_t direct_offsets[direct_count];
 
-instruction_index instruction_hashtable[];
+instruction_index sparse_indices[sparse_count];
 
 instruction instructions[];
 
-where instruction_hashtable_size is the number of uint32_t in
-instruction_hashtable, and instruction_hashtable holds the byte-offset into the
-instructions array at which the given instruction is located.
-All character strings are null terminated, meaning that a '\\0' indicates the
-beginning of the next field.
+char strings[];
+
+uint16_t named_enum_count;
+uint16_t bucket_count;
+uint16_t seeds[bucket_count];
+struct { uint16_t name_offset; uint16_t enum_index; } slots[named_enum_count];
+
+where direct_offsets holds the byte-offset of the instruction with each opcode
+below direct_count, or 0 if there is no such instruction, and sparse_indices
+holds the remaining instructions sorted by opcode. direct_count is chosen so
+that at least half of the opcodes below it are used.
+Names are stored as null-terminated strings in strings, and referenced through
+their byte-offset into it. The first string is empty, so unnamed arguments have
+a name offset of 0.
+Named enums are looked up through a minimal perfect hash over their names,
+where a name's slot is found through the seed of its bucket.
 )";
 
 
@@ -97,6 +109,7 @@ R"(
 inputfile: Name of the file that contains the textual input which is used to build SPIR-V instruction
 data.
 outputfile: Name of the file that receives the built SPIR-V instruction data.
+headerfile: Optional name of a C++ header that receives the same data as a constexpr array.
 See --help for further information.
 )";
 
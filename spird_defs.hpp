@@ -21,17 +21,70 @@ namespace spird
 		uint16_t unnamed_table_count;
 
 		uint16_t first_table_header_byte;
+
+		// Start of the null-terminated names referenced by elem_record.
+		uint32_t string_pool_byte;
+
+		// Start of the name_hash_header for looking up named enums.
+		uint32_t name_hash_byte;
 	};
 
+	// Version of the format described by the structures below, which is
+	// stored in file_header::version.
+	static constexpr uint32_t file_version = 20;
+
+	// offset points to the table's index, which consists of direct_count
+	// uint32_t offsets of the elements with ids 0 to direct_count - 1, followed
+	// by sparse_count elem_index entries for all other elements, sorted by id.
+	// Ids in the direct range that have no element have an offset of 0.
 	struct table_header
 	{
-		uint16_t size;
+		uint16_t direct_count;
 
 		enum_flags flags;
 
 		uint32_t offset;
+
+		uint32_t sparse_count;
 	};
 	
+	// Minimal perfect hash table mapping the names of named enums to their
+	// index. The header is followed by bucket_count uint16_t seeds and
+	// name_count name_hash_slot, as described in spird_hashing.hpp.
+	struct name_hash_header
+	{
+		uint16_t name_count;
+
+		uint16_t bucket_count;
+	};
+
+	// name_offset is the byte offset of the enum's null-terminated name from
+	// the start of the file.
+	struct name_hash_slot
+	{
+		uint16_t name_offset;
+
+		uint16_t enum_index;
+	};
+
+	// Entry of a single element, which is followed by argc arg_flags, argc
+	// arg_type, padding to a multiple of four bytes, argc uint32_t offsets of
+	// the arguments' names into the string pool and the element's capabilities
+	// as uint16_t, again padded to a multiple of four bytes. Unnamed arguments
+	// have a name offset of 0, which points to an empty string.
+	struct elem_record
+	{
+		uint32_t name;
+
+		uint8_t argc;
+
+		// Number of capabilities, with the high bit set if they are implied
+		// instead of depended upon.
+		uint8_t implies_or_depends;
+
+		uint16_t unused;
+	};
+
 	static constexpr uint32_t enum_id_count = 41;
 
 	static constexpr uint32_t max_named_enum_count = 64;
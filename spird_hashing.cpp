@@ -1,5 +1,8 @@
 #include "spird_hashing.hpp"
 
+#include <cstdlib>
+#include <cstring>
+
 uint32_t hash_knuth(uint32_t v, uint32_t table_size) noexcept
 {
 	// Use Knuth's hash algorithm
@@ -16,3 +19,129 @@ uint32_t hash_knuth(uint32_t v, uint32_t table_size) noexcept
 
 	return hash;
 }
+
+uint32_t hash_name(const char* name, uint32_t bytes) noexcept
+{
+	// FNV-1a
+
+	uint32_t hash = 2166136261;
+
+	for (uint32_t i = 0; i != bytes; ++i)
+		hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619;
+
+	return hash;
+}
+
+static uint32_t seeded_hash(uint32_t name_hash, uint32_t seed) noexcept
+{
+	// Finalizer of MurmurHash3, so that nearby seeds give unrelated slots.
+
+	uint32_t hash = name_hash ^ (seed * 2654435769);
+
+	hash ^= hash >> 16;
+
+	hash *= 0x85EBCA6B;
+
+	hash ^= hash >> 13;
+
+	hash *= 0xC2B2AE35;
+
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+// Finds a seed for which the bucket_size names in bucket_names all land in
+// distinct free slots, and claims these slots.
+static bool place_bucket(uint32_t name_count, const uint32_t* name_hashes, uint32_t bucket_size, const uint32_t* bucket_names, uint16_t* out_seed, uint16_t* slots) noexcept
+{
+	for (uint32_t seed = 1; seed != 0x10000; ++seed)
+	{
+		bool fits = true;
+
+		for (uint32_t i = 0; i != bucket_size && fits; ++i)
+		{
+			const uint32_t slot = seeded_hash(name_hashes[bucket_names[i]], seed) % name_count;
+
+			if (slots[slot] != 0xFFFF)
+				fits = false;
+
+			for (uint32_t j = 0; j != i && fits; ++j)
+				if (seeded_hash(name_hashes[bucket_names[j]], seed) % name_count == slot)
+					fits = false;
+		}
+
+		if (fits)
+		{
+			for (uint32_t i = 0; i != bucket_size; ++i)
+				slots[seeded_hash(name_hashes[bucket_names[i]], seed) % name_count] = static_cast<uint16_t>(bucket_names[i]);
+
+			*out_seed = static_cast<uint16_t>(seed);
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool create_perfect_hash(uint32_t name_count, const uint32_t* name_hashes, uint16_t* out_seeds, uint16_t* out_slots) noexcept
+{
+	if (name_count >= 0xFFFF)
+		return false;
+
+	const uint32_t bucket_count = perfect_hash_bucket_count(name_count);
+
+	uint32_t* const bucket_sizes = static_cast<uint32_t*>(malloc((bucket_count + name_count) * sizeof(uint32_t)));
+
+	if (bucket_sizes == nullptr)
+		return false;
+
+	uint32_t* const bucket_names = bucket_sizes + bucket_count;
+
+	memset(bucket_sizes, 0, bucket_count * sizeof(uint32_t));
+
+	memset(out_seeds, 0, bucket_count * sizeof(uint16_t));
+
+	memset(out_slots, 0xFF, name_count * sizeof(uint16_t));
+
+	uint32_t max_bucket_size = 0;
+
+	for (uint32_t i = 0; i != name_count; ++i)
+	{
+		const uint32_t bucket_size = ++bucket_sizes[name_hashes[i] % bucket_count];
+
+		if (bucket_size > max_bucket_size)
+			max_bucket_size = bucket_size;
+	}
+
+	bool success = true;
+
+	// Larger buckets are harder to place, so they go first while most slots
+	// are still free.
+	for (uint32_t size = max_bucket_size; size != 0 && success; --size)
+	{
+		for (uint32_t bucket = 0; bucket != bucket_count && success; ++bucket)
+		{
+			if (bucket_sizes[bucket] != size)
+				continue;
+
+			uint32_t bucket_size = 0;
+
+			for (uint32_t i = 0; i != name_count; ++i)
+				if (name_hashes[i] % bucket_count == bucket)
+					bucket_names[bucket_size++] = i;
+
+			success = place_bucket(name_count, name_hashes, bucket_size, bucket_names, out_seeds + bucket, out_slots);
+		}
+	}
+
+	free(bucket_sizes);
+
+	return success;
+}
+
+uint32_t perfect_hash_slot(uint32_t name_hash, uint32_t name_count, const uint16_t* seeds) noexcept
+{
+	return seeded_hash(name_hash, seeds[name_hash % perfect_hash_bucket_count(name_count)]) % name_count;
+}
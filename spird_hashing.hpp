@@ -5,4 +5,24 @@
 
 uint32_t hash_knuth(uint32_t v, uint32_t table_size) noexcept;
 
-#endif // SPV_DATA_HASHING_HPP_INCLUDE_GUARD
\ No newline at end of file
+uint32_t hash_name(const char* name, uint32_t bytes) noexcept;
+
+// Minimal perfect hashing through hash and displace. Names are distributed
+// into bucket_count buckets by their hash, after which each bucket receives a
+// seed that places all of its names into distinct free slots of a table with
+// exactly one slot per name. Looking up a name thus takes two hashes and a
+// single comparison against the name in its slot.
+constexpr uint32_t perfect_hash_bucket_count(uint32_t name_count) noexcept
+{
+	return name_count / 2 + 1;
+}
+
+// Fills out_seeds with bucket_count seeds and out_slots with the index of the
+// name in each of the name_count slots. Returns false if no seeds could be
+// found, which only happens if names are duplicated, or if allocating
+// temporary memory failed.
+bool create_perfect_hash(uint32_t name_count, const uint32_t* name_hashes, uint16_t* out_seeds, uint16_t* out_slots) noexcept;
+
+uint32_t perfect_hash_slot(uint32_t name_hash, uint32_t name_count, const uint16_t* seeds) noexcept;
+
+#endif // SPV_DATA_HASHING_HPP_INCLUDE_GUARD
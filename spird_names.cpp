@@ -2,6 +2,8 @@
 
 #include <cstring>
 
+#include "spird_hashing.hpp"
+
 static constexpr const char* const arg_type_names_low_part[]
 {
 	"INSTRUCTION",
@@ -550,6 +552,98 @@ static bool names_equal(const char* a, uint32_t a_bytes, const char* b) noexcept
 	return false;
 }
 
+static constexpr uint32_t arg_type_low_count = sizeof(arg_type_names_low_part) / sizeof(*arg_type_names_low_part);
+
+static constexpr uint32_t arg_type_high_count = sizeof(arg_type_names_high_part) / sizeof(*arg_type_names_high_part);
+
+static constexpr uint32_t capability_count = sizeof(capability_names) / sizeof(*capability_names);
+
+static constexpr uint32_t enum_count = sizeof(enum_names) / sizeof(*enum_names);
+
+// Minimal perfect hash table over one of the name arrays above, mapping each
+// name to its index. Indices of arg types run through the low part and then
+// through the high part.
+template<uint32_t Count>
+struct name_hash_table
+{
+	uint16_t seeds[perfect_hash_bucket_count(Count)];
+
+	uint16_t slots[Count];
+
+	bool is_valid;
+};
+
+using name_at_fn = const char* (*) (uint32_t index) noexcept;
+
+static const char* arg_type_name_at(uint32_t index) noexcept
+{
+	if (index < arg_type_low_count)
+		return arg_type_names_low_part[index];
+
+	return arg_type_names_high_part[index - arg_type_low_count];
+}
+
+static const char* capability_name_at(uint32_t index) noexcept
+{
+	return capability_names[index];
+}
+
+static const char* enum_name_at(uint32_t index) noexcept
+{
+	return enum_names[index];
+}
+
+template<uint32_t Count>
+static name_hash_table<Count> create_name_hash_table(name_at_fn name_at) noexcept
+{
+	name_hash_table<Count> table;
+
+	uint32_t name_hashes[Count];
+
+	for (uint32_t i = 0; i != Count; ++i)
+	{
+		const char* name = name_at(i);
+
+		name_hashes[i] = hash_name(name, static_cast<uint32_t>(strlen(name)));
+	}
+
+	table.is_valid = create_perfect_hash(Count, name_hashes, table.seeds, table.slots);
+
+	return table;
+}
+
+// Looks up the index of a name, which is null-terminated if bytes is 0. The
+// tables are built on first use and fall back to a linear scan in the
+// unlikely case that building them failed.
+template<uint32_t Count>
+static bool find_name(const name_hash_table<Count>& table, name_at_fn name_at, const char* name, uint32_t bytes, uint32_t* out_index) noexcept
+{
+	if (!table.is_valid)
+	{
+		for (uint32_t i = 0; i != Count; ++i)
+			if (names_equal(name, bytes, name_at(i)))
+			{
+				*out_index = i;
+
+				return true;
+			}
+
+		return false;
+	}
+
+	if (bytes == 0)
+		bytes = static_cast<uint32_t>(strlen(name));
+
+	const uint32_t index = table.slots[perfect_hash_slot(hash_name(name, bytes), Count, table.seeds)];
+
+	if (!names_equal(name, bytes, name_at(index)))
+		return false;
+
+	*out_index = index;
+
+	return true;
+}
+
 bool spird::get_name_from_arg_type(spird::arg_type type, const char** out_name) noexcept
 {
 	if (static_cast<uint8_t>(type) < sizeof(arg_type_names_low_part) / sizeof(*arg_type_names_low_part))
@@ -571,23 +665,19 @@ bool spird::get_name_from_arg_type(spird::arg_type type, const char** out_name)
 
 bool spird::get_arg_type_from_name(const char* name, uint32_t bytes, spird::arg_type* out_type) noexcept
 {
-	for (uint32_t i = 0; i != sizeof(arg_type_names_low_part) / sizeof(*arg_type_names_low_part); ++i)
-		if (names_equal(name, bytes, arg_type_names_low_part[i]))
-		{
-			*out_type = static_cast<spird::arg_type>(i);
+	static const name_hash_table<arg_type_low_count + arg_type_high_count> table = create_name_hash_table<arg_type_low_count + arg_type_high_count>(arg_type_name_at);
 
-			return true;
-		}
+	uint32_t index;
 
-	for (uint32_t i = 0; i != sizeof(arg_type_names_high_part) / sizeof(*arg_type_names_high_part); ++i)
-		if (names_equal(name, bytes, arg_type_names_high_part[i]))
-		{
-			*out_type = static_cast<spird::arg_type>(256 - sizeof(arg_type_names_high_part) / sizeof(*arg_type_names_high_part) + i);
+	if (!find_name(table, arg_type_name_at, name, bytes, &index))
+		return false;
 
-			return true;
-		}
+	if (index < arg_type_low_count)
+		*out_type = static_cast<spird::arg_type>(index);
+	else
+		*out_type = static_cast<spird::arg_type>(256 - arg_type_high_count + index - arg_type_low_count);
 
-	return false;
+	return true;
 }
 
 bool spird::get_name_from_capability_id(uint16_t id, const char** out_name) noexcept
@@ -605,15 +695,16 @@ bool spird::get_name_from_capability_id(uint16_t id, const char** out_name) noex
 
 bool spird::get_capability_id_from_name(const char* name, uint32_t bytes, uint16_t* out_id) noexcept
 {
-	for (uint32_t i = 0; i != sizeof(capability_names) / sizeof(*capability_names); ++i)
-		if (names_equal(name, bytes, capability_names[i]))
-		{
-			*out_id = capability_ids[i];
+	static const name_hash_table<capability_count> table = create_name_hash_table<capability_count>(capability_name_at);
 
-			return true;
-		}
+	uint32_t index;
 
-	return false;
+	if (!find_name(table, capability_name_at, name, bytes, &index))
+		return false;
+
+	*out_id = capability_ids[index];
+
+	return true;
 }
 
 bool spird::get_name_from_enum_id(spird::enum_id id, const char** out_name) noexcept
@@ -630,13 +721,14 @@ bool spird::get_name_from_enum_id(spird::enum_id id, const char** out_name) noex
 
 bool spird::get_enum_id_from_name(const char* name, uint32_t bytes, spird::enum_id* out_id) noexcept
 {
-	for (uint32_t i = 0; i != sizeof(enum_names) / sizeof(*enum_names); ++i)
-		if (names_equal(name, bytes, enum_names[i]))
-		{
-			*out_id = static_cast<spird::enum_id>(i);
+	static const name_hash_table<enum_count> table = create_name_hash_table<enum_count>(enum_name_at);
 
-			return true;
-		}
+	uint32_t index;
 
-	return false;
+	if (!find_name(table, enum_name_at, name, bytes, &index))
+		return false;
+
+	*out_id = static_cast<spird::enum_id>(index);
+
+	return true;
 }
@@ -33,6 +33,18 @@ namespace spvcpu
 		unhandled_float_width,
 		expected_constant,
 		unknown_constant_instruction,
+		entry_point_not_found,
+		unbound_resource,
+		unhandled_ext_inst,
+		unhandled_image_format,
+		unhandled_builtin,
+		invocation_finished,
+		unsupported_lane_count,
+		thread_creation_failed,
+		too_many_workgroups,
+		output_sink_failed,
+		changed_range_out_of_bounds,
+		spirv_data_not_embedded,
 	};
 }
 
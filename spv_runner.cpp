@@ -1,27 +1,584 @@
 #include "spv_runner.hpp"
 
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "runner_program.hpp"
+
+static const char* entry_point_name(const cpu_program* program, uint32_t index) noexcept
+{
+	return program->m_strings.data() + program->m_entry_points[index].name_offset;
+}
+
+static void write_builtin(const invocation_state* state, const spvcpu::module_init_info* init_info, Builtin builtin, uint32_t* out) noexcept
+{
+	const uint32_t* local_size = state->m_local_size;
+
+	const uint32_t* local_id = init_info->local_invocation_id;
+
+	const uint32_t* group_id = init_info->workgroup_id;
+
+	const uint32_t local_index = local_id[0] + local_id[1] * local_size[0] + local_id[2] * local_size[0] * local_size[1];
+
+	switch (builtin)
+	{
+	case Builtin::NumWorkgroups:
+		memcpy(out, init_info->workgroup_count, 12);
+		break;
+
+	case Builtin::WorkgroupSize:
+		memcpy(out, local_size, 12);
+		break;
+
+	case Builtin::WorkgroupId:
+		memcpy(out, group_id, 12);
+		break;
+
+	case Builtin::LocalInvocationId:
+		memcpy(out, local_id, 12);
+		break;
+
+	case Builtin::GlobalInvocationId:
+		for (uint32_t i = 0; i != 3; ++i)
+			out[i] = group_id[i] * local_size[i] + local_id[i];
+		break;
+
+	case Builtin::LocalInvocationIndex:
+	case Builtin::SubgroupId:
+		out[0] = local_index;
+		break;
+
+	// Subgroups consist of a single invocation.
+	case Builtin::NumSubgroups:
+		out[0] = local_size[0] * local_size[1] * local_size[2];
+		break;
+
+	case Builtin::SubgroupSize:
+	case Builtin::SubgroupMaxSize:
+		out[0] = 1;
+		break;
+
+	case Builtin::SubgroupLocalInvocationId:
+		out[0] = 0;
+		break;
+
+	case Builtin::SubgroupEqMask:
+	case Builtin::SubgroupGeMask:
+	case Builtin::SubgroupLeMask:
+		out[0] = 1;
+		out[1] = 0;
+		out[2] = 0;
+		out[3] = 0;
+		break;
+
+	default:
+		memset(out, 0, 16);
+		break;
+	}
+}
+
+static bool is_handled_builtin(Builtin builtin) noexcept
+{
+	switch (builtin)
+	{
+	case Builtin::NumWorkgroups:
+	case Builtin::WorkgroupSize:
+	case Builtin::WorkgroupId:
+	case Builtin::LocalInvocationId:
+	case Builtin::GlobalInvocationId:
+	case Builtin::LocalInvocationIndex:
+	case Builtin::SubgroupId:
+	case Builtin::NumSubgroups:
+	case Builtin::SubgroupSize:
+	case Builtin::SubgroupMaxSize:
+	case Builtin::SubgroupLocalInvocationId:
+	case Builtin::SubgroupEqMask:
+	case Builtin::SubgroupGeMask:
+	case Builtin::SubgroupGtMask:
+	case Builtin::SubgroupLeMask:
+	case Builtin::SubgroupLtMask:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static void free_invocation_state(invocation_state* state) noexcept
+{
+	free(state->m_registers);
+
+	free(state->m_memory);
+
+	free(state->m_scratch);
+
+	free(state->m_frames);
+
+	free(state->m_images);
+
+	free(state->m_variable_bytes);
+
+	free(state);
+}
+
+static spvcpu::result bind_variables(invocation_state* state, const spvcpu::module_init_info* init_info) noexcept
+{
+	const cpu_program* const program = state->m_program;
+
+	for (uint32_t i = 0; i != program->m_variables.size(); ++i)
+	{
+		const program_variable& var = program->m_variables[i];
+
+		void* ptr = nullptr;
+
+		uint64_t bytes = program->m_layout_nodes[var.node].memory_bytes;
+
+		if (var.storage_class == StorageClass::PushConstant)
+		{
+			if (init_info->push_constants == nullptr)
+				return spvcpu::result::unbound_resource;
+
+			ptr = const_cast<void*>(init_info->push_constants);
+
+			bytes = init_info->push_constant_bytes;
+		}
+		else if (var.storage_class == StorageClass::Uniform || var.storage_class == StorageClass::StorageBuffer)
+		{
+			for (uint32_t j = 0; j != init_info->buffer_count; ++j)
+			{
+				if (init_info->buffers[j].descriptor_set == var.descriptor_set && init_info->buffers[j].binding == var.binding)
+				{
+					ptr = init_info->buffers[j].data;
+
+					bytes = init_info->buffers[j].bytes;
+
+					break;
+				}
+			}
+
+			if (ptr == nullptr)
+				return spvcpu::result::unbound_resource;
+		}
+		else
+		{
+			ptr = state->m_memory + var.memory_offset;
+		}
+
+		if (var.is_image)
+		{
+			const spvcpu::image_binding* image = nullptr;
+
+			for (uint32_t j = 0; j != init_info->image_count; ++j)
+			{
+				if (init_info->images[j].descriptor_set == var.descriptor_set && init_info->images[j].binding == var.binding)
+				{
+					state->m_images[j] = init_info->images[j];
+
+					image = state->m_images + j;
+
+					break;
+				}
+			}
+
+			if (image == nullptr)
+				return spvcpu::result::unbound_resource;
+
+			memcpy(ptr, &image, sizeof(image));
+		}
+
+		if (var.builtin != ~0u && !is_handled_builtin(static_cast<Builtin>(var.builtin)))
+			return spvcpu::result::unhandled_builtin;
+
+		state->m_variable_bytes[i] = bytes;
+
+		const uint64_t address = reinterpret_cast<uintptr_t>(ptr);
+
+		uint32_t* const reg = state->m_registers + program->m_register_offsets[var.id];
+
+		reg[0] = static_cast<uint32_t>(address);
+
+		reg[1] = static_cast<uint32_t>(address >> 32);
+	}
+
+	return spvcpu::result::success;
+}
 
 __declspec(dllexport) spvcpu::result spvcpu::create_cpu_module(uint64_t spirv_bytes, const void* spirv, const void* spird, void** out_module) noexcept
 {
+	return create_cpu_module_cached(spirv_bytes, spirv, spird, nullptr, out_module);
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::create_cpu_module_cached(uint64_t spirv_bytes, const void* spirv, const void* spird, const char* cache_directory, void** out_module) noexcept
+{
+	*out_module = nullptr;
+
+	cpu_program* program = new(std::nothrow) cpu_program{};
+
+	if (program == nullptr)
+		return result::no_memory;
+
+	if (cache_directory != nullptr)
+	{
+		if (load_cached_program(cache_directory, spirv_bytes, spirv, spird, program))
+		{
+			thread_program(program);
+
+			*out_module = program;
 
+			return result::success;
+		}
+
+		// A partially loaded program cannot be reused for lowering.
+		delete program;
+
+		program = new(std::nothrow) cpu_program{};
+
+		if (program == nullptr)
+			return result::no_memory;
+	}
+
+	if (result rst = lower_program(spirv_bytes, spirv, spird, program); rst != result::success)
+	{
+		delete program;
+
+		return rst;
+	}
+
+	thread_program(program);
+
+	if (program->m_entry_points.size() == 0)
+	{
+		delete program;
+
+		return result::entry_point_not_found;
+	}
+
+#if defined(SPVCPU_JIT)
+	if (result rst = compile_native(program); rst != result::success)
+	{
+		delete program;
+
+		return rst;
+	}
+#endif
+
+	if (cache_directory != nullptr)
+		store_cached_program(cache_directory, spirv_bytes, spirv, spird, program);
+
+	*out_module = program;
+
+	return result::success;
 }
 
 __declspec(dllexport) spvcpu::result spvcpu::free_cpu_module(void* module) noexcept
 {
+	delete static_cast<cpu_program*>(module);
 
+	return result::success;
+}
+
+// Creates the state of the invocation described by init_info, ready to run from
+// the start of its entry point.
+static spvcpu::result create_invocation(const cpu_program* program, const spvcpu::module_init_info* init_info, invocation_state** out_state) noexcept
+{
+	uint32_t entry_index = 0;
+
+	if (init_info->entry_point_name != nullptr)
+	{
+		while (entry_index != program->m_entry_points.size() && strcmp(entry_point_name(program, entry_index), init_info->entry_point_name) != 0)
+			++entry_index;
+
+		if (entry_index == program->m_entry_points.size())
+			return spvcpu::result::entry_point_not_found;
+	}
+
+	invocation_state* state = static_cast<invocation_state*>(calloc(1, sizeof(invocation_state)));
+
+	if (state == nullptr)
+		return spvcpu::result::no_memory;
+
+	state->m_program = program;
+	state->m_registers = static_cast<uint32_t*>(calloc(1, program->m_register_words * 4 + 4));
+	state->m_memory = static_cast<uint8_t*>(calloc(1, program->m_memory_bytes + 16));
+	state->m_scratch = static_cast<uint32_t*>(malloc(program->m_scratch_words * 4 + 4));
+	state->m_frames = static_cast<call_frame*>(malloc((program->m_function_count + 1) * sizeof(call_frame)));
+	state->m_images = static_cast<spvcpu::image_binding*>(malloc((init_info->image_count + 1) * sizeof(spvcpu::image_binding)));
+	state->m_variable_bytes = static_cast<uint64_t*>(malloc((program->m_variables.size() + 1) * sizeof(uint64_t)));
+
+	if (state->m_registers == nullptr || state->m_memory == nullptr || state->m_scratch == nullptr || state->m_frames == nullptr || state->m_images == nullptr || state->m_variable_bytes == nullptr)
+	{
+		free_invocation_state(state);
+
+		return spvcpu::result::no_memory;
+	}
+
+	memcpy(state->m_registers, program->m_initial_registers.data(), program->m_pool_words * 4);
+
+	if (spvcpu::result rst = bind_variables(state, init_info); rst != spvcpu::result::success)
+	{
+		free_invocation_state(state);
+
+		return rst;
+	}
+
+	// Run the prologue computing the values of OpSpecConstantOp and
+	// OpSpecConstantComposite. It occupies the start of the instruction stream.
+	state->m_pc = 0;
+	state->m_frame_cnt = 0;
+	state->m_prev_block = 0;
+	state->m_status = spvcpu::execution_status::running;
+
+	if (spvcpu::result rst = execute(state, false); rst != spvcpu::result::success)
+	{
+		free_invocation_state(state);
+
+		return rst;
+	}
+
+	const entry_point_info& entry = program->m_entry_points[entry_index];
+
+	if (program->m_workgroup_size_id != 0)
+		memcpy(state->m_local_size, state->m_registers + program->m_register_offsets[program->m_workgroup_size_id], 12);
+	else
+		memcpy(state->m_local_size, entry.local_size, 12);
+
+	for (uint32_t i = 0; i != program->m_variables.size(); ++i)
+	{
+		const program_variable& var = program->m_variables[i];
+
+		uint32_t* const reg = state->m_registers + program->m_register_offsets[var.id];
+
+		uint8_t* const ptr = reinterpret_cast<uint8_t*>(static_cast<uintptr_t>(reg[0] | (static_cast<uint64_t>(reg[1]) << 32)));
+
+		if (var.builtin != ~0u)
+			write_builtin(state, init_info, static_cast<Builtin>(var.builtin), reinterpret_cast<uint32_t*>(ptr));
+
+		if (var.initializer != 0)
+			memcpy(ptr, state->m_registers + program->m_register_offsets[var.initializer], program->m_layout_nodes[var.node].register_words * 4);
+	}
+
+	state->m_pc = entry.function_pc;
+	state->m_status = spvcpu::execution_status::running;
+
+	*out_state = state;
+
+	return spvcpu::result::success;
 }
 
 __declspec(dllexport) spvcpu::result spvcpu::initialize_cpu_module(const void* module, const module_init_info* init_info, module_state* out_initial_state) noexcept
 {
+	const cpu_program* const program = static_cast<const cpu_program*>(module);
 
+	invocation_state* state;
+
+	if (result rst = create_invocation(program, init_info, &state); rst != result::success)
+		return rst;
+
+	out_initial_state->m_variable_count = program->m_id_bound;
+	out_initial_state->m_variable_data = state->m_registers;
+	out_initial_state->m_variable_offsets = program->m_register_offsets.data();
+	out_initial_state->m_variable_names = const_cast<const char**>(program->m_id_names.data());
+	out_initial_state->m_status = state->m_status;
+	out_initial_state->m_opaque_data = state;
+
+	return result::success;
 }
 
 __declspec(dllexport) spvcpu::result spvcpu::step_module(const void* initialized_module, module_state* state) noexcept
 {
+	invocation_state* const invocation = static_cast<invocation_state*>(state->m_opaque_data);
+
+	if (invocation->m_program != initialized_module)
+		return result::incompatible_types;
+
+	if (invocation->m_status == execution_status::finished)
+		return result::invocation_finished;
+
+	const result rst = execute(invocation, true);
+
+	state->m_status = invocation->m_status;
+
+	return rst;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::run_module(const void* initialized_module, module_state* state) noexcept
+{
+	invocation_state* const invocation = static_cast<invocation_state*>(state->m_opaque_data);
+
+	if (invocation->m_program != initialized_module)
+		return result::incompatible_types;
+
+	if (invocation->m_status == execution_status::finished)
+		return result::invocation_finished;
+
+	const result rst = execute(invocation, false);
+
+	state->m_status = invocation->m_status;
+
+	return rst;
+}
+
+// Points the invocation's Workgroup variables into memory shared by all
+// invocations of its workgroup.
+static void share_workgroup_variables(const cpu_program* program, uint32_t* registers, uint8_t* workgroup_memory) noexcept
+{
+	for (uint32_t i = 0; i != program->m_variables.size(); ++i)
+	{
+		const program_variable& var = program->m_variables[i];
+
+		if (var.storage_class != StorageClass::Workgroup)
+			continue;
+
+		const uint64_t address = reinterpret_cast<uintptr_t>(workgroup_memory + var.memory_offset);
+
+		uint32_t* const reg = registers + program->m_register_offsets[var.id];
 
+		reg[0] = static_cast<uint32_t>(address);
+
+		reg[1] = static_cast<uint32_t>(address >> 32);
+	}
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::run_workgroup(const void* module, const module_init_info* init_info, uint32_t lane_count) noexcept
+{
+	if (lane_count != 1 && lane_count != 8 && lane_count != 16)
+		return result::unsupported_lane_count;
+
+	const cpu_program* const program = static_cast<const cpu_program*>(module);
+
+	// The workgroup's size is only known once the prologue has run, so start with
+	// the first invocation.
+	module_init_info lane_info = *init_info;
+
+	memset(lane_info.local_invocation_id, 0, sizeof(lane_info.local_invocation_id));
+
+	invocation_state* first;
+
+	if (result rst = create_invocation(program, &lane_info, &first); rst != result::success)
+		return rst;
+
+	const uint32_t local_size[3]{ first->m_local_size[0], first->m_local_size[1], first->m_local_size[2] };
+
+	free_invocation_state(first);
+
+	const uint32_t invocation_count = local_size[0] * local_size[1] * local_size[2];
+
+	const uint32_t batch_count = (invocation_count + lane_count - 1) / lane_count;
+
+	const uint32_t state_count = batch_count * lane_count;
+
+	// All invocations of the workgroup have to be alive at the same time, since
+	// any of them may be suspended at a barrier waiting for the others.
+	invocation_state** const states = static_cast<invocation_state**>(calloc(state_count, sizeof(invocation_state*)));
+
+	uint32_t* const registers = lane_count == 1 ? nullptr : static_cast<uint32_t*>(malloc(static_cast<uint64_t>(program->m_register_words) * state_count * 4 + 4));
+
+	uint8_t* const workgroup_memory = static_cast<uint8_t*>(calloc(1, program->m_memory_bytes + 16));
+
+	if (states == nullptr || (registers == nullptr && lane_count != 1) || workgroup_memory == nullptr)
+	{
+		free(states);
+
+		free(registers);
+
+		free(workgroup_memory);
+
+		return result::no_memory;
+	}
+
+	result rst = result::success;
+
+	for (uint32_t s = 0; s != state_count; ++s)
+	{
+		// Lanes past the end of the workgroup replay its last invocation, but are
+		// marked as finished and thus never executed.
+		const uint32_t index = s < invocation_count ? s : invocation_count - 1;
+
+		lane_info.local_invocation_id[0] = index % local_size[0];
+		lane_info.local_invocation_id[1] = (index / local_size[0]) % local_size[1];
+		lane_info.local_invocation_id[2] = index / (local_size[0] * local_size[1]);
+
+		if (rst = create_invocation(program, &lane_info, states + s); rst != result::success)
+			break;
+
+		invocation_state* const state = states[s];
+
+		if (s >= invocation_count)
+			state->m_status = execution_status::finished;
+
+		state->m_suspend_at_barrier = true;
+
+		share_workgroup_variables(program, state->m_registers, workgroup_memory);
+
+		// Without batching, invocations keep their own register file.
+		if (lane_count == 1)
+			continue;
+
+		uint32_t* const batch_registers = registers + static_cast<uint64_t>(s / lane_count) * program->m_register_words * lane_count + s % lane_count;
+
+		for (uint32_t w = 0; w != program->m_register_words; ++w)
+			batch_registers[w * lane_count] = state->m_registers[w];
+
+		free(state->m_registers);
+
+		state->m_registers = batch_registers;
+	}
+
+	// Run every invocation or batch until it has either finished or reached a
+	// barrier. Once all of them have, release those waiting at the barrier and
+	// go again. Suspended invocations keep all their state in their
+	// invocation_state, so this only takes a pass over the workgroup.
+	bool is_waiting = rst == result::success;
+
+	while (is_waiting)
+	{
+		for (uint32_t b = 0; b != batch_count && rst == result::success; ++b)
+			rst = lane_count == 1 ? execute(states[b], false) : execute_lanes(states + b * lane_count, lane_count);
+
+		if (rst != result::success)
+			break;
+
+		is_waiting = false;
+
+		for (uint32_t s = 0; s != state_count; ++s)
+		{
+			if (states[s]->m_status == execution_status::barrier)
+			{
+				states[s]->m_status = execution_status::running;
+
+				is_waiting = true;
+			}
+		}
+	}
+
+	for (uint32_t s = 0; s != state_count; ++s)
+	{
+		if (states[s] == nullptr)
+			continue;
+
+		// The invocation's registers are part of the batches' register file.
+		if (lane_count != 1)
+			states[s]->m_registers = nullptr;
+
+		free_invocation_state(states[s]);
+	}
+
+	free(states);
+
+	free(registers);
+
+	free(workgroup_memory);
+
+	return rst;
 }
 
 __declspec(dllexport) spvcpu::result spvcpu::free_module_state(module_state* state) noexcept
 {
+	if (state->m_opaque_data != nullptr)
+		free_invocation_state(static_cast<invocation_state*>(state->m_opaque_data));
+
+	state->m_opaque_data = nullptr;
 
+	return result::success;
 }
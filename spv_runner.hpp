@@ -1,20 +1,91 @@
+#ifndef SPV_RUNNER_HPP_INCLUDE_GUARD
+#define SPV_RUNNER_HPP_INCLUDE_GUARD
+
 #include "spv_result.hpp"
 #include <cstdint>
 
 namespace spvcpu
 {
+	struct buffer_binding
+	{
+		uint32_t descriptor_set;
+
+		uint32_t binding;
+
+		uint64_t bytes;
+
+		void* data;
+	};
+
+	struct image_binding
+	{
+		uint32_t descriptor_set;
+
+		uint32_t binding;
+
+		// Width, height and depth in texels. Unused dimensions must be 1.
+		uint32_t extent[3];
+
+		// Distance in bytes between two consecutive rows.
+		uint64_t row_pitch;
+
+		// Distance in bytes between two consecutive slices (or array layers).
+		uint64_t slice_pitch;
+
+		void* data;
+	};
+
 	struct module_init_info
 	{
+		// Name of the entry point to run. nullptr selects the first entry point in the module.
+		const char* entry_point_name;
+
+		uint32_t buffer_count;
+
+		const buffer_binding* buffers;
+
+		uint32_t image_count;
+
+		const image_binding* images;
+
+		uint32_t push_constant_bytes;
+
+		const void* push_constants;
+
+		uint32_t workgroup_count[3];
+
+		uint32_t workgroup_id[3];
+
+		uint32_t local_invocation_id[3];
+	};
+
+	enum class execution_status : uint32_t
+	{
+		running,
+		finished,
 
+		// Suspended at an OpControlBarrier until the rest of its workgroup arrives.
+		// Only occurs for invocations run by run_workgroup or dispatch.
+		barrier,
 	};
 
 	struct module_state
 	{
-		const uint32_t m_variable_count;
+		// Number of ids in the module. Indexes m_variable_offsets and m_variable_names.
+		uint32_t m_variable_count;
 
+		// Register file of the invocation. Each id's value starts at m_variable_offsets[id] words.
 		const void* m_variable_data;
 
+		// Word offset of each id's value in m_variable_data, or ~0u if the id has no value.
+		const uint32_t* m_variable_offsets;
+
+		// Name of each id as given by OpName, or nullptr if the id has no name.
 		const char** m_variable_names;
+
+		execution_status m_status;
+
+		void* m_opaque_data;
 	};
 
 	struct cpu_module
@@ -24,11 +95,50 @@ namespace spvcpu
 
 	__declspec(dllexport) result create_cpu_module(uint64_t spirv_bytes, const void* spirv, const void* spird, void** out_module) noexcept;
 
+	// Same as create_cpu_module, but reuses modules compiled by earlier calls,
+	// which are stored as files in cache_directory, keyed by a hash of the
+	// SPIR-V and the version of spird. On a hit, the stored module is mapped
+	// back instead of being compiled again. On a miss, the module is compiled
+	// and then stored, creating cache_directory if necessary. Failing to read
+	// or write the cache is not an error. Only implemented on Linux; elsewhere
+	// this behaves like create_cpu_module.
+	__declspec(dllexport) result create_cpu_module_cached(uint64_t spirv_bytes, const void* spirv, const void* spird, const char* cache_directory, void** out_module) noexcept;
+
 	__declspec(dllexport) result free_cpu_module(void* module) noexcept;
 
 	__declspec(dllexport) result initialize_cpu_module(const void* module, const module_init_info* init_info, module_state* out_initial_state) noexcept;
 
+	// Executes a single instruction of the invocation described by state.
 	__declspec(dllexport) result step_module(const void* initialized_module, module_state* state) noexcept;
 
+	// Executes the invocation described by state until it returns from its entry point.
+	__declspec(dllexport) result run_module(const void* initialized_module, module_state* state) noexcept;
+
 	__declspec(dllexport) result free_module_state(module_state* state) noexcept;
+
+	// Runs every invocation of the workgroup given by init_info->workgroup_id to
+	// completion. init_info->local_invocation_id is ignored. Invocations are
+	// executed in batches of lane_count, which must be 8 or 16, with each value
+	// held as one SIMD vector across the batch. A lane_count of 1 runs the
+	// invocations one after the other. Barriers with Workgroup execution scope
+	// suspend an invocation until all invocations of the workgroup reach them;
+	// the whole workgroup still runs on the calling thread.
+	__declspec(dllexport) result run_workgroup(const void* module, const module_init_info* init_info, uint32_t lane_count) noexcept;
+
+	// Creates a pool of thread_count threads for running dispatches, or one thread
+	// per hardware thread if thread_count is 0. The thread calling dispatch is
+	// counted as one of them. A pool runs only one dispatch at a time.
+	__declspec(dllexport) result create_thread_pool(uint32_t thread_count, void** out_pool) noexcept;
+
+	__declspec(dllexport) result free_thread_pool(void* pool) noexcept;
+
+	// Runs group_count_x * group_count_y * group_count_z workgroups, spreading them
+	// across the threads of pool. init_info supplies the resources; its
+	// workgroup_count, workgroup_id and local_invocation_id are ignored. Each
+	// workgroup is run as if by run_workgroup with the given lane_count. A pool
+	// with a single thread runs all workgroups on the calling thread, in order of
+	// increasing x, then y, then z.
+	__declspec(dllexport) result dispatch(void* pool, const void* module, const module_init_info* init_info, uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z, uint32_t lane_count) noexcept;
 }
+
+#endif // SPV_RUNNER_HPP_INCLUDE_GUARD
@@ -1,14 +1,25 @@
 #include "spv_viewer.hpp"
 
+#include <atomic>
+#include <charconv>
 #include <cstdint>
 #include <cstdlib>
 #include <memory>
+#include <new>
+#include <system_error>
+#include <thread>
 
 #include "spv_defs.hpp"
 #include "spird_defs.hpp"
 #include "spird_accessor.hpp"
 #include "id_data.hpp"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 struct output_buffer
 {
 private:
@@ -21,13 +32,27 @@ private:
 
 	static constexpr size_t max_i64_chars = 20;
 
+	// Sign, 309 integral digits, the decimal point and six fractional digits.
+	static constexpr size_t max_f64_chars = 317;
+
+	// Space reserved for the result column at the start of each line. This is
+	// its exact length unless a result type printed with type info is long.
+	static constexpr uint32_t line_prefix_reserve = 24;
+
 	char* m_string;
 	uint32_t m_string_used;
 	uint32_t m_string_capacity;
 
-	char* m_line;
-	uint32_t m_line_used;
-	uint32_t m_line_capacity;
+	// Offset in m_string of the line currently being disassembled. Its first
+	// line_prefix_reserve bytes are left free for the result column, which is
+	// only known once the instruction's arguments have been processed.
+	uint32_t m_line_begin;
+
+	// Holds the text of the result type until it is placed in the result
+	// column.
+	char* m_scratch;
+	uint32_t m_scratch_used;
+	uint32_t m_scratch_capacity;
 
 	uint32_t m_rst_id;
 	uint32_t m_rtype_id;
@@ -38,6 +63,57 @@ private:
 
 	bool m_print_type_info;
 
+	// If set, m_string is handed to m_sink and emptied whenever it holds at
+	// least m_flush_bytes after a line has been completed.
+	spvcpu::disassembly_sink m_sink;
+
+	void* m_sink_data;
+
+	uint64_t m_flush_bytes;
+
+	// If set, each instruction is decoded into an instruction_record and its
+	// operand_records instead of being printed, and m_string only holds the
+	// null-terminated strings referenced by string operands. All print
+	// functions do nothing in this case.
+	bool m_emit_records;
+
+	const uint32_t* m_module_words;
+
+	simple_vec<spvcpu::instruction_record> m_instructions;
+
+	simple_vec<spvcpu::operand_record> m_operands;
+
+	// Instructions looked up so far. Kept across reset, since all modules
+	// disassembled through the same buffer share the same spird data.
+	spird::elem_view_cache m_instruction_views;
+
+	bool initialize_strings() noexcept
+	{
+		m_string = static_cast<char*>(malloc(4096));
+
+		if (m_string == nullptr)
+			return false;
+
+		m_string_used = 0;
+
+		m_string_capacity = 4096;
+
+		m_scratch = static_cast<char*>(malloc(4096));
+
+		if (m_scratch == nullptr)
+			return false;
+
+		m_scratch_used = 0;
+
+		m_scratch_capacity = 4096;
+
+		m_rst_id = ~0u;
+
+		m_rtype_id = ~0u;
+
+		return true;
+	}
+
 	bool grow_string(size_t additional) noexcept
 	{
 		while (m_string_used + additional > m_string_capacity)
@@ -55,234 +131,220 @@ private:
 		return true;
 	}
 
-	bool grow_line(size_t additional) noexcept
+	bool grow_scratch(size_t additional) noexcept
 	{
-		while (m_line_used + additional > m_line_capacity)
+		while (m_scratch_used + additional > m_scratch_capacity)
 		{
-			char* tmp = static_cast<char*>(realloc(m_line, m_line_capacity * 2));
+			char* tmp = static_cast<char*>(realloc(m_scratch, m_scratch_capacity * 2));
 
 			if (tmp == nullptr)
 				return false;
 
-			m_line_capacity *= 2;
+			m_scratch_capacity *= 2;
 
-			m_line = tmp;
+			m_scratch = tmp;
 		}
 
 		return true;
 	}
 
+	// Digits are produced two at a time from the back of a scratch buffer, so
+	// that neither the digit count nor a division per digit is needed.
 	static void print_integer_to_buffer(char* out, uint32_t& out_used, uint64_t n, bool is_signed) noexcept
 	{
-		bool is_negative = false;
+		static constexpr char digit_pairs[201] =
+			"00010203040506070809"
+			"10111213141516171819"
+			"20212223242526272829"
+			"30313233343536373839"
+			"40414243444546474849"
+			"50515253545556575859"
+			"60616263646566676869"
+			"70717273747576777879"
+			"80818283848586878889"
+			"90919293949596979899";
 
 		if (is_signed && (n & (1ui64 << 63)))
 		{
-			is_negative = true;
+			out[out_used++] = '-';
 
 			n = 0 - n;
 		}
 
-		uint32_t log10_ceil = 1;
+		char digits[max_u64_chars];
 
-		uint64_t approx = 10;
+		uint32_t first = max_u64_chars;
 
-		while (n >= approx)
+		while (n >= 100)
 		{
-			approx *= 10;
+			const uint64_t pair = (n % 100) * 2;
 
-			++log10_ceil;
-		}
+			n /= 100;
 
-		if (is_negative)
-			out[out_used++] = '-';
+			first -= 2;
+
+			digits[first] = digit_pairs[pair];
+
+			digits[first + 1] = digit_pairs[pair + 1];
+		}
 
-		for(uint32_t i = 0; i != log10_ceil; ++i)
+		if (n >= 10)
 		{
-			out[out_used + log10_ceil - i - 1] = (n % 10) + '0';
+			first -= 2;
 
-			n /= 10;
+			digits[first] = digit_pairs[n * 2];
+
+			digits[first + 1] = digit_pairs[n * 2 + 1];
+		}
+		else
+		{
+			digits[--first] = static_cast<char>('0' + n);
 		}
 
-		out_used += log10_ceil;
+		memcpy(out + out_used, digits + first, max_u64_chars - first);
+
+		out_used += max_u64_chars - first;
+	}
+
+	bool emit_operand(spvcpu::operand_kind kind, uint32_t detail, uint64_t value) noexcept
+	{
+		return !m_emit_records || m_operands.append({ kind, detail, value });
 	}
 
 	bool print_char(char c) noexcept
 	{
-		if (!grow_line(1))
+		if (m_emit_records)
+			return true;
+
+		if (!grow_string(1))
 			return false;
 
-		m_line[m_line_used++] = c;
+		m_string[m_string_used++] = c;
 
 		return true;
 	}
 
 	bool print_id(uint32_t id) noexcept
 	{
-		if (!print_str("$") || !grow_line(max_u32_chars))
+		if (m_emit_records)
+			return true;
+
+		if (!print_str("$") || !grow_string(max_u32_chars))
 			return false;
 			
-		print_integer_to_buffer(m_line, m_line_used, id, false);
+		print_integer_to_buffer(m_string, m_string_used, id, false);
 
 		return true;
 	}
 
 	bool print_typid(uint32_t typid) noexcept
 	{
+		if (m_emit_records)
+			return true;
+
 		if (!m_print_type_info)
 		{
 			if (!print_char('T'))
 				return false;
 		}
 
-		if (!print_char('$') || !grow_line(max_u32_chars))
+		if (!print_char('$') || !grow_string(max_u32_chars))
 			return false;
 			
-			print_integer_to_buffer(m_line, m_line_used, typid, false);
+			print_integer_to_buffer(m_string, m_string_used, typid, false);
 
 		return true;
 	}
 
 	bool print_u32(uint32_t n) noexcept
 	{
-		if (!grow_line(max_u32_chars))
+		if (m_emit_records)
+			return true;
+
+		if (!grow_string(max_u32_chars))
 			return false;
 
-		print_integer_to_buffer(m_line, m_line_used, n, false);
+		print_integer_to_buffer(m_string, m_string_used, n, false);
 
 		return true;
 	}
 
 	bool print_str(const char* str) noexcept
 	{
+		if (m_emit_records)
+			return true;
+
 		const size_t len = strlen(str);
 
-		if (!grow_line(len))
+		if (!grow_string(len))
 			return false;
 
-		memcpy(m_line + m_line_used, str, len);
+		memcpy(m_string + m_string_used, str, len);
 
-		m_line_used += len;
+		m_string_used += len;
 
 		return true;
 	}
 
 	bool print_member(uint32_t member) noexcept
 	{
-		if (!print_str("@") || !grow_line(max_u32_chars))
+		if (m_emit_records)
+			return true;
+
+		if (!print_str("@") || !grow_string(max_u32_chars))
 			return false;
 
-		print_integer_to_buffer(m_line, m_line_used, member, false);
+		print_integer_to_buffer(m_string, m_string_used, member, false);
 
 		return true;
 	}
 
 	bool print_i64(int64_t n) noexcept
 	{
-		if (!grow_line(max_i64_chars))
+		if (m_emit_records)
+			return true;
+
+		if (!grow_string(max_i64_chars))
 			return false;
 		
-		print_integer_to_buffer(m_line, m_line_used, n, true);
+		print_integer_to_buffer(m_string, m_string_used, n, true);
 
 		return true;
 	}
 
 	bool print_u64(uint64_t n) noexcept
 	{
-		if (!grow_line(max_u64_chars))
+		if (m_emit_records)
+			return true;
+
+		if (!grow_string(max_u64_chars))
 			return false;
 		
-		print_integer_to_buffer(m_line, m_line_used, n, false);
+		print_integer_to_buffer(m_string, m_string_used, n, false);
 
 		return true;
 	}
 
+	// Prints n in the same format as printf's "%f", but without going through
+	// the locale and format string handling of snprintf.
 	bool print_f64(double n) noexcept
 	{
-		if (!grow_line(350))
-			return false;
-
-		int chars_used = snprintf(m_line + m_line_used, 350, "%f", n);
-
-		if (chars_used >= 0 && chars_used < 350)
-		{
-			m_line_used += chars_used;
-
+		if (m_emit_records)
 			return true;
-		}
-
-		if (chars_used < 0)
-			return false;
 
-		if (!grow_line(chars_used - 349))
+		if (!grow_string(max_f64_chars))
 			return false;
 
-		int chars_used_retry = snprintf(m_line + m_line_used, chars_used + 1, "%f", n);
+		const std::to_chars_result rst = std::to_chars(m_string + m_string_used, m_string + m_string_used + max_f64_chars, n, std::chars_format::fixed, 6);
 
-		if (chars_used_retry < 0 || chars_used_retry > chars_used)
+		if (rst.ec != std::errc{})
 			return print_str("[FloatTooBig]");
 
-		m_line_used += chars_used_retry;
+		m_string_used = static_cast<uint32_t>(rst.ptr - m_string);
 
 		return true;
 	}
 
-	spvcpu::result str_print_rst_and_rtype(uint32_t* out_used) noexcept
-	{
-		// Factor in additional growth from writing rst and rtype or spaces.
-		// Since ids are limited to at most 4194303, it is safe to assume that
-		// 7 charcters for rst and rtype each, two additonal chars for spaces,
-		// one for the rst marker, two for the rtype marker, and two for "= "
-		// for a total of 7 + 7 + 2 + 1 + 2 + 2 = 21 should suffice for holding
-		// the result prefix.
-		constexpr uint32_t expected_prefix_len = 21;
-
-		// To be conservative ensure that ints larger than the id-limit will
-		// also fit.
-		constexpr uint32_t conservative_prefix_len = expected_prefix_len + 6;
-
-		if (!grow_string(conservative_prefix_len))
-			return spvcpu::result::no_memory;
-
-		uint32_t prev_string_used = m_string_used;
-
-		memset(m_string + m_string_used, ' ', expected_prefix_len);
-
-		if (m_rst_id != ~0u)
-		{
-			m_string[m_string_used++] = '$';
-
-			uint32_t rst_used = m_string_used;
-
-			print_integer_to_buffer(m_string, rst_used, m_rst_id, false);
-
-			if (rst_used < m_string_used + 7)
-				rst_used = m_string_used + 7;
-
-			m_string_used = rst_used;
-
-			m_string[m_string_used++] = ' ';
-		}
-		else
-		{
-			m_string_used += 9;
-		}
-
-		if (m_rtype_id != ~0u)
-		{
-			if (!m_print_type_info)
-				m_string[m_string_used++] = 'T';
-
-			m_string[m_string_used++] = '$';
-
-			print_integer_to_buffer(m_string, m_string_used, m_rtype_id, false);
-		}
-
-		*out_used = m_string_used - prev_string_used;
-
-		return spvcpu::result::success;
-	}
-
 	spvcpu::result print_enum(const void* spird, const spird::enum_location& enum_loc, spird::enum_id enum_id, const uint32_t*& word, const uint32_t* word_end) noexcept
 	{
 		if (word == word_end)
@@ -307,12 +369,12 @@ private:
 
 				elem_id_bits ^= lsb;
 
-				spird::elem_data elem_data;
+				spird::elem_view elem;
 
-				if (spvcpu::result rst = spird::get_elem_data(spird, enum_loc, lsb, &elem_data); rst != spvcpu::result::success)
+				if (spvcpu::result rst = spird::get_elem_view(spird, enum_loc, lsb, &elem); rst != spvcpu::result::success)
 					return rst;
 
-				if (!print_str(elem_data.name))
+				if (!print_str(elem.name))
 					return spvcpu::result::no_memory;
 			}
 
@@ -324,22 +386,22 @@ private:
 
 				elem_id_bits ^= lsb;
 
-				spird::elem_data elem_data;
+				spird::elem_view elem;
 
-				if (spvcpu::result rst = spird::get_elem_data(spird, enum_loc, lsb, &elem_data); rst != spvcpu::result::success)
+				if (spvcpu::result rst = spird::get_elem_view(spird, enum_loc, lsb, &elem); rst != spvcpu::result::success)
 					return rst;
 
-				for (uint32_t arg = 0; arg != elem_data.argc; ++arg)
+				for (uint32_t arg = 0; arg != elem.argc; ++arg)
 				{
-					spird::arg_flags flags = elem_data.arg_flags[arg], second_flags = spird::arg_flags::none;
+					spird::arg_flags flags = elem.arg_flags[arg], second_flags = spird::arg_flags::none;
 
-					spird::arg_type type = elem_data.arg_types[arg], second_type = spird::arg_type::INSTRUCTION;
+					spird::arg_type type = elem.arg_types[arg], second_type = spird::arg_type::INSTRUCTION;
 
 					if ((flags & spird::arg_flags::pair) == spird::arg_flags::pair)
 					{
-						second_flags = elem_data.arg_flags[arg + 1];
+						second_flags = elem.arg_flags[arg + 1];
 
-						second_type = elem_data.arg_types[arg + 1];
+						second_type = elem.arg_types[arg + 1];
 
 						++arg;
 					}
@@ -351,32 +413,32 @@ private:
 		}
 		else
 		{
-			spird::elem_data elem_data;
+			spird::elem_view elem;
 
-			if (spvcpu::result rst = spird::get_elem_data(spird, enum_loc, elem_id, &elem_data); rst != spvcpu::result::success)
+			if (spvcpu::result rst = spird::get_elem_view(spird, enum_loc, elem_id, &elem); rst != spvcpu::result::success)
 				return rst;
 
-			if (!print_str(elem_data.name))
+			if (!print_str(elem.name))
 				return spvcpu::result::no_memory;
 
 			// Skip RST and RTYPE for instructions, as these should only be encountered in
 			// OpSpecConstantOp, which includes RST and RTYPE before the opcode.
 			const uint32_t initial_arg = enum_id == spird::enum_id::Instruction ? 2 : 0;
 
-			if (enum_id == spird::enum_id::Instruction && elem_data.argc < 2)
+			if (enum_id == spird::enum_id::Instruction && elem.argc < 2)
 				return spvcpu::result::instruction_wordcount_mismatch;
 
-			for (uint32_t arg = initial_arg; arg != elem_data.argc; ++arg)
+			for (uint32_t arg = initial_arg; arg != elem.argc; ++arg)
 			{
-				spird::arg_flags flags = elem_data.arg_flags[arg], second_flags = spird::arg_flags::none;
+				spird::arg_flags flags = elem.arg_flags[arg], second_flags = spird::arg_flags::none;
 
-				spird::arg_type type = elem_data.arg_types[arg], second_type = spird::arg_type::INSTRUCTION;
+				spird::arg_type type = elem.arg_types[arg], second_type = spird::arg_type::INSTRUCTION;
 
 				if ((flags & spird::arg_flags::pair) == spird::arg_flags::pair)
 				{
-					second_flags = elem_data.arg_flags[arg + 1];
+					second_flags = elem.arg_flags[arg + 1];
 
-					second_type = elem_data.arg_types[arg + 1];
+					second_type = elem.arg_types[arg + 1];
 
 					++arg;
 				}
@@ -791,12 +853,12 @@ private:
 
 			if (data->m_data.int_data.is_signed)
 			{
-				if (!print_i64(static_cast<int64_t>(n)))
+				if (!print_i64(static_cast<int64_t>(n)) || !emit_operand(spvcpu::operand_kind::signed_integer, 0, n))
 					return spvcpu::result::no_memory;
 			}
 			else
 			{
-				if (!print_u64(n))
+				if (!print_u64(n) || !emit_operand(spvcpu::operand_kind::integer, 0, n))
 					return spvcpu::result::no_memory;
 			}
 
@@ -870,7 +932,11 @@ private:
 				return spvcpu::result::unhandled_float_width;
 			}
 
-			if (!print_f64(n))
+			uint64_t f64_bits;
+
+			memcpy(&f64_bits, &n, 8);
+
+			if (!print_f64(n) || !emit_operand(spvcpu::operand_kind::floating_point, 0, f64_bits))
 				return spvcpu::result::no_memory;
 
 			break;
@@ -1318,7 +1384,7 @@ private:
 			}
 			else if (type == spird::arg_type::TYPE)
 			{
-				if (!print_typid(*word))
+				if (!print_typid(*word) || !emit_operand(spvcpu::operand_kind::type_id, 0, *word))
 					return spvcpu::result::no_memory;
 
 				if (m_print_type_info)
@@ -1351,7 +1417,7 @@ private:
 			}
 			else
 			{
-				if (!print_id(*word))
+				if (!print_id(*word) || !emit_operand(spvcpu::operand_kind::id, 0, *word))
 					return spvcpu::result::no_memory;
 			}
 
@@ -1359,6 +1425,9 @@ private:
 		}
 		else if (static_cast<uint32_t>(type) < spird::enum_id_count)
 		{
+			if (word != word_end && !emit_operand(spvcpu::operand_kind::enumerant, static_cast<uint32_t>(type), *word))
+				return spvcpu::result::no_memory;
+
 			spird::enum_location enum_loc;
 
 			if (spvcpu::result rst = spird::get_enum_location(spird, static_cast<spird::enum_id>(type), &enum_loc); rst != spvcpu::result::success)
@@ -1372,6 +1441,9 @@ private:
 			{
 			case spird::arg_type::NAMEDENUM:
 			{
+				if (word != word_end && !emit_operand(spvcpu::operand_kind::enumerant, ~0u, *word))
+					return spvcpu::result::no_memory;
+
 				uint32_t ext_inst_set_id = word[-1];
 
 				type_data* ext_inst_set_type;
@@ -1407,6 +1479,9 @@ private:
 				{
 					if (!print_str("[LIT ") || !print_u32(word_end - word) || !print_str("]"))
 						return spvcpu::result::no_memory;
+
+					if (!emit_operand(spvcpu::operand_kind::raw_literal, static_cast<uint32_t>(word_end - word), word - m_module_words))
+						return spvcpu::result::no_memory;
 				}
 
 				word = word_end;
@@ -1428,7 +1503,7 @@ private:
 				if (word + 1 > word_end)
 					return spvcpu::result::instruction_wordcount_mismatch;
 
-				if (!print_u32(*word))
+				if (!print_u32(*word) || !emit_operand(spvcpu::operand_kind::integer, 0, *word))
 					return spvcpu::result::no_memory;
 
 				++word; 
@@ -1447,6 +1522,16 @@ private:
 				if (!print_str("\"") || !print_str(str) || !print_str("\""))
 					return spvcpu::result::no_memory;
 
+				// The string table lives in m_string, which is unused otherwise.
+				if (m_emit_records)
+				{
+					if (!emit_operand(spvcpu::operand_kind::string, 0, m_string_used))
+						return spvcpu::result::no_memory;
+
+					if (spvcpu::result rst = append(str, static_cast<uint32_t>(strlen(str) + 1)); rst != spvcpu::result::success)
+						return rst;
+				}
+
 				word += str_words;
 
 				break;
@@ -1466,7 +1551,7 @@ private:
 				if (word + 1 > word_end)
 					return spvcpu::result::instruction_wordcount_mismatch;
 
-				if (!print_member(*word))
+				if (!print_member(*word) || !emit_operand(spvcpu::operand_kind::member, 0, *word))
 					return spvcpu::result::no_memory;
 
 				++word;
@@ -1480,7 +1565,7 @@ private:
 
 				int64_t n = *word | (static_cast<int64_t>(word[1]) << 32); 
 
-				if (!print_i64(n))
+				if (!print_i64(n) || !emit_operand(spvcpu::operand_kind::signed_integer, 0, static_cast<uint64_t>(n)))
 					return spvcpu::result::no_memory;
 
 				word += 2;
@@ -1499,44 +1584,107 @@ private:
 
 public:
 
-	output_buffer() noexcept : m_string{ nullptr }, m_line{ nullptr } {}
+	output_buffer() noexcept : m_string{ nullptr }, m_scratch{ nullptr }, m_sink{ nullptr }, m_emit_records{ false } {}
 
 	~output_buffer() noexcept
 	{
 		free(m_string);
+
+		free(m_scratch);
 	}
 
 	spvcpu::result initialize(bool print_type_info) noexcept
 	{
-		m_string = static_cast<char*>(malloc(4096));
-
-		if (m_string == nullptr)
+		if (!initialize_strings())
 			return spvcpu::result::no_memory;
 
-		m_string_used = 0;
+		m_print_type_info = print_type_info;
 
-		m_string_capacity = 4096;
+		return m_id_map.initialize();
+	}
+
+	// Initializes the buffer for disassembling a part of a module, with the ids
+	// known to global, which has disassembled everything preceding the part.
+	spvcpu::result initialize_shard(const output_buffer& global) noexcept
+	{
+		if (!initialize_strings())
+			return spvcpu::result::no_memory;
+
+		m_print_type_info = global.m_print_type_info;
 
-		m_line = static_cast<char*>(malloc(4096));
+		return m_id_map.initialize_copy(global.m_id_map);
+	}
 
-		if (m_line == nullptr)
+	// Switches the buffer to decoding the module starting at module_words into
+	// records instead of text.
+	spvcpu::result initialize_records(const uint32_t* module_words) noexcept
+	{
+		if (!m_instructions.initialize(1024) || !m_operands.initialize(4096))
 			return spvcpu::result::no_memory;
 
-		m_line_used = 0;
+		m_emit_records = true;
+
+		m_module_words = module_words;
+
+		return spvcpu::result::success;
+	}
+
+	// Hands the records and the string table over to out_records.
+	void steal_records(spvcpu::disassembly_records* out_records) noexcept
+	{
+		out_records->instruction_count = m_instructions.size();
+
+		out_records->operand_count = m_operands.size();
+
+		out_records->strings_bytes = m_string_used;
+
+		out_records->instructions = m_instructions.steal();
+
+		out_records->operands = m_operands.steal();
 
-		m_line_capacity = 4096;
+		out_records->strings = steal();
+	}
+
+	// Prepares the buffer for disassembling another module, keeping its memory.
+	void reset() noexcept
+	{
+		m_string_used = 0;
 
 		m_rst_id = ~0u;
 
 		m_rtype_id = ~0u;
 
-		m_print_type_info = print_type_info;
+		m_id_map.reset();
+	}
 
-		return m_id_map.initialize();
+	void set_sink(spvcpu::disassembly_sink sink, void* sink_data, uint64_t flush_bytes) noexcept
+	{
+		m_sink = sink;
+
+		m_sink_data = sink_data;
+
+		m_flush_bytes = flush_bytes;
+	}
+
+	spvcpu::result flush() noexcept
+	{
+		if (m_string_used == 0)
+			return spvcpu::result::success;
+
+		if (!m_sink(m_string, m_string_used, m_sink_data))
+			return spvcpu::result::output_sink_failed;
+
+		m_string_used = 0;
+
+		return spvcpu::result::success;
 	}
 
 	spvcpu::result finalize() noexcept
 	{
+		// Output passed to a sink is not null-terminated.
+		if (m_sink != nullptr)
+			return flush();
+
 		if (!grow_string(1))
 			return spvcpu::result::no_memory;
 
@@ -1559,6 +1707,33 @@ public:
 		return m_string_used;
 	}
 
+	bool emits_records() const noexcept
+	{
+		return m_emit_records;
+	}
+
+	spvcpu::result get_instruction(const void* spird, const spird::enum_location& insn_enum_loc, uint32_t opcode, spird::elem_view* out_view) noexcept
+	{
+		return m_instruction_views.get(spird, insn_enum_loc, opcode, out_view);
+	}
+
+	const char* data() const noexcept
+	{
+		return m_string;
+	}
+
+	spvcpu::result append(const char* text, uint32_t bytes) noexcept
+	{
+		if (!grow_string(bytes))
+			return spvcpu::result::no_memory;
+
+		memcpy(m_string + m_string_used, text, bytes);
+
+		m_string_used += bytes;
+
+		return spvcpu::result::success;
+	}
+
 	spvcpu::result print_arg(const void* spird, spird::arg_flags flags, spird::arg_type type, spird::arg_flags second_flag, spird::arg_type second_type, const uint32_t*& word, const uint32_t* word_end) noexcept
 	{
 		const bool is_optional = (flags & spird::arg_flags::optional) == spird::arg_flags::optional;
@@ -1586,25 +1761,67 @@ public:
 		return spvcpu::result::success;
 	}
 
+	// Starts a new line. Everything printed up to the next call to end_line is
+	// written to m_string directly, following the space reserved for the
+	// result column.
 	spvcpu::result print_instruction_name(const char* name) noexcept
 	{
+		if (!grow_string(line_prefix_reserve))
+			return spvcpu::result::no_memory;
+
+		m_line_begin = m_string_used;
+
+		m_string_used += line_prefix_reserve;
+
 		if (!print_str("Op") || !print_str(name))
 			return spvcpu::result::no_memory;
 
 		return spvcpu::result::success;
 	}
 
+	// Starts the record of the instruction at word.
+	spvcpu::result begin_record(Op opcode, const uint32_t* word) noexcept
+	{
+		if (!m_instructions.append({ static_cast<uint32_t>(opcode), ~0u, ~0u, static_cast<uint32_t>(word - m_module_words), m_operands.size(), 0 }))
+			return spvcpu::result::no_memory;
+
+		return spvcpu::result::success;
+	}
+
+	// Fills in the result column of the current line, consisting of the result
+	// id padded to 8 characters, a space, and the result type, padded to a
+	// total of 21 characters and followed by " = ". Only if the result column
+	// ends up longer than the reserved space does the rest of the line have to
+	// be moved.
 	spvcpu::result end_line() noexcept
 	{
-		uint32_t result_used;
+		if (m_emit_records)
+		{
+			spvcpu::instruction_record& record = m_instructions[m_instructions.size() - 1];
 
-		if (spvcpu::result rst = str_print_rst_and_rtype(&result_used); rst != spvcpu::result::success)
-			return rst;
+			record.result_id = m_rst_id;
+
+			record.result_type_id = m_rtype_id;
+
+			record.operand_count = m_operands.size() - record.first_operand;
+
+			m_rst_id = ~0u;
 
-		const uint32_t actual_line_used = m_line_used;
+			m_rtype_id = ~0u;
+
+			m_rst_type = spird::arg_type::AUTO;
+
+			return spvcpu::result::success;
+		}
+
+		m_scratch_used = 0;
 
 		if (m_print_type_info && m_rtype_id != ~0u)
 		{
+			// The type is printed after the line and then moved out of the way
+			// into m_scratch, since the print functions only write to m_string.
+			const uint32_t line_end = m_string_used;
+
 			type_data* rtype_type;
 
 			constant_data* rtype_value;
@@ -1630,62 +1847,91 @@ public:
 				return rst;
 			}
 
-			const uint32_t rtype_used = m_line_used - actual_line_used;
-
-			if (!grow_string(rtype_used))
+			if (!grow_scratch(m_string_used - line_end))
 				return spvcpu::result::no_memory;
 
-			memcpy(m_string + m_string_used, m_line + actual_line_used, rtype_used);
-
-			m_string_used += rtype_used;
+			memcpy(m_scratch, m_string + line_end, m_string_used - line_end);
 
-			m_line_used -= rtype_used;
+			m_scratch_used = m_string_used - line_end;
 
-			result_used += rtype_used;
+			m_string_used = line_end;
 		}
 
-		if (result_used < 21)
-		{
-			if (!grow_string(21 - result_used))
-				return spvcpu::result::no_memory;
+		// Ids take at most 10 digits, so the result id with its padding takes
+		// at most 12 characters and the result type id at most 12 as well.
+		char ids[24];
 
-			for (uint32_t i = 0; i != 21 - result_used; ++i)
-				m_string[m_string_used++] = ' ';
-		}
+		uint32_t ids_used = 0;
 
-		if (!grow_string(3))
-			return spvcpu::result::no_memory;
+		memset(ids, ' ', sizeof(ids));
 
 		if (m_rst_id != ~0u)
 		{
-			m_string[m_string_used++] = ' ';
-			m_string[m_string_used++] = '=';
-			m_string[m_string_used++] = ' ';
+			ids[ids_used++] = '$';
+
+			print_integer_to_buffer(ids, ids_used, m_rst_id, false);
+
+			if (ids_used < 8)
+				ids_used = 8;
+
+			++ids_used;
 		}
 		else
 		{
-			m_string[m_string_used++] = ' ';
-			m_string[m_string_used++] = ' ';
-			m_string[m_string_used++] = ' ';
+			ids_used = 9;
+		}
+
+		if (m_rtype_id != ~0u)
+		{
+			if (!m_print_type_info)
+				ids[ids_used++] = 'T';
+
+			ids[ids_used++] = '$';
+
+			print_integer_to_buffer(ids, ids_used, m_rtype_id, false);
 		}
 
-		// Don't forget to reserve space for the trailing '\n'
-		if (!grow_string(m_line_used + 1))
+		uint32_t column_used = ids_used + m_scratch_used;
+
+		if (column_used < 21)
+			column_used = 21;
+
+		const uint32_t prefix_used = column_used + 3;
+
+		const uint32_t prefix_growth = prefix_used > line_prefix_reserve ? prefix_used - line_prefix_reserve : 0;
+
+		// Reserve space for the trailing '\n' as well.
+		if (!grow_string(prefix_growth + 1))
 			return spvcpu::result::no_memory;
 
-		memcpy(m_string + m_string_used, m_line, actual_line_used);
+		char* const line = m_string + m_line_begin;
+
+		const uint32_t body_used = m_string_used - m_line_begin - line_prefix_reserve;
+
+		if (prefix_used != line_prefix_reserve)
+			memmove(line + prefix_used, line + line_prefix_reserve, body_used);
 
-		m_string_used += m_line_used + 1;
+		memcpy(line, ids, ids_used);
+
+		memcpy(line + ids_used, m_scratch, m_scratch_used);
+
+		memset(line + ids_used + m_scratch_used, ' ', prefix_used - ids_used - m_scratch_used);
+
+		if (m_rst_id != ~0u)
+			line[column_used + 1] = '=';
 
-		m_string[m_string_used - 1] = '\n';
+		m_string_used = m_line_begin + prefix_used + body_used;
 
-		m_line_used = 0;
+		m_string[m_string_used++] = '\n';
 
 		m_rst_id = ~0u;
 
 		m_rtype_id = ~0u;
 
 		m_rst_type = spird::arg_type::AUTO;
+
+		if (m_sink != nullptr && m_string_used >= m_flush_bytes)
+			return flush();
 		
 		return spvcpu::result::success;
 	}
@@ -1713,6 +1959,36 @@ static constexpr uint32_t reverse_endianness(uint32_t n) noexcept
 	return ((n >> 24) & 0x000000FF) | ((n >> 8) & 0x0000FF00) | ((n << 8) & 0x00FF0000) | ((n << 24) & 0xFF000000);
 }
 
+// Copies word_count words from src to dst, reversing the byte order of each.
+static void copy_reversing_endianness(const uint32_t* src, uint32_t* dst, uint64_t word_count) noexcept
+{
+	uint64_t i = 0;
+
+#if defined(__AVX2__)
+	const __m256i byte_order = _mm256_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+	);
+
+	for (; i + 8 <= word_count; i += 8)
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), byte_order));
+#elif defined(__SSE2__) || defined(_M_X64)
+	// Without pshufb, the bytes of each 16-bit half are swapped first, followed
+	// by the halves themselves.
+	for (; i + 4 <= word_count; i += 4)
+	{
+		const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+
+		const __m128i halves_swapped = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shufflehi_epi16(_mm_shufflelo_epi16(halves_swapped, 0xB1), 0xB1));
+	}
+#endif
+
+	for (; i != word_count; ++i)
+		dst[i] = reverse_endianness(src[i]);
+}
+
 static spvcpu::result check_header(const void* spirv) noexcept
 {
 	const spirv_header* header = static_cast<const spirv_header*>(spirv);
@@ -1740,71 +2016,70 @@ static spvcpu::result check_header(const void* spirv) noexcept
 	return spvcpu::result::success;
 }
 
-__declspec(dllexport) spvcpu::result spvcpu::disassemble(
-	uint64_t spirv_bytes,
-	const void* spirv,
-	const void* spird,
-	bool print_type_info,
-	uint64_t* out_disassembly_bytes,
-	char** out_disassembly
-) noexcept
+// Checks the header of the shader at spirv and sets out_words to its words in
+// native byte order, which are copied to copied_shader_data if necessary.
+static spvcpu::result prepare_shader(uint64_t spirv_bytes, const void* spirv, std::unique_ptr<uint32_t, deleter>& copied_shader_data, const uint32_t** out_words) noexcept
 {
 	if (spirv_bytes < sizeof(spirv_header))
 		return spvcpu::result::shader_too_small;
 
 	const uint32_t* shader_words = static_cast<const uint32_t*>(spirv);
 
-	std::unique_ptr<uint32_t, deleter> copied_shader_data;
-
-	if (result header_result = check_header(shader_words); header_result == result::wrong_endianness)
+	if (spvcpu::result header_result = check_header(shader_words); header_result == spvcpu::result::wrong_endianness)
 	{
+		// The header is checked before copying, so that invalid shaders are
+		// rejected without touching the rest of their data.
+		spirv_header swapped_header;
+
+		copy_reversing_endianness(shader_words, reinterpret_cast<uint32_t*>(&swapped_header), sizeof(spirv_header) / 4);
+
+		if (spvcpu::result swapped_result = check_header(&swapped_header); swapped_result != spvcpu::result::success)
+			return swapped_result;
+
 		copied_shader_data = std::unique_ptr<uint32_t, deleter>(static_cast<uint32_t*>(malloc(spirv_bytes)));
 
 		if (copied_shader_data == nullptr)
-			return result::no_memory;
+			return spvcpu::result::no_memory;
 
-		for (uint32_t i = 0; i != spirv_bytes / 4; ++i)
-			copied_shader_data.get()[i] = reverse_endianness(shader_words[i]);
-		
-		shader_words = copied_shader_data.get();
+		copy_reversing_endianness(shader_words, copied_shader_data.get(), spirv_bytes / 4);
 
-		if (result header_result = check_header(shader_words); header_result != result::success)
-			return header_result;
+		shader_words = copied_shader_data.get();
 	}
-	else if (header_result != result::success)
+	else if (header_result != spvcpu::result::success)
 		return header_result;
 
-	output_buffer output;
+	*out_words = shader_words;
 
-	if (result rst = output.initialize(print_type_info); rst != result::success)
-		return rst;
+	return spvcpu::result::success;
+}
 
-	if (spirv_bytes & 3)
-		return result::shader_size_not_divisible_by_four;
-
-	const uint32_t* word_end = shader_words + (spirv_bytes >> 2);
-
-	spird::enum_location insn_enum_loc;
-
-	if (spvcpu::result rst = spird::get_enum_location(spird, spird::enum_id::Instruction, &insn_enum_loc); rst != spvcpu::result::success)
-		return rst;
-
-	for(const uint32_t* word = shader_words + 5; word < word_end;)
+// Disassembles the instructions from word_begin up to word_end.
+static spvcpu::result disassemble_range(const uint32_t* word_begin, const uint32_t* word_end, const void* spird, const spird::enum_location& insn_enum_loc, output_buffer* output) noexcept
+{
+	for(const uint32_t* word = word_begin; word < word_end;)
 	{
 		uint32_t wordcount = *word >> 16;
 
 		Op opcode = static_cast<Op>(*word & 0xFFFF);
 
 		if (word + wordcount > word_end)
-			return result::instruction_past_data_end;
+			return spvcpu::result::instruction_past_data_end;
 
-		spird::elem_data op_data;
+		spird::elem_view op_data;
 
-		if (result rst = spird::get_elem_data(spird, insn_enum_loc, static_cast<uint32_t>(opcode), &op_data); rst != result::success)
+		if (spvcpu::result rst = output->get_instruction(spird, insn_enum_loc, static_cast<uint32_t>(opcode), &op_data); rst != spvcpu::result::success)
 			return rst;
 
-		if (result rst = output.print_instruction_name(op_data.name); rst != result::success)
-			return rst;
+		if (output->emits_records())
+		{
+			if (spvcpu::result rst = output->begin_record(opcode, word); rst != spvcpu::result::success)
+				return rst;
+		}
+		else
+		{
+			if (spvcpu::result rst = output->print_instruction_name(op_data.name); rst != spvcpu::result::success)
+				return rst;
+		}
 
 		const uint32_t* arg_word = word + 1;
 
@@ -1823,20 +2098,72 @@ __declspec(dllexport) spvcpu::result spvcpu::disassemble(
 				++arg;
 			}
 
-			if (spvcpu::result rst = output.print_arg(spird, flags, type, second_flags, second_type, arg_word, word + wordcount); rst != spvcpu::result::success)
+			if (spvcpu::result rst = output->print_arg(spird, flags, type, second_flags, second_type, arg_word, word + wordcount); rst != spvcpu::result::success)
 				return rst;
 		}
 
-		if (result rst = output.end_line(); rst != result::success)
+		if (spvcpu::result rst = output->end_line(); rst != spvcpu::result::success)
 			return rst;
 
 		if (arg_word != word + wordcount)
-			return result::instruction_wordcount_mismatch;
+			return spvcpu::result::instruction_wordcount_mismatch;
 
 		word = arg_word;
 	}
 
-	if (result rst = output.finalize(); rst != result::success)
+	return spvcpu::result::success;
+}
+
+static spvcpu::result disassemble_words(const uint32_t* shader_words, const uint32_t* word_end, const void* spird, output_buffer* output) noexcept
+{
+	spird::enum_location insn_enum_loc;
+
+	if (spvcpu::result rst = spird::get_enum_location(spird, spird::enum_id::Instruction, &insn_enum_loc); rst != spvcpu::result::success)
+		return rst;
+
+	if (spvcpu::result rst = disassemble_range(shader_words + 5, word_end, spird, insn_enum_loc, output); rst != spvcpu::result::success)
+		return rst;
+
+	return output->finalize();
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::get_embedded_spird(const void** out_spird) noexcept
+{
+	const void* spird = spird::get_embedded_data();
+
+	if (spird == nullptr)
+		return result::spirv_data_not_embedded;
+
+	*out_spird = spird;
+
+	return result::success;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::disassemble(
+	uint64_t spirv_bytes,
+	const void* spirv,
+	const void* spird,
+	bool print_type_info,
+	uint64_t* out_disassembly_bytes,
+	char** out_disassembly
+) noexcept
+{
+	const uint32_t* shader_words;
+
+	std::unique_ptr<uint32_t, deleter> copied_shader_data;
+
+	if (result rst = prepare_shader(spirv_bytes, spirv, copied_shader_data, &shader_words); rst != result::success)
+		return rst;
+
+	output_buffer output;
+
+	if (result rst = output.initialize(print_type_info); rst != result::success)
+		return rst;
+
+	if (spirv_bytes & 3)
+		return result::shader_size_not_divisible_by_four;
+
+	if (result rst = disassemble_words(shader_words, shader_words + (spirv_bytes >> 2), spird, &output); rst != result::success)
 		return rst;
 	
 	*out_disassembly_bytes = output.size();
@@ -1845,3 +2172,893 @@ __declspec(dllexport) spvcpu::result spvcpu::disassemble(
 
 	return result::success;
 }
+
+__declspec(dllexport) spvcpu::result spvcpu::disassemble_to_sink(
+	uint64_t spirv_bytes,
+	const void* spirv,
+	const void* spird,
+	bool print_type_info,
+	uint64_t flush_bytes,
+	disassembly_sink sink,
+	void* sink_data
+) noexcept
+{
+	const uint32_t* shader_words;
+
+	std::unique_ptr<uint32_t, deleter> copied_shader_data;
+
+	if (result rst = prepare_shader(spirv_bytes, spirv, copied_shader_data, &shader_words); rst != result::success)
+		return rst;
+
+	output_buffer output;
+
+	if (result rst = output.initialize(print_type_info); rst != result::success)
+		return rst;
+
+	output.set_sink(sink, sink_data, flush_bytes);
+
+	if (spirv_bytes & 3)
+		return result::shader_size_not_divisible_by_four;
+
+	return disassemble_words(shader_words, shader_words + (spirv_bytes >> 2), spird, &output);
+}
+
+// Range of instructions disassembled as a unit by disassemble_parallel. Shards
+// consist of whole functions, so that only the ids of the preceding global
+// section are needed to disassemble them.
+struct disassembly_shard
+{
+	const uint32_t* word_begin;
+
+	const uint32_t* word_end;
+
+	// Output buffer of the worker that disassembled the shard, and the range of
+	// its text belonging to the shard.
+	uint32_t worker;
+
+	uint32_t text_begin;
+
+	uint32_t text_end;
+
+	spvcpu::result rst;
+};
+
+// Runs worker(job, 0) to worker(job, worker_count - 1), the first on the
+// calling thread and the others on threads, which are joined before
+// returning. If threads cannot be created, the remaining work is simply left
+// to the workers that exist.
+template<typename Job>
+static void run_workers(void (*worker)(Job*, uint32_t) noexcept, Job* job, uint32_t worker_count, std::thread* threads) noexcept
+{
+	uint32_t started_count = 0;
+
+	for (; started_count + 1 < worker_count; ++started_count)
+	{
+		try
+		{
+			threads[started_count] = std::thread(worker, job, started_count + 1);
+		}
+		catch (const std::system_error&)
+		{
+			break;
+		}
+	}
+
+	worker(job, 0);
+
+	for (uint32_t i = 0; i != started_count; ++i)
+		threads[i].join();
+}
+
+struct parallel_disassembly
+{
+	const void* spird;
+
+	spird::enum_location insn_enum_loc;
+
+	disassembly_shard* shards;
+
+	uint32_t shard_count;
+
+	output_buffer* outputs;
+
+	std::atomic<uint32_t> next_shard;
+};
+
+static void disassemble_shards(parallel_disassembly* job, uint32_t worker) noexcept
+{
+	output_buffer* const output = job->outputs + worker;
+
+	while (true)
+	{
+		const uint32_t index = job->next_shard.fetch_add(1, std::memory_order_relaxed);
+
+		if (index >= job->shard_count)
+			return;
+
+		disassembly_shard& shard = job->shards[index];
+
+		shard.worker = worker;
+
+		shard.text_begin = output->size();
+
+		shard.rst = disassemble_range(shard.word_begin, shard.word_end, job->spird, job->insn_enum_loc, output);
+
+		shard.text_end = output->size();
+	}
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::disassemble_parallel(
+	uint64_t spirv_bytes,
+	const void* spirv,
+	const void* spird,
+	bool print_type_info,
+	uint32_t thread_count,
+	uint64_t* out_disassembly_bytes,
+	char** out_disassembly
+) noexcept
+{
+	const uint32_t* shader_words;
+
+	std::unique_ptr<uint32_t, deleter> copied_shader_data;
+
+	if (result rst = prepare_shader(spirv_bytes, spirv, copied_shader_data, &shader_words); rst != result::success)
+		return rst;
+
+	if (spirv_bytes & 3)
+		return result::shader_size_not_divisible_by_four;
+
+	const uint32_t* const word_end = shader_words + (spirv_bytes >> 2);
+
+	if (thread_count == 0)
+		thread_count = std::thread::hardware_concurrency();
+
+	// Find the start of every function by only looking at opcodes and
+	// wordcounts. Malformed instructions end the search, leaving them to be
+	// reported by the sequential disassembly of the last shard.
+	uint32_t function_count = 0;
+
+	const uint32_t* first_function = word_end;
+
+	for (const uint32_t* word = shader_words + 5; word < word_end; word += *word >> 16)
+	{
+		if ((*word >> 16) == 0 || word + (*word >> 16) > word_end)
+			break;
+
+		if (static_cast<Op>(*word & 0xFFFF) == Op::Function)
+		{
+			if (function_count == 0)
+				first_function = word;
+
+			++function_count;
+		}
+	}
+
+	if (thread_count <= 1 || function_count <= 1)
+		return disassemble(spirv_bytes, spirv, spird, print_type_info, out_disassembly_bytes, out_disassembly);
+
+	// Consecutive functions are grouped into shards of at least target_words, so
+	// that there are still several shards per thread to balance the load.
+	const uint64_t target_words = (word_end - first_function) / (thread_count * 8);
+
+	simple_vec<disassembly_shard> shards;
+
+	if (!shards.initialize(function_count))
+		return result::no_memory;
+
+	const uint32_t* shard_begin = first_function;
+
+	for (const uint32_t* word = first_function; word < word_end; word += *word >> 16)
+	{
+		if ((*word >> 16) == 0 || word + (*word >> 16) > word_end)
+			break;
+
+		if (word != shard_begin && static_cast<Op>(*word & 0xFFFF) == Op::Function && static_cast<uint64_t>(word - shard_begin) >= target_words)
+		{
+			if (!shards.append({ shard_begin, word, 0, 0, 0, result::success }))
+				return result::no_memory;
+
+			shard_begin = word;
+		}
+	}
+
+	if (!shards.append({ shard_begin, word_end, 0, 0, 0, result::success }))
+		return result::no_memory;
+
+	if (thread_count > shards.size())
+		thread_count = shards.size();
+
+	output_buffer output;
+
+	if (result rst = output.initialize(print_type_info); rst != result::success)
+		return rst;
+
+	parallel_disassembly job;
+
+	job.spird = spird;
+
+	if (result rst = spird::get_enum_location(spird, spird::enum_id::Instruction, &job.insn_enum_loc); rst != result::success)
+		return rst;
+
+	// The global section has to be disassembled first, since it defines the
+	// types and constants used by the functions.
+	if (result rst = disassemble_range(shader_words + 5, first_function, spird, job.insn_enum_loc, &output); rst != result::success)
+		return rst;
+
+	std::unique_ptr<output_buffer[]> outputs{ new(std::nothrow) output_buffer[thread_count] };
+
+	std::unique_ptr<std::thread[]> threads{ new(std::nothrow) std::thread[thread_count - 1] };
+
+	if (outputs == nullptr || threads == nullptr)
+		return result::no_memory;
+
+	for (uint32_t i = 0; i != thread_count; ++i)
+	{
+		if (result rst = outputs[i].initialize_shard(output); rst != result::success)
+			return rst;
+	}
+
+	job.shards = shards.data();
+
+	job.shard_count = shards.size();
+
+	job.outputs = outputs.get();
+
+	job.next_shard.store(0, std::memory_order_relaxed);
+
+	run_workers(disassemble_shards, &job, thread_count, threads.get());
+
+	// Shards are joined in order, which also makes the reported error the one a
+	// sequential disassembly would have run into first.
+	for (uint32_t i = 0; i != shards.size(); ++i)
+	{
+		const disassembly_shard& shard = shards[i];
+
+		if (shard.rst != result::success)
+			return shard.rst;
+
+		if (result rst = output.append(outputs[shard.worker].data() + shard.text_begin, shard.text_end - shard.text_begin); rst != result::success)
+			return rst;
+	}
+
+	if (result rst = output.finalize(); rst != result::success)
+		return rst;
+
+	*out_disassembly_bytes = output.size();
+
+	*out_disassembly = output.steal();
+
+	return result::success;
+}
+
+// State shared by all calls to disassemble_many on the same disassembler. Each
+// worker owns an output buffer, whose memory is kept across modules and calls.
+struct disassembler
+{
+	const void* spird;
+
+	spird::enum_location insn_enum_loc;
+
+	uint32_t worker_count;
+
+	output_buffer* outputs;
+
+	std::thread* threads;
+};
+
+struct batch_disassembly
+{
+	disassembler* ctx;
+
+	const spvcpu::disassembly_span* modules;
+
+	spvcpu::disassembly_output* out_disassemblies;
+
+	uint32_t module_count;
+
+	std::atomic<uint32_t> next_module;
+};
+
+static spvcpu::result disassemble_module(const disassembler* ctx, output_buffer* output, const spvcpu::disassembly_span& module, spvcpu::disassembly_output* out) noexcept
+{
+	const uint32_t* shader_words;
+
+	std::unique_ptr<uint32_t, deleter> copied_shader_data;
+
+	if (spvcpu::result rst = prepare_shader(module.spirv_bytes, module.spirv, copied_shader_data, &shader_words); rst != spvcpu::result::success)
+		return rst;
+
+	if (module.spirv_bytes & 3)
+		return spvcpu::result::shader_size_not_divisible_by_four;
+
+	output->reset();
+
+	if (spvcpu::result rst = disassemble_range(shader_words + 5, shader_words + (module.spirv_bytes >> 2), ctx->spird, ctx->insn_enum_loc, output); rst != spvcpu::result::success)
+		return rst;
+
+	if (spvcpu::result rst = output->finalize(); rst != spvcpu::result::success)
+		return rst;
+
+	// The text is copied out so that the output buffer can keep its memory for
+	// the next module.
+	char* disassembly = static_cast<char*>(malloc(output->size()));
+
+	if (disassembly == nullptr)
+		return spvcpu::result::no_memory;
+
+	memcpy(disassembly, output->data(), output->size());
+
+	out->disassembly_bytes = output->size();
+
+	out->disassembly = disassembly;
+
+	return spvcpu::result::success;
+}
+
+static void disassemble_modules(batch_disassembly* job, uint32_t worker) noexcept
+{
+	output_buffer* const output = job->ctx->outputs + worker;
+
+	while (true)
+	{
+		const uint32_t index = job->next_module.fetch_add(1, std::memory_order_relaxed);
+
+		if (index >= job->module_count)
+			return;
+
+		spvcpu::disassembly_output* const out = job->out_disassemblies + index;
+
+		out->disassembly_bytes = 0;
+
+		out->disassembly = nullptr;
+
+		out->rst = disassemble_module(job->ctx, output, job->modules[index], out);
+	}
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::create_disassembler(const void* spird, bool print_type_info, uint32_t thread_count, void** out_disassembler) noexcept
+{
+	if (thread_count == 0)
+		thread_count = std::thread::hardware_concurrency();
+
+	if (thread_count == 0)
+		thread_count = 1;
+
+	spird::enum_location insn_enum_loc;
+
+	if (result rst = spird::get_enum_location(spird, spird::enum_id::Instruction, &insn_enum_loc); rst != result::success)
+		return rst;
+
+	std::unique_ptr<output_buffer[]> outputs{ new(std::nothrow) output_buffer[thread_count] };
+
+	std::unique_ptr<std::thread[]> threads{ thread_count == 1 ? nullptr : new(std::nothrow) std::thread[thread_count - 1] };
+
+	disassembler* ctx = static_cast<disassembler*>(malloc(sizeof(disassembler)));
+
+	if (outputs == nullptr || (thread_count != 1 && threads == nullptr) || ctx == nullptr)
+	{
+		free(ctx);
+
+		return result::no_memory;
+	}
+
+	for (uint32_t i = 0; i != thread_count; ++i)
+	{
+		if (result rst = outputs[i].initialize(print_type_info); rst != result::success)
+		{
+			free(ctx);
+
+			return rst;
+		}
+	}
+
+	ctx->spird = spird;
+
+	ctx->insn_enum_loc = insn_enum_loc;
+
+	ctx->worker_count = thread_count;
+
+	ctx->outputs = outputs.release();
+
+	ctx->threads = threads.release();
+
+	*out_disassembler = ctx;
+
+	return result::success;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::free_disassembler(void* disassembler_ptr) noexcept
+{
+	disassembler* ctx = static_cast<disassembler*>(disassembler_ptr);
+
+	delete[] ctx->outputs;
+
+	delete[] ctx->threads;
+
+	free(ctx);
+
+	return result::success;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::disassemble_many(void* disassembler_ptr, uint32_t module_count, const disassembly_span* modules, disassembly_output* out_disassemblies) noexcept
+{
+	disassembler* ctx = static_cast<disassembler*>(disassembler_ptr);
+
+	batch_disassembly job;
+
+	job.ctx = ctx;
+
+	job.modules = modules;
+
+	job.out_disassemblies = out_disassemblies;
+
+	job.module_count = module_count;
+
+	job.next_module.store(0, std::memory_order_relaxed);
+
+	const uint32_t worker_count = module_count < ctx->worker_count ? module_count : ctx->worker_count;
+
+	run_workers(disassemble_modules, &job, worker_count, ctx->threads);
+
+	for (uint32_t i = 0; i != module_count; ++i)
+	{
+		if (out_disassemblies[i].rst != result::success)
+			return out_disassemblies[i].rst;
+	}
+
+	return result::success;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::disassemble_to_records(
+	uint64_t spirv_bytes,
+	const void* spirv,
+	const void* spird,
+	disassembly_records* out_records
+) noexcept
+{
+	const uint32_t* shader_words;
+
+	std::unique_ptr<uint32_t, deleter> copied_shader_data;
+
+	if (result rst = prepare_shader(spirv_bytes, spirv, copied_shader_data, &shader_words); rst != result::success)
+		return rst;
+
+	if (spirv_bytes & 3)
+		return result::shader_size_not_divisible_by_four;
+
+	output_buffer output;
+
+	if (result rst = output.initialize(false); rst != result::success)
+		return rst;
+
+	if (result rst = output.initialize_records(shader_words); rst != result::success)
+		return rst;
+
+	spird::enum_location insn_enum_loc;
+
+	if (result rst = spird::get_enum_location(spird, spird::enum_id::Instruction, &insn_enum_loc); rst != result::success)
+		return rst;
+
+	if (result rst = disassemble_range(shader_words + 5, shader_words + (spirv_bytes >> 2), spird, insn_enum_loc, &output); rst != result::success)
+		return rst;
+
+	output.steal_records(out_records);
+
+	return result::success;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::free_disassembly_records(disassembly_records* records) noexcept
+{
+	free(const_cast<instruction_record*>(records->instructions));
+
+	free(const_cast<operand_record*>(records->operands));
+
+	free(const_cast<char*>(records->strings));
+
+	return result::success;
+}
+
+// Text of one function of a module kept by an incremental_disassembly. Word
+// offsets are from the start of the module, text offsets from the start of
+// the text.
+struct function_text
+{
+	uint32_t word_begin;
+
+	uint32_t word_end;
+
+	uint32_t text_begin;
+
+	uint32_t text_end;
+};
+
+struct incremental_disassembly
+{
+	const void* spird;
+
+	spird::enum_location insn_enum_loc;
+
+	bool print_type_info;
+
+	// Copy of the header and global section of the module, which the ids known
+	// to global refer to.
+	uint32_t* global_words;
+
+	uint32_t global_word_count;
+
+	uint32_t module_word_count;
+
+	// Holds the ids of the global section, from which function texts are
+	// disassembled.
+	output_buffer* global;
+
+	simple_vec<function_text> functions;
+
+	// Null-terminated disassembly of the whole module, starting with the
+	// global section's global_text_bytes.
+	char* text;
+
+	uint32_t text_bytes;
+
+	uint32_t global_text_bytes;
+
+	incremental_disassembly() noexcept : global_words{ nullptr }, global{ nullptr }, text{ nullptr } {}
+
+	~incremental_disassembly() noexcept
+	{
+		free(global_words);
+
+		delete global;
+
+		free(text);
+	}
+};
+
+// Disassembles the functions in the words from begin up to end into shard,
+// appending their texts, with offsets into shard, to out_functions. The words
+// have to start with an OpFunction.
+static spvcpu::result disassemble_functions(const incremental_disassembly* state, const uint32_t* words, uint32_t begin, uint32_t end, output_buffer* shard, simple_vec<function_text>* out_functions) noexcept
+{
+	uint32_t function_begin = begin;
+
+	uint32_t curr = begin;
+
+	while (curr != end)
+	{
+		const uint32_t wordcount = words[curr] >> 16;
+
+		// Malformed instructions end the search. The remaining words are then
+		// disassembled as part of the current function, which reports them.
+		if (wordcount == 0 || wordcount > end - curr)
+		{
+			curr = end;
+
+			break;
+		}
+
+		if (curr != function_begin && static_cast<Op>(words[curr] & 0xFFFF) == Op::Function)
+		{
+			const uint32_t text_begin = shard->size();
+
+			if (spvcpu::result rst = disassemble_range(words + function_begin, words + curr, state->spird, state->insn_enum_loc, shard); rst != spvcpu::result::success)
+				return rst;
+
+			if (!out_functions->append({ function_begin, curr, text_begin, shard->size() }))
+				return spvcpu::result::no_memory;
+
+			function_begin = curr;
+		}
+
+		curr += wordcount;
+	}
+
+	if (function_begin != end)
+	{
+		const uint32_t text_begin = shard->size();
+
+		if (spvcpu::result rst = disassemble_range(words + function_begin, words + end, state->spird, state->insn_enum_loc, shard); rst != spvcpu::result::success)
+			return rst;
+
+		if (!out_functions->append({ function_begin, end, text_begin, shard->size() }))
+			return spvcpu::result::no_memory;
+	}
+
+	return spvcpu::result::success;
+}
+
+// Disassembles the whole module into state, replacing everything it held.
+static spvcpu::result build_incremental_disassembly(incremental_disassembly* state, const uint32_t* words, uint32_t word_count) noexcept
+{
+	uint32_t global_word_count = word_count;
+
+	// Malformed instructions end the search, leaving them to be reported by
+	// the disassembly of the global section.
+	for (uint32_t curr = 5; curr < word_count && (words[curr] >> 16) != 0; curr += words[curr] >> 16)
+	{
+		if (static_cast<Op>(words[curr] & 0xFFFF) == Op::Function)
+		{
+			global_word_count = curr;
+
+			break;
+		}
+	}
+
+	uint32_t* global_words = static_cast<uint32_t*>(malloc(global_word_count * sizeof(uint32_t)));
+
+	output_buffer* global = new(std::nothrow) output_buffer;
+
+	if (global_words == nullptr || global == nullptr)
+	{
+		free(global_words);
+
+		delete global;
+
+		return spvcpu::result::no_memory;
+	}
+
+	memcpy(global_words, words, global_word_count * sizeof(uint32_t));
+
+	// Freed on failure, and swapped with the old state on success.
+	incremental_disassembly built;
+
+	built.global_words = global_words;
+
+	built.global = global;
+
+	if (spvcpu::result rst = global->initialize(state->print_type_info); rst != spvcpu::result::success)
+		return rst;
+
+	if (spvcpu::result rst = disassemble_range(global_words + 5, global_words + global_word_count, state->spird, state->insn_enum_loc, global); rst != spvcpu::result::success)
+		return rst;
+
+	output_buffer shard;
+
+	if (spvcpu::result rst = shard.initialize_shard(*global); rst != spvcpu::result::success)
+		return rst;
+
+	if (!built.functions.initialize(64))
+		return spvcpu::result::no_memory;
+
+	if (spvcpu::result rst = disassemble_functions(state, words, global_word_count, word_count, &shard, &built.functions); rst != spvcpu::result::success)
+		return rst;
+
+	const uint32_t global_text_bytes = global->size();
+
+	char* text = static_cast<char*>(malloc(global_text_bytes + shard.size() + 1));
+
+	if (text == nullptr)
+		return spvcpu::result::no_memory;
+
+	memcpy(text, global->data(), global_text_bytes);
+
+	memcpy(text + global_text_bytes, shard.data(), shard.size());
+
+	text[global_text_bytes + shard.size()] = '\0';
+
+	for (uint32_t i = 0; i != built.functions.size(); ++i)
+	{
+		built.functions[i].text_begin += global_text_bytes;
+
+		built.functions[i].text_end += global_text_bytes;
+	}
+
+	std::swap(state->global_words, built.global_words);
+
+	std::swap(state->global, built.global);
+
+	state->functions.swap(built.functions);
+
+	free(state->text);
+
+	state->text = text;
+
+	state->text_bytes = global_text_bytes + shard.size() + 1;
+
+	state->global_text_bytes = global_text_bytes;
+
+	state->global_word_count = global_word_count;
+
+	state->module_word_count = word_count;
+
+	return spvcpu::result::success;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::create_incremental_disassembly(
+	uint64_t spirv_bytes,
+	const void* spirv,
+	const void* spird,
+	bool print_type_info,
+	void** out_disassembly
+) noexcept
+{
+	const uint32_t* shader_words;
+
+	std::unique_ptr<uint32_t, deleter> copied_shader_data;
+
+	if (result rst = prepare_shader(spirv_bytes, spirv, copied_shader_data, &shader_words); rst != result::success)
+		return rst;
+
+	if (spirv_bytes & 3)
+		return result::shader_size_not_divisible_by_four;
+
+	std::unique_ptr<incremental_disassembly> state{ new(std::nothrow) incremental_disassembly };
+
+	if (state == nullptr)
+		return result::no_memory;
+
+	state->spird = spird;
+
+	state->print_type_info = print_type_info;
+
+	if (result rst = spird::get_enum_location(spird, spird::enum_id::Instruction, &state->insn_enum_loc); rst != result::success)
+		return rst;
+
+	if (result rst = build_incremental_disassembly(state.get(), shader_words, static_cast<uint32_t>(spirv_bytes >> 2)); rst != result::success)
+		return rst;
+
+	*out_disassembly = state.release();
+
+	return result::success;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::update_incremental_disassembly(
+	void* disassembly,
+	uint64_t spirv_bytes,
+	const void* spirv,
+	uint64_t changed_word_begin,
+	uint64_t changed_word_end
+) noexcept
+{
+	incremental_disassembly* state = static_cast<incremental_disassembly*>(disassembly);
+
+	const uint32_t* shader_words;
+
+	std::unique_ptr<uint32_t, deleter> copied_shader_data;
+
+	if (result rst = prepare_shader(spirv_bytes, spirv, copied_shader_data, &shader_words); rst != result::success)
+		return rst;
+
+	if (spirv_bytes & 3)
+		return result::shader_size_not_divisible_by_four;
+
+	const uint64_t word_count = spirv_bytes >> 2;
+
+	// The changed words replaced those from changed_word_begin up to
+	// old_changed_word_end in the previous module.
+	const uint64_t old_changed_word_end = changed_word_end + state->module_word_count - word_count;
+
+	if (changed_word_begin > changed_word_end || changed_word_end > word_count || old_changed_word_end < changed_word_begin || old_changed_word_end > state->module_word_count)
+		return result::changed_range_out_of_bounds;
+
+	// Changes to the header or global section may affect any function.
+	if (changed_word_begin < state->global_word_count)
+		return build_incremental_disassembly(state, shader_words, static_cast<uint32_t>(word_count));
+
+	// Functions before the change and after it are kept. The latter only
+	// move by the difference in word count. A function ending right where the
+	// change starts is redone as well, since words inserted there might
+	// continue it rather than start a new function.
+	const function_text* const functions = state->functions.data();
+
+	const uint32_t function_count = state->functions.size();
+
+	uint32_t kept_before = 0;
+
+	while (kept_before != function_count && functions[kept_before].word_end < changed_word_begin)
+		++kept_before;
+
+	uint32_t kept_after_begin = function_count;
+
+	while (kept_after_begin != kept_before && functions[kept_after_begin - 1].word_begin >= old_changed_word_end)
+		--kept_after_begin;
+
+	const uint32_t old_redone_word_begin = kept_before == 0 ? state->global_word_count : functions[kept_before - 1].word_end;
+
+	const uint32_t old_redone_word_end = kept_after_begin == function_count ? state->module_word_count : functions[kept_after_begin].word_begin;
+
+	const uint32_t old_redone_text_begin = kept_before == 0 ? state->global_text_bytes : functions[kept_before - 1].text_end;
+
+	const uint32_t old_redone_text_end = kept_after_begin == function_count ? state->text_bytes - 1 : functions[kept_after_begin].text_begin;
+
+	const uint32_t redone_word_end = static_cast<uint32_t>(old_redone_word_end + word_count - state->module_word_count);
+
+	// If the changed words no longer start with a function, the global section
+	// grew into them.
+	if (old_redone_word_begin != redone_word_end && static_cast<Op>(shader_words[old_redone_word_begin] & 0xFFFF) != Op::Function)
+		return build_incremental_disassembly(state, shader_words, static_cast<uint32_t>(word_count));
+
+	output_buffer shard;
+
+	if (result rst = shard.initialize_shard(*state->global); rst != result::success)
+		return rst;
+
+	simple_vec<function_text> redone_functions;
+
+	if (!redone_functions.initialize(8))
+		return result::no_memory;
+
+	if (result rst = disassemble_functions(state, shader_words, old_redone_word_begin, redone_word_end, &shard, &redone_functions); rst != result::success)
+		return rst;
+
+	const uint32_t text_bytes = state->text_bytes - (old_redone_text_end - old_redone_text_begin) + shard.size();
+
+	char* text = static_cast<char*>(malloc(text_bytes));
+
+	simple_vec<function_text> new_functions;
+
+	if (text == nullptr || !new_functions.initialize(kept_before + redone_functions.size() + function_count - kept_after_begin + 1))
+	{
+		free(text);
+
+		return result::no_memory;
+	}
+
+	memcpy(text, state->text, old_redone_text_begin);
+
+	memcpy(text + old_redone_text_begin, shard.data(), shard.size());
+
+	memcpy(text + old_redone_text_begin + shard.size(), state->text + old_redone_text_end, state->text_bytes - old_redone_text_end);
+
+	// Guaranteed to succeed, since enough capacity was reserved above.
+	(void) new_functions.append_range(functions, kept_before);
+
+	for (uint32_t i = 0; i != redone_functions.size(); ++i)
+	{
+		function_text f = redone_functions[i];
+
+		f.text_begin += old_redone_text_begin;
+
+		f.text_end += old_redone_text_begin;
+
+		(void) new_functions.append(f);
+	}
+
+	const uint32_t word_shift = static_cast<uint32_t>(word_count - state->module_word_count);
+
+	const uint32_t text_shift = shard.size() - (old_redone_text_end - old_redone_text_begin);
+
+	for (uint32_t i = kept_after_begin; i != function_count; ++i)
+	{
+		function_text f = functions[i];
+
+		f.word_begin += word_shift;
+
+		f.word_end += word_shift;
+
+		f.text_begin += text_shift;
+
+		f.text_end += text_shift;
+
+		(void) new_functions.append(f);
+	}
+
+	state->functions.swap(new_functions);
+
+	free(state->text);
+
+	state->text = text;
+
+	state->text_bytes = text_bytes;
+
+	state->module_word_count = static_cast<uint32_t>(word_count);
+
+	return result::success;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::get_incremental_disassembly_text(const void* disassembly, uint64_t* out_disassembly_bytes, const char** out_disassembly) noexcept
+{
+	const incremental_disassembly* state = static_cast<const incremental_disassembly*>(disassembly);
+
+	*out_disassembly_bytes = state->text_bytes;
+
+	*out_disassembly = state->text;
+
+	return result::success;
+}
+
+__declspec(dllexport) spvcpu::result spvcpu::free_incremental_disassembly(void* disassembly) noexcept
+{
+	delete static_cast<incremental_disassembly*>(disassembly);
+
+	return result::success;
+}
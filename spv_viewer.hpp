@@ -7,6 +7,12 @@
 
 namespace spvcpu
 {
+	// Retrieves the spird data compiled into the library, which can be passed
+	// as spird to all functions taking it instead of the contents of a .spird
+	// file. Fails with result::spirv_data_not_embedded unless the library was
+	// built with SPVCPU_EMBEDDED_SPIRD.
+	__declspec(dllexport) result get_embedded_spird(const void** out_spird) noexcept;
+
 	__declspec(dllexport) result disassemble(
 		uint64_t spirv_bytes,
 		const void* spirv,
@@ -15,6 +21,203 @@ namespace spvcpu
 		uint64_t* out_disassembly_bytes,
 		char** out_disassembly
 	) noexcept;
+
+	// Receives the next bytes of text produced by disassemble_to_sink, which
+	// are not null-terminated. Returning false stops disassembly with
+	// result::output_sink_failed.
+	using disassembly_sink = bool (*)(const char* text, uint64_t bytes, void* sink_data);
+
+	// Same as disassemble, but hands the text to sink while disassembly runs
+	// instead of returning it as a whole. Output is passed on in pieces of
+	// complete lines as soon as at least flush_bytes have accumulated, so a
+	// flush_bytes of 0 passes on every line by itself. Memory use is bounded
+	// by flush_bytes plus the length of the longest line.
+	__declspec(dllexport) result disassemble_to_sink(
+		uint64_t spirv_bytes,
+		const void* spirv,
+		const void* spird,
+		bool print_type_info,
+		uint64_t flush_bytes,
+		disassembly_sink sink,
+		void* sink_data
+	) noexcept;
+
+	// Same as disassemble, but disassembles the module's functions on up to
+	// thread_count threads, or one per hardware thread if thread_count is 0.
+	// The global section preceding the first function is disassembled first,
+	// after which functions are split into shards that are disassembled
+	// independently and joined in order. Output is identical to that of
+	// disassemble. Modules with fewer than two functions are disassembled
+	// sequentially.
+	__declspec(dllexport) result disassemble_parallel(
+		uint64_t spirv_bytes,
+		const void* spirv,
+		const void* spird,
+		bool print_type_info,
+		uint32_t thread_count,
+		uint64_t* out_disassembly_bytes,
+		char** out_disassembly
+	) noexcept;
+
+	struct disassembly_span
+	{
+		uint64_t spirv_bytes;
+
+		const void* spirv;
+	};
+
+	struct disassembly_output
+	{
+		result rst;
+
+		// Includes the null-terminator, as with disassemble. Must be freed by
+		// the caller.
+		uint64_t disassembly_bytes;
+
+		char* disassembly;
+	};
+
+	// Creates a context for disassembling many modules through
+	// disassemble_many. The Instruction enum of spird is only looked up once,
+	// and the output buffers and id tables of the context are reused for all
+	// modules it disassembles. Up to thread_count modules are disassembled at
+	// the same time, or one per hardware thread if thread_count is 0.
+	__declspec(dllexport) result create_disassembler(const void* spird, bool print_type_info, uint32_t thread_count, void** out_disassembler) noexcept;
+
+	__declspec(dllexport) result free_disassembler(void* disassembler) noexcept;
+
+	// Disassembles each of the module_count modules into the corresponding
+	// element of out_disassemblies, whose rst is set to the module's result.
+	// Modules that fail have a null disassembly. Returns the first of these
+	// results that is not result::success, or result::success if all modules
+	// were disassembled. A disassembler must not be used by more than one call
+	// at a time.
+	__declspec(dllexport) result disassemble_many(void* disassembler, uint32_t module_count, const disassembly_span* modules, disassembly_output* out_disassemblies) noexcept;
+
+	enum class operand_kind : uint32_t
+	{
+		// value is an id.
+		id,
+
+		// value is the id of a type.
+		type_id,
+
+		// value is an unsigned integer literal.
+		integer,
+
+		// value is a signed integer literal, sign-extended to 64 bits.
+		signed_integer,
+
+		// value holds the bits of a float literal, converted to a double.
+		floating_point,
+
+		// value is the offset of a null-terminated string in the string table.
+		string,
+
+		// value is a member index of OpMemberName and OpMemberDecorate.
+		member,
+
+		// value is an enumerant, which for bitmask enums holds all of its set
+		// bits. detail is the spird::enum_id of its enum, or ~0u for the
+		// instructions of extended instruction sets.
+		enumerant,
+
+		// A literal whose type is not known. value is the offset of its first
+		// word from the start of the module, and detail its number of words.
+		raw_literal,
+	};
+
+	struct operand_record
+	{
+		operand_kind kind;
+
+		uint32_t detail;
+
+		uint64_t value;
+	};
+
+	// Decoded form of one instruction. Its operands are the operand_count
+	// consecutive operand_records starting at first_operand, in the order in
+	// which disassemble prints them, with the arguments of enumerants directly
+	// following them.
+	struct instruction_record
+	{
+		uint32_t opcode;
+
+		// ~0u if the instruction has no result.
+		uint32_t result_id;
+
+		// ~0u if the instruction has no result type.
+		uint32_t result_type_id;
+
+		// Offset of the instruction's first word from the start of the module.
+		uint32_t word_offset;
+
+		uint32_t first_operand;
+
+		uint32_t operand_count;
+	};
+
+	struct disassembly_records
+	{
+		uint64_t instruction_count;
+
+		const instruction_record* instructions;
+
+		uint64_t operand_count;
+
+		const operand_record* operands;
+
+		uint64_t strings_bytes;
+
+		const char* strings;
+	};
+
+	// Decodes the module into records using the same spird-driven decoding as
+	// disassemble, but without producing any text. out_records has to be freed
+	// with free_disassembly_records.
+	__declspec(dllexport) result disassemble_to_records(
+		uint64_t spirv_bytes,
+		const void* spirv,
+		const void* spird,
+		disassembly_records* out_records
+	) noexcept;
+
+	__declspec(dllexport) result free_disassembly_records(disassembly_records* records) noexcept;
+
+	// Disassembles the module like disassemble, but keeps the decoded global
+	// section and the text of each function, so that the module can be
+	// re-disassembled after it was edited through
+	// update_incremental_disassembly.
+	__declspec(dllexport) result create_incremental_disassembly(
+		uint64_t spirv_bytes,
+		const void* spirv,
+		const void* spird,
+		bool print_type_info,
+		void** out_disassembly
+	) noexcept;
+
+	// Updates the disassembly to the edited module at spirv, in which the words
+	// from changed_word_begin up to changed_word_end replaced words starting at
+	// the same offset in the previous module. The number of replaced words
+	// follows from the change in the module's size. Offsets are in words from
+	// the start of the module. Only the functions overlapping the change are
+	// disassembled again, while the text of all others is kept. Changes to the
+	// header or global section cause the whole module to be disassembled again.
+	__declspec(dllexport) result update_incremental_disassembly(
+		void* disassembly,
+		uint64_t spirv_bytes,
+		const void* spirv,
+		uint64_t changed_word_begin,
+		uint64_t changed_word_end
+	) noexcept;
+
+	// Returns the current text of the disassembly, which remains valid until it
+	// is next updated or freed. out_disassembly_bytes includes the
+	// null-terminator, as with disassemble.
+	__declspec(dllexport) result get_incremental_disassembly_text(const void* disassembly, uint64_t* out_disassembly_bytes, const char** out_disassembly) noexcept;
+
+	__declspec(dllexport) result free_incremental_disassembly(void* disassembly) noexcept;
 }
 
 #endif // SPVCPU_HPP_INCLUDE_GUARD
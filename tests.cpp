@@ -5,6 +5,8 @@
 
 #include "spird_accessor.hpp"
 #include "spird_names.hpp"
+#include "spv_defs.hpp"
+#include "spv_runner.hpp"
 #include "spv_viewer.hpp"
 
 #ifdef _WIN32
@@ -12,8 +14,60 @@
 #define fseek _fseeki64
 #endif
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+// Maps the file read-only instead of copying it into a separate buffer.
+// Returns false if it has to be read instead, without printing an error.
+static bool map_file_content(const char* filename, void** out_data, uint64_t* out_bytes) noexcept
+{
+	const int fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return false;
+
+	struct stat file_stat;
+
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+	{
+		close(fd);
+
+		return false;
+	}
+
+	void* data = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return false;
+
+	// Shaders are disassembled front to back. spird files are accessed
+	// randomly, but are small enough for the hint not to matter.
+	madvise(data, static_cast<size_t>(file_stat.st_size), MADV_SEQUENTIAL);
+
+	*out_data = data;
+
+	*out_bytes = static_cast<uint64_t>(file_stat.st_size);
+
+	return true;
+}
+#endif
+
+// Returns the contents of the file, which are never freed, since they are
+// used until the program exits. They are read-only if they were mapped.
 bool get_file_content(const char* filename, void** out_data, uint64_t* out_bytes) noexcept
 {
+#if defined(__linux__)
+	if (map_file_content(filename, out_data, out_bytes))
+		return true;
+#endif
+
 	FILE* file;
 
 	if (fopen_s(&file, filename, "rb") != 0)
@@ -179,18 +233,20 @@ int cycle(int argc, const char** argv) noexcept
 
 		const spird::table_header* table_header = reinterpret_cast<const spird::table_header*>(raw_data + file_header->first_table_header_byte) + t;
 
-		const spird::elem_index* indices = reinterpret_cast<const spird::elem_index*>(raw_data + table_header->offset);
+		const uint32_t* direct_offsets = reinterpret_cast<const uint32_t*>(raw_data + table_header->offset);
+
+		const spird::elem_index* sparse_indices = reinterpret_cast<const spird::elem_index*>(direct_offsets + table_header->direct_count);
 
-		for (uint32_t i = 0; i != table_header->size; ++i)
+		for (uint32_t i = 0; i != table_header->direct_count + table_header->sparse_count; ++i)
 		{
-			uint32_t id = indices[i].id;
+			const uint32_t id = i < table_header->direct_count ? i : sparse_indices[i - table_header->direct_count].id;
 
-			if (id == ~0u)
+			if (i < table_header->direct_count && direct_offsets[i] == 0)
 				continue;
 
-			spird::elem_data elem_data;
+			spird::elem_view elem;
 
-			if (spvcpu::result rst = spird::get_elem_data(spird, enum_loc, id, &elem_data); rst != spvcpu::result::success)
+			if (spvcpu::result rst = spird::get_elem_view(spird, enum_loc, id, &elem); rst != spvcpu::result::success)
 			{
 				fprintf(stderr, "Could not get data for element %d of enumeration '%s' (%d). (Error %d)\n", id, enum_data.name, t, rst);
 
@@ -202,16 +258,16 @@ int cycle(int argc, const char** argv) noexcept
 			else
 				fprintf(output_file, "\t{\n\t\tid : %d", id);
 
-			fprintf(output_file, "\n\t\tname : \"%s\"\n", elem_data.name == nullptr ? "<Unknown>" : elem_data.name);
+			fprintf(output_file, "\n\t\tname : \"%s\"\n", elem.name == nullptr ? "<Unknown>" : elem.name);
 
-			if (elem_data.argc > 0)
+			if (elem.argc > 0)
 				fprintf(output_file, "\t\targs : [\n");
 
-			for (uint32_t i = 0; i != elem_data.argc; ++i)
+			for (uint32_t i = 0; i != elem.argc; ++i)
 			{
-				spird::arg_type arg_type = elem_data.arg_types[i];
+				spird::arg_type arg_type = elem.arg_types[i];
 
-				spird::arg_flags arg_flags = elem_data.arg_flags[i];
+				spird::arg_flags arg_flags = elem.arg_flags[i];
 
 				const char* optstr = "";
 
@@ -250,31 +306,31 @@ int cycle(int argc, const char** argv) noexcept
 				{
 					fprintf(output_file, "\t\t\t%s%s%s%s", optstr, varstr, idstr, type_name);
 
-					if (elem_data.arg_names[i] == nullptr)
+					if (elem.arg_name(i) == nullptr)
 						fprintf(output_file, "\n");
 					else
-						fprintf(output_file, " \"%s\"\n", elem_data.arg_names[i]);
+						fprintf(output_file, " \"%s\"\n", elem.arg_name(i));
 				}
 			}
 
-			if (elem_data.argc > 0)
+			if (elem.argc > 0)
 				fprintf(output_file, "\t\t]\n");
 
-			if (elem_data.implies_or_depends != spird::implies_or_depends_mode::none)
+			if (elem.implies_or_depends != spird::implies_or_depends_mode::none)
 			{
-				fprintf(output_file, elem_data.implies_or_depends == spird::implies_or_depends_mode::depends ? "\t\tdepends : " : "\t\timplies : ");
+				fprintf(output_file, elem.implies_or_depends == spird::implies_or_depends_mode::depends ? "\t\tdepends : " : "\t\timplies : ");
 
-				if (elem_data.capability_cnt > 1)
+				if (elem.capability_cnt > 1)
 				{
 					fprintf(output_file, "[\n");
 
-					for (uint8_t j = 0; j != elem_data.capability_cnt; ++j)
+					for (uint8_t j = 0; j != elem.capability_cnt; ++j)
 					{
 						const char* str;
 
-						if (!spird::get_name_from_capability_id(elem_data.capabilities[j], &str))
+						if (!spird::get_name_from_capability_id(elem.capabilities[j], &str))
 						{
-							fprintf(stderr, "Could not get name of capability %d.\n", elem_data.capabilities[j]);
+							fprintf(stderr, "Could not get name of capability %d.\n", elem.capabilities[j]);
 
 							return 1;
 						}
@@ -288,9 +344,9 @@ int cycle(int argc, const char** argv) noexcept
 				{
 					const char* str;
 
-					if (!spird::get_name_from_capability_id(elem_data.capabilities[0], &str))
+					if (!spird::get_name_from_capability_id(elem.capabilities[0], &str))
 					{
-						fprintf(stderr, "Could not get name of capability %d.\n", elem_data.capabilities[i]);
+						fprintf(stderr, "Could not get name of capability %d.\n", elem.capabilities[i]);
 
 						return 1;
 					}
@@ -308,24 +364,46 @@ int cycle(int argc, const char** argv) noexcept
 	return 0;
 }
 
+static bool write_disassembly(const char* text, uint64_t bytes, void* sink_data) noexcept
+{
+	return fwrite(text, 1, bytes, static_cast<FILE*>(sink_data)) == bytes;
+}
+
 int disasm(int argc, const char** argv) noexcept
 {
-	if (argc < 3 || argc > 5)
-	{
-		printf("Usage: %s [--types] shader-file spird-file [output-file]\n", argv[0]);
+	bool print_type_info = false;
 
-		return 0;
-	}
+	// 0 disassembles sequentially, streaming the output, while anything else
+	// is passed on to disassemble_parallel.
+	uint32_t thread_count = 0;
 
-	bool print_type_info = false;
+	int curr_arg = 1;
+
+	while (curr_arg < argc)
+	{
+		if (strcmp(argv[curr_arg], "--types") == 0)
+		{
+			print_type_info = true;
+
+			curr_arg += 1;
+		}
+		else if (strcmp(argv[curr_arg], "--threads") == 0 && curr_arg + 1 < argc)
+		{
+			thread_count = static_cast<uint32_t>(strtoul(argv[curr_arg + 1], nullptr, 10));
 
-	uint32_t curr_arg = 1;
+			curr_arg += 2;
+		}
+		else
+		{
+			break;
+		}
+	}
 
-	if (strcmp(argv[1], "--types") == 0)
+	if (argc - curr_arg < 2 || argc - curr_arg > 3)
 	{
-		print_type_info = true;
+		printf("Usage: %s [--types] [--threads thread-count] shader-file spird-file [output-file]\n", argv[0]);
 
-		curr_arg = 2;
+		return 0;
 	}
 
 	FILE* output_file = stdout;
@@ -355,20 +433,45 @@ int disasm(int argc, const char** argv) noexcept
 		}
 	}
 
-	char* disassembly;
+	if (thread_count != 0)
+	{
+		uint64_t disassembly_bytes;
+
+		char* disassembly;
 
-	uint64_t disassembly_bytes;
+		if (spvcpu::result rst = spvcpu::disassemble_parallel(shader_bytes, shader_data, spird_data, print_type_info, thread_count, &disassembly_bytes, &disassembly); rst != spvcpu::result::success)
+		{
+			fprintf(stderr, "spvcpu::disassemble_parallel failed with error %d.\n", static_cast<uint32_t>(rst));
+
+			return 1;
+		}
+
+		// disassembly_bytes includes the null-terminator, which is not written.
+		const bool written = write_disassembly(disassembly, disassembly_bytes - 1, output_file);
+
+		free(disassembly);
+
+		if (!written)
+		{
+			fprintf(stderr, "Could not write to %s%s", output_file == stdout ? "" : "file ", output_file == stdout ? "stdout" : argv[curr_arg]);
 
-	if (spvcpu::result rst = spvcpu::disassemble(shader_bytes, shader_data, spird_data, print_type_info, &disassembly_bytes, &disassembly); rst != spvcpu::result::success)
+			return 1;
+		}
+
+		return 0;
+	}
+
+	// Written out in 64 KiB pieces while disassembly runs, so that large
+	// shaders never have to be held in memory as a whole.
+	if (spvcpu::result rst = spvcpu::disassemble_to_sink(shader_bytes, shader_data, spird_data, print_type_info, 65536, write_disassembly, output_file); rst == spvcpu::result::output_sink_failed)
 	{
-		fprintf(stderr, "spvcpu::disassemble failed with error %d.\n", static_cast<uint32_t>(rst));
+		fprintf(stderr, "Could not write to %s%s", output_file == stdout ? "" : "file ", output_file == stdout ? "stdout" : argv[curr_arg]);
 
 		return 1;
 	}
-
-	if (fwrite(disassembly, 1, disassembly_bytes - 1, output_file) != disassembly_bytes - 1)
+	else if (rst != spvcpu::result::success)
 	{
-		fprintf(stderr, "Could not write to %s%s", output_file == stdout ? "" : "file ", output_file == stdout ? "stdout" : argv[3]);
+		fprintf(stderr, "spvcpu::disassemble_to_sink failed with error %d.\n", static_cast<uint32_t>(rst));
 
 		return 1;
 	}
@@ -376,26 +479,993 @@ int disasm(int argc, const char** argv) noexcept
 	return 0;
 }
 
-void print_usage(const char* prog_name) noexcept
+// Kinds of edits applied by make_edit.
+enum class edit_kind
 {
-	fprintf(stderr, "Usage: %s (--cycle|--disasm) [additional args...]\n", prog_name);
+	// Swaps the operands of the function's first binary arithmetic
+	// instruction, or rewrites the function unchanged if it has none.
+	swap_operands,
+
+	// Inserts an OpNop before the terminator of the function's last block.
+	insert_nop,
+
+	// Moves the function to the end of the module.
+	move_to_end,
+
+	// Removes the function, unless it is the only one.
+	remove,
+
+	// Flips the lowest bit of the value of the first OpConstant in the global
+	// section, which makes the whole module be disassembled again.
+	change_constant,
+};
+
+static constexpr uint32_t edit_kind_count = 5;
+
+// Writes the word offsets at which the module's functions start to
+// out_begins, followed by word_count, and returns the number of functions.
+// out_begins needs space for one entry more than there are instructions.
+static uint32_t find_functions(const uint32_t* words, uint32_t word_count, uint32_t* out_begins) noexcept
+{
+	uint32_t function_count = 0;
+
+	for (uint32_t i = 5; i < word_count && (words[i] >> 16) != 0; i += words[i] >> 16)
+	{
+		if (static_cast<Op>(words[i] & 0xFFFF) == Op::Function)
+			out_begins[function_count++] = i;
+	}
+
+	out_begins[function_count] = word_count;
+
+	return function_count;
 }
 
-int main(int argc, const char** argv)
+// Applies an edit to function function_index of the module in words, writing
+// the result to out_words, which needs space for word_count + 1 words. The
+// changed words of the result are returned as for
+// update_incremental_disassembly. Returns false if the edit does not apply to
+// the module.
+static bool make_edit(edit_kind kind, uint32_t function_index, const uint32_t* words, uint32_t word_count, uint32_t* function_begins, uint32_t* out_words, uint32_t* out_word_count, uint32_t* out_changed_begin, uint32_t* out_changed_end) noexcept
 {
-	if (argc < 2)
+	const uint32_t function_count = find_functions(words, word_count, function_begins);
+
+	if (function_index >= function_count)
+		return false;
+
+	const uint32_t function_begin = function_begins[function_index];
+
+	const uint32_t function_end = function_begins[function_index + 1];
+
+	memcpy(out_words, words, word_count * sizeof(uint32_t));
+
+	*out_word_count = word_count;
+
+	switch (kind)
 	{
-		print_usage(argv[0]);
+	case edit_kind::swap_operands:
+	{
+		*out_changed_begin = function_begin;
+
+		*out_changed_end = function_end;
+
+		for (uint32_t i = function_begin; i != function_end; i += words[i] >> 16)
+		{
+			const Op op = static_cast<Op>(words[i] & 0xFFFF);
+
+			if ((words[i] >> 16) == 5 && (op == Op::IAdd || op == Op::FAdd || op == Op::IMul || op == Op::FMul))
+			{
+				out_words[i + 3] = words[i + 4];
+
+				out_words[i + 4] = words[i + 3];
+
+				*out_changed_begin = i + 3;
+
+				*out_changed_end = i + 5;
+
+				break;
+			}
+		}
+
+		return true;
+	}
+	case edit_kind::insert_nop:
+	{
+		uint32_t terminator = function_begin;
+
+		for (uint32_t i = function_begin; static_cast<Op>(words[i] & 0xFFFF) != Op::FunctionEnd; i += words[i] >> 16)
+			terminator = i;
+
+		memcpy(out_words + terminator + 1, words + terminator, (word_count - terminator) * sizeof(uint32_t));
+
+		out_words[terminator] = (1 << 16) | static_cast<uint32_t>(Op::Nop);
+
+		*out_word_count = word_count + 1;
+
+		*out_changed_begin = terminator;
+
+		*out_changed_end = terminator + 1;
+
+		return true;
+	}
+	case edit_kind::move_to_end:
+	{
+		const uint32_t function_words = function_end - function_begin;
+
+		memcpy(out_words + function_begin, words + function_end, (word_count - function_end) * sizeof(uint32_t));
+
+		memcpy(out_words + word_count - function_words, words + function_begin, function_words * sizeof(uint32_t));
+
+		*out_changed_begin = function_begin;
+
+		*out_changed_end = word_count;
+
+		return true;
+	}
+	case edit_kind::remove:
+	{
+		if (function_count == 1)
+			return false;
+
+		memcpy(out_words + function_begin, words + function_end, (word_count - function_end) * sizeof(uint32_t));
+
+		*out_word_count = word_count - (function_end - function_begin);
+
+		*out_changed_begin = function_begin;
+
+		*out_changed_end = function_begin;
+
+		return true;
+	}
+	case edit_kind::change_constant:
+	{
+		for (uint32_t i = 5; i != function_begins[0]; i += words[i] >> 16)
+		{
+			if (static_cast<Op>(words[i] & 0xFFFF) == Op::Constant)
+			{
+				const uint32_t last_word = i + (words[i] >> 16) - 1;
+
+				out_words[last_word] ^= 1;
+
+				*out_changed_begin = last_word;
+
+				*out_changed_end = last_word + 1;
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+	}
+
+	return false;
+}
+
+// Checks that the incremental disassembly matches a fresh disassembly of the
+// module, printing the failing edit otherwise.
+static bool check_incremental_text(const void* incremental, const uint32_t* words, uint32_t word_count, const void* spird, bool print_type_info, const char* mode, edit_kind kind, uint32_t function_index) noexcept
+{
+	uint64_t expected_bytes;
+
+	char* expected;
+
+	if (spvcpu::result rst = spvcpu::disassemble(word_count * sizeof(uint32_t), words, spird, print_type_info, &expected_bytes, &expected); rst != spvcpu::result::success)
+	{
+		fprintf(stderr, "spvcpu::disassemble failed with error %d after %s edit %d of function %d.\n", static_cast<uint32_t>(rst), mode, static_cast<uint32_t>(kind), function_index);
+
+		return false;
+	}
+
+	uint64_t actual_bytes;
+
+	const char* actual;
+
+	const bool is_equal = spvcpu::get_incremental_disassembly_text(incremental, &actual_bytes, &actual) == spvcpu::result::success
+	                   && actual_bytes == expected_bytes
+	                   && memcmp(actual, expected, expected_bytes) == 0;
+
+	free(expected);
+
+	if (!is_equal)
+		fprintf(stderr, "Incremental disassembly differs after %s edit %d of function %d%s.\n", mode, static_cast<uint32_t>(kind), function_index, print_type_info ? " with type info" : "");
+
+	return is_equal;
+}
+
+// Edits the shader in various ways and checks that updating an incremental
+// disassembly gives the same text as disassembling the edited shader from
+// scratch. Every edit is applied once to the unchanged shader, and once more
+// on top of all previous edits.
+int incremental(int argc, const char** argv) noexcept
+{
+	if (argc != 3)
+	{
+		fprintf(stderr, "Usage: %s shader-file spird-file\n", argv[0]);
 
 		return 0;
 	}
-	else if (strcmp(argv[1], "--cycle") == 0)
+
+	void* shader_data;
+
+	uint64_t shader_bytes;
+
+	void* spird;
+
+	uint64_t spird_bytes;
+
+	if (!get_file_content(argv[1], &shader_data, &shader_bytes))
+		return 1;
+
+	if (!get_file_content(argv[2], &spird, &spird_bytes))
+		return 1;
+
+	const uint32_t* const original_words = static_cast<const uint32_t*>(shader_data);
+
+	const uint32_t original_word_count = static_cast<uint32_t>(shader_bytes / sizeof(uint32_t));
+
+	// Chained edits grow the module by at most one word per function, and
+	// there are fewer functions than words.
+	const uint32_t capacity = 2 * original_word_count + 1;
+
+	uint32_t* const words = static_cast<uint32_t*>(malloc(capacity * sizeof(uint32_t)));
+
+	uint32_t* const edited_words = static_cast<uint32_t*>(malloc(capacity * sizeof(uint32_t)));
+
+	uint32_t* const function_begins = static_cast<uint32_t*>(malloc(capacity * sizeof(uint32_t)));
+
+	if (words == nullptr || edited_words == nullptr || function_begins == nullptr)
 	{
-		return cycle(argc - 1, argv + 1);
+		fprintf(stderr, "malloc failed.\n");
+
+		return 1;
 	}
-	else if (strcmp(argv[1], "--disasm") == 0)
+
+	const uint32_t function_count = find_functions(original_words, original_word_count, function_begins);
+
+	uint32_t edit_count = 0;
+
+	uint32_t failure_count = 0;
+
+	for (uint32_t print_type_info = 0; print_type_info != 2; ++print_type_info)
 	{
-		return disasm(argc - 1, argv + 1);
+		void* chained;
+
+		if (spvcpu::result rst = spvcpu::create_incremental_disassembly(shader_bytes, shader_data, spird, print_type_info != 0, &chained); rst != spvcpu::result::success)
+		{
+			fprintf(stderr, "spvcpu::create_incremental_disassembly failed with error %d.\n", static_cast<uint32_t>(rst));
+
+			return 1;
+		}
+
+		memcpy(words, original_words, original_word_count * sizeof(uint32_t));
+
+		uint32_t word_count = original_word_count;
+
+		for (uint32_t k = 0; k != edit_kind_count; ++k)
+		{
+			const edit_kind kind = static_cast<edit_kind>(k);
+
+			for (uint32_t f = 0; f != function_count; ++f)
+			{
+				uint32_t edited_word_count;
+
+				uint32_t changed_begin;
+
+				uint32_t changed_end;
+
+				if (make_edit(kind, f, original_words, original_word_count, function_begins, edited_words, &edited_word_count, &changed_begin, &changed_end))
+				{
+					void* single;
+
+					if (spvcpu::result rst = spvcpu::create_incremental_disassembly(shader_bytes, shader_data, spird, print_type_info != 0, &single); rst != spvcpu::result::success)
+					{
+						fprintf(stderr, "spvcpu::create_incremental_disassembly failed with error %d.\n", static_cast<uint32_t>(rst));
+
+						return 1;
+					}
+
+					if (spvcpu::result rst = spvcpu::update_incremental_disassembly(single, edited_word_count * sizeof(uint32_t), edited_words, changed_begin, changed_end); rst != spvcpu::result::success)
+					{
+						fprintf(stderr, "spvcpu::update_incremental_disassembly failed with error %d on single edit %d of function %d.\n", static_cast<uint32_t>(rst), k, f);
+
+						failure_count += 1;
+					}
+					else if (!check_incremental_text(single, edited_words, edited_word_count, spird, print_type_info != 0, "single", kind, f))
+					{
+						failure_count += 1;
+					}
+
+					spvcpu::free_incremental_disassembly(single);
+
+					edit_count += 1;
+				}
+
+				if (make_edit(kind, f, words, word_count, function_begins, edited_words, &edited_word_count, &changed_begin, &changed_end))
+				{
+					memcpy(words, edited_words, edited_word_count * sizeof(uint32_t));
+
+					word_count = edited_word_count;
+
+					if (spvcpu::result rst = spvcpu::update_incremental_disassembly(chained, word_count * sizeof(uint32_t), words, changed_begin, changed_end); rst != spvcpu::result::success)
+					{
+						fprintf(stderr, "spvcpu::update_incremental_disassembly failed with error %d on chained edit %d of function %d.\n", static_cast<uint32_t>(rst), k, f);
+
+						failure_count += 1;
+					}
+					else if (!check_incremental_text(chained, words, word_count, spird, print_type_info != 0, "chained", kind, f))
+					{
+						failure_count += 1;
+					}
+
+					edit_count += 1;
+				}
+			}
+		}
+
+		spvcpu::free_incremental_disassembly(chained);
+	}
+
+	free(words);
+
+	free(edited_words);
+
+	free(function_begins);
+
+	printf("%s: %d of %d incremental edits failed.\n", argv[1], failure_count, edit_count);
+
+	return failure_count == 0 ? 0 : 1;
+}
+
+// Resources bound to every shader run by the runner tests. As with the runner
+// benchmark, shaders only pick up the (set, binding) pairs they declare.
+static constexpr uint32_t runner_descriptor_sets = 2;
+
+static constexpr uint32_t runner_bindings_per_set = 8;
+
+static constexpr uint32_t runner_binding_count = runner_descriptor_sets * runner_bindings_per_set;
+
+static constexpr uint64_t runner_buffer_bytes = 1 << 22;
+
+static constexpr uint32_t runner_image_extent = 64;
+
+static constexpr uint32_t runner_image_layers = 4;
+
+static constexpr uint32_t runner_texel_bytes = 16;
+
+static constexpr uint64_t runner_image_bytes = static_cast<uint64_t>(runner_image_extent) * runner_image_extent * runner_image_layers * runner_texel_bytes;
+
+static constexpr uint32_t runner_group_count = 16;
+
+struct runner_resources
+{
+	spvcpu::buffer_binding buffers[runner_binding_count];
+
+	spvcpu::image_binding images[runner_binding_count];
+
+	float push_constants[64];
+};
+
+static bool create_runner_resources(runner_resources* out) noexcept
+{
+	memset(out, 0, sizeof(*out));
+
+	for (uint32_t i = 0; i != runner_binding_count; ++i)
+	{
+		const uint64_t slice_pitch = static_cast<uint64_t>(runner_image_extent) * runner_image_extent * runner_texel_bytes;
+
+		out->buffers[i] = { i / runner_bindings_per_set, i % runner_bindings_per_set, runner_buffer_bytes, malloc(runner_buffer_bytes) };
+
+		out->images[i] = { i / runner_bindings_per_set, i % runner_bindings_per_set, { runner_image_extent, runner_image_extent, runner_image_layers }, runner_image_extent * runner_texel_bytes, slice_pitch, malloc(runner_image_bytes) };
+
+		if (out->buffers[i].data == nullptr || out->images[i].data == nullptr)
+		{
+			fprintf(stderr, "malloc failed.\n");
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void free_runner_resources(runner_resources* resources) noexcept
+{
+	for (uint32_t i = 0; i != runner_binding_count; ++i)
+	{
+		free(resources->buffers[i].data);
+
+		free(resources->images[i].data);
+	}
+}
+
+// Fills all resources with the same pseudo-random contents before each run.
+static void seed_runner_resources(runner_resources* resources) noexcept
+{
+	uint32_t state = 0x12345678;
+
+	for (uint32_t i = 0; i != runner_binding_count; ++i)
+	{
+		uint32_t* buffer_words = static_cast<uint32_t*>(resources->buffers[i].data);
+
+		for (uint64_t j = 0; j != runner_buffer_bytes / sizeof(uint32_t); ++j)
+		{
+			state = state * 1664525 + 1013904223;
+
+			buffer_words[j] = state;
+		}
+
+		uint32_t* image_words = static_cast<uint32_t*>(resources->images[i].data);
+
+		for (uint64_t j = 0; j != runner_image_bytes / sizeof(uint32_t); ++j)
+		{
+			state = state * 1664525 + 1013904223;
+
+			image_words[j] = state;
+		}
+	}
+
+	for (uint32_t i = 0; i != sizeof(resources->push_constants) / sizeof(*resources->push_constants); ++i)
+		resources->push_constants[i] = i % 5 == 0 ? 1.0F : 0.25F * i;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, uint64_t bytes) noexcept
+{
+	// FNV-1a
+
+	const uint8_t* data_bytes = static_cast<const uint8_t*>(data);
+
+	for (uint64_t i = 0; i != bytes; ++i)
+		hash = (hash ^ data_bytes[i]) * 1099511628211;
+
+	return hash;
+}
+
+static uint64_t hash_runner_resources(const runner_resources* resources) noexcept
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (uint32_t i = 0; i != runner_binding_count; ++i)
+	{
+		hash = hash_bytes(hash, resources->buffers[i].data, runner_buffer_bytes);
+
+		hash = hash_bytes(hash, resources->images[i].data, runner_image_bytes);
+	}
+
+	return hash;
+}
+
+struct runner_expected_hash
+{
+	const char* shader_name;
+
+	uint64_t hash;
+};
+
+// Hashes of the resources after running the compute shaders in test_data,
+// which all dispatch tiers and SIMD targets have to reproduce.
+static constexpr runner_expected_hash runner_expected_hashes[]
+{
+	{ "buffer_copy.comp.spv",     0x89DE3D0900E1F552ULL },
+	{ "simplex3d.comp.spv",       0xE754B2EBD8182EB8ULL },
+	{ "trace.comp.spv",           0xDF29AE9ED4FBEC81ULL },
+	{ "init_checkempty.comp.spv", 0x839FC5D0BF43E2C0ULL },
+};
+
+// Returns the expected hash for the shader at path, or false if there is none.
+static bool get_expected_runner_hash(const char* path, uint64_t* out_hash) noexcept
+{
+	const uint64_t path_bytes = strlen(path);
+
+	for (const runner_expected_hash& expected : runner_expected_hashes)
+	{
+		const uint64_t name_bytes = strlen(expected.shader_name);
+
+		if (path_bytes < name_bytes || strcmp(path + path_bytes - name_bytes, expected.shader_name) != 0)
+			continue;
+
+		if (path_bytes == name_bytes || path[path_bytes - name_bytes - 1] == '/' || path[path_bytes - name_bytes - 1] == '\\')
+		{
+			*out_hash = expected.hash;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Dispatches runner_group_count workgroups of the module on freshly seeded
+// resources and returns a hash of the resources' contents afterwards.
+static bool run_dispatch(const void* module, runner_resources* resources, uint32_t thread_count, uint32_t lane_count, uint64_t* out_hash) noexcept
+{
+	seed_runner_resources(resources);
+
+	spvcpu::module_init_info info{};
+	info.buffer_count = runner_binding_count;
+	info.buffers = resources->buffers;
+	info.image_count = runner_binding_count;
+	info.images = resources->images;
+	info.push_constant_bytes = sizeof(resources->push_constants);
+	info.push_constants = resources->push_constants;
+
+	void* pool;
+
+	if (spvcpu::result rst = spvcpu::create_thread_pool(thread_count, &pool); rst != spvcpu::result::success)
+	{
+		fprintf(stderr, "spvcpu::create_thread_pool failed with error %d.\n", static_cast<uint32_t>(rst));
+
+		return false;
+	}
+
+	const spvcpu::result rst = spvcpu::dispatch(pool, module, &info, runner_group_count, 1, 1, lane_count);
+
+	spvcpu::free_thread_pool(pool);
+
+	if (rst != spvcpu::result::success)
+	{
+		fprintf(stderr, "spvcpu::dispatch failed with error %d on %d threads with %d lanes.\n", static_cast<uint32_t>(rst), thread_count, lane_count);
+
+		return false;
+	}
+
+	*out_hash = hash_runner_resources(resources);
+
+	return true;
+}
+
+// Runs the compute shader on seeded resources with different lane and thread
+// counts, and checks that all of them leave the resources in the same state as
+// running every invocation on its own on a single thread. For the shaders in
+// runner_expected_hashes, that state is also checked against the stored hash.
+// Shaders whose results depend on the order of invocations, such as through
+// atomic counters, cannot be checked this way. If a cache directory is given,
+// the module is additionally created through create_cpu_module_cached twice,
+// storing it and then loading it back, and the loaded module has to give the
+// same results.
+int runner(int argc, const char** argv) noexcept
+{
+	if (argc != 3 && argc != 4)
+	{
+		fprintf(stderr, "Usage: %s shader-file spird-file [cache-directory]\n", argv[0]);
+
+		return 0;
+	}
+
+	void* shader_data;
+
+	uint64_t shader_bytes;
+
+	void* spird;
+
+	uint64_t spird_bytes;
+
+	if (!get_file_content(argv[1], &shader_data, &shader_bytes))
+		return 1;
+
+	if (!get_file_content(argv[2], &spird, &spird_bytes))
+		return 1;
+
+	void* module;
+
+	if (spvcpu::result rst = spvcpu::create_cpu_module(shader_bytes, shader_data, spird, &module); rst != spvcpu::result::success)
+	{
+		fprintf(stderr, "spvcpu::create_cpu_module failed with error %d.\n", static_cast<uint32_t>(rst));
+
+		return 1;
+	}
+
+	runner_resources* resources = static_cast<runner_resources*>(malloc(sizeof(runner_resources)));
+
+	if (resources == nullptr || !create_runner_resources(resources))
+		return 1;
+
+	uint64_t expected_hash;
+
+	if (!run_dispatch(module, resources, 1, 1, &expected_hash))
+		return 1;
+
+	static constexpr uint32_t configurations[][2]
+	{
+		// thread count, lane count
+		{ 1, 8 },
+		{ 1, 16 },
+		{ 4, 1 },
+		{ 4, 8 },
+		{ 4, 16 },
+	};
+
+	uint32_t failure_count = 0;
+
+	uint64_t stored_hash;
+
+	if (get_expected_runner_hash(argv[1], &stored_hash) && stored_hash != expected_hash)
+	{
+		fprintf(stderr, "Resources differ from the stored hash %016llx.\n", static_cast<unsigned long long>(stored_hash));
+
+		failure_count += 1;
+	}
+
+	for (const uint32_t* configuration : configurations)
+	{
+		uint64_t hash;
+
+		if (!run_dispatch(module, resources, configuration[0], configuration[1], &hash))
+		{
+			failure_count += 1;
+		}
+		else if (hash != expected_hash)
+		{
+			fprintf(stderr, "Resources differ after running on %d threads with %d lanes.\n", configuration[0], configuration[1]);
+
+			failure_count += 1;
+		}
+	}
+
+	if (argc == 4)
+	{
+		void* cached_module = nullptr;
+
+		for (uint32_t i = 0; i != 2; ++i)
+		{
+			if (cached_module != nullptr)
+				spvcpu::free_cpu_module(cached_module);
+
+			if (spvcpu::result rst = spvcpu::create_cpu_module_cached(shader_bytes, shader_data, spird, argv[3], &cached_module); rst != spvcpu::result::success)
+			{
+				fprintf(stderr, "spvcpu::create_cpu_module_cached failed with error %d.\n", static_cast<uint32_t>(rst));
+
+				return 1;
+			}
+		}
+
+		uint64_t hash;
+
+		if (!run_dispatch(cached_module, resources, 1, 1, &hash))
+		{
+			failure_count += 1;
+		}
+		else if (hash != expected_hash)
+		{
+			fprintf(stderr, "Resources differ after running the module loaded from the cache.\n");
+
+			failure_count += 1;
+		}
+
+		spvcpu::free_cpu_module(cached_module);
+	}
+
+	free_runner_resources(resources);
+
+	free(resources);
+
+	spvcpu::free_cpu_module(module);
+
+	printf("%s: %d runner checks failed (hash %016llx).\n", argv[1], failure_count, static_cast<unsigned long long>(expected_hash));
+
+	return failure_count == 0 ? 0 : 1;
+}
+
+static void print_record(FILE* output_file, const spvcpu::disassembly_records& records, const spvcpu::instruction_record& insn, const char* opcode_name) noexcept
+{
+	fprintf(output_file, "%u Op%s", insn.word_offset, opcode_name);
+
+	if (insn.result_id != ~0u)
+		fprintf(output_file, " result $%u", insn.result_id);
+
+	if (insn.result_type_id != ~0u)
+		fprintf(output_file, " type $%u", insn.result_type_id);
+
+	for (uint32_t i = 0; i != insn.operand_count; ++i)
+	{
+		const spvcpu::operand_record& operand = records.operands[insn.first_operand + i];
+
+		switch (operand.kind)
+		{
+		case spvcpu::operand_kind::id:
+			fprintf(output_file, " $%llu", static_cast<unsigned long long>(operand.value));
+			break;
+
+		case spvcpu::operand_kind::type_id:
+			fprintf(output_file, " T$%llu", static_cast<unsigned long long>(operand.value));
+			break;
+
+		case spvcpu::operand_kind::integer:
+			fprintf(output_file, " %llu", static_cast<unsigned long long>(operand.value));
+			break;
+
+		case spvcpu::operand_kind::signed_integer:
+			fprintf(output_file, " %lld", static_cast<long long>(operand.value));
+			break;
+
+		case spvcpu::operand_kind::floating_point:
+		{
+			double value;
+
+			memcpy(&value, &operand.value, sizeof(value));
+
+			fprintf(output_file, " %g", value);
+
+			break;
+		}
+
+		case spvcpu::operand_kind::string:
+			fprintf(output_file, " \"%s\"", records.strings + operand.value);
+			break;
+
+		case spvcpu::operand_kind::member:
+			fprintf(output_file, " @%llu", static_cast<unsigned long long>(operand.value));
+			break;
+
+		case spvcpu::operand_kind::enumerant:
+			fprintf(output_file, " enum(%d):%llu", static_cast<int32_t>(operand.detail), static_cast<unsigned long long>(operand.value));
+			break;
+
+		case spvcpu::operand_kind::raw_literal:
+			fprintf(output_file, " raw(%llu, %u)", static_cast<unsigned long long>(operand.value), operand.detail);
+			break;
+		}
+	}
+
+	fprintf(output_file, "\n");
+}
+
+// Parses the decimal id following the '$' at text, or returns ~0u if there is
+// none.
+static uint32_t parse_text_id(const char* text) noexcept
+{
+	if (*text != '$' || text[1] < '0' || text[1] > '9')
+		return ~0u;
+
+	return static_cast<uint32_t>(strtoul(text + 1, nullptr, 10));
+}
+
+// Checks that the line of the disassembly at line, which ends at line_end,
+// shows the opcode, result id and result type id of insn. Lines start with the
+// result id and type, if any, in fixed columns, followed by "= " and the
+// opcode name, or just with the opcode name if there is no result.
+static bool check_record_line(const char* line, const char* line_end, const spvcpu::instruction_record& insn, const char* opcode_name) noexcept
+{
+	uint32_t result_id = ~0u;
+
+	uint32_t result_type_id = ~0u;
+
+	const char* curr = line;
+
+	if (*curr == '$')
+	{
+		result_id = parse_text_id(curr);
+
+		while (curr != line_end && *curr != ' ')
+			++curr;
+
+		while (curr != line_end && *curr == ' ')
+			++curr;
+
+		if (curr != line_end && *curr == 'T')
+			++curr;
+
+		if (curr != line_end && *curr == '$')
+			result_type_id = parse_text_id(curr);
+
+		const char* equals = strstr(curr, "= Op");
+
+		if (equals == nullptr || equals >= line_end)
+			return false;
+
+		curr = equals + 2;
+	}
+	else
+	{
+		while (curr != line_end && *curr == ' ')
+			++curr;
+	}
+
+	const uint64_t name_bytes = strlen(opcode_name);
+
+	if (line_end - curr < static_cast<int64_t>(name_bytes + 2) || strncmp(curr, "Op", 2) != 0 || strncmp(curr + 2, opcode_name, name_bytes) != 0)
+		return false;
+
+	curr += 2 + name_bytes;
+
+	if (curr != line_end && *curr != ' ')
+		return false;
+
+	return result_id == insn.result_id && result_type_id == insn.result_type_id;
+}
+
+// Writes the records of the shader and checks that their opcodes, result ids
+// and result type ids match the text disassembly, both with and without type
+// info. Instructions take one line each, plus one more for every line break in
+// their string operands.
+int records(int argc, const char** argv) noexcept
+{
+	if (argc != 3 && argc != 4)
+	{
+		fprintf(stderr, "Usage: %s shader-file spird-file [output-file]\n", argv[0]);
+
+		return 0;
+	}
+
+	void* shader_data;
+
+	uint64_t shader_bytes;
+
+	void* spird;
+
+	uint64_t spird_bytes;
+
+	if (!get_file_content(argv[1], &shader_data, &shader_bytes))
+		return 1;
+
+	if (!get_file_content(argv[2], &spird, &spird_bytes))
+		return 1;
+
+	FILE* output_file = stdout;
+
+	if (argc == 4)
+	{
+		if (fopen_s(&output_file, argv[3], "w") != 0)
+		{
+			fprintf(stderr, "Could not open file %s for writing.\n", argv[3]);
+
+			return 1;
+		}
+	}
+
+	spvcpu::disassembly_records records;
+
+	if (spvcpu::result rst = spvcpu::disassemble_to_records(shader_bytes, shader_data, spird, &records); rst != spvcpu::result::success)
+	{
+		fprintf(stderr, "spvcpu::disassemble_to_records failed with error %d.\n", static_cast<uint32_t>(rst));
+
+		return 1;
+	}
+
+	spird::enum_location insn_enum_loc;
+
+	if (spvcpu::result rst = spird::get_enum_location(spird, spird::enum_id::Instruction, &insn_enum_loc); rst != spvcpu::result::success)
+	{
+		fprintf(stderr, "Could not locate the instruction enumeration. (Error %d)\n", rst);
+
+		return 1;
+	}
+
+	uint32_t failure_count = 0;
+
+	for (uint32_t print_type_info = 0; print_type_info != 2; ++print_type_info)
+	{
+		uint64_t disassembly_bytes;
+
+		char* disassembly;
+
+		if (spvcpu::result rst = spvcpu::disassemble(shader_bytes, shader_data, spird, print_type_info != 0, &disassembly_bytes, &disassembly); rst != spvcpu::result::success)
+		{
+			fprintf(stderr, "spvcpu::disassemble failed with error %d.\n", static_cast<uint32_t>(rst));
+
+			return 1;
+		}
+
+		const char* line = disassembly;
+
+		const char* const disassembly_end = disassembly + disassembly_bytes - 1;
+
+		for (uint64_t i = 0; i != records.instruction_count; ++i)
+		{
+			const spvcpu::instruction_record& insn = records.instructions[i];
+
+			spird::elem_view elem;
+
+			if (spird::get_elem_view(spird, insn_enum_loc, insn.opcode, &elem) != spvcpu::result::success)
+			{
+				fprintf(stderr, "Record %llu has unknown opcode %d.\n", static_cast<unsigned long long>(i), insn.opcode);
+
+				failure_count += 1;
+
+				break;
+			}
+
+			if (print_type_info == 0)
+				print_record(output_file, records, insn, elem.name);
+
+			if (line == disassembly_end)
+			{
+				fprintf(stderr, "Disassembly ends before record %llu.\n", static_cast<unsigned long long>(i));
+
+				failure_count += 1;
+
+				break;
+			}
+
+			uint32_t line_count = 1;
+
+			for (uint32_t j = 0; j != insn.operand_count; ++j)
+			{
+				const spvcpu::operand_record& operand = records.operands[insn.first_operand + j];
+
+				if (operand.kind != spvcpu::operand_kind::string)
+					continue;
+
+				for (const char* c = records.strings + operand.value; *c != '\0'; ++c)
+				{
+					if (*c == '\n')
+						line_count += 1;
+				}
+			}
+
+			const char* line_end = line;
+
+			for (uint32_t j = 0; j != line_count && line_end != disassembly_end; ++j)
+			{
+				if (j != 0)
+					++line_end;
+
+				while (line_end != disassembly_end && *line_end != '\n')
+					++line_end;
+			}
+
+			if (!check_record_line(line, line_end, insn, elem.name))
+			{
+				fprintf(stderr, "Record %llu (Op%s at word %d) does not match line '%.*s'%s.\n", static_cast<unsigned long long>(i), elem.name, insn.word_offset, static_cast<int>(line_end - line), line, print_type_info != 0 ? " with type info" : "");
+
+				failure_count += 1;
+			}
+
+			line = line_end == disassembly_end ? line_end : line_end + 1;
+		}
+
+		if (line != disassembly_end)
+		{
+			fprintf(stderr, "Disassembly has more lines than there are records%s.\n", print_type_info != 0 ? " with type info" : "");
+
+			failure_count += 1;
+		}
+
+		free(disassembly);
+	}
+
+	spvcpu::free_disassembly_records(&records);
+
+	if (output_file != stdout)
+		fclose(output_file);
+
+	if (failure_count != 0)
+		fprintf(stderr, "%s: %d records do not match the disassembly.\n", argv[1], failure_count);
+
+	return failure_count == 0 ? 0 : 1;
+}
+
+void print_usage(const char* prog_name) noexcept
+{
+	fprintf(stderr, "Usage: %s (--cycle|--disasm|--incremental|--runner|--records) [additional args...]\n", prog_name);
+}
+
+int main(int argc, const char** argv)
+{
+	if (argc < 2)
+	{
+		print_usage(argv[0]);
+
+		return 0;
+	}
+	else if (strcmp(argv[1], "--cycle") == 0)
+	{
+		return cycle(argc - 1, argv + 1);
+	}
+	else if (strcmp(argv[1], "--disasm") == 0)
+	{
+		return disasm(argc - 1, argv + 1);
+	}
+	else if (strcmp(argv[1], "--incremental") == 0)
+	{
+		return incremental(argc - 1, argv + 1);
+	}
+	else if (strcmp(argv[1], "--runner") == 0)
+	{
+		return runner(argc - 1, argv + 1);
+	}
+	else if (strcmp(argv[1], "--records") == 0)
+	{
+		return records(argc - 1, argv + 1);
 	}
 	else
 	{
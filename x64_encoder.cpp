@@ -0,0 +1,700 @@
+#include "x64_encoder.hpp"
+
+#include <cstring>
+
+static uint8_t reg_index(gpr r) noexcept
+{
+	return static_cast<uint8_t>(r);
+}
+
+static uint8_t reg_index(xmm r) noexcept
+{
+	return static_cast<uint8_t>(r);
+}
+
+void x64_encoder::byte(uint8_t b) noexcept
+{
+	if (!m_bytes.append(b))
+		m_failed = true;
+}
+
+void x64_encoder::dword(uint32_t d) noexcept
+{
+	for (uint32_t i = 0; i != 4; ++i)
+		byte(static_cast<uint8_t>(d >> (i * 8)));
+}
+
+void x64_encoder::qword(uint64_t q) noexcept
+{
+	for (uint32_t i = 0; i != 8; ++i)
+		byte(static_cast<uint8_t>(q >> (i * 8)));
+}
+
+void x64_encoder::rex(bool w, uint8_t reg, uint8_t rm) noexcept
+{
+	const uint8_t bits = (w ? 0x08 : 0) | ((reg & 8) != 0 ? 0x04 : 0) | ((rm & 8) != 0 ? 0x01 : 0);
+
+	if (bits != 0)
+		byte(0x40 | bits);
+}
+
+void x64_encoder::modrm_reg(uint8_t reg, uint8_t rm) noexcept
+{
+	byte(0b11'000'000 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void x64_encoder::modrm_mem(uint8_t reg, mem_operand m, bool force_disp32) noexcept
+{
+	const uint8_t base = reg_index(m.base) & 7;
+
+	const bool is_disp8 = !force_disp32 && m.disp >= -128 && m.disp <= 127;
+
+	// mod = 01 (disp8) or 10 (disp32). mod = 00 is never used, which sidesteps
+	// its special meaning for rbp / r13 as base.
+	byte((is_disp8 ? 0b01'000'000 : 0b10'000'000) | ((reg & 7) << 3) | base);
+
+	// rsp / r12 as base can only be encoded through a SIB byte without index.
+	if (base == reg_index(gpr::rsp))
+		byte(0x24);
+
+	if (is_disp8)
+		byte(static_cast<uint8_t>(m.disp));
+	else
+		dword(static_cast<uint32_t>(m.disp));
+}
+
+void x64_encoder::simd_opcode(uint8_t prefix, uint8_t map, uint8_t opcode, bool w_gpr, bool w_evex, uint32_t width, uint8_t reg, uint8_t vvvv, uint8_t rm) noexcept
+{
+	const uint8_t pp = prefix == 0x66 ? 1 : prefix == 0xF3 ? 2 : prefix == 0xF2 ? 3 : 0;
+
+	// ModRM.reg, index and base extensions, stored inverted in VEX and EVEX.
+	const uint8_t r = (reg & 8) != 0 ? 0 : 0x80;
+
+	const uint8_t b = (rm & 8) != 0 ? 0 : 0x20;
+
+	if (width == 64)
+	{
+		// EVEX. Only registers up to 15 are used, so R' and V' are always set,
+		// and neither masking nor broadcasting is used.
+		byte(0x62);
+
+		byte(r | 0x40 | b | 0x10 | map);
+
+		byte((w_evex ? 0x80 : 0) | ((~vvvv & 15) << 3) | 0x04 | pp);
+
+		byte(0x40 | 0x08);
+	}
+	else if (m_use_vex)
+	{
+		const uint8_t l = width == 32 ? 0x04 : 0;
+
+		if (b != 0 && map == 1 && !w_gpr)
+		{
+			byte(0xC5);
+
+			byte(r | ((~vvvv & 15) << 3) | l | pp);
+		}
+		else
+		{
+			byte(0xC4);
+
+			byte(r | 0x40 | b | map);
+
+			byte((w_gpr ? 0x80 : 0) | ((~vvvv & 15) << 3) | l | pp);
+		}
+	}
+	else
+	{
+		if (prefix != 0)
+			byte(prefix);
+
+		rex(w_gpr, reg, rm);
+
+		byte(0x0F);
+
+		if (map == 2)
+			byte(0x38);
+	}
+
+	byte(opcode);
+}
+
+void x64_encoder::simd_x_m(uint8_t prefix, uint8_t map, uint8_t opcode, bool w_evex, uint32_t width, uint8_t reg, uint8_t vvvv, mem_operand m) noexcept
+{
+	simd_opcode(prefix, map, opcode, false, w_evex, width, reg, vvvv, reg_index(m.base));
+
+	// EVEX scales 8-bit displacements by an instruction-specific factor, which
+	// is avoided by always using 32-bit ones.
+	modrm_mem(reg, m, width == 64);
+}
+
+void x64_encoder::simd_x_x(uint8_t prefix, uint8_t map, uint8_t opcode, bool w_evex, uint32_t width, uint8_t reg, uint8_t vvvv, uint8_t rm) noexcept
+{
+	simd_opcode(prefix, map, opcode, false, w_evex, width, reg, vvvv, rm);
+
+	modrm_reg(reg, rm);
+}
+
+void x64_encoder::legacy_move(xmm dst, xmm src1) noexcept
+{
+	if (m_use_vex || dst == src1)
+		return;
+
+	movaps_x_x(dst, src1);
+}
+
+bool x64_encoder::initialize(uint32_t initial_capacity, bool use_vex) noexcept
+{
+	m_failed = false;
+
+	m_use_vex = use_vex;
+
+	return m_bytes.initialize(initial_capacity);
+}
+
+uint32_t x64_encoder::size() const noexcept
+{
+	return m_bytes.size();
+}
+
+void x64_encoder::push(gpr r) noexcept
+{
+	rex(false, 0, reg_index(r));
+
+	byte(0x50 + (reg_index(r) & 7));
+}
+
+void x64_encoder::pop(gpr r) noexcept
+{
+	rex(false, 0, reg_index(r));
+
+	byte(0x58 + (reg_index(r) & 7));
+}
+
+void x64_encoder::ret() noexcept
+{
+	byte(0xC3);
+}
+
+void x64_encoder::mov_r64_r64(gpr dst, gpr src) noexcept
+{
+	rex(true, reg_index(src), reg_index(dst));
+
+	byte(0x89);
+
+	modrm_reg(reg_index(src), reg_index(dst));
+}
+
+void x64_encoder::mov_r32_r32(gpr dst, gpr src) noexcept
+{
+	rex(false, reg_index(src), reg_index(dst));
+
+	byte(0x89);
+
+	modrm_reg(reg_index(src), reg_index(dst));
+}
+
+void x64_encoder::mov_r32_imm32(gpr dst, uint32_t imm) noexcept
+{
+	rex(false, 0, reg_index(dst));
+
+	byte(0xB8 + (reg_index(dst) & 7));
+
+	dword(imm);
+}
+
+void x64_encoder::mov_r64_imm64(gpr dst, uint64_t imm) noexcept
+{
+	rex(true, 0, reg_index(dst));
+
+	byte(0xB8 + (reg_index(dst) & 7));
+
+	qword(imm);
+}
+
+void x64_encoder::mov_r32_m(gpr dst, mem_operand src) noexcept
+{
+	rex(false, reg_index(dst), reg_index(src.base));
+
+	byte(0x8B);
+
+	modrm_mem(reg_index(dst), src);
+}
+
+void x64_encoder::mov_r64_m(gpr dst, mem_operand src) noexcept
+{
+	rex(true, reg_index(dst), reg_index(src.base));
+
+	byte(0x8B);
+
+	modrm_mem(reg_index(dst), src);
+}
+
+void x64_encoder::mov_m_r32(mem_operand dst, gpr src) noexcept
+{
+	rex(false, reg_index(src), reg_index(dst.base));
+
+	byte(0x89);
+
+	modrm_mem(reg_index(src), dst);
+}
+
+void x64_encoder::mov_m_r64(mem_operand dst, gpr src) noexcept
+{
+	rex(true, reg_index(src), reg_index(dst.base));
+
+	byte(0x89);
+
+	modrm_mem(reg_index(src), dst);
+}
+
+void x64_encoder::mov_m_imm32(mem_operand dst, uint32_t imm) noexcept
+{
+	rex(false, 0, reg_index(dst.base));
+
+	byte(0xC7);
+
+	modrm_mem(0, dst);
+
+	dword(imm);
+}
+
+void x64_encoder::movsx_r64_m8(gpr dst, mem_operand src) noexcept
+{
+	rex(true, reg_index(dst), reg_index(src.base));
+
+	byte(0x0F);
+
+	byte(0xBE);
+
+	modrm_mem(reg_index(dst), src);
+}
+
+void x64_encoder::movsx_r64_m16(gpr dst, mem_operand src) noexcept
+{
+	rex(true, reg_index(dst), reg_index(src.base));
+
+	byte(0x0F);
+
+	byte(0xBF);
+
+	modrm_mem(reg_index(dst), src);
+}
+
+void x64_encoder::movsxd_r64_m32(gpr dst, mem_operand src) noexcept
+{
+	rex(true, reg_index(dst), reg_index(src.base));
+
+	byte(0x63);
+
+	modrm_mem(reg_index(dst), src);
+}
+
+void x64_encoder::movsx_r64_r8(gpr dst, gpr src) noexcept
+{
+	rex(true, reg_index(dst), reg_index(src));
+
+	byte(0x0F);
+
+	byte(0xBE);
+
+	modrm_reg(reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::movsx_r64_r16(gpr dst, gpr src) noexcept
+{
+	rex(true, reg_index(dst), reg_index(src));
+
+	byte(0x0F);
+
+	byte(0xBF);
+
+	modrm_reg(reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::movsxd_r64_r32(gpr dst, gpr src) noexcept
+{
+	rex(true, reg_index(dst), reg_index(src));
+
+	byte(0x63);
+
+	modrm_reg(reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::movzx_r32_r8(gpr dst, gpr src) noexcept
+{
+	rex(false, reg_index(dst), reg_index(src));
+
+	byte(0x0F);
+
+	byte(0xB6);
+
+	modrm_reg(reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::alu_r32_m(alu_op op, gpr dst, mem_operand src) noexcept
+{
+	rex(false, reg_index(dst), reg_index(src.base));
+
+	byte(static_cast<uint8_t>(op) * 8 + 3);
+
+	modrm_mem(reg_index(dst), src);
+}
+
+void x64_encoder::alu_r32_imm32(alu_op op, gpr dst, uint32_t imm) noexcept
+{
+	rex(false, 0, reg_index(dst));
+
+	byte(0x81);
+
+	modrm_reg(static_cast<uint8_t>(op), reg_index(dst));
+
+	dword(imm);
+}
+
+void x64_encoder::alu_r32_r32(alu_op op, gpr dst, gpr src) noexcept
+{
+	rex(false, reg_index(src), reg_index(dst));
+
+	byte(static_cast<uint8_t>(op) * 8 + 1);
+
+	modrm_reg(reg_index(src), reg_index(dst));
+}
+
+void x64_encoder::alu_r64_r64(alu_op op, gpr dst, gpr src) noexcept
+{
+	rex(true, reg_index(src), reg_index(dst));
+
+	byte(static_cast<uint8_t>(op) * 8 + 1);
+
+	modrm_reg(reg_index(src), reg_index(dst));
+}
+
+void x64_encoder::alu_r64_imm32(alu_op op, gpr dst, int32_t imm) noexcept
+{
+	rex(true, 0, reg_index(dst));
+
+	byte(0x81);
+
+	modrm_reg(static_cast<uint8_t>(op), reg_index(dst));
+
+	dword(static_cast<uint32_t>(imm));
+}
+
+void x64_encoder::alu_r8_r8(alu_op op, gpr dst, gpr src) noexcept
+{
+	byte(static_cast<uint8_t>(op) * 8);
+
+	modrm_reg(reg_index(src), reg_index(dst));
+}
+
+void x64_encoder::cmp_m32_imm8(mem_operand dst, int8_t imm) noexcept
+{
+	rex(false, 0, reg_index(dst.base));
+
+	byte(0x83);
+
+	modrm_mem(static_cast<uint8_t>(alu_op::cmp), dst);
+
+	byte(static_cast<uint8_t>(imm));
+}
+
+void x64_encoder::cmp_r32_imm32(gpr dst, uint32_t imm) noexcept
+{
+	alu_r32_imm32(alu_op::cmp, dst, imm);
+}
+
+void x64_encoder::test_r32_r32(gpr a, gpr b) noexcept
+{
+	rex(false, reg_index(b), reg_index(a));
+
+	byte(0x85);
+
+	modrm_reg(reg_index(b), reg_index(a));
+}
+
+void x64_encoder::imul_r32_r32(gpr dst, gpr src) noexcept
+{
+	rex(false, reg_index(dst), reg_index(src));
+
+	byte(0x0F);
+
+	byte(0xAF);
+
+	modrm_reg(reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::imul_r32_m(gpr dst, mem_operand src) noexcept
+{
+	rex(false, reg_index(dst), reg_index(src.base));
+
+	byte(0x0F);
+
+	byte(0xAF);
+
+	modrm_mem(reg_index(dst), src);
+}
+
+void x64_encoder::imul_r64_r64_imm32(gpr dst, gpr src, int32_t imm) noexcept
+{
+	rex(true, reg_index(dst), reg_index(src));
+
+	byte(0x69);
+
+	modrm_reg(reg_index(dst), reg_index(src));
+
+	dword(static_cast<uint32_t>(imm));
+}
+
+void x64_encoder::shift_r32_cl(shift_op op, gpr dst) noexcept
+{
+	rex(false, 0, reg_index(dst));
+
+	byte(0xD3);
+
+	modrm_reg(static_cast<uint8_t>(op), reg_index(dst));
+}
+
+void x64_encoder::setcc_r8(cond cc, gpr dst) noexcept
+{
+	byte(0x0F);
+
+	byte(0x90 + static_cast<uint8_t>(cc));
+
+	modrm_reg(0, reg_index(dst));
+}
+
+void x64_encoder::cmovcc_r32_m(cond cc, gpr dst, mem_operand src) noexcept
+{
+	rex(false, reg_index(dst), reg_index(src.base));
+
+	byte(0x0F);
+
+	byte(0x40 + static_cast<uint8_t>(cc));
+
+	modrm_mem(reg_index(dst), src);
+}
+
+void x64_encoder::cmovcc_r32_r32(cond cc, gpr dst, gpr src) noexcept
+{
+	rex(false, reg_index(dst), reg_index(src));
+
+	byte(0x0F);
+
+	byte(0x40 + static_cast<uint8_t>(cc));
+
+	modrm_reg(reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::movss_x_m(xmm dst, mem_operand src) noexcept
+{
+	simd_x_m(0xF3, 1, 0x10, false, 16, reg_index(dst), 0, src);
+}
+
+void x64_encoder::movss_m_x(mem_operand dst, xmm src) noexcept
+{
+	simd_x_m(0xF3, 1, 0x11, false, 16, reg_index(src), 0, dst);
+}
+
+void x64_encoder::movsd_m_x(mem_operand dst, xmm src) noexcept
+{
+	simd_x_m(0xF2, 1, 0x11, false, 16, reg_index(src), 0, dst);
+}
+
+void x64_encoder::movaps_x_x(xmm dst, xmm src) noexcept
+{
+	simd_x_x(0, 1, 0x28, false, 16, reg_index(dst), 0, reg_index(src));
+}
+
+void x64_encoder::movd_x_r32(xmm dst, gpr src) noexcept
+{
+	simd_x_x(0x66, 1, 0x6E, false, 16, reg_index(dst), 0, reg_index(src));
+}
+
+void x64_encoder::movd_r32_x(gpr dst, xmm src) noexcept
+{
+	simd_x_x(0x66, 1, 0x7E, false, 16, reg_index(src), 0, reg_index(dst));
+}
+
+void x64_encoder::ss_x_m(simd_op op, xmm dst, mem_operand src) noexcept
+{
+	simd_x_m(0xF3, 1, static_cast<uint8_t>(op), false, 16, reg_index(dst), reg_index(dst), src);
+}
+
+void x64_encoder::ss_x_x(simd_op op, xmm dst, xmm src) noexcept
+{
+	simd_x_x(0xF3, 1, static_cast<uint8_t>(op), false, 16, reg_index(dst), reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::sd_x_x(simd_op op, xmm dst, xmm src) noexcept
+{
+	simd_x_x(0xF2, 1, static_cast<uint8_t>(op), false, 16, reg_index(dst), reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::ucomiss_x_m(xmm dst, mem_operand src) noexcept
+{
+	simd_x_m(0, 1, 0x2E, false, 16, reg_index(dst), 0, src);
+}
+
+void x64_encoder::ucomiss_x_x(xmm dst, xmm src) noexcept
+{
+	simd_x_x(0, 1, 0x2E, false, 16, reg_index(dst), 0, reg_index(src));
+}
+
+void x64_encoder::cvtsi2ss_x_m32(xmm dst, mem_operand src) noexcept
+{
+	simd_x_m(0xF3, 1, 0x2A, false, 16, reg_index(dst), reg_index(dst), src);
+}
+
+void x64_encoder::cvtsi2ss_x_r32(xmm dst, gpr src) noexcept
+{
+	simd_opcode(0xF3, 1, 0x2A, false, false, 16, reg_index(dst), reg_index(dst), reg_index(src));
+
+	modrm_reg(reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::cvtsi2ss_x_r64(xmm dst, gpr src) noexcept
+{
+	simd_opcode(0xF3, 1, 0x2A, true, true, 16, reg_index(dst), reg_index(dst), reg_index(src));
+
+	modrm_reg(reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::cvtss2sd_x_m(xmm dst, mem_operand src) noexcept
+{
+	simd_x_m(0xF3, 1, 0x5A, false, 16, reg_index(dst), reg_index(dst), src);
+}
+
+void x64_encoder::cvtsd2ss_x_x(xmm dst, xmm src) noexcept
+{
+	simd_x_x(0xF2, 1, 0x5A, false, 16, reg_index(dst), reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::xorps_x_x(xmm dst, xmm src) noexcept
+{
+	simd_x_x(0, 1, 0x57, false, 16, reg_index(dst), reg_index(dst), reg_index(src));
+}
+
+void x64_encoder::vmovups_x_m(uint32_t width, xmm dst, mem_operand src) noexcept
+{
+	simd_x_m(0, 1, 0x10, false, width, reg_index(dst), 0, src);
+}
+
+void x64_encoder::vmovups_m_x(uint32_t width, mem_operand dst, xmm src) noexcept
+{
+	simd_x_m(0, 1, 0x11, false, width, reg_index(src), 0, dst);
+}
+
+void x64_encoder::vps_x_x_m(simd_op op, uint32_t width, xmm dst, xmm src1, mem_operand src2) noexcept
+{
+	legacy_move(dst, src1);
+
+	simd_x_m(0, 1, static_cast<uint8_t>(op), false, width, reg_index(dst), reg_index(src1), src2);
+}
+
+void x64_encoder::vps_x_x_x(simd_op op, uint32_t width, xmm dst, xmm src1, xmm src2) noexcept
+{
+	legacy_move(dst, src1);
+
+	simd_x_x(0, 1, static_cast<uint8_t>(op), false, width, reg_index(dst), reg_index(src1), reg_index(src2));
+}
+
+void x64_encoder::vpd_x_x_x(simd_op op, uint32_t width, xmm dst, xmm src1, xmm src2) noexcept
+{
+	legacy_move(dst, src1);
+
+	simd_x_x(0x66, 1, static_cast<uint8_t>(op), true, width, reg_index(dst), reg_index(src1), reg_index(src2));
+}
+
+void x64_encoder::vbroadcastss_x_m(uint32_t width, xmm dst, mem_operand src) noexcept
+{
+	if (m_use_vex || width == 64)
+	{
+		simd_x_m(0x66, 2, 0x18, false, width, reg_index(dst), 0, src);
+
+		return;
+	}
+
+	// SSE has no broadcast, so load the scalar and shufps it into all elements.
+	movss_x_m(dst, src);
+
+	simd_x_x(0, 1, 0xC6, false, 16, reg_index(dst), 0, reg_index(dst));
+
+	byte(0);
+}
+
+void x64_encoder::vcvtps2pd_x_m(uint32_t width, xmm dst, mem_operand src) noexcept
+{
+	simd_x_m(0, 1, 0x5A, false, width, reg_index(dst), 0, src);
+}
+
+void x64_encoder::vcvtps2pd_x_x(uint32_t width, xmm dst, xmm src) noexcept
+{
+	simd_x_x(0, 1, 0x5A, false, width, reg_index(dst), 0, reg_index(src));
+}
+
+void x64_encoder::vcvtpd2ps_x_x(uint32_t width, xmm dst, xmm src) noexcept
+{
+	simd_x_x(0x66, 1, 0x5A, true, width, reg_index(dst), 0, reg_index(src));
+}
+
+void x64_encoder::vzeroupper() noexcept
+{
+	byte(0xC5);
+
+	byte(0xF8);
+
+	byte(0x77);
+}
+
+void x64_encoder::call_r64(gpr target) noexcept
+{
+	rex(false, 0, reg_index(target));
+
+	byte(0xFF);
+
+	modrm_reg(2, reg_index(target));
+}
+
+void x64_encoder::jmp_r64(gpr target) noexcept
+{
+	rex(false, 0, reg_index(target));
+
+	byte(0xFF);
+
+	modrm_reg(4, reg_index(target));
+}
+
+uint32_t x64_encoder::jmp_rel32() noexcept
+{
+	byte(0xE9);
+
+	const uint32_t fixup_offset = size();
+
+	dword(0);
+
+	return fixup_offset;
+}
+
+uint32_t x64_encoder::jcc_rel32(cond cc) noexcept
+{
+	byte(0x0F);
+
+	byte(0x80 + static_cast<uint8_t>(cc));
+
+	const uint32_t fixup_offset = size();
+
+	dword(0);
+
+	return fixup_offset;
+}
+
+void x64_encoder::patch_rel32(uint32_t fixup_offset, uint32_t target_offset) noexcept
+{
+	if (m_failed)
+		return;
+
+	const int32_t rel = static_cast<int32_t>(target_offset - (fixup_offset + 4));
+
+	memcpy(m_bytes.data() + fixup_offset, &rel, 4);
+}
@@ -0,0 +1,270 @@
+#ifndef X64_ENCODER_HPP_INCLUDE_GUARD
+#define X64_ENCODER_HPP_INCLUDE_GUARD
+
+#include <cstdint>
+
+#include "simple_vec.hpp"
+
+// General purpose registers, numbered as in their ModRM and REX encoding.
+enum class gpr : uint8_t
+{
+	rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+	r8,  r9,  r10, r11, r12, r13, r14, r15,
+};
+
+enum class xmm : uint8_t
+{
+	xmm0, xmm1, xmm2,  xmm3,  xmm4,  xmm5,  xmm6,  xmm7,
+	xmm8, xmm9, xmm10, xmm11, xmm12, xmm13, xmm14, xmm15,
+};
+
+// Condition codes, as encoded in the low nibble of Jcc, SETcc and CMOVcc.
+enum class cond : uint8_t
+{
+	o, no, b, ae, e, ne, be, a, s, ns, p, np, l, ge, le, g,
+};
+
+// Integer operations of the 0x81 group. The value is the opcode extension,
+// which also determines the opcode of the register / memory forms.
+enum class alu_op : uint8_t
+{
+	add = 0,
+	or_ = 1,
+	and_ = 4,
+	sub = 5,
+	xor_ = 6,
+	cmp = 7,
+};
+
+// Shift operations of the 0xD3 group, again identified by their opcode extension.
+enum class shift_op : uint8_t
+{
+	shl = 4,
+	shr = 5,
+	sar = 7,
+};
+
+// Packed arithmetic, identified by its opcode in the 0F map. Combined with the
+// F3 / F2 prefixes this also selects the scalar single / double variants.
+enum class simd_op : uint8_t
+{
+	add = 0x58,
+	mul = 0x59,
+	sub = 0x5C,
+	div = 0x5E,
+};
+
+// Memory operand of the form [base + disp].
+struct mem_operand
+{
+	gpr base;
+
+	int32_t disp;
+};
+
+// Appends x86-64 machine code to a buffer. Instruction methods are named after
+// the Intel mnemonic followed by their operand forms, with r32 / r64 denoting
+// general purpose registers, m a memory operand, x an xmm register and imm an
+// immediate. Out-of-memory conditions are collected in m_failed instead of
+// being reported by every method.
+//
+// SSE instructions are encoded with VEX if m_use_vex is set and with their
+// legacy encoding otherwise. Methods starting with v take the vector width in
+// bytes: 16 or, with VEX, 32 for xmm / ymm, and 64 for zmm, which is always
+// encoded with EVEX and requires AVX-512F. Their x operands then name the
+// xmm, ymm or zmm register of the same number. Legacy encodings have no
+// separate first source, so there src1 is copied to dst first if they differ.
+// Scalar instructions leave the upper bits of their destination unchanged with
+// legacy encodings and zero them with VEX.
+struct x64_encoder
+{
+	simple_vec<uint8_t> m_bytes;
+
+	bool m_failed;
+
+	bool m_use_vex;
+
+	[[nodiscard]] bool initialize(uint32_t initial_capacity, bool use_vex) noexcept;
+
+	uint32_t size() const noexcept;
+
+	void push(gpr r) noexcept;
+
+	void pop(gpr r) noexcept;
+
+	void ret() noexcept;
+
+	void mov_r64_r64(gpr dst, gpr src) noexcept;
+
+	void mov_r32_r32(gpr dst, gpr src) noexcept;
+
+	void mov_r32_imm32(gpr dst, uint32_t imm) noexcept;
+
+	void mov_r64_imm64(gpr dst, uint64_t imm) noexcept;
+
+	void mov_r32_m(gpr dst, mem_operand src) noexcept;
+
+	void mov_r64_m(gpr dst, mem_operand src) noexcept;
+
+	void mov_m_r32(mem_operand dst, gpr src) noexcept;
+
+	void mov_m_r64(mem_operand dst, gpr src) noexcept;
+
+	void mov_m_imm32(mem_operand dst, uint32_t imm) noexcept;
+
+	void movsx_r64_m8(gpr dst, mem_operand src) noexcept;
+
+	void movsx_r64_m16(gpr dst, mem_operand src) noexcept;
+
+	void movsxd_r64_m32(gpr dst, mem_operand src) noexcept;
+
+	void movsx_r64_r8(gpr dst, gpr src) noexcept;
+
+	void movsx_r64_r16(gpr dst, gpr src) noexcept;
+
+	void movsxd_r64_r32(gpr dst, gpr src) noexcept;
+
+	void movzx_r32_r8(gpr dst, gpr src) noexcept;
+
+	void alu_r32_m(alu_op op, gpr dst, mem_operand src) noexcept;
+
+	void alu_r32_imm32(alu_op op, gpr dst, uint32_t imm) noexcept;
+
+	void alu_r32_r32(alu_op op, gpr dst, gpr src) noexcept;
+
+	void alu_r64_r64(alu_op op, gpr dst, gpr src) noexcept;
+
+	void alu_r64_imm32(alu_op op, gpr dst, int32_t imm) noexcept;
+
+	void alu_r8_r8(alu_op op, gpr dst, gpr src) noexcept;
+
+	void cmp_m32_imm8(mem_operand dst, int8_t imm) noexcept;
+
+	void cmp_r32_imm32(gpr dst, uint32_t imm) noexcept;
+
+	void test_r32_r32(gpr a, gpr b) noexcept;
+
+	void imul_r32_m(gpr dst, mem_operand src) noexcept;
+
+	void imul_r32_r32(gpr dst, gpr src) noexcept;
+
+	void imul_r64_r64_imm32(gpr dst, gpr src, int32_t imm) noexcept;
+
+	void shift_r32_cl(shift_op op, gpr dst) noexcept;
+
+	// Only al, cl, dl and bl can be used as dst, since the others would require
+	// a REX prefix.
+	void setcc_r8(cond cc, gpr dst) noexcept;
+
+	void cmovcc_r32_m(cond cc, gpr dst, mem_operand src) noexcept;
+
+	void cmovcc_r32_r32(cond cc, gpr dst, gpr src) noexcept;
+
+	void movss_x_m(xmm dst, mem_operand src) noexcept;
+
+	void movss_m_x(mem_operand dst, xmm src) noexcept;
+
+	void movsd_m_x(mem_operand dst, xmm src) noexcept;
+
+	void movaps_x_x(xmm dst, xmm src) noexcept;
+
+	void movd_x_r32(xmm dst, gpr src) noexcept;
+
+	void movd_r32_x(gpr dst, xmm src) noexcept;
+
+	void ss_x_m(simd_op op, xmm dst, mem_operand src) noexcept;
+
+	void ss_x_x(simd_op op, xmm dst, xmm src) noexcept;
+
+	void sd_x_x(simd_op op, xmm dst, xmm src) noexcept;
+
+	void ucomiss_x_m(xmm dst, mem_operand src) noexcept;
+
+	void ucomiss_x_x(xmm dst, xmm src) noexcept;
+
+	void cvtsi2ss_x_m32(xmm dst, mem_operand src) noexcept;
+
+	void cvtsi2ss_x_r32(xmm dst, gpr src) noexcept;
+
+	void cvtsi2ss_x_r64(xmm dst, gpr src) noexcept;
+
+	void cvtss2sd_x_m(xmm dst, mem_operand src) noexcept;
+
+	void cvtsd2ss_x_x(xmm dst, xmm src) noexcept;
+
+	// Zeroes the whole register, including the upper bits of ymm / zmm with VEX.
+	void xorps_x_x(xmm dst, xmm src) noexcept;
+
+	void vmovups_x_m(uint32_t width, xmm dst, mem_operand src) noexcept;
+
+	void vmovups_m_x(uint32_t width, mem_operand dst, xmm src) noexcept;
+
+	void vps_x_x_m(simd_op op, uint32_t width, xmm dst, xmm src1, mem_operand src2) noexcept;
+
+	void vps_x_x_x(simd_op op, uint32_t width, xmm dst, xmm src1, xmm src2) noexcept;
+
+	void vpd_x_x_x(simd_op op, uint32_t width, xmm dst, xmm src1, xmm src2) noexcept;
+
+	// Broadcasts the float at src to all elements of dst.
+	void vbroadcastss_x_m(uint32_t width, xmm dst, mem_operand src) noexcept;
+
+	// Converts the floats in the lower half of src to doubles filling dst, whose
+	// width is given.
+	void vcvtps2pd_x_m(uint32_t width, xmm dst, mem_operand src) noexcept;
+
+	void vcvtps2pd_x_x(uint32_t width, xmm dst, xmm src) noexcept;
+
+	// Converts the doubles in src, whose width is given, to floats in the lower
+	// half of dst.
+	void vcvtpd2ps_x_x(uint32_t width, xmm dst, xmm src) noexcept;
+
+	// Must be executed before calling into code that may use legacy SSE
+	// encodings after 256 or 512-bit instructions were used.
+	void vzeroupper() noexcept;
+
+	void call_r64(gpr target) noexcept;
+
+	void jmp_r64(gpr target) noexcept;
+
+	// Emits a jump with a 32-bit displacement and returns the offset of the
+	// displacement, which has to be filled in through patch_rel32.
+	uint32_t jmp_rel32() noexcept;
+
+	uint32_t jcc_rel32(cond cc) noexcept;
+
+	// Makes the displacement at fixup_offset point at target_offset.
+	void patch_rel32(uint32_t fixup_offset, uint32_t target_offset) noexcept;
+
+private:
+
+	void byte(uint8_t b) noexcept;
+
+	void dword(uint32_t d) noexcept;
+
+	void qword(uint64_t q) noexcept;
+
+	// Emits a REX prefix if any of its bits are needed. reg and rm are the full
+	// four-bit register numbers going into ModRM.
+	void rex(bool w, uint8_t reg, uint8_t rm) noexcept;
+
+	void modrm_reg(uint8_t reg, uint8_t rm) noexcept;
+
+	void modrm_mem(uint8_t reg, mem_operand m, bool force_disp32 = false) noexcept;
+
+	// Emits everything of an SSE / AVX instruction up to and including its
+	// opcode. prefix is the mandatory prefix (0, 0x66, 0xF3 or 0xF2) and map
+	// the opcode map (1 for 0F, 2 for 0F38). vvvv is the additional source
+	// register of VEX / EVEX encodings and ignored for legacy ones. w_gpr is
+	// the W bit for instructions with a 64-bit general purpose operand, w_evex
+	// the W bit EVEX encodings require for double precision instructions.
+	void simd_opcode(uint8_t prefix, uint8_t map, uint8_t opcode, bool w_gpr, bool w_evex, uint32_t width, uint8_t reg, uint8_t vvvv, uint8_t rm) noexcept;
+
+	void simd_x_m(uint8_t prefix, uint8_t map, uint8_t opcode, bool w_evex, uint32_t width, uint8_t reg, uint8_t vvvv, mem_operand m) noexcept;
+
+	void simd_x_x(uint8_t prefix, uint8_t map, uint8_t opcode, bool w_evex, uint32_t width, uint8_t reg, uint8_t vvvv, uint8_t rm) noexcept;
+
+	// Copies src1 to dst for legacy encodings, which have no separate first source.
+	void legacy_move(xmm dst, xmm src1) noexcept;
+};
+
+#endif // X64_ENCODER_HPP_INCLUDE_GUARD